@@ -28,6 +28,10 @@ public:
     // Dừng phát
     virtual void stopPlayback() = 0;
 
+    // Bỏ mọi thứ đang chờ phát (DMA ring, writePcm đang chạy dở): im lặng
+    // trong vòng một DMA period. Any task; playback keeps running.
+    virtual void flush() = 0;
+
     // ========================================================================
     // Data write
     // ========================================================================
@@ -57,4 +61,7 @@ public:
     virtual uint32_t sampleRate() const = 0;
     virtual uint8_t  channels() const   = 0;
     virtual uint8_t  bitsPerSample() const = 0;
+
+    // One DMA buffer of audio: the bound on flush() → silence
+    virtual uint32_t periodUs() const = 0;
 };
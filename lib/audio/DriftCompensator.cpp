@@ -0,0 +1,116 @@
+#include "DriftCompensator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DriftCompensator::DriftCompensator() : DriftCompensator(Config{}) {}
+
+DriftCompensator::DriftCompensator(const Config &cfg)
+    : cfg_(cfg)
+{
+    reset();
+}
+
+void DriftCompensator::reset()
+{
+    window_sum_ = 0.0f;
+    window_count_ = 0;
+    window_elapsed_ = 0;
+
+    target_locked_ = cfg_.target_fill_ms > 0;
+    target_fill_ = static_cast<float>(cfg_.target_fill_ms) * cfg_.sample_rate / 1000.0f;
+
+    drift_ppm_ = 0.0f;
+    ratio_ppm_ = 0.0f;
+
+    hist_[0] = hist_[1] = hist_[2] = 0;
+    pos_ = 0.0;
+}
+
+// ============================================================================
+// Estimator + PI controller
+// ============================================================================
+void DriftCompensator::update(size_t fill_samples, size_t elapsed_samples)
+{
+    window_sum_ += static_cast<float>(fill_samples);
+    window_elapsed_ += elapsed_samples;
+    if (++window_count_ < cfg_.window_blocks)
+        return;
+
+    const float mean_fill = window_sum_ / window_count_;
+    const float window_s = static_cast<float>(window_elapsed_) / cfg_.sample_rate;
+    window_sum_ = 0.0f;
+    window_count_ = 0;
+    window_elapsed_ = 0;
+
+    if (!target_locked_)
+    {
+        target_fill_ = mean_fill;
+        target_locked_ = true;
+        return;
+    }
+
+    const float error_ms = (mean_fill - target_fill_) * 1000.0f / cfg_.sample_rate;
+
+    drift_ppm_ += cfg_.ki_ppm_per_ms_s * error_ms * window_s;
+    drift_ppm_ = std::clamp(drift_ppm_, -cfg_.max_ppm, cfg_.max_ppm); // anti-windup
+
+    ratio_ppm_ = std::clamp(drift_ppm_ + cfg_.kp_ppm_per_ms * error_ms,
+                            -cfg_.max_ppm, cfg_.max_ppm);
+}
+
+size_t DriftCompensator::maxOutputSamples(size_t in_samples) const
+{
+    double min_ratio = 1.0 - cfg_.max_ppm * 1e-6;
+    return static_cast<size_t>(std::ceil(in_samples / min_ratio)) + 2;
+}
+
+// ============================================================================
+// Cubic (Catmull-Rom) fractional resampler
+// ============================================================================
+size_t DriftCompensator::process(const int16_t *in, size_t in_samples,
+                                 int16_t *out, size_t out_capacity)
+{
+    if (!in || !out || in_samples == 0)
+        return 0;
+
+    const double ratio = 1.0 + ratio_ppm_ * 1e-6;
+
+    // e[0..2] = history, e[3..] = new block
+    auto at = [&](size_t i) -> float
+    {
+        return static_cast<float>(i < 3 ? hist_[i] : in[i - 3]);
+    };
+
+    size_t produced = 0;
+    while (pos_ < in_samples && produced < out_capacity)
+    {
+        size_t i = static_cast<size_t>(pos_);
+        float t = static_cast<float>(pos_ - i);
+
+        float p0 = at(i);
+        float p1 = at(i + 1);
+        float p2 = at(i + 2);
+        float p3 = at(i + 3);
+
+        float a = -0.5f * p0 + 1.5f * p1 - 1.5f * p2 + 0.5f * p3;
+        float b = p0 - 2.5f * p1 + 2.0f * p2 - 0.5f * p3;
+        float c = -0.5f * p0 + 0.5f * p2;
+        float y = ((a * t + b) * t + c) * t + p1;
+
+        y = std::clamp(y, -32768.0f, 32767.0f);
+        out[produced++] = static_cast<int16_t>(std::lrintf(y));
+        pos_ += ratio;
+    }
+
+    pos_ -= static_cast<double>(in_samples);
+    if (pos_ < 0.0)
+        pos_ = 0.0; // out_capacity hit: drop the remainder rather than stall
+
+    for (size_t k = 0; k < 3; ++k)
+    {
+        hist_[k] = static_cast<int16_t>(at(in_samples + k));
+    }
+
+    return produced;
+}
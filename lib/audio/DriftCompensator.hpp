@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * DriftCompensator
+ * ============================================================================
+ * Giữ mức đầy của downlink buffer ổn định khi clock server ≠ clock I2S.
+ *
+ * Server paces audio by its own wall clock while the speaker drains at the
+ * I2S clock (APLL off → not exactly 16 kHz). A few hundred ppm offset slowly
+ * fills or empties the buffer over a long answer.
+ *
+ *  - Estimator : buffer fill averaged over a window (rejects packet jitter)
+ *  - Controller: PI on the fill error; the integral term is the drift (ppm)
+ *  - Actuator  : 4-point cubic fractional resampler, ratio within ±max_ppm
+ *
+ * Ratio > 1 → consume input faster (buffer drains), < 1 → slower.
+ * Thread-safety: none. Chỉ CODEC task dùng.
+ */
+class DriftCompensator
+{
+public:
+    struct Config
+    {
+        uint32_t sample_rate = 16000;
+
+        // Target fill (ms). 0 = latch the fill of the first window
+        uint32_t target_fill_ms = 0;
+
+        // Observations averaged per controller step (1 per decoded block)
+        uint16_t window_blocks = 32;
+
+        // Hard limit of the correction (ppm). Inaudible well beyond ±1000.
+        float max_ppm = 1000.0f;
+
+        // PI gains. Fill error in ms, time in seconds of playback.
+        // kp=40 / ki=0.8 → damping ≈0.7, settles in ~1 min, peak error
+        // for a 500 ppm step ≈ 12 ms.
+        float kp_ppm_per_ms = 40.0f;
+        float ki_ppm_per_ms_s = 0.8f;
+    };
+
+    DriftCompensator();
+    explicit DriftCompensator(const Config &cfg);
+
+    /**
+     * Feed one buffer observation (call once per decoded block)
+     * @param fill_samples      samples queued ahead of the speaker (encoded + PCM)
+     * @param elapsed_samples   samples played since the previous update
+     */
+    void update(size_t fill_samples, size_t elapsed_samples);
+
+    /**
+     * Resample one block at the current ratio
+     * @return samples written to out (≈ in_samples / ratio)
+     */
+    size_t process(const int16_t *in, size_t in_samples,
+                   int16_t *out, size_t out_capacity);
+
+    // New stream: forget history and target
+    void reset();
+
+    // Worst-case output growth for a block of n input samples
+    size_t maxOutputSamples(size_t in_samples) const;
+
+    float driftPpm() const { return drift_ppm_; }
+    float ratioPpm() const { return ratio_ppm_; }
+
+private:
+    Config cfg_;
+
+    // Estimator state
+    float window_sum_ = 0.0f;
+    uint16_t window_count_ = 0;
+    size_t window_elapsed_ = 0;
+    float target_fill_ = 0.0f;
+    bool target_locked_ = false;
+
+    float drift_ppm_ = 0.0f; // integral term
+    float ratio_ppm_ = 0.0f;
+
+    // Resampler state: last 3 input samples + fractional read position
+    int16_t hist_[3] = {};
+    double pos_ = 0.0;
+};
@@ -0,0 +1,52 @@
+#include "HalfbandDecimator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr size_t HIST = HalfbandDecimator::TAPS - 1;
+    constexpr size_t CENTER = HIST / 2;
+
+    // Q15, center tap then the odd offsets 1, 3, ..., 23 (even offsets are 0)
+    constexpr int32_t H_CENTER = 16384;
+    constexpr int32_t H_ODD[] = {
+        10358, -3262, 1745, -1046, 639, -383, 219, -116, 55, -23, 7, -1,
+    };
+    static_assert(2 * (sizeof(H_ODD) / sizeof(H_ODD[0])) - 1 == CENTER,
+                  "tap table does not match TAPS");
+}
+
+size_t HalfbandDecimator::process(const int16_t *in, size_t in_samples, int16_t *out)
+{
+    size_t produced = 0;
+    while (in_samples >= 2)
+    {
+        const size_t n = std::min(in_samples, BLOCK) & ~size_t(1);
+        std::memcpy(buf_ + HIST, in, n * sizeof(int16_t));
+
+        // Window of output k: buf_[2k + 1 .. 2k + TAPS], newest = in[2k + 1]
+        for (size_t k = 0; k < n / 2; ++k)
+        {
+            const int16_t *c = buf_ + 2 * k + 1 + CENTER;
+            int32_t acc = H_CENTER * c[0];
+            for (size_t i = 0; i < sizeof(H_ODD) / sizeof(H_ODD[0]); ++i)
+            {
+                const size_t off = 2 * i + 1;
+                acc += H_ODD[i] * (static_cast<int32_t>(c[-static_cast<ptrdiff_t>(off)]) + c[off]);
+            }
+            acc = (acc + (1 << 14)) >> 15;
+            out[produced++] = static_cast<int16_t>(std::clamp<int32_t>(acc, -32768, 32767));
+        }
+
+        std::memmove(buf_, buf_ + n, HIST * sizeof(int16_t));
+        in += n;
+        in_samples -= n;
+    }
+    return produced;
+}
+
+void HalfbandDecimator::reset()
+{
+    std::memset(buf_, 0, sizeof(buf_));
+}
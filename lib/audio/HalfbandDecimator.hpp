@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * HalfbandDecimator
+ * ============================================================================
+ * Hạ tần số lấy mẫu 2:1 (16 kHz → 8 kHz) cho uplink profile half-rate.
+ *
+ *  - 47-tap half-band FIR (Kaiser β=8), Q15: every other tap is zero, so
+ *    one output costs 12 symmetric pairs + the center tap
+ *  - Passband flat to -0.2 dB at 0.425 fs_out (3.4 kHz @8k), stopband
+ *    -33 dB from 0.575 fs_out (4.6 kHz): speech above it is already
+ *    ~20 dB down, so the aliases land below -50 dB
+ *  - Delay: 23 input samples (1.4 ms @16k)
+ *
+ * Dòng dữ liệu (profile half-rate):
+ *   NoiseSuppressor → PCM 16k → HalfbandDecimator → AudioCodec (8k)
+ *
+ * Thread-safety: none. Chỉ CODEC task gọi process()/reset().
+ */
+class HalfbandDecimator
+{
+public:
+    static constexpr size_t TAPS = 47;
+    // Input samples per internal pass; longer blocks are split
+    static constexpr size_t BLOCK = 512;
+
+    /**
+     * Filter + keep every other sample
+     * @param in_samples even; history carries across calls
+     * @return samples written to out (in_samples / 2). out must not alias in.
+     */
+    size_t process(const int16_t *in, size_t in_samples, int16_t *out);
+
+    // New stream (profile switch, new turn): forget the history
+    void reset();
+
+private:
+    // [TAPS - 1 history][BLOCK input]
+    int16_t buf_[TAPS - 1 + BLOCK] = {};
+};
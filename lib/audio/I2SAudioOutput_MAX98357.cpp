@@ -1,4 +1,5 @@
 #include "I2SAudioOutput_MAX98357.hpp"
+#include "freertos/task.h"
 #include "esp_log.h"
 #include <cstring>
 
@@ -14,8 +15,8 @@ I2SAudioOutput_MAX98357::I2SAudioOutput_MAX98357(const Config& cfg)
     i2s_cfg.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
     i2s_cfg.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
     i2s_cfg.communication_format = I2S_COMM_FORMAT_STAND_I2S;
-    i2s_cfg.dma_buf_count = 6;
-    i2s_cfg.dma_buf_len = 256;
+    i2s_cfg.dma_buf_count = cfg_.dma_buf_count;
+    i2s_cfg.dma_buf_len = cfg_.dma_buf_len;
     i2s_cfg.use_apll = false;
     i2s_cfg.tx_desc_auto_clear = true;
     i2s_cfg.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1;
@@ -26,7 +27,8 @@ I2SAudioOutput_MAX98357::I2SAudioOutput_MAX98357(const Config& cfg)
     pin_cfg.data_out_num = cfg_.pin_dout;
     pin_cfg.data_in_num  = I2S_PIN_NO_CHANGE;
 
-    esp_err_t err = i2s_driver_install(cfg_.i2s_port, &i2s_cfg, 0, nullptr);
+    // Event queue: TX_DONE = one DMA buffer free (writePcm waits on it)
+    esp_err_t err = i2s_driver_install(cfg_.i2s_port, &i2s_cfg, cfg_.dma_buf_count, &i2s_events);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "I2S driver install failed: %s", esp_err_to_name(err));
         return;
@@ -71,6 +73,7 @@ I2SAudioOutput_MAX98357::~I2SAudioOutput_MAX98357()
 
 bool I2SAudioOutput_MAX98357::startPlayback()
 {
+    std::lock_guard<std::mutex> lk(tx_lock);
     if (running) return true;
     if (!i2s_installed) {
         ESP_LOGE(TAG, "I2S not installed, cannot start playback");
@@ -96,6 +99,7 @@ bool I2SAudioOutput_MAX98357::startPlayback()
 
 void I2SAudioOutput_MAX98357::stopPlayback()
 {
+    std::lock_guard<std::mutex> lk(tx_lock);
     if (!running) return;
 
     i2s_stop(cfg_.i2s_port);
@@ -103,6 +107,16 @@ void I2SAudioOutput_MAX98357::stopPlayback()
     ESP_LOGI(TAG, "MAX98357 playback stopped");
 }
 
+void I2SAudioOutput_MAX98357::flush()
+{
+    std::lock_guard<std::mutex> lk(tx_lock);
+    ++flush_gen; // a writePcm in progress drops the rest of its chunk
+    if (running) {
+        // Zeroes every DMA buffer, the one on the wire included
+        i2s_zero_dma_buffer(cfg_.i2s_port);
+    }
+}
+
 // ============================================================================
 // Data
 // ============================================================================
@@ -120,14 +134,33 @@ size_t I2SAudioOutput_MAX98357::writePcm(const int16_t* pcm, size_t pcm_samples)
         scaled[i] = (pcm[i] * volume) / 100;
     }
 
+    const uint32_t gen = flush_gen.load();
+    const TickType_t wait = pdMS_TO_TICKS(2 * periodUs() / 1000 + 1);
+    const size_t total = pcm_samples * sizeof(int16_t);
     size_t bytes_written = 0;
-    i2s_write(
-        cfg_.i2s_port,
-        scaled,
-        pcm_samples * sizeof(int16_t),
-        &bytes_written,
-        portMAX_DELAY
-    );
+    while (bytes_written < total) {
+        {
+            std::lock_guard<std::mutex> lk(tx_lock);
+            if (!running || flush_gen.load() != gen) break; // flushed: the rest is stale
+
+            size_t n = 0;
+            i2s_write(
+                cfg_.i2s_port,
+                reinterpret_cast<const uint8_t*>(scaled) + bytes_written,
+                total - bytes_written,
+                &n,
+                0 // only into free DMA buffers
+            );
+            bytes_written += n;
+        }
+        if (bytes_written < total) {
+            // Ring full: sleep until a buffer went out
+            i2s_event_t evt;
+            if (!i2s_events || xQueueReceive(i2s_events, &evt, wait) != pdTRUE) {
+                vTaskDelay(1);
+            }
+        }
+    }
 
     return bytes_written / sizeof(int16_t); // trả về số sample
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+
 #include "AudioOutput.hpp"
 #include "driver/i2s.h"
+#include "freertos/queue.h"
 
 /**
  * I2SAudioOutput_MAX98357
@@ -26,6 +30,10 @@ public:
 
         uint32_t sample_rate = 16000;
         uint8_t channels     = 1;   // mono default
+
+        // DMA ring: count × len frames (6 × 256 @16k = 96 ms, 16 ms period)
+        int dma_buf_count = 6;
+        int dma_buf_len   = 256;
     };
 
 public:
@@ -37,6 +45,7 @@ public:
     // ========================================================================
     bool startPlayback() override;
     void stopPlayback() override;
+    void flush() override;
 
     size_t writePcm(const int16_t* pcm, size_t pcm_samples) override;
 
@@ -46,11 +55,21 @@ public:
     uint32_t sampleRate() const override { return cfg_.sample_rate; }
     uint8_t  channels() const override   { return cfg_.channels; }
     uint8_t  bitsPerSample() const override { return 16; }
+    uint32_t periodUs() const override {
+        return static_cast<uint32_t>(uint64_t(cfg_.dma_buf_len) * 1000000 / cfg_.sample_rate);
+    }
 
 private:
     Config cfg_;
 
-    bool running = false;
+    std::atomic<bool> running{false};
     bool i2s_installed = false;
     uint8_t volume = 60;  // 60% volume
+
+    // writePcm never blocks inside i2s_write: it fills what the DMA ring
+    // has free under tx_lock, then waits for a TX_DONE event. flush() takes
+    // the same lock, so no stale sample lands after the ring is zeroed.
+    std::mutex tx_lock;
+    QueueHandle_t i2s_events = nullptr;
+    std::atomic<uint32_t> flush_gen{0};
 };
@@ -0,0 +1,235 @@
+#include "NoiseSuppressor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    constexpr float kPi = 3.14159265358979f;
+    constexpr float kEps = 1e-9f;
+
+    // Minimum statistics: power smoothing, and the bias of a minimum of
+    // smoothed noise power against its mean
+    constexpr float kSmoothAlpha = 0.85f;
+    constexpr float kMinBias = 2.0f;
+}
+
+NoiseSuppressor::NoiseSuppressor() : NoiseSuppressor(Config{}) {}
+
+NoiseSuppressor::NoiseSuppressor(const Config &cfg)
+    : cfg_(cfg)
+{
+    // sqrt-Hann (periodic): w^2 sums to 1 at 50% overlap → perfect reconstruction
+    for (size_t n = 0; n < FRAME; ++n)
+    {
+        window_[n] = std::sin(kPi * static_cast<float>(n) / FRAME);
+    }
+
+    for (size_t k = 0; k < FRAME / 2; ++k)
+    {
+        float phase = -2.0f * kPi * static_cast<float>(k) / FRAME;
+        cos_[k] = std::cos(phase);
+        sin_[k] = std::sin(phase);
+    }
+
+    size_t bits = 0;
+    while ((static_cast<size_t>(1) << bits) < FRAME)
+        ++bits;
+    for (size_t i = 0; i < FRAME; ++i)
+    {
+        size_t r = 0;
+        for (size_t b = 0; b < bits; ++b)
+        {
+            if (i & (static_cast<size_t>(1) << b))
+                r |= static_cast<size_t>(1) << (bits - 1 - b);
+        }
+        bitrev_[i] = static_cast<uint8_t>(r);
+    }
+
+    reset();
+    resetNoiseFloor();
+}
+
+void NoiseSuppressor::reset()
+{
+    std::memset(in_hop_, 0, sizeof(in_hop_));
+    std::memset(out_hop_, 0, sizeof(out_hop_));
+    std::memset(analysis_, 0, sizeof(analysis_));
+    std::memset(overlap_, 0, sizeof(overlap_));
+    std::memset(prev_clean_, 0, sizeof(prev_clean_));
+    std::fill(gain_, gain_ + BINS, 1.0f);
+    hop_pos_ = 0;
+}
+
+void NoiseSuppressor::resetNoiseFloor()
+{
+    std::memset(noise_, 0, sizeof(noise_));
+    std::memset(smooth_, 0, sizeof(smooth_));
+    std::memset(win_min_, 0, sizeof(win_min_));
+    frame_count_ = 0;
+    win_frames_ = 0;
+}
+
+// ============================================================================
+// Streaming entry
+// ============================================================================
+void NoiseSuppressor::process(int16_t *pcm, size_t samples)
+{
+    if (!cfg_.enabled || !pcm)
+        return;
+
+    for (size_t i = 0; i < samples; ++i)
+    {
+        in_hop_[hop_pos_] = static_cast<float>(pcm[i]);
+
+        float y = out_hop_[hop_pos_];
+        y = std::clamp(y, -32768.0f, 32767.0f);
+        pcm[i] = static_cast<int16_t>(std::lrintf(y));
+
+        if (++hop_pos_ == HOP)
+        {
+            hop_pos_ = 0;
+            processHop();
+        }
+    }
+}
+
+// ============================================================================
+// One hop: analysis → gain → synthesis
+// ============================================================================
+void NoiseSuppressor::processHop()
+{
+    // Slide analysis frame and append new hop
+    std::memmove(analysis_, analysis_ + HOP, HOP * sizeof(float));
+    std::memcpy(analysis_ + HOP, in_hop_, HOP * sizeof(float));
+
+    for (size_t n = 0; n < FRAME; ++n)
+    {
+        re_[n] = analysis_[n] * window_[n];
+        im_[n] = 0.0f;
+    }
+    fft(re_, im_);
+
+    // ---------------- Noise floor tracking ----------------
+    // Per-bin decision: a bin well above the floor is treated as speech and
+    // may only pull the floor down; quiet bins refresh it.
+    float power[BINS];
+    for (size_t k = 0; k < BINS; ++k)
+        power[k] = re_[k] * re_[k] + im_[k] * im_[k];
+
+    for (size_t k = 0; k < BINS; ++k)
+    {
+        smooth_[k] = frame_count_ == 0 ? power[k]
+                                       : kSmoothAlpha * smooth_[k] + (1.0f - kSmoothAlpha) * power[k];
+        win_min_[k] = win_frames_ == 0 ? smooth_[k] : std::min(win_min_[k], smooth_[k]);
+    }
+    ++win_frames_;
+
+    const bool learning = frame_count_ < cfg_.init_frames;
+    if (learning)
+    {
+        // Seed: the quietest moment of the first frames, not their mean,
+        // so a first turn that starts with speech does not learn it
+        for (size_t k = 0; k < BINS; ++k)
+            noise_[k] = win_min_[k] * kMinBias;
+    }
+    else
+    {
+        for (size_t k = 0; k < BINS; ++k)
+        {
+            if (power[k] < cfg_.speech_threshold * noise_[k])
+                noise_[k] = cfg_.noise_alpha * noise_[k] + (1.0f - cfg_.noise_alpha) * power[k];
+            else if (power[k] < noise_[k])
+                noise_[k] = 0.8f * noise_[k] + 0.2f * power[k];
+        }
+
+        // A floor under the window minimum is stale (the room got louder
+        // while bins looked like speech): raise it
+        if (win_frames_ >= cfg_.min_window_frames)
+        {
+            for (size_t k = 0; k < BINS; ++k)
+                noise_[k] = std::max(noise_[k], win_min_[k] * kMinBias);
+            win_frames_ = 0;
+        }
+    }
+    ++frame_count_;
+
+    // ---------------- Wiener gain (decision-directed) ----------------
+    // While the floor is still being learned the frame passes unmodified
+    for (size_t k = 0; k < BINS && !learning; ++k)
+    {
+        float n = noise_[k] + kEps;
+        float gamma = power[k] / n;
+        float xi = cfg_.dd_alpha * (prev_clean_[k] / n) +
+                   (1.0f - cfg_.dd_alpha) * std::max(gamma - 1.0f, 0.0f);
+
+        float g = xi / (1.0f + xi);
+        g = std::max(g, cfg_.gain_floor);
+        // Fast attack, smoothed release → ít "musical noise"
+        g = std::max(g, gain_[k] * cfg_.gain_release);
+        g = std::min(g, 1.0f);
+
+        gain_[k] = g;
+        prev_clean_[k] = g * g * power[k];
+
+        re_[k] *= g;
+        im_[k] *= g;
+        if (k != 0 && k != FRAME / 2)
+        {
+            re_[FRAME - k] *= g;
+            im_[FRAME - k] *= g;
+        }
+    }
+
+    // ---------------- Inverse FFT: conj → FFT → conj / N ----------------
+    for (size_t n = 0; n < FRAME; ++n)
+        im_[n] = -im_[n];
+    fft(re_, im_);
+
+    const float scale = 1.0f / FRAME;
+    for (size_t n = 0; n < HOP; ++n)
+    {
+        out_hop_[n] = overlap_[n] + re_[n] * scale * window_[n];
+        overlap_[n] = re_[n + HOP] * scale * window_[n + HOP];
+    }
+}
+
+// ============================================================================
+// Radix-2 in-place complex FFT (forward)
+// ============================================================================
+void NoiseSuppressor::fft(float *re, float *im) const
+{
+    for (size_t i = 0; i < FRAME; ++i)
+    {
+        size_t j = bitrev_[i];
+        if (j > i)
+        {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= FRAME; len <<= 1)
+    {
+        size_t half = len >> 1;
+        size_t step = FRAME / len;
+        for (size_t start = 0; start < FRAME; start += len)
+        {
+            for (size_t j = 0; j < half; ++j)
+            {
+                float wr = cos_[j * step];
+                float wi = sin_[j * step];
+                size_t a = start + j;
+                size_t b = a + half;
+
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
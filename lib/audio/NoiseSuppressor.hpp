@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * NoiseSuppressor
+ * ============================================================================
+ * Streaming single-channel noise suppression for the mic uplink.
+ *
+ *  - 256-point float FFT, 50% overlap (hop 128 = 8 ms @16kHz)
+ *  - sqrt-Hann analysis + synthesis window → weighted overlap-add
+ *  - Noise floor tracked per bin, only while the bin looks like non-speech;
+ *    kept across turns, raised by minimum statistics when the room gets
+ *    louder
+ *  - Decision-directed Wiener gain, floored and smoothed over time
+ *
+ * Dòng dữ liệu:
+ *   AudioInput → PCM → NoiseSuppressor (in-place) → AudioCodec
+ *
+ * Thread-safety: none. Chỉ MIC task gọi process()/reset().
+ * Latency: FRAME samples (16 ms @16kHz) while enabled.
+ */
+class NoiseSuppressor
+{
+public:
+    struct Config
+    {
+        bool enabled = true;
+
+        // Noise PSD smoothing when a frame is judged non-speech (0..1)
+        float noise_alpha = 0.92f;
+
+        // Decision-directed a-priori SNR smoothing (0..1)
+        float dd_alpha = 0.98f;
+
+        // Minimum gain per bin (0.1 ≈ -20 dB max attenuation)
+        float gain_floor = 0.1f;
+
+        // Release smoothing of the gain (0 = none, closer to 1 = slower)
+        float gain_release = 0.6f;
+
+        // Posterior SNR (linear) above which a bin counts as speech
+        float speech_threshold = 2.5f;
+
+        // Leading frames that seed the noise estimate (minimum of their
+        // smoothed power): once, later turns keep the learned floor
+        uint16_t init_frames = 12;
+
+        // Minimum-statistics window (~1.3 s): the floor rises to the
+        // quietest smoothed power seen over it
+        uint16_t min_window_frames = 160;
+    };
+
+    static constexpr size_t FRAME = 256;
+    static constexpr size_t HOP = FRAME / 2;
+    static constexpr size_t BINS = FRAME / 2 + 1;
+
+    NoiseSuppressor();
+    explicit NoiseSuppressor(const Config &cfg);
+
+    /**
+     * Suppress noise in-place
+     * @param pcm      PCM 16-bit mono, overwritten with the processed signal
+     * @param samples  any count; output is delayed by latencySamples()
+     */
+    void process(int16_t *pcm, size_t samples);
+
+    // Clear the stream history (call at the start of each turn); the
+    // learned noise floor is kept, a turn may start with speech
+    void reset();
+
+    // Forget the noise floor too: the next init_frames seed it again
+    void resetNoiseFloor();
+
+    void setEnabled(bool enable) { cfg_.enabled = enable; }
+    bool isEnabled() const { return cfg_.enabled; }
+
+    size_t latencySamples() const { return cfg_.enabled ? FRAME : 0; }
+
+private:
+    void processHop();
+    void fft(float *re, float *im) const;
+
+private:
+    Config cfg_;
+
+    // Streaming buffers
+    float in_hop_[HOP];   // samples of the hop being collected
+    float out_hop_[HOP];  // processed samples handed back during this hop
+    float analysis_[FRAME];
+    float overlap_[HOP];
+    size_t hop_pos_ = 0;
+
+    // FFT workspace + tables
+    float re_[FRAME];
+    float im_[FRAME];
+    float window_[FRAME];
+    float cos_[FRAME / 2];
+    float sin_[FRAME / 2];
+    uint8_t bitrev_[FRAME];
+
+    // Spectral state
+    float noise_[BINS];
+    float prev_clean_[BINS]; // |G|^2 * |X|^2 of previous frame (DD estimator)
+    float gain_[BINS];
+    float smooth_[BINS];  // recursively smoothed power
+    float win_min_[BINS]; // minimum of smooth_ in the current window
+    uint32_t frame_count_ = 0; // frames since the floor was forgotten
+    uint32_t win_frames_ = 0;
+};
@@ -0,0 +1,268 @@
+#include "TimeStretcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    constexpr float kPi = 3.14159265358979f;
+}
+
+TimeStretcher::TimeStretcher() : TimeStretcher(Config{}) {}
+
+TimeStretcher::TimeStretcher(const Config &cfg)
+    : cfg_(cfg)
+{
+    frame_ = std::min<size_t>(static_cast<size_t>(cfg_.sample_rate) * cfg_.frame_ms / 1000, MAX_FRAME);
+    frame_ &= ~static_cast<size_t>(1);
+    hop_ = frame_ / 2;
+    search_ = static_cast<size_t>(cfg_.sample_rate) * cfg_.search_ms / 1000;
+
+    // Periodic Hann: w[n] + w[n + hop] = 1 → overlap-add is transparent
+    for (size_t n = 0; n < frame_; ++n)
+    {
+        window_[n] = 0.5f - 0.5f * std::cos(2.0f * kPi * static_cast<float>(n) / frame_);
+    }
+
+    reset();
+}
+
+void TimeStretcher::reset()
+{
+    std::memset(overlap_, 0, sizeof(overlap_));
+    buf_len_ = 0;
+    next_pos_ = 0.0;
+    prev_pos_ = -1;
+    speed_ = 1.0f;
+    mode_ = Mode::NORMAL;
+}
+
+void TimeStretcher::setSpeed(float speed)
+{
+    speed_ = std::clamp(speed, 1.0f - cfg_.slowdown, 1.0f + cfg_.max_catchup);
+}
+
+// ============================================================================
+// Depth policy (hysteresis: engage far from target, release near it)
+// ============================================================================
+void TimeStretcher::updateDepth(size_t fill_samples)
+{
+    const uint32_t depth_ms =
+        static_cast<uint32_t>(static_cast<uint64_t>(fill_samples) * 1000 / cfg_.sample_rate);
+
+    switch (mode_)
+    {
+    case Mode::NORMAL:
+        if (depth_ms > cfg_.target_ms + cfg_.catchup_above_ms)
+            mode_ = Mode::CATCHUP;
+        else if (depth_ms < cfg_.underrun_below_ms)
+            mode_ = Mode::REFILL;
+        break;
+
+    case Mode::CATCHUP:
+        if (depth_ms <= cfg_.target_ms + cfg_.settle_band_ms)
+            mode_ = Mode::NORMAL;
+        break;
+
+    case Mode::REFILL:
+        if (depth_ms + cfg_.settle_band_ms >= cfg_.target_ms)
+            mode_ = Mode::NORMAL;
+        break;
+    }
+
+    if (mode_ == Mode::CATCHUP)
+    {
+        // Proportional to the excess, so a long stall drains in bounded time
+        float excess_s = static_cast<float>(depth_ms - cfg_.target_ms) / 1000.0f;
+        speed_ = 1.0f + std::clamp(excess_s * cfg_.catchup_per_s,
+                                   cfg_.min_catchup, cfg_.max_catchup);
+    }
+    else if (mode_ == Mode::REFILL)
+    {
+        speed_ = 1.0f - cfg_.slowdown;
+    }
+    else
+    {
+        speed_ = 1.0f;
+    }
+}
+
+// ============================================================================
+// WSOLA
+// ============================================================================
+size_t TimeStretcher::process(const int16_t *in, size_t in_samples,
+                              int16_t *out, size_t out_capacity)
+{
+    if (!out)
+        return 0;
+
+    if (in && in_samples > 0)
+    {
+        compact();
+        size_t room = IN_CAPACITY - buf_len_;
+        if (in_samples > room)
+        {
+            // Caller outran the stage (should not happen with ≥1 hop per block):
+            // drop the excess rather than corrupt the stream position
+            in_samples = room;
+        }
+        std::memcpy(buf_ + buf_len_, in, in_samples * sizeof(int16_t));
+        buf_len_ += in_samples;
+    }
+
+    size_t produced = 0;
+    while (produced + hop_ <= out_capacity)
+    {
+        const size_t nominal = static_cast<size_t>(std::lround(next_pos_));
+        if (nominal + search_ + frame_ > buf_len_)
+            break; // need more input
+
+        size_t start = nominal;
+        if (prev_pos_ < 0)
+        {
+            // First frame: seed the overlap as if the same input came before,
+            // so the first hop passes through instead of fading in
+            for (size_t n = 0; n < hop_; ++n)
+                overlap_[n] = window_[n + hop_] * buf_[start + n];
+        }
+        else if (speed_ == 1.0f)
+        {
+            // Natural continuation of the previous frame: overlap-add is
+            // transparent. Re-anchors after a stretched stretch, whose last
+            // frame may sit up to ±search away from the nominal position.
+            start = static_cast<size_t>(prev_pos_) + hop_;
+            next_pos_ = static_cast<double>(start);
+        }
+        else
+        {
+            start = findBestOffset(nominal);
+        }
+
+        const int16_t *x = buf_ + start;
+        for (size_t n = 0; n < hop_; ++n)
+        {
+            float y = overlap_[n] + window_[n] * x[n];
+            y = std::clamp(y, -32768.0f, 32767.0f);
+            out[produced + n] = static_cast<int16_t>(std::lrintf(y));
+            overlap_[n] = window_[n + hop_] * x[n + hop_];
+        }
+        produced += hop_;
+
+        prev_pos_ = static_cast<long>(start);
+        next_pos_ += static_cast<double>(speed_) * hop_;
+    }
+
+    return produced;
+}
+
+size_t TimeStretcher::flush(int16_t *out, size_t out_capacity)
+{
+    if (!out)
+        return 0;
+
+    size_t produced = 0;
+    size_t start = 0; // nothing emitted yet: all verbatim
+
+    if (prev_pos_ >= 0)
+    {
+        // Continue the last frame (as speed 1 would), not the nominal position
+        start = std::min(static_cast<size_t>(prev_pos_) + hop_, buf_len_);
+        // Second half of the last frame still sits in overlap_: complete it
+        for (size_t n = 0; n < hop_ && produced < out_capacity; ++n)
+        {
+            float x = (start + n < buf_len_) ? buf_[start + n] : 0.0f;
+            float y = overlap_[n] + window_[n] * x;
+            y = std::clamp(y, -32768.0f, 32767.0f);
+            out[produced++] = static_cast<int16_t>(std::lrintf(y));
+        }
+        start = std::min(start + hop_, buf_len_);
+    }
+
+    size_t rest = std::min(buf_len_ - start, out_capacity - produced);
+    std::memcpy(out + produced, buf_ + start, rest * sizeof(int16_t));
+    produced += rest;
+
+    const float speed = speed_;
+    const Mode mode = mode_;
+    reset();
+    speed_ = speed; // policy state survives, only the stream restarts
+    mode_ = mode;
+
+    return produced;
+}
+
+// Offset within [nominal - search, nominal + search] whose first half-frame
+// best matches the natural continuation of the previous frame.
+size_t TimeStretcher::findBestOffset(size_t nominal) const
+{
+    const int16_t *target = buf_ + prev_pos_ + hop_;
+    const size_t lo = nominal > search_ ? nominal - search_ : 0;
+    const size_t hi = nominal + search_;
+
+    // Normalised cross-correlation; step = decimation of lags and samples
+    auto score = [&](size_t cand, size_t step) -> float
+    {
+        const int16_t *c = buf_ + cand;
+        float xy = 0.0f;
+        float yy = 1.0f;
+        for (size_t n = 0; n < hop_; n += step)
+        {
+            float v = c[n];
+            xy += static_cast<float>(target[n]) * v;
+            yy += v * v;
+        }
+        return xy / std::sqrt(yy);
+    };
+
+    size_t best = nominal;
+    float best_score = score(nominal, 2);
+    for (size_t cand = lo; cand <= hi; cand += 2)
+    {
+        float s = score(cand, 2);
+        if (s > best_score)
+        {
+            best_score = s;
+            best = cand;
+        }
+    }
+
+    // Refine ±1 at full resolution
+    size_t refined = best;
+    float refined_score = score(best, 1);
+    for (size_t cand : {best - 1, best + 1})
+    {
+        if (cand < lo || cand > hi)
+            continue;
+        float s = score(cand, 1);
+        if (s > refined_score)
+        {
+            refined_score = s;
+            refined = cand;
+        }
+    }
+
+    return refined;
+}
+
+// Drop input no later frame can reach: before the natural continuation of
+// the previous frame and before the next search window.
+void TimeStretcher::compact()
+{
+    size_t keep_from = static_cast<size_t>(next_pos_);
+    keep_from = keep_from > search_ ? keep_from - search_ : 0;
+    // Keep the previous frame's start: prev_pos_ < 0 means "no previous
+    // frame" (search and flush() depend on it)
+    if (prev_pos_ >= 0)
+        keep_from = std::min(keep_from, static_cast<size_t>(prev_pos_));
+    keep_from = std::min(keep_from, buf_len_);
+
+    if (keep_from == 0)
+        return;
+
+    std::memmove(buf_, buf_ + keep_from, (buf_len_ - keep_from) * sizeof(int16_t));
+    buf_len_ -= keep_from;
+    next_pos_ -= static_cast<double>(keep_from);
+    if (prev_pos_ >= 0)
+        prev_pos_ -= static_cast<long>(keep_from);
+}
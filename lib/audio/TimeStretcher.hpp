@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * TimeStretcher
+ * ============================================================================
+ * WSOLA time-scale modification cho downlink: đổi tốc độ phát, giữ cao độ.
+ *
+ * After a Wi-Fi stall the server's burst leaves the downlink queue full and
+ * every later word plays late. This stage plays a little faster until the
+ * queue is back at its target depth, and a little slower when it is about
+ * to run dry.
+ *
+ *  - Frame 20 ms, Hann window, 50% overlap-add (synthesis hop fixed)
+ *  - Analysis hop = speed × synthesis hop
+ *  - Each frame is shifted within ±search_ms to best match the natural
+ *    continuation of the previous frame (normalised cross-correlation,
+ *    coarse step 2 then ±1 refine) → no pitch shift, no phasing
+ *  - speed == 1 skips the search and continues the previous frame:
+ *    output = input delayed by one frame, from the first sample on, and a
+ *    catch-up / refill episode ends without a phase jump
+ *
+ * Thread-safety: none. Chỉ CODEC task dùng.
+ */
+class TimeStretcher
+{
+public:
+    struct Config
+    {
+        uint32_t sample_rate = 16000;
+        uint16_t frame_ms = 20;
+        uint16_t search_ms = 6; // ≥ half the longest pitch period of interest
+
+        // Depth policy (ms of audio queued ahead of the speaker)
+        uint32_t target_ms = 160;
+        uint32_t catchup_above_ms = 120;  // start speeding up at target + this
+        uint32_t underrun_below_ms = 60;  // start slowing down below this
+        uint32_t settle_band_ms = 20;     // back to 1.0 within target ± band
+
+        float min_catchup = 0.05f;        // +5%
+        float max_catchup = 0.15f;        // +15%
+        float catchup_per_s = 0.25f;      // speed-up per second of excess depth
+        float slowdown = 0.05f;           // -5% while refilling
+    };
+
+    static constexpr size_t MAX_FRAME = 640;  // 40 ms @16kHz
+    static constexpr size_t IN_CAPACITY = 4096;
+
+    TimeStretcher();
+    explicit TimeStretcher(const Config &cfg);
+
+    /**
+     * Update the depth policy (call once per decoded block)
+     * @param fill_samples  samples queued ahead of the speaker (encoded + PCM)
+     * Sets speed() to 1.0, a catch-up speed or the slowdown speed.
+     */
+    void updateDepth(size_t fill_samples);
+
+    // Manual override (policy sẽ ghi đè ở lần updateDepth() sau)
+    void setSpeed(float speed);
+    float speed() const { return speed_; }
+
+    // True while the policy is changing the playout rate
+    bool isAdjusting() const { return speed_ != 1.0f; }
+
+    /**
+     * Stretch one block
+     * @return samples written to out. Input that cannot be processed yet
+     *         stays buffered internally (at most one frame + search range).
+     */
+    size_t process(const int16_t *in, size_t in_samples,
+                   int16_t *out, size_t out_capacity);
+
+    /**
+     * End of stream: emit everything still buffered (completes the pending
+     * overlap, rest verbatim) and reset. Nothing fed to process() is lost.
+     */
+    size_t flush(int16_t *out, size_t out_capacity);
+
+    void reset();
+
+private:
+    size_t findBestOffset(size_t nominal) const;
+    void compact();
+
+private:
+    Config cfg_;
+    size_t frame_;
+    size_t hop_;
+    size_t search_;
+
+    float speed_ = 1.0f;
+    enum class Mode : uint8_t
+    {
+        NORMAL,
+        CATCHUP,
+        REFILL
+    } mode_ = Mode::NORMAL;
+
+    float window_[MAX_FRAME];
+    float overlap_[MAX_FRAME / 2];
+
+    int16_t buf_[IN_CAPACITY];
+    size_t buf_len_ = 0;
+    double next_pos_ = 0.0; // nominal analysis start of the next frame
+    long prev_pos_ = -1;    // chosen start of the previous frame (-1 = none)
+};
@@ -0,0 +1,148 @@
+#include "BitrateController.hpp"
+
+#include <algorithm>
+
+const BitrateController::Profile BitrateController::PROFILES[PROFILE_COUNT] = {
+    {proto::Codec::ADPCM_IMA, false, 64000, "adpcm-16k"},
+    {proto::Codec::ADPCM_IMA_HALF, true, 32000, "adpcm-8k"},
+    {proto::Codec::OPUS, false, 16000, "opus-16k"},
+};
+
+BitrateController::BitrateController() : BitrateController(Config{}) {}
+
+BitrateController::BitrateController(const Config &cfg)
+{
+    setConfig(cfg);
+}
+
+void BitrateController::setConfig(const Config &cfg)
+{
+    cfg_ = cfg;
+    up_hold_ms_ = cfg_.up_hold_ms;
+    index_ = std::min(index_, lowestIndex());
+    reset();
+}
+
+void BitrateController::setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (!enabled_)
+        index_ = 0;
+}
+
+void BitrateController::reset()
+{
+    have_age_ = false;
+    latency_ms_ = 0;
+    bad_ = false;
+    good_ = false;
+    settling_ = false;
+    probing_ = false; // verdict unknown: neither backoff nor reset
+}
+
+void BitrateController::setRtt(uint32_t rtt_ms)
+{
+    rtt_ms_ = rtt_ms;
+    if (rtt_ms == 0 || rtt_min_ms_ == 0 || rtt_ms < rtt_min_ms_)
+        rtt_min_ms_ = rtt_ms;
+}
+
+void BitrateController::switchTo(size_t index, uint32_t now_ms)
+{
+    index_ = index;
+    ++switches_;
+    bad_ = false;
+    good_ = false;
+    settling_ = true;
+    settle_since_ = now_ms;
+}
+
+// ============================================================================
+// One sample per uplink packet
+// ============================================================================
+bool BitrateController::onPacket(uint32_t now_ms, uint32_t age_ms, uint32_t depth_ms, uint32_t send_ms)
+{
+    if (!enabled_)
+        return false;
+
+    // Estimator: EWMA 1/4 of the packet age (Q4 ms) + one-way RTT
+    const uint32_t age_q4 = age_ms * 16;
+    if (!have_age_)
+    {
+        age_q4_ = age_q4;
+        have_age_ = true;
+    }
+    else
+    {
+        age_q4_ = static_cast<uint32_t>(static_cast<int32_t>(age_q4_) +
+                                        (static_cast<int32_t>(age_q4) - static_cast<int32_t>(age_q4_)) / 4);
+    }
+    latency_ms_ = age_q4_ / 16 + rtt_ms_ / 2;
+    const uint32_t queue_ms = rtt_ms_ - rtt_min_ms_;
+
+    const bool weak = rssi_dbm_ != 0 && rssi_dbm_ < cfg_.rssi_low_dbm;
+    if (weak && index_ == 0)
+    {
+        switchTo(1, now_ms); // loss and retries follow, do not wait for them
+        return true;
+    }
+
+    // A probe that held for probe_ms: the link has room, forget the backoff
+    if (probing_ && now_ms - probe_since_ >= cfg_.probe_ms)
+    {
+        probing_ = false;
+        up_hold_ms_ = cfg_.up_hold_ms;
+    }
+
+    if (settling_)
+    {
+        if (now_ms - settle_since_ < cfg_.settle_ms)
+            return false;
+        settling_ = false;
+    }
+
+    const bool bad = latency_ms_ > cfg_.target_ms || queue_ms > cfg_.queue_high_ms ||
+                     depth_ms > cfg_.depth_high_ms || send_ms > cfg_.send_slow_ms;
+    const bool good = !bad && queue_ms < cfg_.queue_low_ms && depth_ms < cfg_.depth_low_ms &&
+                      (rssi_dbm_ == 0 || rssi_dbm_ >= cfg_.rssi_up_dbm);
+
+    if (bad)
+    {
+        good_ = false;
+        if (!bad_)
+        {
+            bad_ = true;
+            bad_since_ = now_ms;
+        }
+        if (now_ms - bad_since_ < cfg_.down_hold_ms || index_ >= lowestIndex())
+            return false;
+
+        if (probing_)
+        {
+            // The last step up did not fit: wait twice as long next time
+            probing_ = false;
+            up_hold_ms_ = std::min(up_hold_ms_ * 2, cfg_.up_hold_max_ms);
+        }
+        switchTo(index_ + 1, now_ms);
+        return true;
+    }
+
+    bad_ = false;
+    if (!good)
+    {
+        good_ = false;
+        return false;
+    }
+    if (!good_)
+    {
+        good_ = true;
+        good_since_ = now_ms;
+    }
+    if (now_ms - good_since_ < up_hold_ms_ || index_ == 0)
+        return false;
+
+    switchTo(index_ - 1, now_ms);
+    probing_ = true;
+    probe_since_ = now_ms;
+    return true;
+}
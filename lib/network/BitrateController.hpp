@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "WireProtocol.hpp"
+
+/**
+ * BitrateController
+ * ============================================================================
+ * Chọn codec profile cho uplink theo đo đạc của link, giữ latency dưới target.
+ *
+ * Profiles, best first (PROFILES):
+ *   0  ADPCM       stream rate (16 kHz)   64 kbps
+ *   1  ADPCM/2     half rate (8 kHz)      32 kbps
+ *   2  Opus        16 kbps, only with Config::opus (encoder wired in)
+ *
+ * Inputs, one sample per uplink packet (uplink worker):
+ *  - age: oldest byte of the packet when it was sent (queueing + send stall)
+ *  - depth: audio left in the mic ring after the send (queue depth)
+ *  - send: time spent in the send call (TCP window full → it blocks)
+ * plus the RTT of PINGs sent behind the audio (they wait in the socket send
+ * buffer like the audio: RTT - min RTT = queueing the device cannot see)
+ * and RSSI from the link probe.
+ *
+ * Latency estimate = EWMA(age) + RTT / 2 (one-way).
+ *  - Down: estimate over target, queueing over queue_high_ms, depth over
+ *    depth_high_ms or a slow send, without a break for down_hold_ms → one
+ *    step down, then settle_ms without a decision (the backlog in the old
+ *    profile drains first)
+ *  - Up: queueing under queue_low_ms and depth under depth_low_ms for
+ *    up_hold_ms → one step up. That is a probe: a step down within
+ *    probe_ms doubles up_hold (≤ up_hold_max_ms), a probe that holds
+ *    resets it.
+ *  - RSSI under rssi_low_dbm → at least profile 1 right away; under
+ *    rssi_up_dbm no probing up.
+ *
+ * Switches are signalled in band: every AUDIO frame carries its codec
+ * (feature::CODEC_SWITCH). Bandwidth traces: test/host/test_bitrate_controller.cpp
+ * (this code) and server_test/bitrate_sim.py (Python reference model, same
+ * traces).
+ * Thread-safety: none. Chỉ uplink worker dùng.
+ */
+class BitrateController
+{
+public:
+    struct Profile
+    {
+        proto::Codec codec;
+        bool half_rate;       // PCM decimated 2:1 before the encoder
+        uint32_t bitrate_bps; // codec payload at a 16 kHz stream
+        const char *name;
+    };
+
+    static constexpr size_t PROFILE_COUNT = 3;
+    static const Profile PROFILES[PROFILE_COUNT];
+
+    struct Config
+    {
+        // One-way latency the estimate must stay under (mic → server)
+        uint32_t target_ms = 200;
+
+        // RTT over the path minimum: over high = congested, under low = room
+        uint32_t queue_high_ms = 80;
+        uint32_t queue_low_ms = 20;
+
+        // Mic ring depth after a send: over high = congested, under low = idle link
+        uint32_t depth_high_ms = 160;
+        uint32_t depth_low_ms = 50;
+
+        // A send blocked this long = socket buffer full
+        uint32_t send_slow_ms = 30;
+
+        uint32_t down_hold_ms = 200;
+        uint32_t settle_ms = 600;
+        uint32_t up_hold_ms = 4000;
+        uint32_t up_hold_max_ms = 60000;
+        uint32_t probe_ms = 3000;
+
+        // 0 dBm = unknown (not associated / not sampled yet)
+        int rssi_low_dbm = -80;
+        int rssi_up_dbm = -72;
+
+        // Opus encoder available (OpusCodec is not built yet)
+        bool opus = false;
+    };
+
+    BitrateController();
+    explicit BitrateController(const Config &cfg);
+
+    void setConfig(const Config &cfg);
+
+    // Disabled (server without feature::CODEC_SWITCH): pinned to profile 0
+    void setEnabled(bool enabled);
+
+    // New turn: forget the estimate and the hold timers. The profile and
+    // the probe backoff carry over (same link).
+    void reset();
+
+    // Latest PING → PONG (0 = new path: no sample, minimum forgotten)
+    void setRtt(uint32_t rtt_ms);
+    void setRssi(int dbm) { rssi_dbm_ = dbm; }
+
+    /**
+     * One uplink packet
+     * @return true if the profile changed (apply it before the next frame)
+     */
+    bool onPacket(uint32_t now_ms, uint32_t age_ms, uint32_t depth_ms, uint32_t send_ms);
+
+    size_t profileIndex() const { return index_; }
+    const Profile &profile() const { return PROFILES[index_]; }
+    uint32_t latencyMs() const { return latency_ms_; }
+    uint32_t switches() const { return switches_; }
+
+private:
+    size_t lowestIndex() const { return cfg_.opus ? PROFILE_COUNT - 1 : 1; }
+    void switchTo(size_t index, uint32_t now_ms);
+
+private:
+    Config cfg_{};
+    bool enabled_ = true;
+
+    size_t index_ = 0;
+    uint32_t switches_ = 0;
+
+    uint32_t rtt_ms_ = 0;
+    uint32_t rtt_min_ms_ = 0;
+    int rssi_dbm_ = 0;
+
+    // Estimator (age EWMA, 1/4, in 1/16 ms)
+    uint32_t age_q4_ = 0;
+    bool have_age_ = false;
+    uint32_t latency_ms_ = 0;
+
+    // Condition timers
+    bool bad_ = false;
+    bool good_ = false;
+    uint32_t bad_since_ = 0;
+    uint32_t good_since_ = 0;
+    bool settling_ = false;
+    uint32_t settle_since_ = 0;
+
+    // Probe backoff
+    uint32_t up_hold_ms_ = 0;
+    bool probing_ = false;
+    uint32_t probe_since_ = 0;
+};
@@ -0,0 +1,139 @@
+#include "ClockSync.hpp"
+
+#include <algorithm>
+
+// µs → ms, rounded half away from zero
+static int32_t roundMs(int64_t us)
+{
+    return static_cast<int32_t>(us >= 0 ? (us + 500) / 1000 : -((-us + 500) / 1000));
+}
+
+// Fine offset at a device time, skew applied
+static int64_t offsetAt(const ClockSync::Mapping &m, uint32_t device_ms)
+{
+    const int32_t dt = static_cast<int32_t>(device_ms - m.ref_ms);
+    return m.offset_us + static_cast<int64_t>(m.skew_ppm) * dt / 1000;
+}
+
+uint32_t ClockSync::Mapping::toServer(uint32_t device_ms) const
+{
+    return device_ms + base_ms + static_cast<uint32_t>(roundMs(offsetAt(*this, device_ms)));
+}
+
+uint32_t ClockSync::Mapping::toDevice(uint32_t server_ms) const
+{
+    // The skew term needs the device time: one step from the offset at ref
+    const uint32_t coarse = server_ms - base_ms - static_cast<uint32_t>(roundMs(offset_us));
+    return server_ms - base_ms - static_cast<uint32_t>(roundMs(offsetAt(*this, coarse)));
+}
+
+void ClockSync::reset()
+{
+    map_ = Mapping{};
+    count_ = 0;
+    next_ = 0;
+    hist_count_ = 0;
+    hist_next_ = 0;
+}
+
+// ============================================================================
+// One sample per PONG
+// ============================================================================
+bool ClockSync::onSample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4)
+{
+    const int32_t rtt = static_cast<int32_t>(t4 - t1);
+    const int32_t hold = static_cast<int32_t>(t3 - t2); // server turnaround
+    if (rtt < 0 || hold < 0 || hold > rtt)
+        return false;
+    const uint32_t delay = static_cast<uint32_t>(rtt - hold);
+
+    if (count_ == 0)
+        map_.base_ms = t2 - t1 - delay / 2; // keeps the fine offsets small
+
+    // offset = ((t2 - t1) + (t3 - t4)) / 2, relative to base, in µs
+    const int64_t twice_ms = static_cast<int64_t>(static_cast<int32_t>(t2 - t1 - map_.base_ms)) +
+                             static_cast<int32_t>(t3 - t4 - map_.base_ms);
+    ring_[next_] = Sample{t1 + static_cast<uint32_t>(rtt) / 2, twice_ms * 500, delay};
+    next_ = (next_ + 1) % WINDOW;
+    count_ = std::min(count_ + 1, WINDOW);
+
+    // Clock filter: least delay, the newest of equals
+    const Sample *best = nullptr;
+    for (size_t i = 0; i < count_; ++i)
+    {
+        const Sample &s = ring_[(next_ + WINDOW - count_ + i) % WINDOW];
+        if (!best || s.delay_ms <= best->delay_ms)
+            best = &s;
+    }
+
+    // History: a point per step, or a better one within the step
+    const size_t last = (hist_next_ + HISTORY - 1) % HISTORY;
+    if (hist_count_ == 0 ||
+        static_cast<int32_t>(best->mid_ms - hist_[last].mid_ms) >= static_cast<int32_t>(cfg_.history_step_ms))
+    {
+        hist_[hist_next_] = *best;
+        hist_next_ = (hist_next_ + 1) % HISTORY;
+        hist_count_ = std::min(hist_count_ + 1, HISTORY);
+        fitSkew();
+    }
+    else if (best->delay_ms < hist_[last].delay_ms)
+    {
+        hist_[last] = *best;
+        fitSkew();
+    }
+
+    map_.offset_us = best->offset_us;
+    map_.ref_ms = best->mid_ms;
+    map_.error_ms = (best->delay_ms + 1) / 2;
+    map_.valid = true;
+    return true;
+}
+
+// Least squares over the low-delay history points; the previous skew stays
+// until they span skew_min_span_ms
+void ClockSync::fitSkew()
+{
+    const Sample &ref = hist_[(hist_next_ + HISTORY - 1) % HISTORY];
+    uint32_t min_delay = ref.delay_ms;
+    for (size_t i = 0; i < hist_count_; ++i)
+        min_delay = std::min(min_delay, hist_[i].delay_ms);
+    const uint32_t limit = min_delay + cfg_.delay_slack_ms;
+
+    // x: ms from the newest point, y: µs from its offset (int64: |x| < 2^22
+    // over the history, |y| < 2^24)
+    int64_t n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int32_t x_min = 0, x_max = 0;
+    for (size_t i = 0; i < hist_count_; ++i)
+    {
+        const Sample &s = hist_[i];
+        if (s.delay_ms > limit)
+            continue;
+        const int64_t x = static_cast<int32_t>(s.mid_ms - ref.mid_ms);
+        const int64_t y = s.offset_us - ref.offset_us;
+        ++n;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        x_min = std::min<int32_t>(x_min, static_cast<int32_t>(x));
+        x_max = std::max<int32_t>(x_max, static_cast<int32_t>(x));
+    }
+
+    const int64_t den = n * sxx - sx * sx;
+    if (n < 3 || static_cast<uint32_t>(x_max - x_min) < cfg_.skew_min_span_ms || den <= 0)
+        return;
+
+    // slope in µs per ms = 1000 ppm
+    const int64_t ppm = (n * sxy - sx * sy) * 1000 / den;
+    map_.skew_ppm = static_cast<int32_t>(std::clamp<int64_t>(ppm, -cfg_.max_skew_ppm, cfg_.max_skew_ppm));
+}
+
+int32_t ClockSync::uplinkMs(uint32_t t1, uint32_t t2) const
+{
+    return static_cast<int32_t>(t2 - map_.toServer(t1));
+}
+
+int32_t ClockSync::downlinkMs(uint32_t t3, uint32_t t4) const
+{
+    return static_cast<int32_t>(map_.toServer(t4) - t3);
+}
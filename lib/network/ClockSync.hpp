@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ClockSync
+ * ============================================================================
+ * Ước lượng đồng hồ server từ PING / PONG (kiểu NTP), để device đóng dấu
+ * frame gửi đi và đọc timestamp frame nhận về theo giờ server, rồi tách
+ * latency một chiều (uplink / server / downlink) của từng lượt.
+ *
+ * One sample per PONG (feature::CLOCK):
+ *   t1 device send   t2 server receive   t3 server send   t4 device receive
+ *   delay  = (t4 - t1) - (t3 - t2)
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2     server = device + offset
+ *
+ * The offset of one sample is off by half the delay asymmetry. Queueing
+ * is the asymmetric part (the probe PINGs wait behind uplink audio), so:
+ *  - Clock filter: of the last WINDOW samples the one with the least delay
+ *    gives the offset (NTP). Its error bound is delay / 2.
+ *  - Skew: the window spans seconds, too short against 1 ms stamps. Its
+ *    best sample goes into a history every history_step_ms (HISTORY
+ *    points, minutes); least squares of offset over device time on the
+ *    points within delay_slack_ms of the lowest delay, once they span
+ *    skew_min_span_ms. Clamped to ±max_skew_ppm.
+ * The offset of the best sample is carried to any time with the skew.
+ *
+ * Clocks: u32 ms on both sides, wrap-safe (differences only). Offsets are
+ * kept relative to the first sample's, in µs. Resolution is the 1 ms of the
+ * stamps: ±0.5 ms on top of the bound.
+ *
+ * Asymmetric delay test: test/host/test_clock_sync.cpp (this code) and
+ * server_test/clock_sim.py (Python reference model, same scenarios).
+ * Thread-safety: none. Chỉ một task gọi onSample(); các task khác dùng bản
+ * sao Mapping.
+ */
+class ClockSync
+{
+public:
+    static constexpr size_t WINDOW = 16;
+    static constexpr size_t HISTORY = 16;
+
+    struct Config
+    {
+        // History points this close to the minimum delay take part in the skew fit
+        uint32_t delay_slack_ms = 4;
+
+        // One history point per step; the fit needs this much device time
+        uint32_t history_step_ms = 15000;
+        uint32_t skew_min_span_ms = 60000;
+
+        int32_t max_skew_ppm = 500;
+    };
+
+    /**
+     * Device → server clock, as of the last sample. Plain value: copy it to
+     * the task that stamps or reads frames.
+     */
+    struct Mapping
+    {
+        bool valid = false;
+        uint32_t base_ms = 0; // coarse offset (first sample)
+        int64_t offset_us = 0; // fine offset at ref_ms, on top of base_ms
+        uint32_t ref_ms = 0;   // device time of the best sample
+        int32_t skew_ppm = 0;  // server clock rate - device clock rate
+        uint32_t error_ms = 0; // bound: half the best sample's delay
+
+        uint32_t toServer(uint32_t device_ms) const;
+        uint32_t toDevice(uint32_t server_ms) const;
+    };
+
+    ClockSync() = default;
+    explicit ClockSync(const Config &cfg) : cfg_(cfg) {}
+
+    void setConfig(const Config &cfg) { cfg_ = cfg; }
+
+    // New connection: the server clock may be another one
+    void reset();
+
+    /**
+     * One PING / PONG exchange
+     * @return false if rejected (negative delay: the stamps are inconsistent)
+     */
+    bool onSample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+
+    const Mapping &mapping() const { return map_; }
+    size_t samples() const { return count_; }
+
+    // Uplink / downlink one-way time of an exchange, by the current mapping
+    int32_t uplinkMs(uint32_t t1, uint32_t t2) const;
+    int32_t downlinkMs(uint32_t t3, uint32_t t4) const;
+
+private:
+    struct Sample
+    {
+        uint32_t mid_ms;   // device time halfway between t1 and t4
+        int64_t offset_us; // relative to map_.base_ms
+        uint32_t delay_ms;
+    };
+
+    void fitSkew();
+
+private:
+    Config cfg_{};
+    Mapping map_{};
+
+    Sample ring_[WINDOW]{};
+    size_t count_ = 0; // valid entries (≤ WINDOW)
+    size_t next_ = 0;  // next slot to write
+
+    // Filter output over minutes, for the skew
+    Sample hist_[HISTORY]{};
+    size_t hist_count_ = 0;
+    size_t hist_next_ = 0;
+};
@@ -0,0 +1,242 @@
+#include "JsonScan.hpp"
+
+namespace json
+{
+    namespace
+    {
+        constexpr size_t MAX_DEPTH = 8;
+
+        inline bool isNumberChar(char c)
+        {
+            return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+        }
+    }
+
+    bool Doc::parse(std::string_view text)
+    {
+        src_ = text;
+        pos_ = 0;
+        count_ = 0;
+        if (text.size() > 0xFFFF)
+            return false;
+
+        if (!value())
+            return false;
+        skipSpace();
+        return pos_ == src_.size(); // trailing garbage = not a command
+    }
+
+    void Doc::skipSpace()
+    {
+        while (pos_ < src_.size())
+        {
+            char c = src_[pos_];
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                break;
+            ++pos_;
+        }
+    }
+
+    // Token for a string, positioned on the opening quote
+    bool Doc::string()
+    {
+        if (count_ >= MAX_TOKENS)
+            return false;
+
+        const size_t begin = ++pos_;
+        while (pos_ < src_.size() && src_[pos_] != '"')
+        {
+            if (src_[pos_] == '\\')
+                ++pos_; // skip the escaped char (kept raw)
+            ++pos_;
+        }
+        if (pos_ >= src_.size())
+            return false;
+
+        Token &t = tok_[count_++];
+        t.type = Type::STRING;
+        t.start = static_cast<uint16_t>(begin);
+        t.len = static_cast<uint16_t>(pos_ - begin);
+        t.next = static_cast<uint16_t>(count_);
+        ++pos_; // closing quote
+        return true;
+    }
+
+    // Iterative over containers: an explicit stack keeps the recursion
+    // (and the task stack) bounded
+    bool Doc::value()
+    {
+        size_t stack[MAX_DEPTH]; // open container token indices
+        size_t depth = 0;
+        bool expect_key = false;
+        bool after_comma = false; // "[1,]" / {"a":1,} are errors
+
+        for (;;)
+        {
+            skipSpace();
+            if (pos_ >= src_.size())
+                return false;
+
+            char c = src_[pos_];
+
+            // Close containers (also right after '{' / '[' for empty ones)
+            if (depth > 0 && (c == '}' || c == ']'))
+            {
+                if (after_comma)
+                    return false;
+                Token &open = tok_[stack[depth - 1]];
+                if ((c == '}') != (open.type == Type::OBJECT))
+                    return false;
+                ++pos_;
+                open.len = static_cast<uint16_t>(pos_ - open.start);
+                open.next = static_cast<uint16_t>(count_);
+                --depth;
+            }
+            else
+            {
+                after_comma = false;
+                if (expect_key)
+                {
+                    if (c != '"' || !string())
+                        return false;
+                    skipSpace();
+                    if (pos_ >= src_.size() || src_[pos_] != ':')
+                        return false;
+                    ++pos_;
+                    skipSpace();
+                    if (pos_ >= src_.size())
+                        return false;
+                    c = src_[pos_];
+                }
+
+                if (count_ >= MAX_TOKENS)
+                    return false;
+
+                if (c == '{' || c == '[')
+                {
+                    if (depth >= MAX_DEPTH)
+                        return false;
+                    Token &t = tok_[count_];
+                    t.type = (c == '{') ? Type::OBJECT : Type::ARRAY;
+                    t.start = static_cast<uint16_t>(pos_);
+                    stack[depth++] = count_++;
+                    ++pos_;
+                    expect_key = (c == '{');
+                    continue; // first member or immediate close
+                }
+                else if (c == '"')
+                {
+                    if (!string())
+                        return false;
+                }
+                else
+                {
+                    const size_t begin = pos_;
+                    while (pos_ < src_.size() && (isNumberChar(src_[pos_]) ||
+                                                  (src_[pos_] >= 'a' && src_[pos_] <= 'z')))
+                        ++pos_;
+                    std::string_view lit = src_.substr(begin, pos_ - begin);
+                    Token &t = tok_[count_++];
+                    if (lit == "true" || lit == "false")
+                        t.type = Type::BOOLEAN;
+                    else if (lit == "null")
+                        t.type = Type::NONE;
+                    else if (!lit.empty() && isNumberChar(lit[0]))
+                        t.type = Type::NUMBER;
+                    else
+                        return false;
+                    t.start = static_cast<uint16_t>(begin);
+                    t.len = static_cast<uint16_t>(lit.size());
+                    t.next = static_cast<uint16_t>(count_);
+                }
+            }
+
+            if (depth == 0)
+                return true;
+
+            // After a value inside a container: ',' continues, close loops
+            skipSpace();
+            if (pos_ >= src_.size())
+                return false;
+            if (src_[pos_] == ',')
+            {
+                ++pos_;
+                expect_key = (tok_[stack[depth - 1]].type == Type::OBJECT);
+                after_comma = true;
+            }
+            else if (src_[pos_] != '}' && src_[pos_] != ']')
+            {
+                return false;
+            }
+            else
+            {
+                expect_key = false;
+            }
+        }
+    }
+
+    // ========================================================================
+    // Lookups (top-level object)
+    // ========================================================================
+    int Doc::find(std::string_view key) const
+    {
+        if (count_ == 0 || tok_[0].type != Type::OBJECT)
+            return -1;
+
+        // Members: [key][value...] pairs; `next` skips nested values
+        size_t i = 1;
+        while (i + 1 < count_ && i < tok_[0].next)
+        {
+            const Token &k = tok_[i];
+            const size_t v = k.next;
+            if (text(k) == key)
+                return static_cast<int>(v);
+            i = tok_[v].next;
+        }
+        return -1;
+    }
+
+    std::string_view Doc::str(std::string_view key) const
+    {
+        int i = find(key);
+        if (i < 0 || tok_[i].type != Type::STRING)
+            return {};
+        return text(tok_[i]);
+    }
+
+    bool Doc::boolean(std::string_view key, bool &out) const
+    {
+        int i = find(key);
+        if (i < 0 || tok_[i].type != Type::BOOLEAN)
+            return false;
+        out = src_[tok_[i].start] == 't';
+        return true;
+    }
+
+    bool Doc::integer(std::string_view key, int32_t &out) const
+    {
+        int i = find(key);
+        if (i < 0 || tok_[i].type != Type::NUMBER)
+            return false;
+
+        std::string_view t = text(tok_[i]);
+        size_t p = 0;
+        bool neg = false;
+        if (p < t.size() && (t[p] == '-' || t[p] == '+'))
+            neg = (t[p++] == '-');
+        if (p >= t.size())
+            return false;
+
+        int64_t v = 0;
+        for (; p < t.size(); ++p)
+        {
+            if (t[p] < '0' || t[p] > '9')
+                return false; // fraction / exponent: not an integer
+            v = v * 10 + (t[p] - '0');
+            if (v > INT32_MAX)
+                return false;
+        }
+        out = static_cast<int32_t>(neg ? -v : v);
+        return true;
+    }
+}
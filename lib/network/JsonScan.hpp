@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * JsonScan
+ * ============================================================================
+ * Tokenizer JSON tại chỗ cho command có cấu trúc từ server.
+ *
+ * Parses into a fixed token array that points into the caller's text: no
+ * heap, no copies. Enough for small command objects such as
+ *   {"type":"control","cmd":"SPEAK_START"}
+ *
+ *  - Strings are returned raw (without quotes, escapes not decoded)
+ *  - Numbers / literals are validated loosely (charset only)
+ *  - Nesting is tokenized and can be skipped, lookups are top-level only
+ */
+namespace json
+{
+    enum class Type : uint8_t
+    {
+        OBJECT,
+        ARRAY,
+        STRING,
+        NUMBER,
+        BOOLEAN, // true / false
+        NONE,    // null
+    };
+
+    struct Token
+    {
+        Type type = Type::NONE;
+        uint16_t start = 0; // offset in the source text
+        uint16_t len = 0;
+        uint16_t next = 0;  // index of the token after this value and its children
+    };
+
+    class Doc
+    {
+    public:
+        static constexpr size_t MAX_TOKENS = 32;
+
+        /**
+         * Tokenize one JSON value (text ≤ 64 KB)
+         * @return false on syntax error or too many tokens
+         */
+        bool parse(std::string_view text);
+
+        // Top-level object members (false / empty if missing or wrong type)
+        std::string_view str(std::string_view key) const;
+        bool boolean(std::string_view key, bool &out) const;
+        bool integer(std::string_view key, int32_t &out) const;
+
+        size_t tokenCount() const { return count_; }
+        const Token &token(size_t i) const { return tok_[i]; }
+        std::string_view text(const Token &t) const { return src_.substr(t.start, t.len); }
+
+    private:
+        // Index of the value token for `key`, or -1
+        int find(std::string_view key) const;
+
+        bool value();
+        bool string();
+        void skipSpace();
+
+    private:
+        std::string_view src_;
+        size_t pos_ = 0;
+        Token tok_[MAX_TOKENS];
+        size_t count_ = 0;
+    };
+}
@@ -0,0 +1,194 @@
+#include "JsonWriter.hpp"
+
+namespace json
+{
+    namespace
+    {
+        constexpr char kHex[] = "0123456789abcdef";
+    }
+
+    Writer::Writer(char *buf, size_t cap)
+        : buf_(buf), cap_(cap)
+    {
+        if (!buf_ || cap_ == 0)
+        {
+            overflow_ = true;
+            cap_ = 0;
+            return;
+        }
+        buf_[0] = '\0';
+    }
+
+    // ========================================================================
+    // Low-level append (one byte is always kept for the terminator)
+    // ========================================================================
+    void Writer::put(char c)
+    {
+        if (overflow_)
+            return;
+        if (len_ + 1 >= cap_)
+        {
+            overflow_ = true;
+            return;
+        }
+        buf_[len_++] = c;
+        buf_[len_] = '\0';
+    }
+
+    void Writer::put(std::string_view s)
+    {
+        if (overflow_)
+            return;
+        if (len_ + s.size() >= cap_)
+        {
+            overflow_ = true;
+            return;
+        }
+        for (char c : s)
+            buf_[len_++] = c;
+        buf_[len_] = '\0';
+    }
+
+    void Writer::quoted(std::string_view s)
+    {
+        put('"');
+        for (char ch : s)
+        {
+            const uint8_t c = static_cast<uint8_t>(ch);
+            switch (c)
+            {
+            case '"':
+                put("\\\"");
+                break;
+            case '\\':
+                put("\\\\");
+                break;
+            case '\n':
+                put("\\n");
+                break;
+            case '\r':
+                put("\\r");
+                break;
+            case '\t':
+                put("\\t");
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    const char esc[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0x0F]};
+                    put(std::string_view(esc, sizeof(esc)));
+                }
+                else
+                {
+                    put(ch); // UTF-8 passes through
+                }
+                break;
+            }
+        }
+        put('"');
+    }
+
+    void Writer::separator()
+    {
+        if (after_key_)
+        {
+            after_key_ = false;
+            return;
+        }
+        if (depth_ == 0)
+            return;
+
+        const uint16_t bit = static_cast<uint16_t>(1u << (depth_ - 1));
+        if (has_items_ & bit)
+            put(',');
+        has_items_ |= bit;
+    }
+
+    // ========================================================================
+    // Containers
+    // ========================================================================
+    Writer &Writer::open(char c)
+    {
+        separator();
+        if (depth_ >= MAX_DEPTH)
+        {
+            overflow_ = true;
+            return *this;
+        }
+        put(c);
+        ++depth_;
+        has_items_ &= static_cast<uint16_t>(~(1u << (depth_ - 1)));
+        return *this;
+    }
+
+    Writer &Writer::close(char c)
+    {
+        if (depth_ == 0 || after_key_)
+        {
+            overflow_ = true; // unbalanced / key without value
+            return *this;
+        }
+        put(c);
+        --depth_;
+        return *this;
+    }
+
+    Writer &Writer::beginObject() { return open('{'); }
+    Writer &Writer::endObject() { return close('}'); }
+    Writer &Writer::beginArray() { return open('['); }
+    Writer &Writer::endArray() { return close(']'); }
+
+    // ========================================================================
+    // Members / values
+    // ========================================================================
+    Writer &Writer::key(std::string_view k)
+    {
+        separator();
+        quoted(k);
+        put(':');
+        after_key_ = true;
+        return *this;
+    }
+
+    Writer &Writer::str(std::string_view v)
+    {
+        separator();
+        quoted(v);
+        return *this;
+    }
+
+    Writer &Writer::integer(int64_t v)
+    {
+        separator();
+
+        char tmp[20];
+        size_t n = 0;
+        // Negate in unsigned space: INT64_MIN has no positive counterpart
+        uint64_t u = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+        do
+        {
+            tmp[n++] = static_cast<char>('0' + u % 10);
+            u /= 10;
+        } while (u != 0);
+
+        if (v < 0)
+            put('-');
+        while (n > 0)
+            put(tmp[--n]);
+        return *this;
+    }
+
+    Writer &Writer::boolean(bool v)
+    {
+        separator();
+        put(v ? std::string_view("true") : std::string_view("false"));
+        return *this;
+    }
+
+    Writer &Writer::null()
+    {
+        separator();
+        put("null");
+        return *this;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * JsonWriter
+ * ============================================================================
+ * Ghi JSON vào buffer cố định của caller (identify, OTA, telemetry).
+ *
+ * No heap, no iostreams, no printf: commas are inserted automatically, strings
+ * are escaped, integers are formatted by hand. The output is always
+ * NUL-terminated, so it can go straight to ESP_LOGx("%s").
+ *
+ *   char buf[128];
+ *   json::Writer w(buf, sizeof(buf));
+ *   w.beginObject().key("type").str("identify").key("proto").integer(1).endObject();
+ *   if (w.ok()) sendText(w.view());
+ *
+ * On overflow the writer stops appending and ok() turns false: the caller
+ * drops the message rather than sending truncated JSON.
+ */
+namespace json
+{
+    class Writer
+    {
+    public:
+        static constexpr size_t MAX_DEPTH = 16;
+
+        Writer(char *buf, size_t cap);
+
+        Writer &beginObject();
+        Writer &endObject();
+        Writer &beginArray();
+        Writer &endArray();
+
+        // Object member name; the next call writes its value
+        Writer &key(std::string_view k);
+
+        Writer &str(std::string_view v);
+        Writer &integer(int64_t v);
+        Writer &boolean(bool v);
+        Writer &null();
+
+        /// Complete (all containers closed) and not truncated
+        bool ok() const { return !overflow_ && depth_ == 0 && len_ > 0; }
+
+        std::string_view view() const { return std::string_view(buf_, len_); }
+        const char *c_str() const { return buf_; }
+        size_t size() const { return len_; }
+
+    private:
+        void separator(); // ',' between siblings, nothing after a key
+        void put(char c);
+        void put(std::string_view s);
+        void quoted(std::string_view s);
+        Writer &open(char c);
+        Writer &close(char c);
+
+    private:
+        char *buf_;
+        size_t cap_;
+        size_t len_ = 0;
+        bool overflow_ = false;
+        bool after_key_ = false;
+        uint8_t depth_ = 0;
+        uint16_t has_items_ = 0; // bit d: container at depth d already has a member
+    };
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+// Platform glue of the WS stack (NetSocket, WebSocketClient): ESP-IDF on
+// the device, plain POSIX on a Linux host (tests, benchmarks against a
+// local server). The only #if of those files lives here and in NetSocket.cpp.
+#if defined(ESP_PLATFORM)
+#include "esp_log.h"
+#elif !defined(ESP_LOGE) // a host esp_log.h (test/host/stubs) came first
+#include <cstdio>
+#define NET_HOST_LOG(level, tag, fmt, ...) std::fprintf(stderr, level " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) NET_HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) NET_HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) NET_HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ((void)0)
+#endif
+
+namespace net
+{
+    // Monotonic ms (wraps after ~49 days: compare with differences)
+    uint32_t nowMs();
+    // Unpredictable 32 bits (WS masking key, handshake nonce)
+    uint32_t random32();
+} // namespace net
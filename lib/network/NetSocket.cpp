@@ -0,0 +1,258 @@
+#include "NetSocket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#if defined(ESP_PLATFORM)
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "esp_vfs_eventfd.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#else
+#include <chrono>
+#include <random>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
+
+static const char *TAG = "NetSocket";
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // lwIP: no SIGPIPE to begin with
+#endif
+
+// ============================================================================
+// PLATFORM
+// ============================================================================
+namespace net
+{
+#if defined(ESP_PLATFORM)
+    uint32_t nowMs()
+    {
+        return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    }
+
+    uint32_t random32()
+    {
+        return esp_random();
+    }
+#else
+    uint32_t nowMs()
+    {
+        using namespace std::chrono;
+        return static_cast<uint32_t>(
+            duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    uint32_t random32()
+    {
+        static std::random_device rd;
+        return rd();
+    }
+#endif
+
+    uint8_t waitReady(int sock, bool want_read, bool want_write, int wake_fd, uint32_t timeout_ms)
+    {
+        fd_set rset;
+        fd_set wset;
+        FD_ZERO(&rset);
+        FD_ZERO(&wset);
+        int maxfd = -1;
+        if (sock >= 0 && want_read)
+        {
+            FD_SET(sock, &rset);
+            maxfd = sock;
+        }
+        if (sock >= 0 && want_write)
+        {
+            FD_SET(sock, &wset);
+            maxfd = sock;
+        }
+        if (wake_fd >= 0)
+        {
+            FD_SET(wake_fd, &rset);
+            if (wake_fd > maxfd)
+                maxfd = wake_fd;
+        }
+
+        timeval tv;
+        timeval *ptv = nullptr;
+        if (timeout_ms != WAIT_FOREVER)
+        {
+            tv.tv_sec = timeout_ms / 1000;
+            tv.tv_usec = (timeout_ms % 1000) * 1000;
+            ptv = &tv;
+        }
+
+        if (select(maxfd + 1, &rset, &wset, nullptr, ptv) <= 0)
+            return 0; // timeout or EINTR: the caller looks at its deadlines
+
+        uint8_t ready = 0;
+        if (sock >= 0 && FD_ISSET(sock, &rset))
+            ready |= READABLE;
+        if (sock >= 0 && FD_ISSET(sock, &wset))
+            ready |= WRITABLE;
+        if (wake_fd >= 0 && FD_ISSET(wake_fd, &rset))
+            ready |= WOKEN;
+        return ready;
+    }
+} // namespace net
+
+// ============================================================================
+// PLAIN TCP
+// ============================================================================
+bool PlainSocket::connectStart(const char *host, uint16_t port)
+{
+    disconnect();
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &res) != 0 || !res)
+    {
+        ESP_LOGW(TAG, "Cannot resolve %s", host);
+        return false;
+    }
+    sockaddr_in addr;
+    std::memcpy(&addr, res->ai_addr, sizeof(addr));
+    freeaddrinfo(res);
+    addr.sin_port = htons(port);
+
+    fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd_ < 0)
+    {
+        ESP_LOGE(TAG, "socket() failed (%d)", errno);
+        return false;
+    }
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS)
+    {
+        ESP_LOGW(TAG, "connect(%s:%u) failed (%d)", host, port, errno);
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+NetSocket::Step PlainSocket::connectStep()
+{
+    if (fd_ < 0)
+        return Step::FAILED;
+    // Connected once writable; SO_ERROR tells how it ended
+    if (!(net::waitReady(fd_, false, true, -1, 0) & net::WRITABLE))
+        return Step::WANT_WRITE;
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+    {
+        ESP_LOGW(TAG, "TCP connect failed (%d)", err);
+        return Step::FAILED;
+    }
+    return Step::DONE;
+}
+
+int PlainSocket::readSome(uint8_t *buf, size_t cap)
+{
+    const int n = recv(fd_, buf, cap, 0);
+    if (n > 0)
+        return n;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+    if (n < 0)
+        ESP_LOGW(TAG, "recv failed (%d)", errno);
+    return -1; // 0 = orderly close by the peer
+}
+
+int PlainSocket::writeSome(const IoSlice *io, size_t n)
+{
+    constexpr size_t MAX_SLICES = 4;
+    iovec iov[MAX_SLICES];
+    if (n > MAX_SLICES)
+        n = MAX_SLICES; // the rest goes with the next call
+    for (size_t i = 0; i < n; ++i)
+    {
+        iov[i].iov_base = const_cast<uint8_t *>(io[i].data);
+        iov[i].iov_len = io[i].len;
+    }
+    msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+
+    const int w = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+    if (w >= 0)
+        return w;
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+    ESP_LOGW(TAG, "send failed (%d)", errno);
+    return -1;
+}
+
+void PlainSocket::disconnect()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+// ============================================================================
+// WAKER
+// ============================================================================
+NetWaker::~NetWaker()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool NetWaker::init()
+{
+    if (fd_ >= 0)
+        return true;
+#if defined(ESP_PLATFORM)
+    esp_vfs_eventfd_config_t cfg = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    const esp_err_t err = esp_vfs_eventfd_register(&cfg);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // already registered
+    {
+        ESP_LOGE(TAG, "eventfd VFS register failed (%d)", (int)err);
+        return false;
+    }
+    fd_ = eventfd(0, 0);
+#else
+    fd_ = eventfd(0, EFD_NONBLOCK);
+#endif
+    if (fd_ < 0)
+    {
+        ESP_LOGE(TAG, "eventfd() failed (%d)", errno);
+        return false;
+    }
+    return true;
+}
+
+void NetWaker::wake()
+{
+    const uint64_t one = 1;
+    if (fd_ >= 0)
+        (void)!write(fd_, &one, sizeof(one));
+}
+
+void NetWaker::drain()
+{
+    // Only after waitReady() reported WOKEN: the counter is non-zero, the
+    // read does not block
+    uint64_t count;
+    if (fd_ >= 0)
+        (void)!read(fd_, &count, sizeof(count));
+}
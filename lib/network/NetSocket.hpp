@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "NetPort.hpp"
+
+/**
+ * NetSocket
+ * ============================================================================
+ * Lớp socket cắm được (pluggable) dưới WebSocketClient.
+ *
+ * Every call is non-blocking: the owner's event loop waits for the fd
+ * (net::waitReady) and calls again. Implementations:
+ *
+ *   PlainSocket   TCP (lwIP BSD sockets / POSIX), ws://
+ *   TlsSocket     mbedTLS on top, wss:// with session resumption (device only)
+ *
+ * Thread-safety: the event loop connects and reads; any task may write,
+ * serialized by the caller. With serializedIo() reads must hold that same
+ * lock (one TLS context for both directions).
+ */
+
+// One piece of a scatter-gather write
+struct IoSlice
+{
+    const uint8_t *data;
+    size_t len;
+};
+
+class NetSocket
+{
+public:
+    enum class Step : uint8_t
+    {
+        DONE,       // connected (and TLS established): ready for data
+        WANT_READ,  // call connectStep() again once the fd is readable
+        WANT_WRITE, // ... once it is writable
+        FAILED,
+    };
+
+    virtual ~NetSocket() = default;
+
+    /// Resolve host and start connecting. Name lookup blocks the caller
+    /// (numeric addresses do not wait); everything after it does not.
+    virtual bool connectStart(const char *host, uint16_t port) = 0;
+    virtual Step connectStep() = 0;
+
+    /// > 0 bytes read, 0 = nothing now, -1 = closed by the peer or failed
+    virtual int readSome(uint8_t *buf, size_t cap) = 0;
+
+    /// Write the slices in order, as much as fits now: bytes written
+    /// (0 = would block), -1 = failed. After 0 or a short count, call again
+    /// with the remaining bytes (TLS: exactly the same bytes).
+    virtual int writeSome(const IoSlice *io, size_t n) = 0;
+
+    /// Close (idempotent). The object can connect again.
+    virtual void disconnect() = 0;
+
+    /// fd to wait on, -1 when none
+    virtual int fd() const = 0;
+
+    /// Bytes already received and decoded inside the layer (TLS record):
+    /// readable although the fd will not signal
+    virtual size_t buffered() const { return 0; }
+
+    /// Reads and writes share state: the caller serializes them
+    virtual bool serializedIo() const { return false; }
+};
+
+/**
+ * PlainSocket: non-blocking TCP, Nagle off (small frames must not wait for
+ * an ACK). writeSome is one sendmsg() for all slices.
+ */
+class PlainSocket : public NetSocket
+{
+public:
+    PlainSocket() = default;
+    ~PlainSocket() override { disconnect(); }
+
+    PlainSocket(const PlainSocket &) = delete;
+    PlainSocket &operator=(const PlainSocket &) = delete;
+
+    bool connectStart(const char *host, uint16_t port) override;
+    Step connectStep() override;
+    int readSome(uint8_t *buf, size_t cap) override;
+    int writeSome(const IoSlice *io, size_t n) override;
+    void disconnect() override;
+    int fd() const override { return fd_; }
+
+private:
+    int fd_ = -1;
+};
+
+/**
+ * NetWaker: wakes an event loop blocked in net::waitReady() (eventfd; on
+ * the device through the VFS, registered by the first init()).
+ * wake() from any task; drain() by the loop after it woke.
+ */
+class NetWaker
+{
+public:
+    NetWaker() = default;
+    ~NetWaker();
+
+    NetWaker(const NetWaker &) = delete;
+    NetWaker &operator=(const NetWaker &) = delete;
+
+    bool init();
+    void wake();
+    void drain();
+    int fd() const { return fd_; }
+
+private:
+    int fd_ = -1;
+};
+
+namespace net
+{
+    constexpr uint8_t READABLE = 1 << 0;
+    constexpr uint8_t WRITABLE = 1 << 1;
+    constexpr uint8_t WOKEN = 1 << 2;
+    constexpr uint32_t WAIT_FOREVER = UINT32_MAX;
+
+    /// Block until `sock` is readable / writable (as asked), `wake_fd` is
+    /// readable, or timeout_ms passed. Either fd may be -1. Returns the
+    /// READABLE / WRITABLE / WOKEN bits that are set (0 = timeout).
+    uint8_t waitReady(int sock, bool want_read, bool want_write, int wake_fd, uint32_t timeout_ms);
+} // namespace net
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * PerfectHash
+ * ============================================================================
+ * Bảng tra string_view → value, perfect hash dựng lúc compile.
+ *
+ * The keys are known at build time (control words, JSON command types), so
+ * the seed is searched by the compiler until every key lands in its own
+ * slot. A lookup is one FNV-1a pass, one slot read and one compare:
+ * no heap, no string construction, no chain of comparisons.
+ *
+ *   constexpr auto kTable = phash::make<16, Control>({
+ *       {"START", Control::LISTEN_START},
+ *       {"END", Control::LISTEN_END},
+ *   });
+ *   static_assert(kTable.valid, "no perfect seed");
+ *   const Control *c = kTable.find(text);
+ */
+namespace phash
+{
+    constexpr uint32_t hash(std::string_view s, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : s)
+        {
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    template <typename V>
+    struct Entry
+    {
+        std::string_view key;
+        V value;
+    };
+
+    // M slots (power of two), N entries (≤ 127)
+    template <typename V, size_t N, size_t M>
+    struct Table
+    {
+        static_assert((M & (M - 1)) == 0, "slot count must be a power of two");
+        static_assert(N > 0 && N < 128 && N <= M, "1..127 entries, at most M");
+
+        uint32_t seed = 0;
+        bool valid = false;
+        int8_t slot[M] = {}; // entry index + 1, 0 = empty
+        Entry<V> entries[N] = {};
+
+        constexpr const V *find(std::string_view s) const
+        {
+            const int8_t i = slot[hash(s, seed) & (M - 1)];
+            if (i == 0)
+                return nullptr;
+            const Entry<V> &e = entries[i - 1];
+            return e.key == s ? &e.value : nullptr;
+        }
+    };
+
+    template <size_t M, typename V, size_t N>
+    constexpr Table<V, N, M> make(const Entry<V> (&in)[N])
+    {
+        Table<V, N, M> t{};
+        for (size_t i = 0; i < N; ++i)
+            t.entries[i] = in[i];
+
+        for (uint32_t seed = 0; seed < 4096; ++seed)
+        {
+            for (size_t s = 0; s < M; ++s)
+                t.slot[s] = 0;
+
+            bool ok = true;
+            for (size_t i = 0; i < N && ok; ++i)
+            {
+                const size_t s = hash(in[i].key, seed) & (M - 1);
+                if (t.slot[s] != 0)
+                    ok = false;
+                else
+                    t.slot[s] = static_cast<int8_t>(i + 1);
+            }
+            if (ok)
+            {
+                t.seed = seed;
+                t.valid = true;
+                return t;
+            }
+        }
+        return t; // valid == false → static_assert at the use site
+    }
+}
@@ -0,0 +1,160 @@
+#include "SpanRing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+SpanRing::~SpanRing()
+{
+    release();
+}
+
+bool SpanRing::init(size_t capacity, size_t headroom)
+{
+    if (alloc_)
+        return true;
+    if (capacity <= headroom)
+        return false;
+
+    alloc_ = new (std::nothrow) uint8_t[headroom + capacity];
+    if (!alloc_)
+        return false;
+
+    base_ = alloc_ + headroom;
+    capacity_ = capacity;
+    headroom_ = headroom;
+    head_ = 0;
+    tail_ = 0;
+    dropped_ = 0;
+    mark_set_ = false;
+    tag_ = 0;
+    return true;
+}
+
+void SpanRing::release()
+{
+    delete[] alloc_;
+    alloc_ = nullptr;
+    base_ = nullptr;
+    capacity_ = 0;
+}
+
+// ============================================================================
+// Producer
+// ============================================================================
+size_t SpanRing::write(const uint8_t *data, size_t len)
+{
+    if (!base_ || !data || len == 0)
+        return 0;
+
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+
+    // Keep `headroom_` consumed bytes behind the reader untouched
+    if ((head - tail) + len > capacity_ - headroom_)
+    {
+        ++dropped_;
+        return 0;
+    }
+
+    const size_t pos = head % capacity_;
+    const size_t first = std::min(len, capacity_ - pos);
+    std::memcpy(base_ + pos, data, first);
+    std::memcpy(base_, data + first, len - first);
+    head_.store(head + len, std::memory_order_release);
+
+    TaskHandle_t waiter = waiter_.load(std::memory_order_acquire);
+    if (waiter)
+        xTaskNotifyGive(waiter);
+    return len;
+}
+
+bool SpanRing::mark(uint8_t tag)
+{
+    if (!base_ || mark_set_.load(std::memory_order_acquire))
+        return false;
+    mark_pos_ = head_.load(std::memory_order_relaxed);
+    mark_tag_ = tag;
+    mark_set_.store(true, std::memory_order_release);
+    return true;
+}
+
+// ============================================================================
+// Consumer
+// ============================================================================
+size_t SpanRing::readable() const
+{
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+}
+
+size_t SpanRing::peek(uint8_t *&span)
+{
+    span = nullptr;
+    if (!base_)
+        return 0;
+
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    passMark(tail);
+    size_t avail = head_.load(std::memory_order_acquire) - tail;
+    if (mark_set_.load(std::memory_order_acquire))
+        avail = std::min(avail, mark_pos_ - tail); // next format starts there
+    if (avail == 0)
+        return 0;
+
+    const size_t pos = tail % capacity_;
+    span = base_ + pos;
+    return std::min(avail, capacity_ - pos);
+}
+
+void SpanRing::consume(size_t n)
+{
+    n = std::min(n, readable());
+    tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+size_t SpanRing::waitReadable(size_t have, TickType_t wait)
+{
+    size_t avail = readable();
+    if (avail > have || wait == 0 || !base_)
+        return avail;
+
+    // Register, then re-check: a write between the two is not missed
+    waiter_.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+    const TickType_t t0 = xTaskGetTickCount();
+    while ((avail = readable()) <= have)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - t0;
+        if (elapsed >= wait)
+            break;
+        // 0 = timeout or xTaskAbortDelay → caller re-evaluates
+        if (ulTaskNotifyTake(pdTRUE, wait - elapsed) == 0)
+        {
+            avail = readable();
+            break;
+        }
+    }
+    waiter_.store(nullptr, std::memory_order_release);
+    return avail;
+}
+
+void SpanRing::reset()
+{
+    tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+uint8_t SpanRing::tag()
+{
+    passMark(tail_.load(std::memory_order_relaxed));
+    return tag_;
+}
+
+void SpanRing::passMark(size_t tail)
+{
+    // Free-running counters: "at / past" is a small forward distance
+    if (mark_set_.load(std::memory_order_acquire) &&
+        tail - mark_pos_ <= capacity_)
+    {
+        tag_ = mark_tag_;
+        mark_set_.store(false, std::memory_order_release);
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * SpanRing
+ * ============================================================================
+ * Ring byte SPSC cho uplink: consumer gửi thẳng từ bộ nhớ ring, không copy.
+ *
+ * A FreeRTOS stream buffer can only be read by copying out. This ring hands
+ * the consumer a pointer to the contiguous bytes at its read position
+ * (peek), which it sends and then releases (consume).
+ *
+ * Headroom: the `headroom` bytes in memory right before any span are
+ * writable by the consumer (frame headers go there), so header + payload
+ * form one buffer. Guaranteed by
+ *  - a prefix of `headroom` bytes ahead of the storage (span at offset 0)
+ *  - the producer never filling the last `headroom` bytes of the ring
+ *    (those are the consumed bytes just behind the read position)
+ *
+ * A span never wraps: a read that crosses the end of storage comes back
+ * as two spans.
+ *
+ * Format marks: the producer tags the position where its byte format
+ * changes (uplink codec profile); a span never crosses a mark and tag()
+ * is the format of the bytes at the read position. One mark in flight.
+ *
+ * Thread-safety: one producer task, one consumer task.
+ */
+class SpanRing
+{
+public:
+    SpanRing() = default;
+    ~SpanRing();
+
+    SpanRing(const SpanRing &) = delete;
+    SpanRing &operator=(const SpanRing &) = delete;
+
+    // Allocate storage (idempotent while allocated). false = out of RAM
+    bool init(size_t capacity, size_t headroom);
+    void release();
+    bool valid() const { return base_ != nullptr; }
+
+    // ------------------------------------------------------------------------
+    // Producer
+    // ------------------------------------------------------------------------
+    /**
+     * Append all of data, or nothing if it does not fit (never splits a
+     * codec frame). Wakes a consumer blocked in waitReadable().
+     * @return len, or 0 if dropped
+     */
+    size_t write(const uint8_t *data, size_t len);
+
+    /**
+     * Bytes written from now on are in format `tag`
+     * @return false if the consumer has not reached the previous mark yet
+     */
+    bool mark(uint8_t tag);
+
+    // ------------------------------------------------------------------------
+    // Consumer
+    // ------------------------------------------------------------------------
+    size_t readable() const;
+
+    /**
+     * Contiguous readable bytes at the read position, up to the next mark
+     * @param span  set to the first byte; span[-headroom() .. -1] is writable
+     * @return span length (0 = empty)
+     */
+    size_t peek(uint8_t *&span);
+
+    // Release n bytes returned by peek()
+    void consume(size_t n);
+
+    /**
+     * Block until more than `have` bytes are readable, the timeout expires
+     * or the task is woken (xTaskAbortDelay)
+     * @return readable bytes
+     */
+    size_t waitReadable(size_t have, TickType_t wait);
+
+    // Drop everything readable (consumer side)
+    void reset();
+
+    // Format of the bytes at the read position (0 until the first mark)
+    uint8_t tag();
+
+    size_t headroom() const { return headroom_; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    uint8_t *alloc_ = nullptr; // [headroom prefix][storage]
+    uint8_t *base_ = nullptr;  // storage
+    size_t capacity_ = 0;
+    size_t headroom_ = 0;
+
+    // Free-running byte counters (position = counter % capacity)
+    std::atomic<size_t> head_{0}; // written by producer
+    std::atomic<size_t> tail_{0}; // written by consumer
+
+    std::atomic<TaskHandle_t> waiter_{nullptr};
+    uint32_t dropped_ = 0;
+
+    // Pending mark: position + tag written by the producer before the flag
+    // is set, the consumer clears the flag once its tail reaches it
+    std::atomic<bool> mark_set_{false};
+    size_t mark_pos_ = 0;
+    uint8_t mark_tag_ = 0;
+    uint8_t tag_ = 0; // consumer: format at the tail
+
+    // Consumer: take the pending mark once the tail is at / past it
+    void passMark(size_t tail);
+};
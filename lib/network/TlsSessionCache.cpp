@@ -0,0 +1,154 @@
+#include "TlsSessionCache.hpp"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#include <cstring>
+
+static const char *TAG = "TlsSessionCache";
+
+namespace
+{
+    constexpr uint32_t RTC_MAGIC = 0x544C5331; // "TLS1"
+
+    // RTC slow memory: kept across deep sleep, garbage after power-on
+    // (magic + CRC tell them apart)
+    struct RtcSession
+    {
+        uint32_t magic;
+        uint32_t crc; // over port..data[len]
+        uint16_t port;
+        uint16_t len;
+        char host[64];
+        uint8_t data[TlsSessionCache::RTC_CAPACITY];
+    };
+
+    RTC_NOINIT_ATTR RtcSession rtc_session;
+
+    uint32_t rtcCrc(const RtcSession &r)
+    {
+        const uint8_t *from = reinterpret_cast<const uint8_t *>(&r.port);
+        const size_t n = offsetof(RtcSession, data) - offsetof(RtcSession, port) + r.len;
+        return esp_rom_crc32_le(0, from, n);
+    }
+} // namespace
+
+TlsSessionCache::TlsSessionCache()
+{
+    mbedtls_ssl_session_init(&session_);
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+    mbedtls_ssl_session_free(&session_);
+}
+
+void TlsSessionCache::restore()
+{
+    if (!config_.keep_in_rtc || valid_)
+        return;
+
+    const RtcSession &r = rtc_session;
+    if (r.magic != RTC_MAGIC || r.len > sizeof(r.data) || r.crc != rtcCrc(r))
+        return; // cold boot
+
+    // Rejects sessions saved by a firmware with another mbedTLS config (OTA)
+    const int rc = mbedtls_ssl_session_load(&session_, r.data, r.len);
+    if (rc != 0)
+    {
+        ESP_LOGW(TAG, "RTC session not loadable (-0x%04x), full handshake", (unsigned)-rc);
+        mbedtls_ssl_session_free(&session_);
+        mbedtls_ssl_session_init(&session_);
+        rtc_session.magic = 0;
+        return;
+    }
+
+    valid_ = true;
+    std::memcpy(host_, r.host, sizeof(host_));
+    host_[sizeof(host_) - 1] = '\0';
+    port_ = r.port;
+    ESP_LOGI(TAG, "TLS session for %s:%u restored from RTC (%u B)", host_, port_, (unsigned)r.len);
+}
+
+bool TlsSessionCache::matches(std::string_view host, uint16_t port) const
+{
+    return valid_ && port == port_ && host == std::string_view(host_);
+}
+
+const mbedtls_ssl_session *TlsSessionCache::get(std::string_view host, uint16_t port)
+{
+    offered_ = matches(host, port);
+    return offered_ ? &session_ : nullptr;
+}
+
+bool TlsSessionCache::store(std::string_view host, uint16_t port, const mbedtls_ssl_context *ssl)
+{
+    const bool offered = offered_;
+    offered_ = false;
+    if (host.size() >= sizeof(host_))
+        return false;
+
+    mbedtls_ssl_session fresh;
+    mbedtls_ssl_session_init(&fresh);
+    if (mbedtls_ssl_get_session(ssl, &fresh) != 0)
+    {
+        mbedtls_ssl_session_free(&fresh);
+        return false;
+    }
+
+    // Abbreviated handshake: the server took the offered session, so the
+    // master secret is the same one
+    const bool resumed = offered && matches(host, port) &&
+                         std::memcmp(fresh.master, session_.master, sizeof(fresh.master)) == 0;
+    if (resumed)
+        ++resumed_;
+    else
+        ++full_;
+
+    // The server may have issued a fresh ticket even when resuming. The
+    // struct copy hands over the ticket / certificate it points to.
+    mbedtls_ssl_session_free(&session_);
+    session_ = fresh;
+    valid_ = true;
+    std::memcpy(host_, host.data(), host.size());
+    host_[host.size()] = '\0';
+    port_ = port;
+
+    saveToRtc();
+    return resumed;
+}
+
+void TlsSessionCache::clear()
+{
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    valid_ = false;
+    host_[0] = '\0';
+    port_ = 0;
+    offered_ = false;
+    if (config_.keep_in_rtc)
+        rtc_session.magic = 0;
+}
+
+void TlsSessionCache::saveToRtc()
+{
+    if (!config_.keep_in_rtc)
+        return;
+
+    RtcSession &r = rtc_session;
+    r.magic = 0; // invalid while being written
+    size_t len = 0;
+    const int rc = mbedtls_ssl_session_save(&session_, r.data, sizeof(r.data), &len);
+    if (rc != 0)
+    {
+        // Typically BUFFER_TOO_SMALL (large server certificate): RAM copy only
+        ESP_LOGW(TAG, "TLS session not kept in RTC (-0x%04x, %u B)", (unsigned)-rc, (unsigned)len);
+        return;
+    }
+    r.port = port_;
+    r.len = static_cast<uint16_t>(len);
+    std::memcpy(r.host, host_, sizeof(r.host));
+    r.crc = rtcCrc(r);
+    r.magic = RTC_MAGIC;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "mbedtls/ssl.h"
+
+/**
+ * TlsSessionCache
+ * ============================================================================
+ * Giữ TLS session giữa các lần reconnect (wss://).
+ *
+ * A full TLS 1.2 handshake costs 2 RTT plus ECDHE and the certificate
+ * chain check, hundreds of ms of ESP32 CPU. Offering the session of the
+ * last connection (session ticket, or session ID when the server keeps a
+ * cache) lets the server answer with an abbreviated handshake: 1 RTT and
+ * no public-key work. A server that no longer accepts it simply runs the
+ * full handshake, so a stale entry costs nothing.
+ *
+ *   connect:  mbedtls_ssl_set_session(&ssl, cache.get(host, port))
+ *   open:     cache.store(host, port, &ssl)
+ *
+ * - One entry: the device talks to one server (keyed by host:port)
+ * - Optional copy in RTC slow memory (keep_in_rtc): survives deep sleep
+ *   and soft resets, not power loss. It holds the session secret in
+ *   plain RTC RAM, the same exposure as the heap copy.
+ * - Used by TlsSocket, on the network task only
+ */
+class TlsSessionCache
+{
+public:
+    struct Config
+    {
+        bool keep_in_rtc = false; // resume after deep sleep too
+    };
+
+    // Serialized session in RTC memory (with KEEP_PEER_CERTIFICATE the
+    // server certificate is part of it)
+    static constexpr size_t RTC_CAPACITY = 2048;
+
+    TlsSessionCache();
+    ~TlsSessionCache();
+
+    TlsSessionCache(const TlsSessionCache &) = delete;
+    TlsSessionCache &operator=(const TlsSessionCache &) = delete;
+
+    void setConfig(const Config &cfg) { config_ = cfg; }
+
+    /// Load the RTC copy left before deep sleep (no-op without keep_in_rtc)
+    void restore();
+
+    /// Session to offer to host:port, or nullptr (full handshake).
+    /// mbedtls_ssl_set_session() copies it.
+    const mbedtls_ssl_session *get(std::string_view host, uint16_t port);
+
+    /// Keep the session of a connection whose handshake just completed.
+    /// true if that handshake resumed (same master secret as the offered
+    /// session).
+    bool store(std::string_view host, uint16_t port, const mbedtls_ssl_context *ssl);
+
+    /// Forget the session (certificate / server change)
+    void clear();
+
+    bool empty() const { return !valid_; }
+
+    // Handshakes seen by store(): resumed ones reused the offered session
+    uint32_t fullHandshakes() const { return full_; }
+    uint32_t resumedHandshakes() const { return resumed_; }
+
+private:
+    bool matches(std::string_view host, uint16_t port) const;
+    void saveToRtc();
+
+private:
+    Config config_{};
+    mbedtls_ssl_session session_;
+    bool valid_ = false;
+    char host_[64] = {};
+    uint16_t port_ = 0;
+    bool offered_ = false; // get() handed session_ out for this connect
+
+    uint32_t full_ = 0;
+    uint32_t resumed_ = 0;
+};
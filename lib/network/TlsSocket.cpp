@@ -0,0 +1,252 @@
+#include "TlsSocket.hpp"
+
+#include <cstring>
+
+static const char *TAG = "TlsSocket";
+
+TlsSocket::TlsSocket()
+{
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_x509_crt_init(&ca_);
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_ctr_drbg_init(&drbg_);
+}
+
+TlsSocket::~TlsSocket()
+{
+    disconnect();
+    mbedtls_ssl_config_free(&conf_);
+    mbedtls_x509_crt_free(&ca_);
+    mbedtls_ctr_drbg_free(&drbg_);
+    mbedtls_entropy_free(&entropy_);
+}
+
+void TlsSocket::setConfig(const Config &cfg)
+{
+    config_ = cfg;
+    TlsSessionCache::Config cache_cfg;
+    cache_cfg.keep_in_rtc = cfg.keep_session_in_rtc;
+    cache_.setConfig(cache_cfg);
+    cache_.restore(); // woke from deep sleep: resume right away
+}
+
+bool TlsSocket::setupOnce()
+{
+    if (ready_)
+        return true;
+
+    // esp-tls refuses a server it cannot verify, so do we
+    if (!config_.ca_pem)
+    {
+        ESP_LOGE(TAG, "wss:// without a CA certificate");
+        return false;
+    }
+
+    static const char PERS[] = "ptalk-wss";
+    int rc = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                   reinterpret_cast<const unsigned char *>(PERS), sizeof(PERS) - 1);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "DRBG seed failed (-0x%04x)", (unsigned)-rc);
+        return false;
+    }
+
+    // PEM: the length includes the NUL
+    rc = mbedtls_x509_crt_parse(&ca_, reinterpret_cast<const unsigned char *>(config_.ca_pem),
+                                std::strlen(config_.ca_pem) + 1);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "CA certificate not parsable (-0x%04x)", (unsigned)-rc);
+        return false;
+    }
+
+    rc = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                     MBEDTLS_SSL_PRESET_DEFAULT);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "SSL config failed (-0x%04x)", (unsigned)-rc);
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+    mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+
+    ready_ = true;
+    return true;
+}
+
+// ============================================================================
+// CONNECT
+// ============================================================================
+bool TlsSocket::connectStart(const char *host, uint16_t port)
+{
+    disconnect();
+    if (!setupOnce())
+        return false;
+
+    const size_t host_len = std::strlen(host);
+    if (host_len >= sizeof(host_))
+    {
+        ESP_LOGE(TAG, "Host name too long (%u chars)", (unsigned)host_len);
+        return false;
+    }
+    std::memcpy(host_, host, host_len + 1);
+    port_ = port;
+
+    if (!tcp_.connectStart(host, port))
+        return false;
+
+    mbedtls_ssl_init(&ssl_);
+    ssl_live_ = true;
+    int rc = mbedtls_ssl_setup(&ssl_, &conf_);
+    // Without a hostname mbedTLS checks no name (and sends no SNI)
+    if (rc == 0 && !config_.skip_cn_check)
+        rc = mbedtls_ssl_set_hostname(&ssl_, host_);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "SSL setup failed (-0x%04x)", (unsigned)-rc);
+        disconnect();
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl_, this, &TlsSocket::bioSend, &TlsSocket::bioRecv, nullptr);
+
+    // Offer the last session; a server that forgot it runs the full handshake
+    if (const mbedtls_ssl_session *s = cache_.get(host_, port_))
+        mbedtls_ssl_set_session(&ssl_, s);
+
+    start_ms_ = net::nowMs();
+    return true;
+}
+
+NetSocket::Step TlsSocket::connectStep()
+{
+    if (!ssl_live_)
+        return Step::FAILED;
+
+    if (!tcp_done_)
+    {
+        const Step s = tcp_.connectStep();
+        if (s != Step::DONE)
+            return s;
+        tcp_done_ = true;
+    }
+
+    const int rc = mbedtls_ssl_handshake(&ssl_);
+    if (rc == MBEDTLS_ERR_SSL_WANT_READ)
+        return Step::WANT_READ;
+    if (rc == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return Step::WANT_WRITE;
+    if (rc != 0)
+    {
+        const uint32_t flags = mbedtls_ssl_get_verify_result(&ssl_);
+        ESP_LOGE(TAG, "TLS handshake with %s failed (-0x%04x, verify 0x%x)",
+                 host_, (unsigned)-rc, (unsigned)flags);
+        return Step::FAILED;
+    }
+
+    tls_done_ = true;
+    const bool resumed = cache_.store(host_, port_, &ssl_);
+    ESP_LOGI(TAG, "TLS %s handshake in %u ms (%s; %u full / %u resumed)",
+             resumed ? "resumed" : "full", (unsigned)(net::nowMs() - start_ms_),
+             mbedtls_ssl_get_ciphersuite(&ssl_),
+             (unsigned)cache_.fullHandshakes(), (unsigned)cache_.resumedHandshakes());
+    return Step::DONE;
+}
+
+// ============================================================================
+// DATA
+// ============================================================================
+int TlsSocket::readSome(uint8_t *buf, size_t cap)
+{
+    if (!tls_done_)
+        return -1;
+    const int n = mbedtls_ssl_read(&ssl_, buf, cap);
+    if (n > 0)
+        return n;
+    // WANT_WRITE: renegotiation / key update flushing, retried on next read
+    if (n == MBEDTLS_ERR_SSL_WANT_READ || n == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return 0;
+    if (n != 0 && n != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        ESP_LOGW(TAG, "TLS read failed (-0x%04x)", (unsigned)-n);
+    return -1;
+}
+
+int TlsSocket::writeSome(const IoSlice *io, size_t n)
+{
+    if (!tls_done_ || n == 0)
+        return -1;
+
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i)
+        total += io[i].len;
+
+    // Header + payload in one record: one MAC / one TCP segment instead of two
+    const uint8_t *data = io[0].data;
+    size_t len = io[0].len;
+    if (n > 1 && total <= sizeof(stage_))
+    {
+        if (stage_len_ == 0) // else: the retry of a WANT_WRITE, same bytes
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::memcpy(stage_ + stage_len_, io[i].data, io[i].len);
+                stage_len_ += io[i].len;
+            }
+        }
+        data = stage_;
+        len = stage_len_;
+    }
+
+    const int w = mbedtls_ssl_write(&ssl_, data, len);
+    if (w == MBEDTLS_ERR_SSL_WANT_WRITE || w == MBEDTLS_ERR_SSL_WANT_READ)
+        return 0; // record kept inside mbedTLS (and in stage_)
+    stage_len_ = 0;
+    if (w < 0)
+    {
+        ESP_LOGW(TAG, "TLS write failed (-0x%04x)", (unsigned)-w);
+        return -1;
+    }
+    return w;
+}
+
+size_t TlsSocket::buffered() const
+{
+    return tls_done_ ? mbedtls_ssl_get_bytes_avail(&ssl_) : 0;
+}
+
+void TlsSocket::disconnect()
+{
+    if (ssl_live_)
+    {
+        if (tls_done_)
+            mbedtls_ssl_close_notify(&ssl_); // best effort, never waits
+        mbedtls_ssl_free(&ssl_);             // record buffers back to the heap
+        ssl_live_ = false;
+    }
+    tcp_.disconnect();
+    tcp_done_ = false;
+    tls_done_ = false;
+    stage_len_ = 0;
+}
+
+// ============================================================================
+// BIO: mbedTLS records over the non-blocking fd
+// ============================================================================
+int TlsSocket::bioSend(void *ctx, const unsigned char *buf, size_t len)
+{
+    auto *self = static_cast<TlsSocket *>(ctx);
+    const IoSlice io{buf, len};
+    const int w = self->tcp_.writeSome(&io, 1);
+    if (w > 0)
+        return w;
+    return w == 0 ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsSocket::bioRecv(void *ctx, unsigned char *buf, size_t len)
+{
+    auto *self = static_cast<TlsSocket *>(ctx);
+    const int n = self->tcp_.readSome(buf, len);
+    if (n > 0)
+        return n;
+    return n == 0 ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "NetSocket.hpp"
+#include "TlsSessionCache.hpp"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+
+/**
+ * TlsSocket
+ * ============================================================================
+ * wss:// transport: mbedTLS chạy trực tiếp trên fd non-blocking của PlainSocket.
+ *
+ * - The handshake is a state machine of the caller's event loop:
+ *   connectStep() returns WANT_READ / WANT_WRITE exactly as mbedTLS asks,
+ *   nothing blocks while the server thinks
+ * - Session resumption through TlsSessionCache: the last session is offered
+ *   on every connect (1 RTT, no ECDHE / certificate check when accepted)
+ * - Config, CA chain and DRBG are set up once; the SSL context (~20 KB of
+ *   record buffers) only lives while connected
+ * - One context serves both directions: serializedIo() is true
+ */
+class TlsSocket : public NetSocket
+{
+public:
+    struct Config
+    {
+        const char *ca_pem = nullptr;     // server CA (PEM, NUL-terminated, static)
+        bool skip_cn_check = false;       // lab servers addressed by IP
+        bool keep_session_in_rtc = false; // resume after deep sleep too
+    };
+
+    TlsSocket();
+    ~TlsSocket() override;
+
+    TlsSocket(const TlsSocket &) = delete;
+    TlsSocket &operator=(const TlsSocket &) = delete;
+
+    // Before the first connect
+    void setConfig(const Config &cfg);
+
+    bool connectStart(const char *host, uint16_t port) override;
+    Step connectStep() override;
+    int readSome(uint8_t *buf, size_t cap) override;
+    int writeSome(const IoSlice *io, size_t n) override;
+    void disconnect() override;
+    int fd() const override { return tcp_.fd(); }
+    size_t buffered() const override;
+    bool serializedIo() const override { return true; }
+
+    const TlsSessionCache &sessions() const { return cache_; }
+
+    // Several slices go out as one record up to this size (WS header +
+    // audio packet), larger writes one record per slice
+    static constexpr size_t COALESCE_MAX = 640;
+
+private:
+    bool setupOnce();
+    static int bioSend(void *ctx, const unsigned char *buf, size_t len);
+    static int bioRecv(void *ctx, unsigned char *buf, size_t len);
+
+private:
+    Config config_{};
+    PlainSocket tcp_;
+    TlsSessionCache cache_;
+
+    bool ready_ = false; // conf / CA / DRBG set up
+    mbedtls_ssl_config conf_;
+    mbedtls_x509_crt ca_;
+    mbedtls_entropy_context entropy_;
+    mbedtls_ctr_drbg_context drbg_;
+
+    mbedtls_ssl_context ssl_;
+    bool ssl_live_ = false; // ssl_ set up for this connection
+    bool tcp_done_ = false;
+    bool tls_done_ = false;
+    char host_[64] = {};
+    uint16_t port_ = 0;
+    uint32_t start_ms_ = 0;
+
+    // Coalesced slices. After WANT_WRITE mbedTLS must be called again with
+    // the same bytes: stage_len_ != 0 means a write is in flight.
+    uint8_t stage_[COALESCE_MAX];
+    size_t stage_len_ = 0;
+};
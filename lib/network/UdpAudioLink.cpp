@@ -0,0 +1,362 @@
+#include "UdpAudioLink.hpp"
+
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+static const char *TAG = "UdpAudioLink";
+
+UdpAudioLink::~UdpAudioLink()
+{
+    unbind();
+    if (task_handle)
+    {
+        vTaskDelete(task_handle);
+        task_handle = nullptr;
+    }
+    const int sock = sock_.exchange(-1);
+    if (sock >= 0)
+        close(sock);
+}
+
+bool UdpAudioLink::start()
+{
+    if (task_handle)
+        return true;
+
+    BaseType_t rc = xTaskCreatePinnedToCore(
+        &UdpAudioLink::taskEntry,
+        "UdpAudio",
+        4096,
+        this,
+        config_.task_prio,
+        &task_handle,
+        tskNO_AFFINITY);
+    if (rc != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create UdpAudio task (%d)", (int)rc);
+        task_handle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// BINDING (any task → link task)
+// ============================================================================
+bool UdpAudioLink::bindTo(std::string_view host, uint16_t port, uint32_t token)
+{
+    if (!task_handle || host.empty() || host.size() >= sizeof(host_) || port == 0)
+        return false;
+
+    ready_ = false;
+    std::memcpy(host_, host.data(), host.size());
+    host_[host.size()] = '\0';
+    port_ = port;
+    token_ = token;
+    want_bind_ = true;
+    ++gen_; // publishes the request; a running session sees it and ends
+    xTaskNotifyGive(task_handle);
+    return true;
+}
+
+void UdpAudioLink::unbind()
+{
+    want_bind_ = false;
+    ready_ = false;
+}
+
+void UdpAudioLink::taskEntry(void *arg)
+{
+    auto *self = static_cast<UdpAudioLink *>(arg);
+    if (self)
+    {
+        self->taskLoop();
+    }
+    vTaskDelete(nullptr);
+}
+
+void UdpAudioLink::taskLoop()
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // A bindTo() during a session replaces it right away
+        while (want_bind_)
+        {
+            const uint32_t gen = gen_;
+            runSession(gen);
+            if (gen_ == gen)
+                break; // unbound or failed: park
+        }
+    }
+}
+
+bool UdpAudioLink::sendBind(int sock, uint32_t token)
+{
+    uint8_t args[4];
+    proto::putU32(args, token);
+    uint8_t frame[proto::HEADER_SIZE + 1 + sizeof(args)];
+    const size_t n = proto::writeControl(proto::Control::UDP_BIND, args, sizeof(args), 0, 0,
+                                         frame, sizeof(frame));
+    return send(sock, frame, n, 0) == static_cast<int>(n);
+}
+
+void UdpAudioLink::runSession(uint32_t gen)
+{
+    char host[sizeof(host_)];
+    std::memcpy(host, host_, sizeof(host));
+    const uint16_t port = port_;
+    const uint32_t token = token_;
+
+    // Resolve (blocking: this task only)
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &res) != 0 || !res)
+    {
+        ESP_LOGW(TAG, "Cannot resolve %s: audio stays on WS", host);
+        if (ready_cb)
+            ready_cb(false, token);
+        return;
+    }
+    sockaddr_in addr;
+    std::memcpy(&addr, res->ai_addr, sizeof(addr));
+    freeaddrinfo(res);
+    addr.sin_port = htons(port);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "socket() failed (%d)", errno);
+        if (ready_cb)
+            ready_cb(false, token);
+        return;
+    }
+
+    // The receive timeout is the poll period for unbind() / rebind
+    timeval tv = {};
+    tv.tv_sec = config_.bind_interval_ms / 1000;
+    tv.tv_usec = (config_.bind_interval_ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // Connected UDP: send() without an address, other peers filtered out
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        ESP_LOGE(TAG, "connect(%s:%u) failed (%d)", host, port, errno);
+        close(sock);
+        if (ready_cb)
+            ready_cb(false, token);
+        return;
+    }
+
+    // 1. Probe until the server echoes the token (NAT mapping open both ways)
+    bool bound = false;
+    for (uint8_t i = 0; i < config_.bind_attempts && !bound && sessionActive(gen); ++i)
+    {
+        sendBind(sock, token);
+        const int n = recv(sock, rx_buf_, sizeof(rx_buf_), 0);
+        proto::Header h;
+        const uint8_t *payload = nullptr;
+        if (n > 0 && proto::parse(rx_buf_, n, h, payload) && h.type == proto::MsgType::CONTROL &&
+            h.payload_len >= 5 && static_cast<proto::Control>(payload[0]) == proto::Control::UDP_BIND &&
+            proto::getU32(payload + 1) == token)
+        {
+            bound = true;
+        }
+    }
+
+    if (!bound)
+    {
+        close(sock);
+        if (sessionActive(gen))
+        {
+            ESP_LOGW(TAG, "No bind echo from %s:%u: audio stays on WS", host, port);
+            if (ready_cb)
+                ready_cb(false, token);
+        }
+        return;
+    }
+
+    // 2. Bound: downlink audio until unbind() / rebind / socket error
+    rx_started_ = false;
+    sock_ = sock;
+    ready_ = true;
+    ESP_LOGI(TAG, "Audio over UDP %s:%u", host, port);
+    if (ready_cb)
+        ready_cb(true, token);
+
+    bool failed = false;
+    while (sessionActive(gen))
+    {
+        const int n = recv(sock, rx_buf_, sizeof(rx_buf_), 0);
+        if (n > 0)
+        {
+            handleDatagram(rx_buf_, static_cast<size_t>(n));
+        }
+        else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            ESP_LOGW(TAG, "recv failed (%d)", errno);
+            failed = true;
+            break;
+        }
+    }
+
+    ready_ = false;
+    sock_ = -1;
+    close(sock);
+
+    const Stats st = stats();
+    ESP_LOGI(TAG, "UDP audio ended (since boot: tx %u, rx %u pkts, %u repaired, %u lost, %u late)",
+             (unsigned)st.tx_packets, (unsigned)st.rx_packets, (unsigned)st.rx_recovered,
+             (unsigned)st.rx_lost, (unsigned)st.rx_late);
+    if (failed && sessionActive(gen) && ready_cb)
+        ready_cb(false, token);
+}
+
+// ============================================================================
+// SEND (uplink task)
+// ============================================================================
+bool UdpAudioLink::sendAudio(const proto::Header &h, uint8_t *payload, size_t len)
+{
+    const int sock = sock_;
+    if (!ready_ || sock < 0)
+        return false;
+
+    // START: the previous packet belongs to the last stream. Codec switch:
+    // the receiver times the copy by this packet's codec, so none.
+    if ((h.flags & proto::flag::START) || h.codec != red_codec_)
+        red_valid_ = false;
+
+    proto::Header out = h;
+    out.type = proto::MsgType::AUDIO;
+    const bool red = config_.redundancy && red_valid_ &&
+                     proto::HEADER_SIZE + RED_HEADER + red_len_ + len <= MAX_DATAGRAM;
+    int sent;
+    size_t size;
+    if (!red)
+    {
+        if (proto::HEADER_SIZE + len > MAX_DATAGRAM)
+            return false;
+        out.flags &= ~proto::flag::RED;
+        out.payload_len = static_cast<uint16_t>(len);
+        uint8_t *frame = payload - proto::HEADER_SIZE;
+        proto::writeHeader(out, frame, proto::HEADER_SIZE);
+        size = proto::HEADER_SIZE + len;
+        sent = send(sock, frame, size, 0);
+    }
+    else
+    {
+        // RFC 2198 style: previous payload first, then this one
+        out.flags |= proto::flag::RED;
+        out.payload_len = static_cast<uint16_t>(RED_HEADER + red_len_ + len);
+        uint8_t *p = tx_buf_ + proto::writeHeader(out, tx_buf_, sizeof(tx_buf_));
+        p[0] = static_cast<uint8_t>(red_len_);
+        p[1] = static_cast<uint8_t>(red_len_ >> 8);
+        p[2] = red_flags_;
+        p += RED_HEADER;
+        std::memcpy(p, red_buf_, red_len_);
+        p += red_len_;
+        std::memcpy(p, payload, len);
+        size = static_cast<size_t>(p + len - tx_buf_);
+        sent = send(sock, tx_buf_, size, 0);
+    }
+
+    // This packet rides along with the next one
+    if (config_.redundancy && len <= sizeof(red_buf_))
+    {
+        std::memcpy(red_buf_, payload, len);
+        red_len_ = len;
+        red_flags_ = h.flags & ~proto::flag::RED;
+        red_codec_ = h.codec;
+        red_valid_ = !(h.flags & proto::flag::EOS);
+    }
+
+    // A full lwIP queue drops the datagram: same as a loss on the air
+    if (sent != static_cast<int>(size))
+        return false;
+    ++tx_packets;
+    return true;
+}
+
+// ============================================================================
+// RECEIVE (link task)
+// ============================================================================
+void UdpAudioLink::handleDatagram(const uint8_t *data, size_t len)
+{
+    proto::Header h;
+    const uint8_t *payload = nullptr;
+    if (!proto::parse(data, len, h, payload) || h.type != proto::MsgType::AUDIO)
+        return;
+    ++rx_packets;
+
+    size_t payload_len = h.payload_len;
+    if (h.flags & proto::flag::RED)
+    {
+        if (payload_len < RED_HEADER)
+            return;
+        const size_t red_len = payload[0] | (payload[1] << 8);
+        const uint8_t red_flags = payload[2] & ~proto::flag::RED;
+        if (RED_HEADER + red_len > payload_len)
+            return;
+        const uint8_t *red = payload + RED_HEADER;
+
+        // Exactly the previous packet is missing: play it from the copy
+        const uint16_t prev = static_cast<uint16_t>(h.seq - 1);
+        if (rx_started_ ? prev == rx_expected_ : (red_flags & proto::flag::START) != 0)
+        {
+            proto::Header r = h;
+            r.flags = red_flags;
+            r.seq = prev;
+            r.payload_len = static_cast<uint16_t>(red_len);
+            r.timestamp = h.timestamp - proto::samplesForBytes(h.codec, red_len);
+            ++rx_recovered;
+            deliver(r, red, red_len);
+        }
+
+        h.flags &= ~proto::flag::RED;
+        payload = red + red_len;
+        payload_len -= RED_HEADER + red_len;
+        h.payload_len = static_cast<uint16_t>(payload_len);
+    }
+    deliver(h, payload, payload_len);
+}
+
+void UdpAudioLink::deliver(const proto::Header &h, const uint8_t *payload, size_t len)
+{
+    if (h.flags & proto::flag::START)
+    {
+        rx_started_ = false;
+    }
+    if (rx_started_)
+    {
+        const int16_t delta = static_cast<int16_t>(h.seq - rx_expected_);
+        if (delta < 0)
+        {
+            ++rx_late; // the stream already moved past it
+            return;
+        }
+        rx_lost += static_cast<uint32_t>(delta);
+    }
+    rx_started_ = true;
+    rx_expected_ = static_cast<uint16_t>(h.seq + 1);
+
+    if (audio_cb)
+        audio_cb(h, payload, len);
+}
+
+UdpAudioLink::Stats UdpAudioLink::stats() const
+{
+    Stats st;
+    st.tx_packets = tx_packets;
+    st.rx_packets = rx_packets;
+    st.rx_recovered = rx_recovered;
+    st.rx_lost = rx_lost;
+    st.rx_late = rx_late;
+    return st;
+}
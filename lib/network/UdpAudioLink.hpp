@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "WireProtocol.hpp"
+
+/**
+ * UdpAudioLink
+ * ============================================================================
+ * Audio qua UDP bên cạnh WebSocket (WS vẫn là kênh control).
+ *
+ * TCP delivers in order: one lost segment holds back every later audio
+ * frame until it is retransmitted (hundreds of ms on lwIP). Over datagrams
+ * a lost packet is only a gap, and with redundancy each packet also carries
+ * the previous one, so a single loss is repaired by the next packet.
+ *
+ * Datagram = one proto frame (same 12-byte header). With flag::RED:
+ *
+ *   payload = [red_len u16][red_flags u8][previous payload][payload]
+ *   previous packet: seq - 1, ts - samplesForBytes(red_len), same codec
+ *   (none after a codec switch)
+ *
+ * Binding, negotiated on the WebSocket (NetworkManager):
+ *
+ *   server → WS   Control::UDP_OFFER [port u16][token u32]
+ *   device → UDP  Control::UDP_BIND [token]   every bind_interval_ms
+ *   server → UDP  Control::UDP_BIND [token]   echo: both directions pass
+ *   device → WS   Control::UDP_BIND [token]   server moves its audio to UDP
+ *
+ * The link task owns the receive side: resolve, bind, then hand downlink
+ * audio out in seq order (a repaired packet before the one carrying it).
+ * sendAudio() is for one sender task (the uplink worker).
+ * Reference implementation (server side): server_test/udp_audio.py
+ */
+class UdpAudioLink
+{
+public:
+    struct Config
+    {
+        bool redundancy = true;          // uplink packets carry the previous one
+        uint16_t bind_interval_ms = 200; // bind probe period (= receive poll)
+        uint8_t bind_attempts = 10;      // no echo after that → stay on WS
+        UBaseType_t task_prio = 5;       // same as NetworkLoop (WS receive)
+    };
+
+    struct Stats
+    {
+        uint32_t tx_packets = 0;
+        uint32_t rx_packets = 0;
+        uint32_t rx_recovered = 0; // lost, rebuilt from the next packet
+        uint32_t rx_lost = 0;      // lost for good
+        uint32_t rx_late = 0;      // behind the stream (reordered): dropped
+    };
+
+    // Largest datagram sent / received (Ethernet MTU minus IP + UDP)
+    static constexpr size_t MAX_DATAGRAM = 1472;
+    static constexpr size_t RED_HEADER = 3;
+
+    using AudioHandler = std::function<void(const proto::Header &h, const uint8_t *payload, size_t len)>;
+    using ReadyHandler = std::function<void(bool ok, uint32_t token)>;
+
+    UdpAudioLink() = default;
+    ~UdpAudioLink();
+
+    void setConfig(const Config &cfg) { config_ = cfg; }
+
+    // Link task, parked until bindTo(). Kept across connections.
+    bool start();
+
+    /// Bind to host:port with the server's token (asynchronous: onReady
+    /// reports the result). Replaces a previous binding. Any task.
+    bool bindTo(std::string_view host, uint16_t port, uint32_t token);
+
+    /// Forget the binding (WS closed). The socket is closed by the link
+    /// task within bind_interval_ms. Any task.
+    void unbind();
+
+    /// Bound and echoed: audio may go this way
+    bool isReady() const { return ready_; }
+
+    /**
+     * Send one AUDIO packet. `payload` needs proto::HEADER_SIZE writable
+     * bytes in front: without redundancy the header is written there and the
+     * datagram goes out without a copy.
+     */
+    bool sendAudio(const proto::Header &h, uint8_t *payload, size_t len);
+
+    // Register before start(). Both run on the link task; onReady(false)
+    // also reports a bound link that failed later.
+    void onAudio(AudioHandler cb) { audio_cb = cb; }
+    void onReady(ReadyHandler cb) { ready_cb = cb; }
+
+    Stats stats() const;
+
+private:
+    static void taskEntry(void *arg);
+    void taskLoop();
+    // One binding: resolve, probe, receive until unbind() / a new bindTo()
+    void runSession(uint32_t gen);
+    bool sessionActive(uint32_t gen) const { return want_bind_ && gen_ == gen; }
+
+    bool sendBind(int sock, uint32_t token);
+    // One datagram: repair from the redundant copy, drop late packets
+    void handleDatagram(const uint8_t *data, size_t len);
+    void deliver(const proto::Header &h, const uint8_t *payload, size_t len);
+
+private:
+    Config config_{};
+    TaskHandle_t task_handle = nullptr;
+
+    // Binding request: written by bindTo(), read by the link task after gen_
+    char host_[64] = {};
+    uint16_t port_ = 0;
+    uint32_t token_ = 0;
+    std::atomic<uint32_t> gen_{0};
+    std::atomic<bool> want_bind_{false};
+
+    std::atomic<int> sock_{-1};
+    std::atomic<bool> ready_{false};
+
+    // Receive side (link task)
+    bool rx_started_ = false;
+    uint16_t rx_expected_ = 0;
+    uint8_t rx_buf_[MAX_DATAGRAM];
+
+    // Send side (uplink task): previous payload for the redundant copy
+    bool red_valid_ = false;
+    uint8_t red_flags_ = 0;
+    proto::Codec red_codec_ = proto::Codec::NONE;
+    size_t red_len_ = 0;
+    uint8_t red_buf_[MAX_DATAGRAM];
+    uint8_t tx_buf_[MAX_DATAGRAM];
+
+    std::atomic<uint32_t> tx_packets{0};
+    std::atomic<uint32_t> rx_packets{0};
+    std::atomic<uint32_t> rx_recovered{0};
+    std::atomic<uint32_t> rx_lost{0};
+    std::atomic<uint32_t> rx_late{0};
+
+    AudioHandler audio_cb = nullptr;
+    ReadyHandler ready_cb = nullptr;
+};
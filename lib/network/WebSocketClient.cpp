@@ -1,149 +1,701 @@
 #include "WebSocketClient.hpp"
-#include "esp_log.h"
-#include "esp_event.h"
-#include "esp_heap_caps.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 static const char* TAG = "WebSocketClient";
 
+namespace {
+
+// RFC 6455 opcodes
+constexpr uint8_t OP_CONT = 0x0;
+constexpr uint8_t OP_TEXT = 0x1;
+constexpr uint8_t OP_BINARY = 0x2;
+constexpr uint8_t OP_CLOSE = 0x8;
+constexpr uint8_t OP_PING = 0x9;
+constexpr uint8_t OP_PONG = 0xA;
+
+// Reads per poll(): a fast server cannot starve the loop's timers
+constexpr int MAX_READS_PER_POLL = 8;
+
+constexpr char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// SHA-1, only for Sec-WebSocket-Accept (once per connect)
+struct Sha1 {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint8_t block[64];
+    size_t used = 0;
+    uint64_t bytes = 0;
+
+    static uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    void compress() {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+                   (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        }
+        for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            const uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        bytes += len;
+        while (len--) {
+            block[used++] = *p++;
+            if (used == 64) { compress(); used = 0; }
+        }
+    }
+
+    void finish(uint8_t out[20]) {
+        const uint64_t bits = bytes * 8;
+        const uint8_t one = 0x80, zero = 0;
+        update(&one, 1);
+        while (used != 56) update(&zero, 1);
+        for (int i = 0; i < 8; ++i) block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        compress();
+        for (int i = 0; i < 20; ++i) out[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+};
+
+// out: 4 * ceil(n / 3) + 1 bytes
+void base64(const uint8_t* in, size_t n, char* out) {
+    static const char A[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < n; i += 3) {
+        const uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < n ? (uint32_t)in[i + 1] << 8 : 0) |
+                           (i + 2 < n ? in[i + 2] : 0);
+        out[o++] = A[(v >> 18) & 63];
+        out[o++] = A[(v >> 12) & 63];
+        out[o++] = i + 1 < n ? A[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < n ? A[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+// Value of header `name` (case-insensitive) in an HTTP response head
+bool headerValue(std::string_view head, std::string_view name, std::string_view& value) {
+    size_t pos = head.find("\r\n");
+    while (pos != std::string_view::npos) {
+        pos += 2;
+        const size_t end = head.find("\r\n", pos);
+        const std::string_view line = head.substr(pos, end == std::string_view::npos ? end : end - pos);
+        if (line.size() > name.size() && line[name.size()] == ':') {
+            bool same = true;
+            for (size_t i = 0; i < name.size() && same; ++i) {
+                const char c = line[i];
+                same = (c >= 'A' && c <= 'Z' ? c + 32 : c) == name[i];
+            }
+            if (same) {
+                value = line.substr(name.size() + 1);
+                while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+                while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+                return true;
+            }
+        }
+        pos = end;
+    }
+    return false;
+}
+
+void putRandom(uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; i += 4) {
+        const uint32_t r = net::random32();
+        for (size_t j = 0; j < 4 && i + j < n; ++j) out[i + j] = (uint8_t)(r >> (8 * j));
+    }
+}
+
+} // namespace
+
 WebSocketClient::WebSocketClient() = default;
 
 WebSocketClient::~WebSocketClient() {
-    close();
+    teardown();
+}
+
+void WebSocketClient::setSocket(NetSocket* s) {
+    if (s != sock) teardown(); // the old transport must not stay open
+    sock = s;
 }
 
-void WebSocketClient::init() {
-    // Nothing heavy here. Actual client created in connect()
+void WebSocketClient::setRxBuffer(uint8_t* buf, size_t cap) {
+    rx_buf = buf;
+    rx_cap = cap;
 }
 
 void WebSocketClient::setUrl(const std::string& url) {
+    if (url == ws_url) return;
     ws_url = url;
+    if (!parseUrl(url)) ESP_LOGE(TAG, "Bad WebSocket URL: %s", url.c_str());
 }
 
-void WebSocketClient::connect() {
-    if (ws_url.empty()) {
-        ESP_LOGE(TAG, "WebSocket URL not set");
-        return;
+bool WebSocketClient::parseUrl(const std::string& url) {
+    host[0] = '\0';
+    std::string_view u(url);
+    if (u.compare(0, 6, "wss://") == 0) {
+        secure = true;
+        port = 443;
+        u.remove_prefix(6);
+    } else if (u.compare(0, 5, "ws://") == 0) {
+        secure = false;
+        port = 80;
+        u.remove_prefix(5);
+    } else {
+        return false;
     }
 
-    if (client != nullptr) {
-        ESP_LOGW(TAG, "WS already created, closing old instance");
-        close();
+    const size_t slash = u.find('/');
+    path = slash == std::string_view::npos ? "/" : std::string(u.substr(slash));
+    std::string_view authority = u.substr(0, slash);
+    const size_t colon = authority.find(':');
+    if (colon != std::string_view::npos) {
+        unsigned p = 0;
+        for (char c : authority.substr(colon + 1)) {
+            if (c < '0' || c > '9') return false;
+            p = p * 10 + (c - '0');
+        }
+        if (p == 0 || p > 65535) return false;
+        port = (uint16_t)p;
+        authority = authority.substr(0, colon);
     }
+    if (authority.empty() || authority.size() >= sizeof(host)) return false;
+    memcpy(host, authority.data(), authority.size());
+    host[authority.size()] = '\0';
+    return true;
+}
 
-    esp_websocket_client_config_t cfg = {};
-    cfg.uri = ws_url.c_str();
-    cfg.buffer_size = 4096;  // Reduced from 8KB - we now have freed 115KB from Framebuffer removal
-    cfg.disable_auto_reconnect = true;
+void WebSocketClient::setKeepalive(int ping_interval, int pong_timeout) {
+    ping_interval_ms = (uint32_t)ping_interval * 1000;
+    pong_timeout_ms = (uint32_t)pong_timeout * 1000;
+}
 
-    client = esp_websocket_client_init(&cfg);
-    if (!client) {
-        ESP_LOGE(TAG, "Failed to init websocket");
+// ======================================================================================
+// CONNECT / CLOSE
+// ======================================================================================
+void WebSocketClient::connect() {
+    if (!host[0]) {
+        ESP_LOGE(TAG, "WebSocket URL not set");
+        return;
+    }
+    if (!sock || !rx_buf || rx_cap < 512) {
+        ESP_LOGE(TAG, "WebSocket socket / rx buffer not set");
         return;
     }
 
-    ESP_ERROR_CHECK(esp_websocket_register_events(
-        client,
-        WEBSOCKET_EVENT_ANY,
-        &WebSocketClient::eventHandlerStatic,
-        this
-    ));
-
-    ESP_LOGI(TAG, "Free heap before ws_start: %d bytes", esp_get_free_heap_size());
+    teardown(); // previous attempt, if any
     ESP_LOGI(TAG, "Connecting to WS: %s", ws_url.c_str());
-    esp_websocket_client_start(client);
-    ESP_LOGI(TAG, "Free heap after ws_start: %d bytes", esp_get_free_heap_size());
+    setStatus(1); // CONNECTING
+    connect_ms = net::nowMs();
 
-    if (status_cb) status_cb(1); // CONNECTING
+    if (!sock->connectStart(host, port)) {
+        fail("connect failed");
+        return;
+    }
+    state = State::CONNECTING;
+    want_write = true;
 }
 
 void WebSocketClient::close() {
-    if (client) {
-        ESP_LOGI(TAG, "Free heap before close: %d bytes", esp_get_free_heap_size());
+    if (state == State::OPEN) {
         ESP_LOGI(TAG, "Closing WebSocket...");
-        esp_websocket_client_close(client, 100);
-        // Give internal task time to cleanup
-        vTaskDelay(pdMS_TO_TICKS(200));
-        esp_websocket_client_destroy(client);
-        client = nullptr;
-        connected = false;
-        ESP_LOGI(TAG, "Free heap after close: %d bytes", esp_get_free_heap_size());
+        const uint8_t code[2] = {0x03, 0xE8}; // 1000 normal closure
+        std::lock_guard<std::mutex> lk(tx_lock);
+        sendFrame(OP_CLOSE, code, sizeof(code)); // no wait for the answer
     }
+    teardown();
+    setStatus(0); // CLOSED
+}
 
-    if (status_cb) status_cb(0); // CLOSED
+void WebSocketClient::abort() {
+    if (state != State::IDLE) ESP_LOGW(TAG, "Aborting WebSocket (no close handshake)");
+    teardown();
+    setStatus(0); // CLOSED
 }
 
-bool WebSocketClient::sendText(const std::string& msg) {
-    if (!client || !connected) return false;
+void WebSocketClient::fail(const char* why) {
+    ESP_LOGW(TAG, "WS %s", why);
+    teardown();
+    setStatus(0);
+}
 
-    int sent = esp_websocket_client_send_text(client, msg.c_str(), msg.size(), 100);
-    return sent == msg.size();
+void WebSocketClient::teardown() {
+    {
+        // Not under a sender's feet
+        std::lock_guard<std::mutex> lk(tx_lock);
+        connected = false;
+        if (sock) sock->disconnect();
+    }
+    state = State::IDLE;
+    want_write = false;
+    rx_len = 0;
+    in_frame = false;
+    msg_op = 0;
+    pong_wait = false;
+    io_failed = false;
 }
 
-bool WebSocketClient::sendBinary(const uint8_t* data, size_t len) {
-    if (!client || !connected) return false;
+void WebSocketClient::setStatus(int s) {
+    if (status.exchange(s) == s) return;
+    if (status_cb) status_cb(s);
+}
 
-    int sent = esp_websocket_client_send_bin(client, (const char*)data, len, 100);
-    return sent == (int)len;
+// ======================================================================================
+// EVENT LOOP
+// ======================================================================================
+int WebSocketClient::fd() const {
+    return sock && state != State::IDLE ? sock->fd() : -1;
 }
 
-void WebSocketClient::onStatus(std::function<void(int)> cb) {
-    status_cb = cb;
+bool WebSocketClient::hasBuffered() const {
+    return sock && state != State::IDLE && sock->buffered() > 0;
 }
 
-void WebSocketClient::onText(std::function<void(const std::string&)> cb) {
-    text_cb = cb;
+uint32_t WebSocketClient::dueMs() const {
+    if (state != State::OPEN) return net::WAIT_FOREVER; // the owner times connects
+    const uint32_t now = net::nowMs();
+    const uint32_t since_ping = now - last_ping_ms;
+    uint32_t due = since_ping >= ping_interval_ms ? 0 : ping_interval_ms - since_ping;
+    if (pong_wait) {
+        const int32_t left = (int32_t)(pong_due_ms - now);
+        due = std::min<uint32_t>(due, left > 0 ? (uint32_t)left : 0);
+    }
+    return due;
 }
 
-void WebSocketClient::onBinary(std::function<void(const uint8_t*, size_t)> cb) {
-    binary_cb = cb;
+void WebSocketClient::poll() {
+    if (io_failed) {
+        fail("send failed, connection dropped");
+        return;
+    }
+
+    switch (state) {
+    case State::IDLE:
+        break;
+    case State::CONNECTING:
+        stepConnect();
+        break;
+    case State::UPGRADING:
+        readUpgrade();
+        break;
+    case State::OPEN:
+        readFrames();
+        if (state == State::OPEN) serviceKeepalive();
+        break;
+    }
 }
 
-// ======================================================================================
-// EVENT HANDLER
-// ======================================================================================
-void WebSocketClient::eventHandlerStatic(void* handler_args, esp_event_base_t base,
-                                         int32_t event_id, void* event_data) {
-    auto* self = static_cast<WebSocketClient*>(handler_args);
-    self->eventHandler(base, event_id, (esp_websocket_event_data_t*)event_data);
-}
-
-void WebSocketClient::eventHandler(esp_event_base_t base, int32_t event_id,
-                                   esp_websocket_event_data_t* data)
-{
-    switch (event_id) {
-    case WEBSOCKET_EVENT_CONNECTED:
-        ESP_LOGI(TAG, "WS connected!");
-        connected = true;
-        if (status_cb) status_cb(2);
+int WebSocketClient::readLocked(uint8_t* buf, size_t cap) {
+    if (!sock->serializedIo()) return sock->readSome(buf, cap);
+    std::lock_guard<std::mutex> lk(tx_lock);
+    return sock->readSome(buf, cap);
+}
+
+void WebSocketClient::stepConnect() {
+    switch (sock->connectStep()) {
+    case NetSocket::Step::DONE:
         break;
+    case NetSocket::Step::WANT_READ:
+        want_write = false;
+        return;
+    case NetSocket::Step::WANT_WRITE:
+        want_write = true;
+        return;
+    case NetSocket::Step::FAILED:
+        fail("connect failed");
+        return;
+    }
 
-    case WEBSOCKET_EVENT_DATA:
-        if (!data) break;
+    // HTTP upgrade (RFC 6455 §4.1)
+    uint8_t nonce[16];
+    putRandom(nonce, sizeof(nonce));
+    base64(nonce, sizeof(nonce), key_b64);
 
-        if (data->op_code == 0x1) {  // WS_OP_TEXT
-            if (text_cb) {
-                text_cb(std::string((const char*)data->data_ptr, data->data_len));
-            }
-        } else if (data->op_code == 0x2) { // WS_OP_BINARY
-            if (binary_cb) {
-                binary_cb((const uint8_t*)data->data_ptr, data->data_len);
+    char port_suffix[8] = "";
+    if (port != (secure ? 443 : 80)) snprintf(port_suffix, sizeof(port_suffix), ":%u", (unsigned)port);
+
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lk(tx_lock);
+        const int n = snprintf((char*)tx_scratch, sizeof(tx_scratch),
+                               "GET %s HTTP/1.1\r\n"
+                               "Host: %s%s\r\n"
+                               "Upgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Key: %s\r\n"
+                               "Sec-WebSocket-Version: 13\r\n\r\n",
+                               path.c_str(), host, port_suffix, key_b64);
+        ok = n > 0 && (size_t)n < sizeof(tx_scratch);
+        if (ok) {
+            IoSlice io{tx_scratch, (size_t)n};
+            ok = writeAll(&io, 1, false);
+        }
+    }
+    if (!ok) {
+        fail("upgrade request not sent");
+        return;
+    }
+    want_write = false;
+    rx_len = 0;
+    state = State::UPGRADING;
+}
+
+void WebSocketClient::readUpgrade() {
+    const int n = readLocked(rx_buf + rx_len, rx_cap - rx_len);
+    if (n < 0) {
+        fail("closed during upgrade");
+        return;
+    }
+    rx_len += (size_t)n;
+
+    const std::string_view got((const char*)rx_buf, rx_len);
+    const size_t end = got.find("\r\n\r\n");
+    if (end == std::string_view::npos) {
+        if (rx_len == rx_cap) fail("upgrade response too long");
+        return;
+    }
+    const std::string_view head = got.substr(0, end + 2);
+
+    if (head.compare(0, 12, "HTTP/1.1 101") != 0) {
+        ESP_LOGW(TAG, "Upgrade refused: %.*s", (int)std::min<size_t>(head.find('\r'), 64), head.data());
+        fail("upgrade refused");
+        return;
+    }
+
+    // Accept = base64(SHA-1(key + GUID)): the server really speaks WS
+    Sha1 sha;
+    sha.update(key_b64, strlen(key_b64));
+    sha.update(WS_GUID, sizeof(WS_GUID) - 1);
+    uint8_t digest[20];
+    sha.finish(digest);
+    char expect[29];
+    base64(digest, sizeof(digest), expect);
+    std::string_view accept;
+    if (!headerValue(head, "sec-websocket-accept", accept) || accept != expect) {
+        fail("bad Sec-WebSocket-Accept");
+        return;
+    }
+
+    // Frames sent right behind the 101 stay in the buffer
+    const size_t used = end + 4;
+    memmove(rx_buf, rx_buf + used, rx_len - used);
+    rx_len -= used;
+
+    state = State::OPEN;
+    in_frame = false;
+    msg_op = 0;
+    text_len = 0;
+    text_drop = false;
+    last_ping_ms = net::nowMs();
+    pong_wait = false;
+    connected = true;
+    ESP_LOGI(TAG, "WS connected in %u ms", (unsigned)(net::nowMs() - connect_ms));
+    setStatus(2);
+
+    if (rx_len > 0) parseFrames();
+}
+
+void WebSocketClient::readFrames() {
+    for (int i = 0; i < MAX_READS_PER_POLL && state == State::OPEN; ++i) {
+        const int n = readLocked(rx_buf + rx_len, rx_cap - rx_len);
+        if (n < 0) {
+            fail("disconnected");
+            return;
+        }
+        if (n == 0) return;
+        rx_len += (size_t)n;
+        pong_wait = false; // the server is alive
+        parseFrames();
+    }
+}
+
+void WebSocketClient::parseFrames() {
+    size_t pos = 0;
+    while (state == State::OPEN) {
+        if (in_frame) {
+            const size_t avail = std::min(rx_len - pos, frame_total - frame_done);
+            if (avail == 0 && frame_done != frame_total) break; // need more
+            deliverData(rx_buf + pos, avail);
+            pos += avail;
+            frame_done += avail;
+            if (frame_done == frame_total) in_frame = false;
+            continue;
+        }
+
+        const size_t left = rx_len - pos;
+        if (left < 2) break;
+        const uint8_t b0 = rx_buf[pos];
+        const uint8_t b1 = rx_buf[pos + 1];
+        if (b1 & 0x80) {
+            fail("masked frame from server");
+            return;
+        }
+        size_t hdr = 2;
+        uint64_t len = b1 & 0x7F;
+        if (len == 126) {
+            hdr = 4;
+            if (left < hdr) break;
+            len = (uint64_t)rx_buf[pos + 2] << 8 | rx_buf[pos + 3];
+        } else if (len == 127) {
+            hdr = 10;
+            if (left < hdr) break;
+            len = 0;
+            for (int i = 0; i < 8; ++i) len = len << 8 | rx_buf[pos + 2 + i];
+        }
+        const uint8_t op = b0 & 0x0F;
+        const bool fin = b0 & 0x80;
+
+        if (op >= OP_CLOSE) {
+            if (!fin || len > 125) {
+                fail("bad control frame");
+                return;
             }
+            if (left < hdr + len) break; // whole control frame first
+            handleControl(op, rx_buf + pos + hdr, (size_t)len);
+            pos += hdr + (size_t)len;
+            continue;
         }
-        break;
 
-    case WEBSOCKET_EVENT_DISCONNECTED:
-        ESP_LOGW(TAG, "WS disconnected");
-        connected = false;
-        if (status_cb) status_cb(0);
-        break;
+        // Data frame: a message is one frame, or TEXT / BINARY with FIN=0
+        // and OP_CONT frames up to the one with FIN (control frames may
+        // come in between, handled above)
+        if (op == OP_CONT ? msg_op == 0 : (op == OP_TEXT || op == OP_BINARY) && msg_op != 0) {
+            fail(op == OP_CONT ? "continuation without a message" : "new message inside a fragmented one");
+            return;
+        }
+        pos += hdr;
+        in_frame = true;
+        frame_fin = fin;
+        frame_total = (size_t)len;
+        frame_done = 0;
+        frame_skip = op != OP_CONT && op != OP_TEXT && op != OP_BINARY;
+        if (frame_skip) {
+            ESP_LOGW(TAG, "WS frame with unknown op %u (%u B), dropped", (unsigned)op, (unsigned)len);
+        } else if (op != OP_CONT) {
+            msg_op = op;
+            msg_done = 0;
+            msg_fragmented = !fin;
+        }
+    }
 
-    case WEBSOCKET_EVENT_ERROR:
-        ESP_LOGE(TAG, "WS error event");
-        connected = false;
-        if (status_cb) status_cb(0);
-        break;
+    if (state != State::OPEN) return; // torn down, buffer reset
+    // Partial header / control frame to the front, next read appends
+    memmove(rx_buf, rx_buf + pos, rx_len - pos);
+    rx_len -= pos;
+}
+
+void WebSocketClient::deliverData(const uint8_t* data, size_t len) {
+    if (frame_skip) return;
+
+    const bool last = frame_fin && frame_done + len == frame_total;
+    const size_t offset = msg_done;
+    msg_done += len;
+    const uint8_t op = msg_op;
+    if (last) msg_op = 0; // callbacks below may see the next message start
+
+    if (op == OP_BINARY) {
+        // Total unknown until the last fragment: 0
+        if (binary_cb) binary_cb(data, len, offset, msg_fragmented ? 0 : frame_total, last);
+        return;
+    }
 
+    if (!text_cb) return;
+    if (!msg_fragmented && frame_done == 0 && len == frame_total) {
+        text_cb(std::string_view((const char*)data, len)); // common case: no copy
+        return;
+    }
+    if (offset == 0) {
+        text_len = 0;
+        text_drop = false;
+    }
+    if (!text_drop && text_len + len > TEXT_MAX) {
+        text_drop = true;
+        ESP_LOGW(TAG, "Text message > %u B, dropped", (unsigned)TEXT_MAX);
+    }
+    if (text_drop) return;
+    memcpy(text_buf + text_len, data, len);
+    text_len += len;
+    if (last) text_cb(std::string_view(text_buf, text_len));
+}
+
+void WebSocketClient::handleControl(uint8_t op, const uint8_t* payload, size_t len) {
+    switch (op) {
+    case OP_PING: {
+        std::lock_guard<std::mutex> lk(tx_lock);
+        if (connected) sendFrame(OP_PONG, payload, len);
+        break;
+    }
+    case OP_PONG:
+        break; // any frame already cleared pong_wait
+    case OP_CLOSE: {
+        const unsigned code = len >= 2 ? (unsigned)payload[0] << 8 | payload[1] : 1005;
+        ESP_LOGW(TAG, "WS closed by server (%u)", code);
+        {
+            std::lock_guard<std::mutex> lk(tx_lock);
+            if (connected) sendFrame(OP_CLOSE, payload, std::min<size_t>(len, 2)); // echo the code
+        }
+        teardown();
+        setStatus(0);
+        break;
+    }
     default:
         break;
     }
 }
+
+void WebSocketClient::serviceKeepalive() {
+    const uint32_t now = net::nowMs();
+    if (pong_wait && (int32_t)(now - pong_due_ms) >= 0) {
+        fail("no pong, connection dead");
+        return;
+    }
+    if (now - last_ping_ms < ping_interval_ms) return;
+
+    last_ping_ms = now;
+    std::lock_guard<std::mutex> lk(tx_lock);
+    if (connected && sendFrame(OP_PING, nullptr, 0) && !pong_wait) {
+        pong_wait = true;
+        pong_due_ms = now + pong_timeout_ms;
+    }
+}
+
+// ======================================================================================
+// SEND
+// ======================================================================================
+size_t WebSocketClient::writeHeader(uint8_t* out, uint8_t op, size_t len, const uint8_t mask[4]) {
+    size_t n;
+    out[0] = 0x80 | op; // FIN
+    if (len < 126) {
+        out[1] = 0x80 | (uint8_t)len;
+        n = 2;
+    } else if (len <= 0xFFFF) {
+        out[1] = 0x80 | 126;
+        out[2] = (uint8_t)(len >> 8);
+        out[3] = (uint8_t)len;
+        n = 4;
+    } else {
+        out[1] = 0x80 | 127;
+        for (int i = 0; i < 8; ++i) out[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        n = 10;
+    }
+    memcpy(out + n, mask, 4);
+    return n + 4;
+}
+
+bool WebSocketClient::writeAll(IoSlice* io, size_t n, bool committed) {
+    const uint32_t start = net::nowMs();
+    size_t written = 0;
+    size_t i = 0;
+    bool broken = false;
+    while (i < n) {
+        const int w = sock->writeSome(io + i, n - i);
+        if (w < 0) {
+            broken = true;
+            break;
+        }
+        if (w == 0) {
+            const uint32_t spent = net::nowMs() - start;
+            if (spent >= SEND_TIMEOUT_MS) break;
+            net::waitReady(sock->fd(), false, true, -1, SEND_TIMEOUT_MS - spent);
+            continue;
+        }
+        written += (size_t)w;
+        size_t left = (size_t)w;
+        while (i < n && left >= io[i].len) {
+            left -= io[i].len;
+            ++i;
+        }
+        if (i < n) {
+            io[i].data += left;
+            io[i].len -= left;
+        }
+    }
+    if (i == n) return true;
+
+    // Nothing of the frame left: drop it, the stream is intact. TLS may
+    // hold a half-sent record even then.
+    if (!broken && !committed && written == 0 && !sock->serializedIo()) {
+        ESP_LOGW(TAG, "WS send timed out, frame dropped");
+        return false;
+    }
+
+    // Half a frame on the wire: the stream is corrupt. The loop tears down.
+    ESP_LOGE(TAG, "WS send failed (%u B written)", (unsigned)written);
+    connected = false;
+    io_failed = true;
+    setStatus(0);
+    return false;
+}
+
+bool WebSocketClient::sendFrame(uint8_t op, const uint8_t* data, size_t len) {
+    uint8_t mask[4];
+    putRandom(mask, sizeof(mask));
+    uint8_t hdr[14];
+    const size_t hn = writeHeader(hdr, op, len, mask);
+
+    // Masked copy in TX_SCRATCH pieces: header + first piece in one write
+    size_t done = 0;
+    do {
+        const size_t chunk = std::min(len - done, TX_SCRATCH);
+        for (size_t i = 0; i < chunk; ++i) tx_scratch[i] = data[done + i] ^ mask[(done + i) & 3];
+        IoSlice io[2] = {{hdr, hn}, {tx_scratch, chunk}};
+        const bool first = done == 0;
+        if (!writeAll(first ? io : io + 1, first ? 2 : 1, !first)) return false;
+        done += chunk;
+    } while (done < len);
+    return true;
+}
+
+bool WebSocketClient::sendText(std::string_view msg) {
+    std::lock_guard<std::mutex> lk(tx_lock);
+    if (!connected) return false;
+    return sendFrame(OP_TEXT, (const uint8_t*)msg.data(), msg.size());
+}
+
+bool WebSocketClient::sendBinary(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lk(tx_lock);
+    if (!connected) return false;
+    return sendFrame(OP_BINARY, data, len);
+}
+
+bool WebSocketClient::sendBinaryInPlace(uint8_t* data, size_t len) {
+    if (len > 0xFFFF) return sendBinary(data, len); // header would not fit the headroom
+    if (!connected) return false;
+
+    uint8_t mask[4];
+    putRandom(mask, sizeof(mask));
+    uint8_t hdr[FRAME_HEADROOM];
+    const size_t hn = writeHeader(hdr, OP_BINARY, len, mask);
+    uint8_t* frame = data - hn;
+    memcpy(frame, hdr, hn);
+    for (size_t i = 0; i < len; ++i) data[i] ^= mask[i & 3];
+
+    std::lock_guard<std::mutex> lk(tx_lock);
+    if (!connected) return false;
+    IoSlice io{frame, hn + len};
+    return writeAll(&io, 1, false);
+}
+
+void WebSocketClient::onStatus(std::function<void(int)> cb) {
+    status_cb = cb;
+}
+
+void WebSocketClient::onText(std::function<void(std::string_view)> cb) {
+    text_cb = cb;
+}
+
+void WebSocketClient::onBinary(std::function<void(const uint8_t*, size_t, size_t, size_t, bool)> cb) {
+    binary_cb = cb;
+}
@@ -1,59 +1,185 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <functional>
-#include <vector>
-#include "esp_websocket_client.h"
+
+#include "NetSocket.hpp"
 
 /**
  * WebSocketClient
  * ---------------------------------------------------------
- * - Đóng gói esp_websocket_client
+ * - Client RFC 6455 gọn, chạy trong event loop của owner (NetworkLoop):
+ *   không task riêng, không buffer heap
+ * - Transport cắm vào qua NetSocket (PlainSocket ws://, TlsSocket wss://)
  * - Tự động callback status / text / binary
  * - Không xử lý logic ứng dụng (NetworkManager làm việc đó)
+ * - Frames are parsed in place in the caller's rx buffer: binary payload is
+ *   handed out in pieces (offset / total / last) without a copy, text pieces
+ *   are reassembled into a fixed buffer. Fragmented messages (FIN=0 +
+ *   continuation frames, control frames in between) arrive the same way
+ * - Sends from any task, serialized by one lock; writes are scatter-gather
+ *   (header + payload in one syscall / one TLS record)
+ *
+ * Threading: connect / close / abort / poll on the loop task only.
  */
 class WebSocketClient {
 public:
     WebSocketClient();
     ~WebSocketClient();
 
-    // Init sơ bộ, chưa connect
-    void init();
+    // Transport used by the next connect() (owned by the caller)
+    void setSocket(NetSocket* sock);
+    // Receive buffer (owned by the caller, static): messages larger than
+    // it arrive in pieces. 512 B minimum.
+    void setRxBuffer(uint8_t* buf, size_t cap);
+
+    // ws://host[:port]/path or wss://...
+    void setUrl(const std::string& url);
+    bool urlIsSecure() const { return secure; }
+
+    // WS-level ping; no pong within pong_timeout_s → disconnect.
+    void setKeepalive(int ping_interval_s, int pong_timeout_s);
 
-    // Kết nối tới ws_url (thiết lập trong setUrl)
+    // Start connecting (name lookup blocks, the rest runs in poll())
     void connect();
+    // Graceful close (close frame, no wait for the answer)
     void close();
+    // Drop the connection without a close handshake (dead peer)
+    void abort();
 
     // Get connection status
     bool isConnected() const { return connected; }
 
-    void setUrl(const std::string& url);
+    // ======================================================
+    // Event loop
+    // ======================================================
+    // fd to wait on for reads (-1: nothing to wait for)
+    int fd() const;
+    // Connecting: wait for writable too
+    bool wantsWrite() const { return state == State::CONNECTING && want_write; }
+    // Decoded bytes are waiting inside the transport: poll() without waiting
+    bool hasBuffered() const;
+    // Connect steps, reads + callbacks, keepalive. Never blocks.
+    void poll();
+    // ms until poll() has timed work (ping / pong deadline)
+    uint32_t dueMs() const;
 
     // Send
-    bool sendText(const std::string& msg);
+    bool sendText(std::string_view msg);
     bool sendBinary(const uint8_t* data, size_t len);
 
+    // Client frame header for payloads < 64 KB: 2 + 2 (len) + 4 (mask)
+    static constexpr size_t FRAME_HEADROOM = 8;
+
+    // Longest text message reassembled from pieces (JSON commands)
+    static constexpr size_t TEXT_MAX = 1024;
+    // Masking scratch for sendText / sendBinary (const payload)
+    static constexpr size_t TX_SCRATCH = 512;
+    // A send waits this long for a full socket, then gives up
+    static constexpr uint32_t SEND_TIMEOUT_MS = 100;
+
+    /**
+     * Send a binary message whose buffer has FRAME_HEADROOM writable bytes
+     * before `data`: the header goes there, the payload is masked in place
+     * and the frame leaves in one write. The payload is clobbered.
+     */
+    bool sendBinaryInPlace(uint8_t* data, size_t len);
+
     // Callbacks
     void onStatus(std::function<void(int)> cb);   // 0=closed,1=connecting,2=open
-    void onText(std::function<void(const std::string&)> cb);
-    void onBinary(std::function<void(const uint8_t*, size_t)> cb);
+    void onText(std::function<void(std::string_view)> cb);  // view valid during the call only
+    // Binary pieces in order: `offset` of this piece in the message (0 = new
+    // message), `last` on its final piece. `total` is the message length, or
+    // 0 for a message sent in several frames (not known before its end).
+    // Whole messages: len == total.
+    void onBinary(std::function<void(const uint8_t* data, size_t len, size_t offset, size_t total, bool last)> cb);
 
 private:
-    static void eventHandlerStatic(void* handler_args, esp_event_base_t base,
-                                   int32_t event_id, void* event_data);
+    enum class State : uint8_t {
+        IDLE,
+        CONNECTING, // TCP / TLS
+        UPGRADING,  // HTTP request sent, waiting for 101
+        OPEN,
+    };
 
-    void eventHandler(esp_event_base_t base, int32_t event_id,
-                      esp_websocket_event_data_t* data);
+    bool parseUrl(const std::string& url);
+    void stepConnect();
+    void readUpgrade();
+    void readFrames();
+    // Consume rx_buf[0, rx_len): deliver data, answer control frames
+    void parseFrames();
+    void handleControl(uint8_t op, const uint8_t* payload, size_t len);
+    void deliverData(const uint8_t* data, size_t len);
+    void serviceKeepalive();
+
+    // Mask + write one frame (tx lock held by the caller)
+    bool sendFrame(uint8_t op, const uint8_t* data, size_t len);
+    static size_t writeHeader(uint8_t* out, uint8_t op, size_t len, const uint8_t mask[4]);
+    // All slices, waiting up to SEND_TIMEOUT_MS for a full socket.
+    // false = frame dropped (nothing written), or stream broken (partial
+    // write; `committed`: earlier pieces of the frame already went out):
+    // io_failed set, the loop tears down.
+    bool writeAll(IoSlice* io, size_t n, bool committed);
+    int readLocked(uint8_t* buf, size_t cap);
+    void fail(const char* why);
+    void teardown();
+
+    // Report a status once per transition (a failed send and the loop may
+    // both see the same CLOSED)
+    void setStatus(int s);
 
 private:
-    esp_websocket_client_handle_t client = nullptr;
+    NetSocket* sock = nullptr;
+    uint8_t* rx_buf = nullptr;
+    size_t rx_cap = 0;
+    size_t rx_len = 0;
 
     std::string ws_url;
+    bool secure = false;
+    char host[64] = {};
+    uint16_t port = 0;
+    std::string path;
+    char key_b64[25] = {}; // Sec-WebSocket-Key of this handshake
+
+    uint32_t ping_interval_ms = 10000;
+    uint32_t pong_timeout_ms = 10000;
+    uint32_t last_ping_ms = 0;
+    uint32_t pong_due_ms = 0;
+    bool pong_wait = false;
+
+    State state = State::IDLE;
+    bool want_write = false;
+    uint32_t connect_ms = 0;
+    std::atomic<bool> connected{false};
+    std::atomic<bool> io_failed{false}; // a send broke the stream: loop tears down
+    std::atomic<int> status{0};
 
-    bool connected = false;
+    // Frame being received (loop only)
+    bool in_frame = false;
+    bool frame_fin = false;
+    bool frame_skip = false; // unknown opcode: dropped
+    size_t frame_total = 0;
+    size_t frame_done = 0;
+
+    // Message being received, across continuation frames (loop only)
+    uint8_t msg_op = 0; // OP_TEXT / OP_BINARY, 0 = between messages
+    bool msg_fragmented = false;
+    size_t msg_done = 0;
+
+    // Send side
+    std::mutex tx_lock;
+    uint8_t tx_scratch[TX_SCRATCH];
 
     // callbacks
     std::function<void(int)> status_cb;               // status
-    std::function<void(const std::string&)> text_cb;  // text message
-    std::function<void(const uint8_t*, size_t)> binary_cb; // binary message
+    std::function<void(std::string_view)> text_cb;  // text message
+    std::function<void(const uint8_t*, size_t, size_t, size_t, bool)> binary_cb; // binary piece
+
+    // Text pieces (loop only)
+    char text_buf[TEXT_MAX];
+    size_t text_len = 0;
+    bool text_drop = false;
 };
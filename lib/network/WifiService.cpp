@@ -448,6 +448,16 @@ std::string WifiService::getIp() const
     return std::string();
 }
 
+int WifiService::getRssi() const
+{
+    if (!connected)
+        return 0;
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return 0;
+    return ap.rssi;
+}
+
 void WifiService::connectWithCredentials(const char *ssid, const char *pass)
 {
     if (!ssid)
@@ -66,6 +66,7 @@ public:
     bool isConnected() const { return connected; }
     std::string getIp() const;
     std::string getSsid() const { return sta_ssid; }
+    int getRssi() const; // dBm của AP đang nối, 0 = chưa associate
 
     // Credential
     void connectWithCredentials(const char* ssid, const char* pass);
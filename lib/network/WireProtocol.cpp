@@ -0,0 +1,378 @@
+#include "WireProtocol.hpp"
+
+#include "PerfectHash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace proto
+{
+    namespace
+    {
+        inline void put16(uint8_t *p, uint16_t v)
+        {
+            p[0] = static_cast<uint8_t>(v);
+            p[1] = static_cast<uint8_t>(v >> 8);
+        }
+
+        inline void put32(uint8_t *p, uint32_t v)
+        {
+            p[0] = static_cast<uint8_t>(v);
+            p[1] = static_cast<uint8_t>(v >> 8);
+            p[2] = static_cast<uint8_t>(v >> 16);
+            p[3] = static_cast<uint8_t>(v >> 24);
+        }
+
+        inline uint16_t get16(const uint8_t *p)
+        {
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        inline uint32_t get32(const uint8_t *p)
+        {
+            return static_cast<uint32_t>(p[0]) |
+                   (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) |
+                   (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        // Header fields, magic / length already checked by the caller
+        void readHeader(const uint8_t *data, Header &h)
+        {
+            h.type = static_cast<MsgType>(data[1]);
+            h.flags = data[2];
+            h.codec = static_cast<Codec>(data[3]);
+            h.seq = get16(data + 4);
+            h.payload_len = get16(data + 6);
+            h.timestamp = get32(data + 8);
+        }
+
+        // Legacy magic strings (server cũ), tra bằng perfect hash
+        constexpr auto kTextMap = phash::make<32, Control>({
+            {"START", Control::LISTEN_START},
+            {"END", Control::LISTEN_END},
+            {"PROCESSING_START", Control::PROCESSING},
+            {"PROCESSING", Control::PROCESSING},
+            {"SPEAK_START", Control::SPEAK_START},
+            {"SPEAKING", Control::SPEAK_START},
+            {"TTS_END", Control::SPEAK_END},
+            {"SPEAK_END", Control::SPEAK_END},
+            {"IDLE", Control::IDLE},
+            {"DONE", Control::IDLE},
+            {"LISTENING", Control::LISTEN},
+        });
+        static_assert(kTextMap.valid, "legacy control words need a perfect seed");
+    }
+
+    // ========================================================================
+    // Encode / decode
+    // ========================================================================
+    size_t writeHeader(const Header &h, uint8_t *out, size_t cap)
+    {
+        if (!out || cap < HEADER_SIZE)
+            return 0;
+
+        out[0] = MAGIC;
+        out[1] = static_cast<uint8_t>(h.type);
+        out[2] = h.flags;
+        out[3] = static_cast<uint8_t>(h.codec);
+        put16(out + 4, h.seq);
+        put16(out + 6, h.payload_len);
+        put32(out + 8, h.timestamp);
+        return HEADER_SIZE;
+    }
+
+    bool parse(const uint8_t *data, size_t len, Header &h, const uint8_t *&payload)
+    {
+        if (!data || len < HEADER_SIZE || data[0] != MAGIC)
+            return false;
+
+        if (HEADER_SIZE + get16(data + 6) != len)
+            return false;
+
+        readHeader(data, h);
+        payload = data + HEADER_SIZE;
+        return true;
+    }
+
+    size_t writeControl(Control c, const uint8_t *args, size_t args_len,
+                        uint16_t seq, uint32_t timestamp_ms,
+                        uint8_t *out, size_t cap, uint8_t flags)
+    {
+        const size_t payload_len = 1 + args_len;
+        if (!out || HEADER_SIZE + payload_len > cap || payload_len > MAX_PAYLOAD)
+            return 0;
+
+        Header h;
+        h.type = MsgType::CONTROL;
+        h.flags = flags;
+        h.seq = seq;
+        h.payload_len = static_cast<uint16_t>(payload_len);
+        h.timestamp = timestamp_ms;
+        writeHeader(h, out, cap);
+
+        out[HEADER_SIZE] = static_cast<uint8_t>(c);
+        if (args_len > 0)
+            std::memcpy(out + HEADER_SIZE + 1, args, args_len);
+        return HEADER_SIZE + payload_len;
+    }
+
+    uint32_t samplesForBytes(Codec c, size_t bytes)
+    {
+        switch (c)
+        {
+        case Codec::PCM16:
+            return static_cast<uint32_t>(bytes / 2);
+        case Codec::ADPCM_IMA:
+            return static_cast<uint32_t>(bytes * 2);
+        case Codec::ADPCM_IMA_HALF:
+            return static_cast<uint32_t>(bytes * 4);
+        default:
+            return 0;
+        }
+    }
+
+    size_t bytesForSamples(Codec c, uint32_t samples)
+    {
+        switch (c)
+        {
+        case Codec::PCM16:
+            return static_cast<size_t>(samples) * 2;
+        case Codec::ADPCM_IMA:
+            return (static_cast<size_t>(samples) + 1) / 2;
+        case Codec::ADPCM_IMA_HALF:
+            return (static_cast<size_t>(samples) + 3) / 4;
+        default:
+            return 0;
+        }
+    }
+
+    void putU16(uint8_t *p, uint16_t v)
+    {
+        put16(p, v);
+    }
+
+    uint16_t getU16(const uint8_t *p)
+    {
+        return get16(p);
+    }
+
+    void putU32(uint8_t *p, uint32_t v)
+    {
+        put32(p, v);
+    }
+
+    uint32_t getU32(const uint8_t *p)
+    {
+        return get32(p);
+    }
+
+    bool controlFromText(std::string_view text, Control &out)
+    {
+        const Control *c = kTextMap.find(text);
+        if (!c)
+            return false;
+        out = *c;
+        return true;
+    }
+
+    const char *controlToText(Control c)
+    {
+        // Tên chính = entry đầu tiên cho code đó
+        for (const auto &e : kTextMap.entries)
+        {
+            if (e.value == c)
+                return e.key.data();
+        }
+        return nullptr;
+    }
+
+    // ========================================================================
+    // Receive-side helpers
+    // ========================================================================
+    uint16_t SeqTracker::update(uint16_t seq)
+    {
+        ++received;
+        if (!started_)
+        {
+            started_ = true;
+            expected_ = static_cast<uint16_t>(seq + 1);
+            return 0;
+        }
+
+        // Signed distance handles the 16-bit wrap
+        int16_t delta = static_cast<int16_t>(seq - expected_);
+        if (delta < 0)
+        {
+            const uint16_t age = static_cast<uint16_t>(expected_ - 1 - seq);
+            if (age >= WINDOW)
+            {
+                ++late; // too old to tell: may have been counted lost
+            }
+            else if (missing_ & (uint64_t{1} << age))
+            {
+                missing_ &= ~(uint64_t{1} << age);
+                ++late; // reordered: it was counted lost
+                --lost;
+            }
+            else
+            {
+                ++duplicate;
+            }
+            return 0;
+        }
+
+        // Newest is bit 0, the delta skipped seqs right behind it
+        const uint32_t gap = static_cast<uint32_t>(delta);
+        missing_ = gap + 1 >= WINDOW ? 0 : missing_ << (gap + 1);
+        missing_ |= (gap + 1 >= WINDOW ? ~uint64_t{0} : (uint64_t{1} << gap) - 1) << 1;
+        expected_ = static_cast<uint16_t>(seq + 1);
+        lost += gap;
+        return static_cast<uint16_t>(gap);
+    }
+
+    void SeqTracker::reset()
+    {
+        received = 0;
+        lost = 0;
+        late = 0;
+        duplicate = 0;
+        started_ = false;
+        expected_ = 0;
+        missing_ = 0;
+    }
+
+    void JitterEstimator::update(uint32_t media_ts, uint32_t sample_rate, uint32_t arrival_ms)
+    {
+        if (sample_rate == 0)
+            return;
+
+        int64_t media_us = static_cast<int64_t>(media_ts) * 1000000 / sample_rate;
+        int64_t transit_us = static_cast<int64_t>(arrival_ms) * 1000 - media_us;
+
+        if (started_)
+        {
+            int64_t d = transit_us - prev_transit_us_;
+            float d_ms = static_cast<float>(d < 0 ? -d : d) / 1000.0f;
+            jitter_ms_ += (d_ms - jitter_ms_) / 16.0f;
+        }
+        started_ = true;
+        prev_transit_us_ = transit_us;
+    }
+
+    void JitterEstimator::reset()
+    {
+        started_ = false;
+        prev_transit_us_ = 0;
+        jitter_ms_ = 0.0f;
+    }
+
+    // ========================================================================
+    // Chunked receive
+    // ========================================================================
+    FrameReader::Status FrameReader::feed(const uint8_t *data, size_t len, size_t offset,
+                                          size_t total, const Handler &on_payload)
+    {
+        if (offset == 0)
+        {
+            // New message. Decide framed vs legacy on the first piece, like
+            // parse(): magic and exact length (len >= 8 covers payload_len).
+            // Length not given: the header's is taken below.
+            pos_ = 0;
+            total_ = total;
+            sized_ = total > 0;
+            const bool framed = data && len > 0 && data[0] == MAGIC &&
+                                (!sized_ || (total >= HEADER_SIZE &&
+                                             (len < 8 || HEADER_SIZE + get16(data + 6) == total)));
+            mode_ = framed ? Mode::HEADER : Mode::LEGACY;
+        }
+        else if (mode_ == Mode::IDLE || offset != pos_ || (sized_ && total != total_))
+        {
+            mode_ = Mode::IDLE; // lost the start of this message
+            return Status::INVALID;
+        }
+
+        if (total_ > 0 && offset + len > total_)
+        {
+            mode_ = Mode::IDLE;
+            return Status::INVALID;
+        }
+        pos_ = offset + len;
+        bool end = total_ > 0 && pos_ == total_;
+
+        if (mode_ == Mode::LEGACY || mode_ == Mode::DROP)
+        {
+            const Status st = mode_ == Mode::LEGACY ? Status::NOT_FRAMED : Status::INVALID;
+            if (end)
+                mode_ = Mode::IDLE;
+            return st;
+        }
+
+        size_t at = offset; // message position of p
+        const uint8_t *p = data;
+        size_t n = len;
+
+        if (mode_ == Mode::HEADER)
+        {
+            const size_t take = std::min(n, HEADER_SIZE - at);
+            std::memcpy(head_ + at, p, take);
+            p += take;
+            n -= take;
+            at += take;
+            if (at < HEADER_SIZE)
+                return Status::MORE;
+
+            readHeader(head_, h_);
+            if (!sized_)
+            {
+                total_ = HEADER_SIZE + h_.payload_len;
+                if (pos_ > total_)
+                {
+                    mode_ = Mode::IDLE; // longer than its header says
+                    return Status::INVALID;
+                }
+                end = pos_ == total_;
+            }
+            if (HEADER_SIZE + h_.payload_len != total_ ||
+                (h_.type != MsgType::AUDIO && h_.payload_len > STASH_SIZE))
+            {
+                mode_ = end ? Mode::IDLE : Mode::DROP;
+                return Status::INVALID;
+            }
+            mode_ = Mode::PAYLOAD;
+
+            if (h_.payload_len == 0)
+            {
+                on_payload(h_, nullptr, 0, true, true); // e.g. empty EOS
+                mode_ = Mode::IDLE;
+                return Status::DONE;
+            }
+        }
+
+        const size_t payload_off = at - HEADER_SIZE;
+        if (h_.type == MsgType::AUDIO)
+        {
+            if (n > 0)
+                on_payload(h_, p, n, payload_off == 0, end);
+        }
+        else
+        {
+            std::memcpy(stash_ + payload_off, p, n);
+            if (end)
+                on_payload(h_, stash_, h_.payload_len, true, true);
+        }
+
+        if (!end)
+            return Status::MORE;
+        mode_ = Mode::IDLE;
+        return Status::DONE;
+    }
+
+    void FrameReader::reset()
+    {
+        mode_ = Mode::IDLE;
+        pos_ = 0;
+        total_ = 0;
+        sized_ = false;
+    }
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+/**
+ * WireProtocol
+ * ============================================================================
+ * Framing nhị phân cho audio + control trên WebSocket (binary frames).
+ *
+ * Header 12 bytes, little-endian:
+ *
+ *   off  size  field
+ *    0    1    magic/version  0xA0 | VERSION
+ *    1    1    type           MsgType
+ *    2    1    flags          flag::*
+ *    3    1    codec          Codec (AUDIO), 0 otherwise
+ *    4    2    seq            per-type sequence number (wraps)
+ *    6    2    payload_len    bytes following the header
+ *    8    4    timestamp      AUDIO: index of first sample (stream clock,
+ *                             codec_sample_rate: a half-rate codec counts 2
+ *                             per coded sample)
+ *                             other: sender clock in ms
+ *
+ * CONTROL payload: [Control code][args...]
+ *
+ * Downlink flow control (feature::CREDIT): the device grants the server a
+ * byte limit, cumulative over the connection, for AUDIO payload bytes. The
+ * server sends while its own total < limit (u32 arithmetic, wraps). Free
+ * space measured on the device already excludes bytes in flight, so the
+ * limit never lets the server overflow the device.
+ *
+ * Uplink codec switch (feature::CODEC_SWITCH): the device may change
+ * codec profile between any two AUDIO frames of a stream; each frame's
+ * codec byte says how to decode it. Codec state (ADPCM predictor) carries
+ * across the switch, the stream clock keeps counting.
+ *
+ * Barge-in (feature::CANCEL): the device cuts the answer with CANCEL
+ * [played seq][fence seq] and drops downlink AUDIO from then on. The
+ * server stops the stream and answers CANCELLED [last seq sent]: frames up
+ * to that seq are the cut answer, the first newer one starts the next.
+ *
+ * Clock sync (feature::CLOCK): PONG carries the PING args + [server
+ * receive ms][server send ms], stamped with the server's header clock. The
+ * device estimates the server clock from them (ClockSync) and, once
+ * synced, stamps its CONTROL frames in server time (flag::SERVER_TIME):
+ * receive time - timestamp is the one-way delay on either side.
+ *
+ * Continuous conversation: SPEAK_END [speak_end::LISTEN] asks the device
+ * to open the next turn by itself once the answer has played (no button);
+ * it ends on IDLE or on a SPEAK_END without the flag. Old firmware ignores
+ * the args.
+ *
+ * Audio over UDP (feature::UDP): each datagram is one frame with this same
+ * header; the WebSocket stays the control channel (see UdpAudioLink).
+ *
+ * Zero-allocation: encode into / decode from caller buffers only.
+ * Reference implementation (server side): server_test/wire_protocol.py
+ */
+namespace proto
+{
+    constexpr uint8_t VERSION = 1;
+    constexpr uint8_t MAGIC = 0xA0 | VERSION;
+    constexpr size_t HEADER_SIZE = 12;
+    constexpr size_t MAX_PAYLOAD = 0xFFFF;
+
+    enum class MsgType : uint8_t
+    {
+        AUDIO = 0x01,
+        CONTROL = 0x02,
+    };
+
+    enum class Codec : uint8_t
+    {
+        NONE = 0,
+        PCM16 = 1,     // 16-bit LE mono
+        ADPCM_IMA = 2, // 4-bit, high nibble first
+        OPUS = 3,
+        ADPCM_IMA_HALF = 4, // ADPCM_IMA at half the stream rate (2:1 decimated)
+    };
+
+    namespace flag
+    {
+        constexpr uint8_t START = 1 << 0; // first packet of a stream
+        constexpr uint8_t EOS = 1 << 1;   // last packet of a stream
+        constexpr uint8_t RED = 1 << 2;   // UDP: payload also carries the previous packet
+        constexpr uint8_t SERVER_TIME = 1 << 3; // device CONTROL: timestamp in server clock
+    }
+
+    // Optional features, advertised by the server in HELLO args[1]
+    namespace feature
+    {
+        constexpr uint8_t CREDIT = 1 << 0; // paces downlink by Control::CREDIT
+        constexpr uint8_t PING = 1 << 1;   // answers Control::PING with PONG
+        constexpr uint8_t UDP = 1 << 2;    // audio over datagrams (Control::UDP_OFFER)
+        constexpr uint8_t CODEC_SWITCH = 1 << 3; // decodes any uplink codec, per frame
+        constexpr uint8_t CANCEL = 1 << 4;       // stops an answer on Control::CANCEL
+        constexpr uint8_t CLOCK = 1 << 5;        // PONG adds server receive / send ms
+    }
+
+    // SPEAK_END args[0] (optional)
+    namespace speak_end
+    {
+        constexpr uint8_t LISTEN = 1 << 0; // listen again once the answer has played
+    }
+
+    // Control codes (thay cho magic strings "START", "TTS_END", ...)
+    enum class Control : uint8_t
+    {
+        // device → server
+        LISTEN_START = 0x01, // "START"
+        LISTEN_END = 0x02,   // "END"
+        CREDIT = 0x03,       // args: [limit u32 LE] downlink payload byte limit
+        PING = 0x04,         // args: [nonce u32][sender ms u32], echoed in PONG
+        UDP_BIND = 0x05,     // args: [token u32]; over UDP: bind probe (server echoes it),
+                             // over WS: both directions work, send audio by UDP
+        CANCEL = 0x06,       // args: [played seq u16][fence seq u16] barge-in: stop the answer
+
+        // server → device
+        HELLO = 0x10,        // server speaks this protocol (args: [version][features])
+        PROCESSING = 0x11,   // "PROCESSING_START" / "PROCESSING"
+        SPEAK_START = 0x12,  // "SPEAK_START" / "SPEAKING"
+        SPEAK_END = 0x13,    // "TTS_END" / "SPEAK_END", args: [speak_end flags] optional
+        IDLE = 0x14,         // "IDLE" / "DONE"
+        LISTEN = 0x15,       // "LISTENING" (server asks device to listen)
+        EMOTION = 0x16,      // 2-char code, args: [tens][units] as ASCII
+        PONG = 0x17,         // args: PING args echoed (+ [rx ms u32][tx ms u32], feature::CLOCK)
+        UDP_OFFER = 0x18,    // args: [port u16][token u32] audio port on the WS host
+        CANCELLED = 0x19,    // args: [last seq u16] answer stopped, AUDIO up to seq is stale
+    };
+
+    struct Header
+    {
+        MsgType type = MsgType::AUDIO;
+        uint8_t flags = 0;
+        Codec codec = Codec::NONE;
+        uint16_t seq = 0;
+        uint16_t payload_len = 0;
+        uint32_t timestamp = 0;
+    };
+
+    /**
+     * Write a header
+     * @return HEADER_SIZE, or 0 if cap is too small
+     */
+    size_t writeHeader(const Header &h, uint8_t *out, size_t cap);
+
+    /**
+     * Parse + validate one frame (magic, version, exact length)
+     * @return true and fills h / payload if data is a well-formed frame.
+     *         Legacy headerless audio fails the length check.
+     *         Whole messages only: pieces go through FrameReader.
+     */
+    bool parse(const uint8_t *data, size_t len, Header &h, const uint8_t *&payload);
+
+    /**
+     * Build a complete CONTROL frame
+     * @return frame size, or 0 if cap is too small
+     */
+    size_t writeControl(Control c, const uint8_t *args, size_t args_len,
+                        uint16_t seq, uint32_t timestamp_ms,
+                        uint8_t *out, size_t cap, uint8_t flags = 0);
+
+    // Stream-clock samples carried by `bytes` of codec payload (0 = variable, e.g. Opus)
+    uint32_t samplesForBytes(Codec c, size_t bytes);
+    // Payload bytes for `samples` (0 = variable)
+    size_t bytesForSamples(Codec c, uint32_t samples);
+
+    // Little-endian u16 / u32 in / out of control args
+    void putU16(uint8_t *p, uint16_t v);
+    uint16_t getU16(const uint8_t *p);
+    void putU32(uint8_t *p, uint32_t v);
+    uint32_t getU32(const uint8_t *p);
+
+    // a is newer than b (16-bit seq, wrap-aware)
+    inline bool seqNewer(uint16_t a, uint16_t b) { return static_cast<int16_t>(a - b) > 0; }
+
+    // Legacy text command ↔ Control. false if the text is not a command.
+    bool controlFromText(std::string_view text, Control &out);
+    const char *controlToText(Control c);
+
+    // ------------------------------------------------------------------------
+    // Receive-side helpers
+    // ------------------------------------------------------------------------
+
+    // Sequence gap detection (wrap-aware). A seq counted missing that
+    // turns up within WINDOW of the newest is taken back from lost; exact
+    // duplicates change nothing but their own counter.
+    struct SeqTracker
+    {
+        static constexpr uint16_t WINDOW = 64;
+
+        uint32_t received = 0;
+        uint32_t lost = 0;
+        uint32_t late = 0;      // out of order (older than WINDOW: lost stays)
+        uint32_t duplicate = 0; // already received
+
+        // @return number of packets missing before this one
+        uint16_t update(uint16_t seq);
+        void reset();
+
+    private:
+        bool started_ = false;
+        uint16_t expected_ = 0;
+        uint64_t missing_ = 0; // bit k: seq expected_ - 1 - k counted lost
+    };
+
+    // Interarrival jitter (RFC 3550 §6.4.1), in ms
+    struct JitterEstimator
+    {
+        void update(uint32_t media_ts, uint32_t sample_rate, uint32_t arrival_ms);
+        float jitterMs() const { return jitter_ms_; }
+        void reset();
+
+    private:
+        bool started_ = false;
+        int64_t prev_transit_us_ = 0;
+        float jitter_ms_ = 0.0f;
+    };
+
+    /**
+     * Frame reader for pieces of one WS binary message. A message larger
+     * than the WS client buffer arrives as several (payload_offset,
+     * payload_len) slices of the same frame; each is fed here in order.
+     *
+     * AUDIO payload is handed out slice by slice, pointing into the caller's
+     * buffer, so every piece goes straight into its ring. Other types are
+     * small and are collected in a fixed stash so the handler sees them
+     * whole. No heap, no reassembly buffer.
+     */
+    class FrameReader
+    {
+    public:
+        static constexpr size_t STASH_SIZE = 64; // largest non-AUDIO payload
+
+        enum class Status : uint8_t
+        {
+            MORE,       // message continues in the next piece
+            DONE,       // message complete, handler saw its last slice
+            NOT_FRAMED, // legacy headerless data: pass the piece through
+            INVALID,    // out-of-order piece, bad length, too large: dropped
+        };
+
+        // One payload slice; first / last mark the ends of the payload
+        using Handler = std::function<void(const Header &h, const uint8_t *slice, size_t len,
+                                           bool first, bool last)>;
+
+        /**
+         * @param offset position of data in the message (0 = new message)
+         * @param total  message length, header included; 0 = not known yet
+         *               (message sent in several WS frames): the header's
+         */
+        Status feed(const uint8_t *data, size_t len, size_t offset, size_t total,
+                    const Handler &on_payload);
+        void reset();
+
+    private:
+        enum class Mode : uint8_t
+        {
+            IDLE,
+            HEADER,  // collecting the 12 header bytes
+            PAYLOAD,
+            LEGACY,  // rest of a headerless message
+            DROP,    // rest of an invalid message
+        };
+
+        Mode mode_ = Mode::IDLE;
+        size_t pos_ = 0; // message bytes consumed
+        size_t total_ = 0;
+        bool sized_ = false; // total given by the caller, not the header
+        Header h_{};
+        uint8_t head_[HEADER_SIZE] = {};
+        uint8_t stash_[STASH_SIZE] = {};
+    };
+}
@@ -0,0 +1,101 @@
+# IMA ADPCM (reference) - mirror of lib/audio/AdpcmCodec, shared by
+# dummy_server.py and fleet_sim.py. State = (predictor, index), None = fresh.
+
+# =====================================================
+# IMA ADPCM TABLES (CHUẨN)
+# =====================================================
+
+STEP_TABLE = [
+     7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+]
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8,
+               -1, -1, -1, -1, 2, 4, 6, 8]
+
+# =====================================================
+# ADPCM ENCODE / DECODE (HIGH nibble trước)
+# =====================================================
+
+def adpcm_decode(adpcm, state):
+    predictor, index = state or (0, 0)
+    pcm = bytearray()
+
+    for b in adpcm:
+        for nibble in ((b >> 4) & 0x0F, b & 0x0F):
+            step = STEP_TABLE[index]
+            diff = step >> 3
+
+            if nibble & 1: diff += step >> 2
+            if nibble & 2: diff += step >> 1
+            if nibble & 4: diff += step
+            if nibble & 8: diff = -diff
+
+            predictor += diff
+            predictor = max(-32768, min(32767, predictor))
+
+            index += INDEX_TABLE[nibble]
+            index = max(0, min(88, index))
+
+            pcm += predictor.to_bytes(2, "little", signed=True)
+
+    return pcm, (predictor, index)
+
+
+def adpcm_encode(pcm, state):
+    predictor, index = state or (0, 0)
+    out = bytearray()
+    high = True
+    byte = 0
+
+    samples = [int.from_bytes(pcm[i:i+2], "little", signed=True)
+               for i in range(0, len(pcm), 2)]
+
+    for s in samples:
+        step = STEP_TABLE[index]
+        diff = s - predictor
+        code = 0
+
+        if diff < 0:
+            code |= 8
+            diff = -diff
+
+        if diff >= step:
+            code |= 4
+            diff -= step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+        if diff >= step >> 2:
+            code |= 1
+
+        delta = step >> 3
+        if code & 1: delta += step >> 2
+        if code & 2: delta += step >> 1
+        if code & 4: delta += step
+        if code & 8: delta = -delta
+
+        predictor += delta
+        predictor = max(-32768, min(32767, predictor))
+
+        index += INDEX_TABLE[code]
+        index = max(0, min(88, index))
+
+        if high:
+            byte = (code & 0x0F) << 4
+            high = False
+        else:
+            out.append(byte | (code & 0x0F))
+            high = True
+
+    if not high:
+        out.append(byte)
+
+    return out, (predictor, index)
@@ -0,0 +1,429 @@
+"""
+Adaptive uplink bitrate: replay bandwidth traces through a model of the
+device uplink and compare fixed 16 kHz ADPCM with BitrateController.
+
+Model (1 ms steps, deterministic), mirrors the firmware:
+  codec task   one 256-sample frame per 16 ms, encoded with the profile in
+               force; a profile change is a SpanRing mark at a frame boundary
+  mic ring     32 KB (MIC_ENCODED_BYTES), full ring drops the frame
+  uplink       40 ms packets, 60 ms flush deadline, a packet never crosses a
+               mark (runUplinkTurn); one controller sample per packet
+  socket       lwIP send buffer (5744 B) drained by the trace bandwidth; a
+               send blocks until the whole packet fits
+  link         + one-way delay; a probe PING every 500 ms queues behind the
+               send buffer, its PONG RTT feeds the controller on arrival;
+               RSSI sampled every 10 s (telemetry)
+
+Latency of a packet = delivered at the server - capture of its first byte.
+
+Traces: built-in (--trace name) or a CSV file of "t_s,kbps[,rssi_dbm]" rows,
+linear between rows. Per-packet wire overhead: 12 proto + 8 WS + 40 TCP/IP.
+
+  python bitrate_sim.py                      # every built-in trace
+  python bitrate_sim.py --trace step --opus  # with the Opus profile enabled
+  python bitrate_sim.py --trace mytrace.csv --dump samples.txt
+
+The built-in traces also run on the C++ controller, with the latency bound
+and the profile decisions checked: test/host/test_bitrate_controller.cpp.
+Keep the two models in step.
+"""
+
+import argparse
+
+import wire_protocol as wp
+
+# =====================================================
+# DEVICE CONSTANTS (mirror of AudioManager / NetworkManager / DeviceProfile)
+# =====================================================
+
+SAMPLE_RATE = 16000
+FRAME_MS = 16                 # codec task: 256 samples
+PACKET_MS = 40                # uplink_packet_ms
+MAX_DELAY_MS = 60             # uplink_max_delay_ms
+RING_BYTES = 32 * 1024 - 20   # MIC_ENCODED_BYTES - UPLINK_HEADROOM
+SND_BUF = 5744                # CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+WIRE_OVERHEAD = wp.HEADER_SIZE + 8 + 40
+PROBE_MS = 500                # bitrate_probe_ms while the uplink streams
+RSSI_PERIOD_MS = 10000        # telemetry_interval_ms
+
+# BitrateController::PROFILES: (name, codec, payload bits per second)
+PROFILES = [
+    ("adpcm-16k", wp.CODEC_ADPCM_IMA, 64000),
+    ("adpcm-8k", wp.CODEC_ADPCM_IMA_HALF, 32000),
+    ("opus-16k", wp.CODEC_OPUS, 16000),
+]
+
+
+def frame_bytes(profile):
+    return PROFILES[profile][2] * FRAME_MS // 8000
+
+
+def bytes_per_ms(profile):
+    return PROFILES[profile][2] / 8000.0
+
+
+def packet_bytes(profile):
+    return int(PACKET_MS * bytes_per_ms(profile))
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    v = sorted(values)
+    k = (len(v) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(v) - 1)
+    return v[lo] + (v[hi] - v[lo]) * (k - lo)
+
+
+def tdiv(a, b):
+    """C++ integer division (truncates toward zero)."""
+    q = abs(a) // b
+    return q if a >= 0 else -q
+
+# =====================================================
+# CONTROLLER (mirror of lib/network/BitrateController.cpp)
+# =====================================================
+
+class Config:
+    target_ms = 200
+    queue_high_ms = 80
+    queue_low_ms = 20
+    depth_high_ms = 160
+    depth_low_ms = 50
+    send_slow_ms = 30
+    down_hold_ms = 200
+    settle_ms = 600
+    up_hold_ms = 4000
+    up_hold_max_ms = 60000
+    probe_ms = 3000
+    rssi_low_dbm = -80
+    rssi_up_dbm = -72
+    opus = False
+
+
+class BitrateController:
+    def __init__(self, cfg):
+        self.cfg = cfg
+        self.enabled = True
+        self.index = 0
+        self.switches = 0
+        self.rtt_ms = 0
+        self.rtt_min_ms = 0
+        self.rssi_dbm = 0
+        self.up_hold_ms = cfg.up_hold_ms
+        self.reset()
+
+    def lowest(self):
+        return len(PROFILES) - 1 if self.cfg.opus else 1
+
+    def reset(self):
+        self.have_age = False
+        self.age_q4 = 0
+        self.latency_ms = 0
+        self.bad = self.good = self.settling = self.probing = False
+        self.bad_since = self.good_since = self.settle_since = self.probe_since = 0
+
+    def set_rtt(self, rtt_ms):
+        self.rtt_ms = rtt_ms
+        if rtt_ms == 0 or self.rtt_min_ms == 0 or rtt_ms < self.rtt_min_ms:
+            self.rtt_min_ms = rtt_ms
+
+    def switch_to(self, index, now):
+        self.index = index
+        self.switches += 1
+        self.bad = self.good = False
+        self.settling = True
+        self.settle_since = now
+
+    def on_packet(self, now, age_ms, depth_ms, send_ms):
+        c = self.cfg
+        if not self.enabled:
+            return False
+
+        age_q4 = age_ms * 16
+        if not self.have_age:
+            self.age_q4 = age_q4
+            self.have_age = True
+        else:
+            self.age_q4 += tdiv(age_q4 - self.age_q4, 4)
+        self.latency_ms = self.age_q4 // 16 + self.rtt_ms // 2
+        queue_ms = self.rtt_ms - self.rtt_min_ms
+
+        weak = self.rssi_dbm != 0 and self.rssi_dbm < c.rssi_low_dbm
+        if weak and self.index == 0:
+            self.switch_to(1, now)
+            return True
+
+        if self.probing and now - self.probe_since >= c.probe_ms:
+            self.probing = False
+            self.up_hold_ms = c.up_hold_ms
+
+        if self.settling:
+            if now - self.settle_since < c.settle_ms:
+                return False
+            self.settling = False
+
+        bad = (self.latency_ms > c.target_ms or queue_ms > c.queue_high_ms or
+               depth_ms > c.depth_high_ms or send_ms > c.send_slow_ms)
+        good = (not bad and queue_ms < c.queue_low_ms and depth_ms < c.depth_low_ms and
+                (self.rssi_dbm == 0 or self.rssi_dbm >= c.rssi_up_dbm))
+
+        if bad:
+            self.good = False
+            if not self.bad:
+                self.bad = True
+                self.bad_since = now
+            if now - self.bad_since < c.down_hold_ms or self.index >= self.lowest():
+                return False
+            if self.probing:
+                self.probing = False
+                self.up_hold_ms = min(self.up_hold_ms * 2, c.up_hold_max_ms)
+            self.switch_to(self.index + 1, now)
+            return True
+
+        self.bad = False
+        if not good:
+            self.good = False
+            return False
+        if not self.good:
+            self.good = True
+            self.good_since = now
+        if now - self.good_since < self.up_hold_ms or self.index == 0:
+            return False
+
+        self.switch_to(self.index - 1, now)
+        self.probing = True
+        self.probe_since = now
+        return True
+
+# =====================================================
+# TRACES: [(t_s, kbps, rssi_dbm)], linear in between
+# =====================================================
+
+TRACES = {
+    # Good Wi-Fi: must never leave the best profile
+    "steady": [(0, 400, -55), (60, 400, -55)],
+    # Congestion step below 16 kHz ADPCM and back
+    "step": [(0, 300, -60), (10, 300, -60), (10.1, 55, -60), (40, 55, -60),
+             (40.1, 300, -60), (60, 300, -60)],
+    # Walking away from the AP and back
+    "fade": [(0, 250, -55), (30, 40, -82), (60, 250, -55)],
+    # Contention flapping around the 16 kHz wire rate
+    "flap": [(t, 110 if (t // 5) % 2 == 0 else 50, -65) for t in range(0, 61, 5)],
+    # Capacity under even 8 kHz ADPCM: only Opus keeps up (--opus)
+    "cliff": [(0, 300, -60), (10, 300, -60), (10.1, 35, -60), (40, 35, -60),
+              (40.1, 300, -60), (60, 300, -60)],
+}
+
+
+def load_trace(arg):
+    if arg in TRACES:
+        return TRACES[arg]
+    rows = []
+    with open(arg) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            v = [float(x) for x in line.split(",")]
+            rows.append((v[0], v[1], v[2] if len(v) > 2 else 0))
+    return rows
+
+
+def sample(trace, t_s):
+    if t_s <= trace[0][0]:
+        return trace[0][1], trace[0][2]
+    for (t0, k0, r0), (t1, k1, r1) in zip(trace, trace[1:]):
+        if t_s <= t1:
+            f = (t_s - t0) / (t1 - t0) if t1 > t0 else 1.0
+            return k0 + (k1 - k0) * f, r0 + (r1 - r0) * f
+    return trace[-1][1], trace[-1][2]
+
+# =====================================================
+# DEVICE + LINK MODEL
+# =====================================================
+
+class Result:
+    def __init__(self, name):
+        self.name = name
+        self.latency = []          # per delivered packet, ms
+        self.time_in = [0] * len(PROFILES)
+        self.dropped_frames = 0
+        self.switches = 0
+
+
+def simulate(trace, cfg, adaptive, delay_ms, dump=None):
+    duration_ms = int(trace[-1][0] * 1000)
+    ctl = BitrateController(cfg)
+    ctl.enabled = adaptive
+    res = Result("adaptive" if adaptive else "fixed")
+
+    ring = []            # [tag, bytes left, capture ms] per frame (tail first)
+    ring_bytes = 0
+    marks = []           # pending format change: ring byte position (1 in flight)
+    written = consumed = 0
+    applied = 0          # codec task format
+    read_tag = 0         # format at the ring tail
+
+    pending_since = None  # oldest pending byte (uplink "oldest")
+    blocked = None        # (packet, since) while a send waits for room
+    snd = []              # [wire bytes left, capture ms, payload] in the socket
+    snd_bytes = 0
+    credit = 0.0          # fractional link bytes
+
+    pongs = []            # (arrival ms, rtt)
+    rssi = 0
+
+    def tag_bytes_per_ms():
+        return bytes_per_ms(read_tag)
+
+    for t in range(duration_ms):
+        kbps, trace_rssi = sample(trace, t / 1000.0)
+        cap = kbps / 8.0  # bytes per ms
+
+        # ---- probe: PING behind the queued audio, RTT on PONG ------------
+        if t % PROBE_MS == 0:
+            rtt = 2 * delay_ms + int(snd_bytes / max(cap, 0.001))
+            pongs.append((t + rtt, rtt))
+        while pongs and pongs[0][0] <= t:
+            ctl.set_rtt(pongs.pop(0)[1])
+        if t % RSSI_PERIOD_MS == 0:
+            rssi = int(round(trace_rssi))
+            ctl.rssi_dbm = rssi
+
+        # ---- codec task: one frame per 16 ms -----------------------------
+        if t % FRAME_MS == 0:
+            want = ctl.index
+            if want != applied and not marks:
+                marks.append((written, want))
+                applied = want
+            n = frame_bytes(applied)
+            if ring_bytes + n > RING_BYTES:
+                res.dropped_frames += 1
+            else:
+                ring.append([applied, n, t])
+                ring_bytes += n
+                written += n
+            res.time_in[applied] += FRAME_MS
+
+        # ---- link: drain the socket buffer -------------------------------
+        credit += cap
+        while snd and credit >= 1:
+            take = min(snd[0][0], int(credit))
+            snd[0][0] -= take
+            snd_bytes -= take
+            credit -= take
+            if snd[0][0] == 0:
+                res.latency.append(t + delay_ms - snd[0][1])
+                snd.pop(0)
+        if not snd:
+            credit = min(credit, cap)  # idle link: no saved-up burst
+
+        # ---- uplink worker -----------------------------------------------
+        if blocked:
+            pkt, since = blocked
+            if SND_BUF - snd_bytes < pkt[0]:
+                continue
+            snd.append(pkt)
+            snd_bytes += pkt[0]
+            blocked = None
+            after_send(ctl, res, t, t - since, pkt[1], ring_bytes, tag_bytes_per_ms(), dump)
+            if not ring_bytes:
+                pending_since = None
+            else:
+                pending_since = t
+
+        if ring_bytes and pending_since is None:
+            pending_since = t
+
+        while ring_bytes and blocked is None:
+            if marks and marks[0][0] == consumed:
+                read_tag = marks.pop(0)[1]
+            pb = packet_bytes(read_tag)
+            if ring_bytes < pb and t - pending_since < MAX_DELAY_MS:
+                break
+            # One span: up to a packet, never across the next mark
+            limit = pb
+            if marks:
+                limit = min(limit, marks[0][0] - consumed)
+            take, first_capture = 0, None
+            while ring and take < limit:
+                f = ring[0]
+                if first_capture is None:
+                    first_capture = f[2]
+                n = min(f[1], limit - take)
+                f[1] -= n
+                take += n
+                if f[1] == 0:
+                    ring.pop(0)
+            ring_bytes -= take
+            consumed += take
+            pkt = [take + WIRE_OVERHEAD, first_capture, take]
+            if SND_BUF - snd_bytes >= pkt[0]:
+                snd.append(pkt)
+                snd_bytes += pkt[0]
+                after_send(ctl, res, t, 0, pkt[1], ring_bytes, tag_bytes_per_ms(), dump)
+                pending_since = t if ring_bytes else None
+            else:
+                blocked = (pkt, t)
+
+    res.switches = ctl.switches
+    return res
+
+
+def after_send(ctl, res, now, send_ms, capture, ring_bytes, bpm, dump):
+    age = now - capture
+    depth = int(ring_bytes / bpm)
+    ctl.on_packet(now, age, depth, send_ms)
+    if dump:
+        dump.write(f"{now} {age} {depth} {send_ms} {ctl.rtt_ms} {ctl.rssi_dbm} {ctl.index}\n")
+
+# =====================================================
+# REPORT
+# =====================================================
+
+def report(trace_name, runs, target):
+    print(f"\n== {trace_name}")
+    print(f"  {'mode':9} {'p50':>6} {'p95':>6} {'p99':>6} {'max':>6} {'>tgt%':>6} {'drops':>6} {'sw':>4}  time per profile")
+    for r in runs:
+        lat = r.latency
+        over = 100.0 * sum(1 for v in lat if v > target) / max(len(lat), 1)
+        total = max(sum(r.time_in), 1)
+        share = " ".join(f"{PROFILES[i][0]} {100.0 * r.time_in[i] / total:.0f}%"
+                         for i in range(len(PROFILES)) if r.time_in[i])
+        print(f"  {r.name:9} {percentile(lat, 50):6.0f} {percentile(lat, 95):6.0f} "
+              f"{percentile(lat, 99):6.0f} {max(lat):6.0f} {over:6.1f} {r.dropped_frames:6d} "
+              f"{r.switches:4d}  {share}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Replay bandwidth traces through the adaptive uplink model")
+    ap.add_argument("--trace", nargs="+", default=list(TRACES),
+                    help="built-in name(s) or CSV file(s) of t_s,kbps[,rssi_dbm]")
+    ap.add_argument("--delay", type=int, default=20, help="one-way base delay, ms")
+    ap.add_argument("--target", type=int, default=Config.target_ms, help="controller target_ms")
+    ap.add_argument("--opus", action="store_true", help="enable the Opus profile")
+    ap.add_argument("--dump", help="write controller samples (now age depth send rtt rssi -> index)")
+    args = ap.parse_args()
+
+    cfg = Config()
+    cfg.target_ms = args.target
+    cfg.opus = args.opus
+    dump = open(args.dump, "w") if args.dump else None
+
+    # E2E adds the packet time and the link delay to the controller target
+    budget = args.target + PACKET_MS + args.delay
+    print(f"target {args.target} ms (controller), e2e budget {budget} ms, "
+          f"one-way delay {args.delay} ms, opus {'on' if args.opus else 'off'}")
+    for name in args.trace:
+        trace = load_trace(name)
+        runs = [simulate(trace, cfg, False, args.delay),
+                simulate(trace, cfg, True, args.delay, dump)]
+        report(name, runs, budget)
+    if dump:
+        dump.close()
+
+
+if __name__ == "__main__":
+    main()
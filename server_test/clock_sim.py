@@ -0,0 +1,259 @@
+"""
+Clock sync: replay PING / PONG exchanges with known clocks through a model
+of ClockSync and check the device's view of the server clock.
+
+Model (deterministic, seeded), mirrors the firmware:
+  device clock  u32 ms, the reference; the server clock runs skew_ppm
+                faster and starts at an arbitrary offset (wraps included)
+  pings         one every 2 s (ping_interval_ms with feature::CLOCK), one
+                every 500 ms while a turn streams uplink audio
+                (bitrate_probe_ms)
+  path          fixed one-way delays, up and down may differ, + jitter;
+                during a turn the uplink also queues behind the audio
+                (up to queue_ms, random per ping)
+  server        stamps t2 on receive, answers after 0-2 ms (t3)
+
+Checks, every second of device time after the first sample:
+  - |estimated - true server time| <= error bound + 1 ms (stamp resolution)
+  - uplink one-way of the turn's PINGs within the same bound of the truth
+  - skew within SKEW_TOLERANCE_PPM of the truth at the end
+An offset estimate cannot see a fixed path asymmetry (only half the
+difference shows), so the bound is what the device reports, not zero.
+
+  python clock_sim.py                  # every scenario, exit 1 on a failure
+  python clock_sim.py --scenario congested --dump samples.txt
+"""
+
+import argparse
+import random
+import sys
+
+MASK = 0xFFFFFFFF
+
+# ClockSync::Config defaults
+WINDOW = 16
+HISTORY = 16
+DELAY_SLACK_MS = 4
+HISTORY_STEP_MS = 15000
+SKEW_MIN_SPAN_MS = 60000
+MAX_SKEW_PPM = 500
+
+PING_MS = 2000     # ping_interval_ms
+PROBE_MS = 500     # bitrate_probe_ms
+
+
+def s32(v):
+    v &= MASK
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def tdiv(a, b):
+    """C++ integer division (truncates toward zero)"""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b >= 0) else -q
+
+
+def round_ms(us):
+    return tdiv(us + 500, 1000) if us >= 0 else -tdiv(-us + 500, 1000)
+
+
+class Mapping:
+    def __init__(self):
+        self.valid = False
+        self.base_ms = 0
+        self.offset_us = 0
+        self.ref_ms = 0
+        self.skew_ppm = 0
+        self.error_ms = 0
+
+    def offset_at(self, device_ms):
+        return self.offset_us + tdiv(self.skew_ppm * s32(device_ms - self.ref_ms), 1000)
+
+    def to_server(self, device_ms):
+        return (device_ms + self.base_ms + round_ms(self.offset_at(device_ms))) & MASK
+
+
+class ClockSync:
+    """Mirror of lib/network/ClockSync"""
+
+    def __init__(self):
+        self.map = Mapping()
+        self.ring = []  # oldest first, (mid_ms, offset_us, delay_ms)
+        self.hist = []  # same, one point per HISTORY_STEP_MS
+
+    def on_sample(self, t1, t2, t3, t4):
+        rtt = s32(t4 - t1)
+        hold = s32(t3 - t2)
+        if rtt < 0 or hold < 0 or hold > rtt:
+            return False
+        delay = rtt - hold
+        if not self.ring:
+            self.map.base_ms = (t2 - t1 - delay // 2) & MASK
+        twice = s32(t2 - t1 - self.map.base_ms) + s32(t3 - t4 - self.map.base_ms)
+        self.ring.append(((t1 + rtt // 2) & MASK, twice * 500, delay))
+        del self.ring[:-WINDOW]
+
+        best = None
+        for s in self.ring:
+            if best is None or s[2] <= best[2]:
+                best = s
+        if not self.hist or s32(best[0] - self.hist[-1][0]) >= HISTORY_STEP_MS:
+            self.hist.append(best)
+            del self.hist[:-HISTORY]
+            self.fit_skew()
+        elif best[2] < self.hist[-1][2]:
+            self.hist[-1] = best
+            self.fit_skew()
+
+        self.map.offset_us = best[1]
+        self.map.ref_ms = best[0]
+        self.map.error_ms = (best[2] + 1) // 2
+        self.map.valid = True
+        return True
+
+    def fit_skew(self):
+        ref = self.hist[-1]
+        limit = min(p[2] for p in self.hist) + DELAY_SLACK_MS
+        n = sx = sy = sxx = sxy = 0
+        x_min = x_max = 0
+        for mid, off, delay in self.hist:
+            if delay > limit:
+                continue
+            x = s32(mid - ref[0])
+            y = off - ref[1]
+            n += 1
+            sx += x
+            sy += y
+            sxx += x * x
+            sxy += x * y
+            x_min = min(x_min, x)
+            x_max = max(x_max, x)
+        den = n * sxx - sx * sx
+        if n < 3 or x_max - x_min < SKEW_MIN_SPAN_MS or den <= 0:
+            return
+        ppm = tdiv((n * sxy - sx * sy) * 1000, den)
+        self.map.skew_ppm = max(-MAX_SKEW_PPM, min(MAX_SKEW_PPM, ppm))
+
+    def uplink_ms(self, t1, t2):
+        return s32(t2 - self.map.to_server(t1))
+
+
+# =====================================================
+# SCENARIOS
+# =====================================================
+# up/down: fixed one-way ms, jitter: ± ms per direction,
+# queue: uplink queueing during turns (max ms), skew: server ppm
+SCENARIOS = {
+    "symmetric": dict(up=20, down=20, jitter=2, queue=0, skew=0),
+    "asymmetric": dict(up=45, down=5, jitter=2, queue=0, skew=0),
+    "congested": dict(up=15, down=15, jitter=3, queue=400, skew=30),
+    "skewed": dict(up=10, down=25, jitter=5, queue=150, skew=-200),
+    "wrap": dict(up=8, down=8, jitter=1, queue=80, skew=60, offset=MASK - 30000, start=MASK - 60000),
+}
+
+DURATION_MS = 300000
+SKEW_TOLERANCE_PPM = 25  # at the end of the run
+TURN_EVERY_MS = 20000   # a 6 s turn every 20 s
+TURN_MS = 6000
+
+
+class Result:
+    def __init__(self, name):
+        self.name = name
+        self.checks = 0
+        self.worst = 0.0      # |error| - bound, ms (> 1 fails)
+        self.max_err = 0
+        self.max_bound = 0
+        self.up_worst = 0.0
+        self.up_checks = 0
+        self.skew = 0
+
+    def ok(self, true_skew):
+        return (self.worst <= 1 and self.up_worst <= 1 and self.checks > 0 and
+                abs(self.skew - true_skew) <= SKEW_TOLERANCE_PPM)
+
+
+def simulate(name, sc, seed=1, dump=None):
+    rng = random.Random(seed)
+    start = sc.get("start", 1000)
+    offset = sc.get("offset", 123456789)
+    skew = sc["skew"]
+
+    def server_at(t):  # t: device ms, exact (float)
+        return (start + t) + offset + t * skew / 1e6
+
+    def in_turn(t):
+        return t % TURN_EVERY_MS >= TURN_EVERY_MS - TURN_MS
+
+    cs = ClockSync()
+    res = Result(name)
+    t = 0.0
+    next_ping = 0.0
+    next_check = 0.0
+    turn_up = []   # (estimated, true) uplink one-way of pings in the turn
+
+    while t < DURATION_MS:
+        step = PROBE_MS if in_turn(t) else PING_MS
+        if t >= next_ping:
+            up = sc["up"] + rng.uniform(-sc["jitter"], sc["jitter"])
+            if in_turn(t) and sc["queue"]:
+                up += rng.uniform(0, sc["queue"])
+            down = sc["down"] + rng.uniform(-sc["jitter"], sc["jitter"])
+            hold = rng.uniform(0, 2)
+            t1 = int(start + t) & MASK
+            t2 = int(server_at(t + up)) & MASK
+            t3 = int(server_at(t + up + hold)) & MASK
+            t4 = int(start + t + up + hold + down) & MASK
+            cs.on_sample(t1, t2, t3, t4)
+            if dump:
+                dump.write(f"{t1} {t2} {t3} {t4}\n")
+            if in_turn(t):
+                # true one-way: server receive - (device send in server time)
+                turn_up.append((cs.uplink_ms(t1, t2), s32(t2 - (int(server_at(t)) & MASK))))
+            next_ping = t + step
+
+        if cs.map.valid and t >= next_check:
+            dev = int(start + t) & MASK
+            err = abs(s32(cs.map.to_server(dev) - (int(server_at(t)) & MASK)))
+            res.checks += 1
+            res.max_err = max(res.max_err, err)
+            res.max_bound = max(res.max_bound, cs.map.error_ms)
+            res.worst = max(res.worst, err - cs.map.error_ms)
+            next_check = t + 1000
+
+        if not in_turn(t) and turn_up:
+            for est, true in turn_up:
+                res.up_checks += 1
+                res.up_worst = max(res.up_worst, abs(est - true) - cs.map.error_ms)
+            turn_up = []
+
+        t += 1.0
+
+    res.skew = cs.map.skew_ppm
+    return res
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("--scenario", choices=sorted(SCENARIOS), help="one scenario (default: all)")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--dump", help="write the t1 t2 t3 t4 samples of the scenario here")
+    args = ap.parse_args()
+
+    names = [args.scenario] if args.scenario else list(SCENARIOS)
+    failed = 0
+    print(f"{'scenario':<11} {'checks':>6} {'max err':>8} {'bound':>6} {'skew ppm':>14} {'uplink':>7}  result")
+    for name in names:
+        dump = open(args.dump, "w") if args.dump and args.scenario else None
+        r = simulate(name, SCENARIOS[name], args.seed, dump)
+        if dump:
+            dump.close()
+        ok = r.ok(SCENARIOS[name]["skew"])
+        failed += not ok
+        print(f"{name:<11} {r.checks:>6} {r.max_err:>6} ms {r.max_bound:>3} ms "
+              f"{r.skew:>6} / {SCENARIOS[name]['skew']:>5} {r.up_checks:>7}  {'ok' if ok else 'FAIL'}")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
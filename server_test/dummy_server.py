@@ -1,108 +1,15 @@
 import asyncio
+import json
+import time
 import wave
 import os
 from datetime import datetime
 from fastapi import FastAPI, WebSocket, WebSocketDisconnect
 import uvicorn
 
-# =====================================================
-# IMA ADPCM TABLES (CHUẨN)
-# =====================================================
-
-STEP_TABLE = [
-     7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
-    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
-    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
-    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
-    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
-    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
-    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
-    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
-    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
-]
-
-INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8,
-               -1, -1, -1, -1, 2, 4, 6, 8]
-
-# =====================================================
-# ADPCM ENCODE / DECODE (HIGH nibble trước)
-# =====================================================
-
-def adpcm_decode(adpcm, state):
-    predictor, index = state or (0, 0)
-    pcm = bytearray()
-
-    for b in adpcm:
-        for nibble in ((b >> 4) & 0x0F, b & 0x0F):
-            step = STEP_TABLE[index]
-            diff = step >> 3
-
-            if nibble & 1: diff += step >> 2
-            if nibble & 2: diff += step >> 1
-            if nibble & 4: diff += step
-            if nibble & 8: diff = -diff
-
-            predictor += diff
-            predictor = max(-32768, min(32767, predictor))
-
-            index += INDEX_TABLE[nibble]
-            index = max(0, min(88, index))
-
-            pcm += predictor.to_bytes(2, "little", signed=True)
-
-    return pcm, (predictor, index)
-
-
-def adpcm_encode(pcm, state):
-    predictor, index = state or (0, 0)
-    out = bytearray()
-    high = True
-    byte = 0
-
-    samples = [int.from_bytes(pcm[i:i+2], "little", signed=True)
-               for i in range(0, len(pcm), 2)]
-
-    for s in samples:
-        step = STEP_TABLE[index]
-        diff = s - predictor
-        code = 0
-
-        if diff < 0:
-            code |= 8
-            diff = -diff
-
-        if diff >= step:
-            code |= 4
-            diff -= step
-        if diff >= step >> 1:
-            code |= 2
-            diff -= step >> 1
-        if diff >= step >> 2:
-            code |= 1
-
-        delta = step >> 3
-        if code & 1: delta += step >> 2
-        if code & 2: delta += step >> 1
-        if code & 4: delta += step
-        if code & 8: delta = -delta
-
-        predictor += delta
-        predictor = max(-32768, min(32767, predictor))
-
-        index += INDEX_TABLE[code]
-        index = max(0, min(88, index))
-
-        if high:
-            byte = (code & 0x0F) << 4
-            high = False
-        else:
-            out.append(byte | (code & 0x0F))
-            high = True
-
-    if not high:
-        out.append(byte)
-
-    return out, (predictor, index)
+import wire_protocol as wp
+import udp_audio
+from adpcm import adpcm_decode, adpcm_encode
 
 # =====================================================
 # SERVER
@@ -110,59 +17,330 @@ def adpcm_encode(pcm, state):
 
 HOST = "0.0.0.0"
 PORT = 8000
+UDP_PORT = 8001  # audio datagrams for devices that identify with "udp": true
+# wss:// stand-in: TLS_CERT=cert.pem TLS_KEY=key.pem python dummy_server.py
+TLS_CERT = os.environ.get("TLS_CERT")
+TLS_KEY = os.environ.get("TLS_KEY")
 SAMPLE_RATE = 16000
 FRAME_ADPCM = 512
 SEND_INTERVAL = 0.06
 
+# Continuous conversation: CONTINUOUS=3 python dummy_server.py → after the
+# button turn, 3 follow-up turns the device opens by itself (SPEAK_END with
+# SPEAK_END_LISTEN). No VAD here: a follow-up turn ends after FOLLOW_UP_S.
+CONTINUOUS = int(os.environ.get("CONTINUOUS", "0"))
+FOLLOW_UP_S = 3.0
+
 RECORD_DIR = "recordings"
 REPLY_WAV = "chẳng-phải-tình-đầu-sao-đau-đến-thế.wav"   # <-- BẠN ĐỔI FILE NÀY
 
 os.makedirs(RECORD_DIR, exist_ok=True)
 
+# Unfinished replies by session token → (wav path, next 1024-sample frame).
+# A device that reconnects with the same token gets the rest of its turn.
+TURNS = {}
+
 app = FastAPI()
+AUDIO_PORT = None  # udp_audio.AudioEndpoint, opened with the first device
+
+
+async def audio_port():
+    global AUDIO_PORT
+    if AUDIO_PORT is None:
+        AUDIO_PORT = await udp_audio.AudioEndpoint.create(HOST, UDP_PORT)
+        log("📦", f"UDP audio on :{UDP_PORT}")
+    return AUDIO_PORT
+
+def now_ms():
+    """Server clock of the header timestamps (u32 ms)"""
+    return int(time.monotonic() * 1000) & 0xFFFFFFFF
+
+
+def s32(v):
+    v &= 0xFFFFFFFF
+    return v - (1 << 32) if v & 0x80000000 else v
+
 
 def log(tag, msg):
     print(f"[{datetime.now().strftime('%H:%M:%S.%f')[:-3]}] {tag} {msg}")
 
+class Session:
+    """Per-connection state. framed=True once the device advertised proto >= 1."""
+
+    def __init__(self, ws):
+        self.ws = ws
+        self.framed = False
+        self.closed = False
+        self.token = None
+        self.tx_ctrl_seq = 0
+        self.tx_audio_seq = 0
+        self.rx_seq = wp.SeqTracker()
+        # Downlink credits: None = device sends none → pace in real time
+        self.credit_limit = None
+        self.tx_audio_bytes = 0
+        self.credit_event = asyncio.Event()
+        # UDP audio: udp_audio.Peer once offered, audio moves when active
+        self.udp = None
+        # Reply being streamed (asyncio.Task), cancelled on barge-in
+        self.reply = None
+        # Turn timing (server ms): uplink frames as (ts, rx), LISTEN_END
+        # receive, SPEAK_START send; checked against the device's report
+        self.up_rx = []
+        self.up_ts0 = None
+        self.listen_end_ms = None
+        self.speak_start_ms = None
+        # Continuous conversation: follow-ups left, SPEAK_END [LISTEN] send
+        # time (None = next LISTEN_START is a button turn), turn end timer
+        self.follow_ups = 0
+        self.speak_end_ms = None
+        self.turn_timer = None
+
+    def on_credit(self, limit):
+        self.credit_limit = limit
+        self.credit_event.set()
+
+    async def wait_credit(self):
+        """Block until the device grants room; return it (0 = socket closed)."""
+        while not self.closed:
+            room = wp.credit_room(self.credit_limit, self.tx_audio_bytes)
+            if room > 0:
+                return room
+            self.credit_event.clear()
+            try:
+                await asyncio.wait_for(self.credit_event.wait(), 1.0)
+            except asyncio.TimeoutError:
+                pass
+        return 0
+
+    async def control(self, code, legacy_text, args=b""):
+        if self.framed:
+            frame = wp.pack_control(code, args, seq=self.tx_ctrl_seq,
+                                    ts_ms=now_ms())
+            self.tx_ctrl_seq += 1
+            await self.ws.send_bytes(frame)
+        else:
+            await self.ws.send_text(legacy_text)
+
+    async def audio(self, payload, ts, flags=0):
+        if self.framed:
+            seq = self.tx_audio_seq
+            self.tx_audio_seq += 1
+            self.tx_audio_bytes = (self.tx_audio_bytes + len(payload)) & 0xFFFFFFFF
+            if self.udp and self.udp.active:
+                self.udp.send_audio(payload, seq, ts, flags)  # datagram: no HOL wait
+                return
+            frame = wp.pack(wp.AUDIO, payload, seq=seq, ts=ts,
+                            flags=flags, codec=wp.CODEC_ADPCM_IMA)
+            await self.ws.send_bytes(frame)
+        elif payload:
+            await self.ws.send_bytes(payload)
+
+
 @app.websocket("/ws")
 async def ws(ws: WebSocket):
     await ws.accept()
     log("📡", "ESP connected")
 
+    sess = Session(ws)
     rx_state = None
+    rx_codec = None
     pcm_buf = []
     recording = False
 
+    def on_start():
+        nonlocal rx_state, rx_codec, recording
+        pcm_buf.clear()
+        rx_state = None
+        rx_codec = None
+        recording = True
+        sess.rx_seq.reset()
+        sess.up_rx.clear()
+        sess.up_ts0 = None
+        log("🎙️", "Record START")
+        if sess.speak_end_ms is None:
+            sess.follow_ups = CONTINUOUS  # button turn: a new conversation
+            return
+        log("🔁", f"Follow-up turn {s32(now_ms() - sess.speak_end_ms)} ms after SPEAK_END "
+                 f"(answer tail included), {sess.follow_ups} left")
+        sess.speak_end_ms = None
+        sess.turn_timer = asyncio.create_task(end_follow_up(sess))
+
+    def on_end():
+        nonlocal recording
+        recording = False
+        if sess.turn_timer:
+            sess.turn_timer.cancel()
+            sess.turn_timer = None
+        if sess.framed:
+            log("📊", f"Uplink: {sess.rx_seq.received} pkts, "
+                      f"{sess.rx_seq.lost} lost, {sess.rx_seq.late} late, {sess.rx_seq.duplicate} dup")
+        path = save_wav(pcm_buf)
+        log("💾", f"Saved {path}")
+        sess.reply = asyncio.create_task(send_wav(sess, REPLY_WAV))
+
+    def on_audio(adpcm, codec=wp.CODEC_ADPCM_IMA):
+        nonlocal rx_state
+        if recording:
+            pcm, rx_state = adpcm_decode(adpcm, rx_state)
+            if codec == wp.CODEC_ADPCM_IMA_HALF:
+                pcm = upsample2(pcm)  # 8 kHz profile → stream rate
+            pcm_buf.append(pcm)
+
+    # Framed uplink audio, from the WS or from the UDP port
+    def on_framed_audio(flags, codec, seq, ts, payload):
+        if flags & wp.FLAG_START:
+            sess.up_ts0 = ts
+        if payload:
+            sess.up_rx.append((ts, now_ms()))
+        gap = sess.rx_seq.update(seq)
+        if gap:
+            log("⚠️", f"Uplink lost {gap} pkt(s) before seq {seq}")
+        nonlocal rx_codec
+        if codec != rx_codec and payload:
+            if rx_codec is not None:
+                log("🎚️", f"Uplink codec {wp.CODEC_NAMES.get(rx_codec, rx_codec)} → "
+                          f"{wp.CODEC_NAMES.get(codec, codec)} at ts={ts}")
+            rx_codec = codec
+        log("⬆️ RX", f"seq={seq} ts={ts} {len(payload)} bytes"
+                     f"{' EOS' if flags & wp.FLAG_EOS else ''}")
+        on_audio(payload, codec)
+
     try:
         while True:
             data = await ws.receive()
-
-            if "bytes" in data:
-                adpcm = data["bytes"]
-                log("⬆️ RX", f"{len(adpcm)} bytes")
-
-                if recording:
-                    pcm, rx_state = adpcm_decode(adpcm, rx_state)
-                    pcm_buf.append(pcm)
-
-            elif "text" in data:
+            rx_ms = now_ms()  # PONG t2, one-way of server-time stamps
+
+            if data.get("type") == "websocket.disconnect":
+                raise WebSocketDisconnect()
+
+            if data.get("bytes") is not None:
+                frame = data["bytes"]
+                parsed = wp.parse(frame) if sess.framed else None
+
+                if parsed is None:
+                    # Legacy headerless ADPCM
+                    log("⬆️ RX", f"{len(frame)} bytes")
+                    on_audio(frame)
+                    continue
+
+                msg_type, flags, codec, seq, ts, payload = parsed
+                if msg_type == wp.AUDIO:
+                    on_framed_audio(flags, codec, seq, ts, payload)
+                elif msg_type == wp.CONTROL and payload:
+                    code = payload[0]
+                    if code == wp.PING:
+                        await sess.control(wp.PONG, "", payload[1:9] + rx_ms.to_bytes(4, "little") +
+                                           now_ms().to_bytes(4, "little"))
+                        continue
+                    if code == wp.CREDIT and len(payload) >= 5:
+                        sess.on_credit(int.from_bytes(payload[1:5], "little"))
+                        continue
+                    if code == wp.CANCEL and len(payload) >= 5:
+                        await cancel_reply(sess, payload[1:5])
+                        continue
+                    if code == wp.UDP_BIND and len(payload) >= 5 and sess.udp:
+                        token = int.from_bytes(payload[1:5], "little")
+                        sess.udp.active = token == sess.udp.token and sess.udp.addr is not None
+                        log("📦", f"Audio over {'UDP ' + str(sess.udp.addr) if sess.udp.active else 'WS'}")
+                        continue
+                    up = f" (up {s32(rx_ms - ts)} ms)" if flags & wp.FLAG_SERVER_TIME else ""
+                    log("📩 RX", wp.CONTROL_NAMES.get(code, hex(code)) + up)
+                    if code == wp.LISTEN_START:
+                        on_start()
+                    elif code == wp.LISTEN_END:
+                        sess.listen_end_ms = rx_ms
+                        on_end()
+
+            elif data.get("text") is not None:
                 msg = data["text"]
+                info = {}
+                if msg.startswith("{"):
+                    try:
+                        info = json.loads(msg)
+                    except ValueError:
+                        pass
+
+                if info.get("type") == "telemetry":
+                    log("📶", f"rtt {info.get('srtt_ms')}±{info.get('rttvar_ms')} ms, "
+                             f"jitter {info.get('jitter_us', 0) / 1000:.1f} ms, "
+                             f"upq {info.get('upq_ms')}/{info.get('upq_max_ms')} ms, "
+                             f"rssi {info.get('rssi')} dBm, "
+                             f"rx {info.get('rx_bps')} tx {info.get('tx_bps')} bps, "
+                             f"ctrl {info.get('ctrl_max_us', 0) / 1000:.1f} ms ({info.get('ctrl_drops', 0)} drops), "
+                             f"udp {'on' if info.get('udp') else 'off'} "
+                             f"({info.get('udp_rep', 0)} repaired, {info.get('udp_lost', 0)} lost), "
+                             f"uplink profile {info.get('prof', 0)}")
+                    continue
+
+                if info.get("type") == "turn":
+                    log_turn(sess, info)
+                    continue
+
                 log("📩 RX", msg)
 
-                if msg == "START":
-                    pcm_buf.clear()
-                    rx_state = None
-                    recording = True
-                    log("🎙️", "Record START")
+                if msg.startswith("{"):
+                    if info.get("type") == "identify" and int(info.get("proto", 0)) >= wp.VERSION:
+                        sess.framed = True
+                        udp = bool(info.get("udp"))
+                        features = (wp.FEATURE_CREDIT | wp.FEATURE_PING | wp.FEATURE_CODEC_SWITCH |
+                                    wp.FEATURE_CANCEL | wp.FEATURE_CLOCK | (wp.FEATURE_UDP if udp else 0))
+                        await sess.control(wp.HELLO, "", bytes([wp.VERSION, features]))
+                        log("🤝", f"Framed protocol v{wp.VERSION}")
+                        if udp:
+                            if sess.udp:
+                                AUDIO_PORT.release(sess.udp)
+                            sess.udp = (await audio_port()).offer(on_framed_audio)
+                            await sess.control(wp.UDP_OFFER, "", UDP_PORT.to_bytes(2, "little") +
+                                               sess.udp.token.to_bytes(4, "little"))
+                    if info.get("type") == "identify":
+                        sess.token = info.get("session")
+                        turn = TURNS.get(sess.token)
+                        if turn:
+                            log("♻️", f"Resume session {sess.token} at frame {turn[1]}")
+                            sess.reply = asyncio.create_task(send_wav(sess, turn[0], turn[1]))
+
+                elif msg == "START":
+                    on_start()
 
                 elif msg == "END":
-                    recording = False
-                    path = save_wav(pcm_buf)
-                    log("💾", f"Saved {path}")
-                    asyncio.create_task(send_wav(ws, REPLY_WAV))
+                    on_end()
 
     except WebSocketDisconnect:
         log("🔌", "Disconnected")
+    finally:
+        sess.closed = True
+        sess.credit_event.set()
+        if sess.turn_timer:
+            sess.turn_timer.cancel()
+        if sess.udp:
+            AUDIO_PORT.release(sess.udp)
+
+def log_turn(sess, info):
+    """Device's split of the turn, next to what the server measured itself"""
+    log("⏱️", f"Turn {info.get('total_ms')} ms = up {info.get('up_ms')} + server {info.get('srv_ms')} "
+             f"+ down {info.get('down_ms')} ms (±{info.get('err_ms')}, skew {info.get('skew_ppm')} ppm)")
+    if sess.listen_end_ms is not None and sess.speak_start_ms is not None:
+        log("⏱️", f"  server measured LISTEN_END → SPEAK_START {s32(sess.speak_start_ms - sess.listen_end_ms)} ms")
+    t0 = info.get("t0") or 0
+    if t0 and sess.up_ts0 is not None and sess.up_rx:
+        # mic (encoder output) → server, per uplink frame, device stamp t0
+        lat = [s32(rx - (t0 + (ts - sess.up_ts0) * 1000 // SAMPLE_RATE)) for ts, rx in sess.up_rx]
+        log("⏱️", f"  uplink audio one-way {sum(lat) // len(lat)} ms mean, {max(lat)} max "
+                 f"over {len(lat)} frames")
+
+
+def upsample2(pcm):
+    """2x linear interpolation, 16-bit LE mono (no state across frames: the
+    half-sample at a frame edge repeats the last sample)"""
+    n = len(pcm) // 2
+    src = [int.from_bytes(pcm[2 * i:2 * i + 2], "little", signed=True) for i in range(n)]
+    out = bytearray()
+    for i, x in enumerate(src):
+        nxt = src[i + 1] if i + 1 < n else x
+        out += x.to_bytes(2, "little", signed=True)
+        out += ((x + nxt) // 2).to_bytes(2, "little", signed=True)
+    return out
+
 
 def save_wav(chunks):
     path = os.path.join(RECORD_DIR, f"rec_{datetime.now().strftime('%H%M%S')}.wav")
@@ -173,32 +351,104 @@ def save_wav(chunks):
         wf.writeframes(b"".join(chunks))    
     return path
 
-async def send_wav(ws, path):
-    await ws.send_text("PROCESSING_START")
-    await ws.send_text("01")
-    await ws.send_text("SPEAK_START")
+async def cancel_reply(sess, args):
+    """Barge-in: stop the reply, tell the device where the cut answer ends"""
+    played = int.from_bytes(args[0:2], "little")
+    fence = int.from_bytes(args[2:4], "little")
+    task, sess.reply = sess.reply, None
+    if task and not task.done():
+        task.cancel()
+        try:
+            await task
+        except asyncio.CancelledError:
+            pass
+    TURNS.pop(sess.token, None)  # an interrupted answer is not resumed
+    last = (sess.tx_audio_seq - 1) & 0xFFFF
+    await sess.control(wp.CANCELLED, "", last.to_bytes(2, "little"))
+    log("✋", f"Barge-in: heard up to seq {played}, fence {fence}, last sent {last}")
+
+
+async def end_follow_up(sess):
+    """Stand-in for VAD: the user stopped talking, close the follow-up turn"""
+    await asyncio.sleep(FOLLOW_UP_S)
+    sess.turn_timer = None
+    log("🤫", "Follow-up turn over")
+    await sess.control(wp.PROCESSING, "PROCESSING_START")
+
+
+async def send_wav(sess, path, start_frame=0):
+    try:
+        await stream_wav(sess, path, start_frame)
+    except Exception as e:  # socket gone mid-send; progress stays in TURNS
+        log("✂️", f"Reply interrupted: {e!r}")
+
+
+async def stream_wav(sess, path, start_frame):
+    await sess.control(wp.PROCESSING, "PROCESSING_START")
+    await sess.control(wp.EMOTION, "01", b"01")
+    await sess.control(wp.SPEAK_START, "SPEAK_START")
+    sess.speak_start_ms = now_ms()
 
     tx_state = None
+    ts = 0
+    flags = wp.FLAG_START
+    frame_no = start_frame
+    t0 = time.monotonic()
     with wave.open(path, "rb") as wf:
+        wf.setpos(min(start_frame * 1024, wf.getnframes()))
         while True:
+            if sess.closed:
+                return  # TURNS giữ vị trí để resume
+            if sess.token:
+                TURNS[sess.token] = (path, frame_no)
+
             # Đọc 1024 mẫu (tương đương 2048 bytes PCM)
             # 1024 mẫu nén ADPCM (4-bit) sẽ ra ĐÚNG 512 bytes
-            pcm = wf.readframes(1024) 
+            pcm = wf.readframes(1024)
             if not pcm:
                 break
+            frame_no += 1
 
             adpcm, tx_state = adpcm_encode(pcm, tx_state)
-            
-            # XÓA DÒNG NÀY: adpcm = adpcm.ljust(FRAME_ADPCM, b'\x00')
-            # Gửi trực tiếp adpcm (lúc này đã đủ 512 bytes)
-            await ws.send_bytes(adpcm)
-            
-            # Quan trọng: 1024 mẫu ở 16kHz chiếm 64ms thời gian thực
-            await asyncio.sleep(0.064) 
 
-    await ws.send_text("TTS_END")
-    log("🏁", "Playback done")
+            if sess.credit_limit is None:
+                # XÓA DÒNG NÀY: adpcm = adpcm.ljust(FRAME_ADPCM, b'\x00')
+                # Gửi trực tiếp adpcm (lúc này đã đủ 512 bytes)
+                await sess.audio(adpcm, ts, flags)
+                ts += len(pcm) // 2
+                flags = 0
+
+                # Quan trọng: 1024 mẫu ở 16kHz chiếm 64ms thời gian thực.
+                # Pace against the media clock: sleep() overshoot must not add up
+                await asyncio.sleep(max(0.0, t0 + ts / SAMPLE_RATE - time.monotonic()))
+                continue
+
+            # Credit mode: nhanh hơn real time, chỉ chờ khi device hết chỗ.
+            # Chia gói theo room (ADPCM decode từng byte → cắt ở đâu cũng được)
+            off = 0
+            while off < len(adpcm):
+                room = await sess.wait_credit()
+                if room == 0:
+                    return  # socket closed
+                chunk = adpcm[off:off + room]
+                await sess.audio(chunk, ts, flags)
+                ts += wp.samples_for_bytes(wp.CODEC_ADPCM_IMA, len(chunk))
+                flags = 0
+                off += len(chunk)
+
+    await sess.audio(b"", ts, wp.FLAG_EOS)
+    listen = sess.framed and sess.follow_ups > 0
+    await sess.control(wp.SPEAK_END, "TTS_END", bytes([wp.SPEAK_END_LISTEN]) if listen else b"")
+    TURNS.pop(sess.token, None)
+    if listen:
+        sess.follow_ups -= 1
+        sess.speak_end_ms = now_ms()
+    log("🏁", "Playback done" + (", device listens again" if listen else ""))
 
 if __name__ == "__main__":
-    log("🚀", f"Server ws://{HOST}:{PORT}/ws")
-    uvicorn.run(app, host=HOST, port=PORT)
+    if TLS_CERT:
+        log("🚀", f"Server wss://{HOST}:{PORT}/ws")
+        uvicorn.run(app, host=HOST, port=PORT, ssl_certfile=TLS_CERT, ssl_keyfile=TLS_KEY)
+    else:
+        log("🚀", f"Server ws://{HOST}:{PORT}/ws")
+        uvicorn.run(app, host=HOST, port=PORT)
@@ -0,0 +1,474 @@
+"""
+Fleet simulator: N thiết bị ảo nói chuyện với server cùng lúc (load test).
+
+Each simulated device follows the firmware's network protocol:
+  identify JSON -> HELLO -> framed uplink (40 ms ADPCM packets, START/EOS),
+  LISTEN_START / LISTEN_END around a push-to-talk turn, downlink credits
+  against a simulated playout buffer, app-level PING, reconnect with
+  exponential backoff + equal jitter, session token reused across
+  reconnects. Servers without HELLO get the legacy text/raw-ADPCM protocol.
+
+Turns replay slices of WAV files (16 kHz mono 16-bit) with push-to-talk
+timing: think time, reaction delay after the press, release delay after
+speech ends.
+
+Report: per-device and fleet turn latency percentiles (LISTEN_END -> first
+downlink audio), failed turns, downlink loss / playout underruns, reconnects.
+
+Fallback only: the reference is the fleet_sim target in test/host, which
+runs the firmware's own NetworkManager / WebSocketClient / AdpcmCodec. Use
+this script where there is no C++ toolchain; protocol changes land there
+first.
+
+  pip install websockets
+  python fleet_sim.py --url ws://127.0.0.1:8000/ws --devices 200 --turns 5
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import time
+import wave
+
+import websockets
+
+import wire_protocol as wp
+from adpcm import adpcm_encode
+
+# =====================================================
+# DEVICE CONSTANTS (mirror of NetworkManager::Config / DeviceProfile)
+# =====================================================
+
+SAMPLE_RATE = 16000
+BYTES_PER_MS = SAMPLE_RATE // 2 // 1000     # ADPCM 4 bit: 8 bytes/ms
+PACKET_MS = 40                              # uplink_packet_ms
+WINDOW_MS = 200                             # downlink_window_ms (playout 160 + 40)
+SPK_ENCODED_BYTES = 16 * 1024               # sb_spk_encoded
+CREDIT_INTERVAL_MS = 40
+CREDIT_MIN_STEP = 20 * BYTES_PER_MS         # grow by >= 20 ms of audio
+RECONNECT_MIN_MS = 250
+RECONNECT_MAX_MS = 30000
+CONNECT_TIMEOUT_S = 5.0
+HELLO_TIMEOUT_S = 1.0
+PING_INTERVAL_MS = 2000
+LIVENESS_TIMEOUT_MS = 6000
+
+
+def now_ms():
+    return time.monotonic() * 1000.0
+
+
+def log(tag, msg):
+    print(f"[{time.strftime('%H:%M:%S')}] {tag} {msg}", flush=True)
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    v = sorted(values)
+    k = (len(v) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(v) - 1)
+    return v[lo] + (v[hi] - v[lo]) * (k - lo)
+
+
+def fmt_ms(v):
+    return "   -" if v is None else f"{v:4.0f}"
+
+# =====================================================
+# UTTERANCES (encode once, shared by every device)
+# =====================================================
+
+class Utterances:
+    def __init__(self, paths, min_s, max_s):
+        self.clips = []
+        for path in paths:
+            with wave.open(path, "rb") as wf:
+                if (wf.getnchannels(), wf.getsampwidth(), wf.getframerate()) != (1, 2, SAMPLE_RATE):
+                    raise SystemExit(f"{path}: need 16 kHz mono 16-bit PCM")
+                pcm = wf.readframes(wf.getnframes())
+            adpcm, _ = adpcm_encode(pcm, None)
+            self.clips.append(bytes(adpcm))
+        self.silence = bytes(adpcm_encode(b"\x00\x00" * SAMPLE_RATE, None)[0])
+        self.min_bytes = int(min_s * 1000 * BYTES_PER_MS)
+        self.max_bytes = int(max_s * 1000 * BYTES_PER_MS)
+
+    def pick(self, rng):
+        """Random slice of a random clip (ADPCM cut anywhere is fine for load)."""
+        clip = rng.choice(self.clips)
+        n = min(len(clip), rng.randint(self.min_bytes, self.max_bytes))
+        start = rng.randint(0, len(clip) - n)
+        return clip[start:start + n]
+
+    def quiet(self, ms):
+        n = int(ms * BYTES_PER_MS)
+        reps = n // len(self.silence) + 1
+        return (self.silence * reps)[:n]
+
+# =====================================================
+# DEVICE
+# =====================================================
+
+class DeviceStats:
+    def __init__(self):
+        self.latencies = []     # LISTEN_END -> first downlink audio (ms)
+        self.turns_ok = 0
+        self.turns_failed = 0   # no reply within turn timeout / link lost
+        self.lost = 0           # downlink packets missing (seq gaps)
+        self.underruns = 0      # playout buffer ran dry mid-reply
+        self.reconnects = 0
+        self.connect_failures = 0
+
+
+class Device:
+    def __init__(self, idx, args, utterances):
+        self.idx = idx
+        self.args = args
+        self.utt = utterances
+        self.rng = random.Random(args.seed * 100003 + idx)
+        self.device_id = f"51{idx:010X}"
+        self.token = f"{self.rng.getrandbits(64):016X}"
+        self.stats = DeviceStats()
+        self.attempt = 0
+        self.done = 0           # turns finished (ok or failed), across links
+
+    # --------------------------------------------------------------
+    # Connection lifecycle
+    # --------------------------------------------------------------
+    def next_backoff_ms(self):
+        cap = min(RECONNECT_MIN_MS << min(self.attempt, 16), RECONNECT_MAX_MS)
+        self.attempt = min(self.attempt + 1, 16)
+        return cap / 2 + self.rng.uniform(0, cap / 2)
+
+    async def run(self, turns, deadline):
+        await asyncio.sleep(self.rng.uniform(0, self.args.ramp))
+        first = True
+        while self.done < turns and time.monotonic() < deadline:
+            if not first:
+                await asyncio.sleep(self.next_backoff_ms() / 1000.0)
+            first = False
+            try:
+                ws = await asyncio.wait_for(
+                    websockets.connect(self.args.url, max_size=None, ping_interval=None,
+                                       open_timeout=None, close_timeout=1),
+                    CONNECT_TIMEOUT_S)
+            except (OSError, asyncio.TimeoutError, websockets.WebSocketException):
+                self.stats.connect_failures += 1
+                continue
+
+            opened = now_ms()
+            try:
+                await Link(self, ws).run(turns, deadline)
+            except (websockets.WebSocketException, OSError):
+                pass
+            finally:
+                await ws.close()
+            if self.done < turns and time.monotonic() < deadline:
+                self.stats.reconnects += 1  # link lost with work left
+            if now_ms() - opened >= LIVENESS_TIMEOUT_MS:
+                self.attempt = 0  # link was healthy: start the backoff over
+
+
+class Link:
+    """One WebSocket connection of a device (state resets like ws OPEN)."""
+
+    def __init__(self, dev, ws):
+        self.dev = dev
+        self.ws = ws
+        self.framed = False
+        self.app_ping = False
+        self.credit = False
+        self.hello = asyncio.Event()
+        self.tx_ctrl_seq = 0
+        self.tx_audio_seq = 0
+        self.tx_ts = 0
+        self.rx_seq = wp.SeqTracker()
+        self.last_rx = now_ms()
+        self.last_ping = now_ms()
+        self.ping_nonce = 0
+        # Playout model: encoded bytes drain at real time once playing
+        self.rx_audio_bytes = 0
+        self.queued = 0.0
+        self.drain_at = now_ms()
+        self.playing = False
+        self.credit_limit = 0
+        self.credit_granted = False
+        # Current turn
+        self.turn_end_ms = None
+        self.first_audio = asyncio.Event()
+        self.reply_done = asyncio.Event()
+        self.closed = False
+
+    # --------------------------------------------------------------
+    # Send helpers
+    # --------------------------------------------------------------
+    async def control(self, code, legacy_text, args=b""):
+        if self.framed:
+            frame = wp.pack_control(code, args, seq=self.tx_ctrl_seq, ts_ms=int(now_ms()))
+            self.tx_ctrl_seq += 1
+            await self.ws.send(frame)
+        elif legacy_text:
+            await self.ws.send(legacy_text)
+
+    async def audio(self, payload, flags):
+        if self.framed:
+            frame = wp.pack(wp.AUDIO, payload, seq=self.tx_audio_seq, ts=self.tx_ts,
+                            flags=flags, codec=wp.CODEC_ADPCM_IMA)
+            self.tx_audio_seq += 1
+            self.tx_ts += len(payload) * 2
+            await self.ws.send(frame)
+        elif payload:
+            await self.ws.send(payload)
+
+    # --------------------------------------------------------------
+    # Playout + credits (NetworkManager::serviceCredits)
+    # --------------------------------------------------------------
+    def drain(self):
+        t = now_ms()
+        if self.playing:
+            self.queued -= (t - self.drain_at) * BYTES_PER_MS
+            if self.queued <= 0:
+                self.queued = 0.0
+                if not self.reply_done.is_set():
+                    self.dev.stats.underruns += 1
+                self.playing = False
+        self.drain_at = t
+
+    async def service_credits(self):
+        self.drain()
+        queued_ms = self.queued / BYTES_PER_MS
+        room_ms = max(0.0, WINDOW_MS - queued_ms)
+        room = min(int(room_ms * BYTES_PER_MS), SPK_ENCODED_BYTES - int(self.queued))
+        limit = (self.rx_audio_bytes + room) & 0xFFFFFFFF
+        advance = (limit - self.credit_limit) & 0xFFFFFFFF
+        if self.credit_granted and (advance >= 0x80000000 or advance < CREDIT_MIN_STEP):
+            return
+        await self.control(wp.CREDIT, None, limit.to_bytes(4, "little"))
+        self.credit_limit = limit
+        self.credit_granted = True
+
+    # --------------------------------------------------------------
+    # Receive
+    # --------------------------------------------------------------
+    def on_downlink_audio(self, payload):
+        self.rx_audio_bytes = (self.rx_audio_bytes + len(payload)) & 0xFFFFFFFF
+        if not payload:
+            return
+        self.drain()
+        self.queued += len(payload)
+        # Device starts playing at the playout target (160 ms) or at EOS
+        if not self.playing and self.queued >= (WINDOW_MS - 40) * BYTES_PER_MS:
+            self.playing = True
+            self.drain_at = now_ms()
+        if self.turn_end_ms is not None and not self.first_audio.is_set():
+            self.dev.stats.latencies.append(now_ms() - self.turn_end_ms)
+            self.first_audio.set()
+
+    def on_control(self, code, args):
+        if code == wp.HELLO:
+            self.framed = True
+            features = args[1] if len(args) > 1 else 0
+            self.app_ping = bool(features & wp.FEATURE_PING)
+            self.credit = bool(features & wp.FEATURE_CREDIT)
+            self.hello.set()
+        elif code == wp.SPEAK_END or code == wp.IDLE:
+            self.reply_done.set()
+            self.playing = self.queued > 0  # flush what is left
+
+    async def receiver(self):
+        try:
+            async for msg in self.ws:
+                self.last_rx = now_ms()
+                if isinstance(msg, str):
+                    if msg in ("TTS_END", "SPEAK_END", "IDLE", "DONE"):
+                        self.reply_done.set()
+                    continue
+                parsed = wp.parse(msg)  # magic + exact length: HELLO arrives before framed
+                if parsed is None:
+                    self.on_downlink_audio(msg)  # legacy raw ADPCM
+                    continue
+                msg_type, flags, codec, seq, ts, payload = parsed
+                if msg_type == wp.AUDIO:
+                    if flags & wp.FLAG_START:
+                        self.rx_seq.reset()
+                    self.dev.stats.lost += self.rx_seq.update(seq)
+                    self.on_downlink_audio(payload)
+                elif msg_type == wp.CONTROL and payload:
+                    self.on_control(payload[0], payload[1:])
+        except websockets.WebSocketException:
+            pass
+        finally:
+            self.closed = True
+            self.first_audio.set()
+            self.reply_done.set()
+            self.hello.set()
+
+    async def housekeeping(self):
+        """Credits every 40 ms while audio is queued, PING / liveness."""
+        try:
+            await self._housekeeping()
+        except websockets.WebSocketException:
+            pass  # receiver sees the close too
+
+    async def _housekeeping(self):
+        while not self.closed:
+            await asyncio.sleep(CREDIT_INTERVAL_MS / 1000.0)
+            if self.credit:
+                await self.service_credits()
+            if not self.app_ping:
+                continue
+            t = now_ms()
+            silent = t - self.last_rx
+            if silent >= LIVENESS_TIMEOUT_MS:
+                await self.ws.close()  # dead peer → reconnect
+                return
+            if silent >= PING_INTERVAL_MS and t - self.last_ping >= PING_INTERVAL_MS:
+                self.ping_nonce += 1
+                args = self.ping_nonce.to_bytes(4, "little") + (int(t) & 0xFFFFFFFF).to_bytes(4, "little")
+                await self.control(wp.PING, None, args)
+                self.last_ping = t
+
+    # --------------------------------------------------------------
+    # Session
+    # --------------------------------------------------------------
+    async def run(self, turns, deadline):
+        rx = asyncio.create_task(self.receiver())
+        await self.ws.send(json.dumps({
+            "type": "identify", "device_id": self.dev.device_id, "version": "fleet-sim",
+            "session": self.dev.token, "proto": wp.VERSION}, separators=(",", ":")))
+        try:
+            await asyncio.wait_for(self.hello.wait(), HELLO_TIMEOUT_S)
+        except asyncio.TimeoutError:
+            pass  # legacy server
+        hk = asyncio.create_task(self.housekeeping())
+
+        try:
+            while self.dev.done < turns and not self.closed and time.monotonic() < deadline:
+                await asyncio.sleep(max(1.0, self.dev.rng.expovariate(1.0 / self.dev.args.think)))
+                if self.closed:
+                    break
+                try:
+                    ok = await self.turn()
+                except websockets.WebSocketException:
+                    ok = False
+                self.dev.done += 1
+                if ok:
+                    self.dev.stats.turns_ok += 1
+                else:
+                    self.dev.stats.turns_failed += 1
+        finally:
+            hk.cancel()
+            rx.cancel()
+
+    async def turn(self):
+        """Press, speak, release, wait for the reply to finish playing."""
+        rng = self.dev.rng
+        speech = self.dev.utt.pick(rng)
+        lead = self.dev.utt.quiet(rng.uniform(200, 500))    # reaction after press
+        tail = self.dev.utt.quiet(rng.uniform(150, 400))    # release after speech
+        mic = lead + speech + tail
+
+        self.first_audio = asyncio.Event()
+        self.reply_done = asyncio.Event()
+        self.turn_end_ms = None
+
+        await self.control(wp.LISTEN_START, "START")
+        packet = PACKET_MS * BYTES_PER_MS
+        t0 = now_ms()
+        flags = wp.FLAG_START
+        off = 0
+        # Real-time mic: a packet leaves once its 40 ms were "recorded"
+        while off + packet < len(mic):
+            due = t0 + (off + packet) / BYTES_PER_MS
+            await asyncio.sleep(max(0.0, (due - now_ms()) / 1000.0))
+            if self.closed:
+                return False
+            await self.audio(mic[off:off + packet], flags)
+            flags = 0
+            off += packet
+
+        # Release: LISTEN_END, then the tail with EOS (uplink task order)
+        await asyncio.sleep(max(0.0, (t0 + len(mic) / BYTES_PER_MS - now_ms()) / 1000.0))
+        await self.control(wp.LISTEN_END, "END")
+        await self.audio(mic[off:], flags | wp.FLAG_EOS)
+        self.turn_end_ms = now_ms()
+
+        timeout = self.dev.args.turn_timeout
+        try:
+            await asyncio.wait_for(self.first_audio.wait(), timeout)
+            await asyncio.wait_for(self.reply_done.wait(), timeout * 4)
+        except asyncio.TimeoutError:
+            return False
+        if self.closed:
+            return False  # link lost mid-turn (events were released by receiver)
+
+        # Let the playout buffer empty before the next press
+        self.drain()
+        await asyncio.sleep(self.queued / BYTES_PER_MS / 1000.0)
+        self.queued = 0.0
+        self.playing = False
+        return True
+
+# =====================================================
+# REPORT
+# =====================================================
+
+def report(devices, elapsed, per_device):
+    if per_device:
+        print(f"\n{'device':>12} {'ok':>4} {'fail':>4} {'p50':>5} {'p90':>5} {'p99':>5} "
+              f"{'lost':>5} {'under':>5} {'recon':>5} {'cfail':>5}")
+        for d in devices:
+            s = d.stats
+            print(f"{d.device_id:>12} {s.turns_ok:4d} {s.turns_failed:4d} "
+                  f"{fmt_ms(percentile(s.latencies, 50)):>5} {fmt_ms(percentile(s.latencies, 90)):>5} "
+                  f"{fmt_ms(percentile(s.latencies, 99)):>5} {s.lost:5d} {s.underruns:5d} "
+                  f"{s.reconnects:5d} {s.connect_failures:5d}")
+
+    lat = [x for d in devices for x in d.stats.latencies]
+    ok = sum(d.stats.turns_ok for d in devices)
+    failed = sum(d.stats.turns_failed for d in devices)
+    p95_dev = [percentile(d.stats.latencies, 95) for d in devices if d.stats.latencies]
+    print(f"\nFleet: {len(devices)} devices, {elapsed:.1f} s")
+    print(f"  turns      {ok} ok, {failed} failed")
+    print(f"  latency    p50 {fmt_ms(percentile(lat, 50))} ms  p90 {fmt_ms(percentile(lat, 90))} ms  "
+          f"p99 {fmt_ms(percentile(lat, 99))} ms  max {fmt_ms(max(lat) if lat else None)} ms")
+    print(f"  worst device p95 {fmt_ms(max(p95_dev) if p95_dev else None)} ms")
+    print(f"  downlink   {sum(d.stats.lost for d in devices)} pkts lost, "
+          f"{sum(d.stats.underruns for d in devices)} underruns")
+    print(f"  link       {sum(d.stats.reconnects for d in devices)} reconnects, "
+          f"{sum(d.stats.connect_failures for d in devices)} failed connects")
+
+
+async def main():
+    ap = argparse.ArgumentParser(description="Simulate a fleet of devices against the server")
+    ap.add_argument("--url", default="ws://127.0.0.1:8000/ws")
+    ap.add_argument("--devices", type=int, default=20)
+    ap.add_argument("--turns", type=int, default=3, help="turns per device")
+    ap.add_argument("--wav", nargs="+", default=["output_1762933136.wav"],
+                    help="16 kHz mono 16-bit utterance sources")
+    ap.add_argument("--utterance", type=float, nargs=2, default=[1.5, 4.0], metavar=("MIN", "MAX"),
+                    help="speech length range in seconds")
+    ap.add_argument("--think", type=float, default=6.0, help="mean seconds between turns")
+    ap.add_argument("--ramp", type=float, default=10.0, help="spread device start over N seconds")
+    ap.add_argument("--turn-timeout", type=float, default=20.0, help="seconds to first reply audio")
+    ap.add_argument("--duration", type=float, default=0, help="stop after N seconds (0 = no limit)")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--summary", action="store_true", help="fleet totals only")
+    args = ap.parse_args()
+
+    utt = Utterances(args.wav, *args.utterance)
+    devices = [Device(i, args, utt) for i in range(args.devices)]
+    deadline = time.monotonic() + (args.duration if args.duration > 0 else 1e9)
+
+    log("🚀", f"{args.devices} devices × {args.turns} turns → {args.url}")
+    t0 = time.monotonic()
+    await asyncio.gather(*(d.run(args.turns, deadline) for d in devices))
+    report(devices, time.monotonic() - t0, not args.summary)
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
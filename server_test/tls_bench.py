@@ -0,0 +1,169 @@
+"""
+TLS handshake: full so với resumed (session ticket / session ID), tới wss:// stand-in.
+
+Each connection is timed the way the device pays for it on a reconnect:
+TCP connect, TLS handshake, then the WebSocket upgrade. "full" offers no
+session; "resumed" offers the session of the previous connection (what
+TlsSessionCache keeps). The handshake runs over a memory BIO so the round
+trips and bytes on the wire are counted too.
+
+TLS 1.2 by default, like the mbedTLS 2.28 client on the device (ECDHE +
+certificate check on a full handshake, neither on a resumed one). Client
+CPU is host CPU: compare the ratio, not the absolute number.
+
+  openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256 -nodes -days 30 \\
+      -subj /CN=ptalk-lab -addext subjectAltName=IP:127.0.0.1 -keyout key.pem -out cert.pem
+  TLS_CERT=cert.pem TLS_KEY=key.pem python dummy_server.py
+  python tls_bench.py --url wss://127.0.0.1:8000/ws --ca cert.pem
+
+RTT: run it across the veth / netem recipe of transport_bench.py.
+"""
+
+import argparse
+import base64
+import os
+import socket
+import ssl
+import time
+from urllib.parse import urlparse
+
+from fleet_sim import log, percentile
+
+MODES = ("full", "resumed")
+RECV_SIZE = 16 * 1024
+
+
+class Sample:
+    def __init__(self):
+        self.tcp = 0.0
+        self.tls = 0.0
+        self.ws = 0.0
+        self.cpu = 0.0
+        self.rtts = 0
+        self.tx = 0
+        self.rx = 0
+        self.reused = False
+
+
+def handshake(sock, obj, out_bio, in_bio, s):
+    """Drive do_handshake over the memory BIOs; count waits for the server."""
+    while True:
+        try:
+            obj.do_handshake()
+            break
+        except ssl.SSLWantReadError:
+            pending = out_bio.read()
+            if pending:
+                sock.sendall(pending)
+                s.tx += len(pending)
+            data = sock.recv(RECV_SIZE)
+            if not data:
+                raise ConnectionError("closed during TLS handshake")
+            s.rtts += 1
+            s.rx += len(data)
+            in_bio.write(data)
+    pending = out_bio.read()  # client Finished when the server spoke last
+    if pending:
+        sock.sendall(pending)
+        s.tx += len(pending)
+
+
+def upgrade(sock, obj, out_bio, in_bio, host, path):
+    key = base64.b64encode(os.urandom(16)).decode()
+    obj.write((f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\n"
+               f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\n"
+               f"Sec-WebSocket-Version: 13\r\n\r\n").encode())
+    sock.sendall(out_bio.read())
+    reply = b""
+    while b"\r\n\r\n" not in reply:
+        try:
+            reply += obj.read(RECV_SIZE)
+        except ssl.SSLWantReadError:
+            data = sock.recv(RECV_SIZE)
+            if not data:
+                raise ConnectionError("closed during WS upgrade")
+            in_bio.write(data)
+    if not reply.startswith(b"HTTP/1.1 101"):
+        raise ConnectionError(reply.split(b"\r\n", 1)[0].decode(errors="replace"))
+
+
+def connect(args, ctx, session):
+    """One wss:// connection. (Sample, session to offer next time)."""
+    url = urlparse(args.url)
+    host, port = url.hostname, url.port or 443
+    s = Sample()
+
+    t0 = time.perf_counter()
+    sock = socket.create_connection((host, port), timeout=args.timeout)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    t1 = time.perf_counter()
+    try:
+        in_bio, out_bio = ssl.MemoryBIO(), ssl.MemoryBIO()
+        obj = ctx.wrap_bio(in_bio, out_bio, server_hostname=host, session=session)
+        cpu0 = time.process_time()
+        handshake(sock, obj, out_bio, in_bio, s)
+        s.cpu = (time.process_time() - cpu0) * 1000.0
+        t2 = time.perf_counter()
+        upgrade(sock, obj, out_bio, in_bio, url.netloc, url.path or "/")
+        t3 = time.perf_counter()
+        s.reused = obj.session_reused
+        next_session = obj.session  # TLS 1.3: ticket arrived with the upgrade reply
+    finally:
+        sock.close()
+
+    s.tcp = (t1 - t0) * 1000.0
+    s.tls = (t2 - t1) * 1000.0
+    s.ws = (t3 - t2) * 1000.0
+    return s, next_session
+
+
+def report(results):
+    def p(values, q):
+        v = percentile(values, q)
+        return "    -" if v is None else f"{v:5.1f}"
+
+    print(f"\n{'mode':>8} {'n':>3} {'reuse':>5} {'rtt':>3} {'tx':>5} {'rx':>5} "
+          f"{'cpu':>5} {'tls50':>5} {'tls95':>5} {'tot50':>5} {'tot95':>5}")
+    for mode, samples in results.items():
+        if not samples:
+            continue
+        tls = [s.tls for s in samples]
+        total = [s.tcp + s.tls + s.ws for s in samples]
+        print(f"{mode:>8} {len(samples):3d} {sum(s.reused for s in samples):5d} "
+              f"{max(s.rtts for s in samples):3d} {samples[-1].tx:5d} {samples[-1].rx:5d} "
+              f"{p([s.cpu for s in samples], 50)} {p(tls, 50)} {p(tls, 95)} "
+              f"{p(total, 50)} {p(total, 95)}")
+    print("\nms; rtt = handshake waits for the server; tx/rx = handshake bytes; "
+          "cpu = client CPU; tot = TCP + TLS + WS upgrade")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="wss:// reconnect cost: full vs resumed TLS handshake")
+    ap.add_argument("--url", default="wss://127.0.0.1:8000/ws")
+    ap.add_argument("--ca", required=True, help="server certificate / CA (PEM)")
+    ap.add_argument("--runs", type=int, default=20, help="connections per mode")
+    ap.add_argument("--tls13", action="store_true", help="allow TLS 1.3 (device: 1.2 only)")
+    ap.add_argument("--timeout", type=float, default=5.0)
+    args = ap.parse_args()
+
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.load_verify_locations(args.ca)
+    if not args.tls13:
+        ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    log("🔐", f"{args.runs} × {'/'.join(MODES)} → {args.url}")
+    results = {mode: [] for mode in MODES}
+    _, session = connect(args, ctx, None)  # warm-up, first session
+    for _ in range(args.runs):
+        s, _ = connect(args, ctx, None)
+        results["full"].append(s)
+        s, session = connect(args, ctx, session)
+        results["resumed"].append(s)
+    report(results)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,236 @@
+"""
+Transport A/B: audio qua WebSocket (TCP) so với UDP, dưới packet loss.
+
+One simulated device runs push-to-talk turns against the server once per
+transport mode and measures the downlink reply as the speaker would see it:
+
+  ws       audio frames on the WebSocket (a lost TCP segment holds back
+           every later frame until it is retransmitted)
+  udp      audio datagrams (udp_audio.py), WS for control only
+  udp-red  same, each datagram also carries the previous one
+
+The server paces the reply in real time (no credits are sent), so a frame's
+delay is measured against its media timestamp, relative to the fastest frame
+of the turn (no clock sync needed). A frame more than --budget ms behind is
+late: the playout buffer has already played past it. Uplink loss / repair
+shows in the server log.
+
+Loss is applied outside, e.g. netem on a veth pair (root):
+
+  ip netns add bench
+  ip link add vethA type veth peer name vethB netns bench
+  ip addr add 10.99.0.1/24 dev vethA && ip link set vethA up
+  ip netns exec bench ip addr add 10.99.0.2/24 dev vethB
+  ip netns exec bench ip link set vethB up
+  tc qdisc add dev vethA root netem delay 20ms loss 3%
+  ip netns exec bench tc qdisc add dev vethB root netem delay 20ms loss 3%
+
+  python dummy_server.py                                  # ws :8000, udp :8001
+  ip netns exec bench python transport_bench.py --url ws://10.99.0.1:8000/ws
+"""
+
+import argparse
+import asyncio
+import json
+import time
+from urllib.parse import urlparse
+
+import websockets
+
+import wire_protocol as wp
+import udp_audio
+from fleet_sim import BYTES_PER_MS, PACKET_MS, SAMPLE_RATE, fmt_ms, log, now_ms, percentile
+
+MODES = ("ws", "udp", "udp-red")
+HELLO_TIMEOUT_S = 2.0
+
+
+class ModeStats:
+    def __init__(self, mode):
+        self.mode = mode
+        self.turns = 0
+        self.failed = 0
+        self.frames = 0    # delivered to the "speaker", repaired ones included
+        self.repaired = 0
+        self.lost = 0      # never delivered (gaps, reordered datagrams)
+        self.late = 0      # delivered over the playout budget
+        self.delays = []  # ms behind the fastest frame of its turn
+
+
+class Run:
+    """One WebSocket connection in one transport mode."""
+
+    def __init__(self, args, ws, stats):
+        self.args = args
+        self.ws = ws
+        self.stats = stats
+        self.udp = None  # udp_audio.DeviceLink once bound
+        self.hello = asyncio.Event()
+        self.offer = asyncio.get_running_loop().create_future()
+        self.reply_done = asyncio.Event()
+        self.ws_seq = wp.SeqTracker()
+        self.arrivals = []  # (arrival ms, media ts) of this turn
+        self.tx_ctrl_seq = 0
+        self.tx_audio_seq = 0
+        self.tx_ts = 0
+
+    async def control(self, code, args=b""):
+        await self.ws.send(wp.pack_control(code, args, seq=self.tx_ctrl_seq, ts_ms=int(now_ms())))
+        self.tx_ctrl_seq += 1
+
+    async def audio(self, payload, flags):
+        seq = self.tx_audio_seq
+        self.tx_audio_seq += 1
+        if self.udp:
+            self.udp.send_audio(payload, seq, self.tx_ts, flags)
+        else:
+            await self.ws.send(wp.pack(wp.AUDIO, payload, seq=seq, ts=self.tx_ts,
+                                       flags=flags, codec=wp.CODEC_ADPCM_IMA))
+        self.tx_ts += len(payload) * 2
+
+    def on_audio(self, flags, codec, seq, ts, payload):
+        self.arrivals.append((now_ms(), ts))
+
+    async def receiver(self):
+        try:
+            async for msg in self.ws:
+                if isinstance(msg, str):
+                    continue
+                parsed = wp.parse(msg)
+                if parsed is None:
+                    continue
+                msg_type, flags, codec, seq, ts, payload = parsed
+                if msg_type == wp.AUDIO:
+                    self.ws_seq.update(seq)  # server seq runs on across turns
+                    self.on_audio(flags, codec, seq, ts, payload)
+                elif msg_type == wp.CONTROL and payload:
+                    code = payload[0]
+                    if code == wp.HELLO:
+                        self.hello.set()
+                    elif code == wp.UDP_OFFER and len(payload) >= 7 and not self.offer.done():
+                        self.offer.set_result((int.from_bytes(payload[1:3], "little"),
+                                               int.from_bytes(payload[3:7], "little")))
+                    elif code in (wp.SPEAK_END, wp.IDLE):
+                        self.reply_done.set()
+        except websockets.WebSocketException:
+            pass
+        finally:
+            self.reply_done.set()
+
+    async def setup(self, mode):
+        await self.ws.send(json.dumps({
+            "type": "identify", "device_id": f"BENCH-{mode}", "version": "transport-bench",
+            "session": f"{int(time.time() * 1000) & 0xFFFFFFFF:08X}", "proto": wp.VERSION,
+            "udp": mode != "ws"}, separators=(",", ":")))
+        await asyncio.wait_for(self.hello.wait(), HELLO_TIMEOUT_S)
+        if mode == "ws":
+            return True
+        port, token = await asyncio.wait_for(self.offer, HELLO_TIMEOUT_S)
+        host = urlparse(self.args.url).hostname
+        self.udp = await udp_audio.bind_device(host, port, token, self.on_audio,
+                                               redundancy=mode == "udp-red")
+        if self.udp is None:
+            return False
+        await self.control(wp.UDP_BIND, token.to_bytes(4, "little"))
+        return True
+
+    async def turn(self):
+        self.reply_done.clear()
+        self.arrivals = []
+        silence = bytes(PACKET_MS * BYTES_PER_MS)
+
+        await self.control(wp.LISTEN_START)
+        t0 = now_ms()
+        flags = wp.FLAG_START
+        packets = int(self.args.speech * 1000 / PACKET_MS)
+        for i in range(packets):
+            await asyncio.sleep(max(0.0, (t0 + (i + 1) * PACKET_MS - now_ms()) / 1000.0))
+            await self.audio(silence, flags)
+            flags = 0
+        await self.control(wp.LISTEN_END)
+        await self.audio(b"", wp.FLAG_EOS)
+
+        try:
+            await asyncio.wait_for(self.reply_done.wait(), self.args.turn_timeout)
+        except asyncio.TimeoutError:
+            self.stats.failed += 1
+            return
+        await asyncio.sleep(self.args.budget / 1000.0)  # UDP stragglers after SPEAK_END
+        if not self.arrivals:
+            self.stats.failed += 1
+            return
+
+        # Delay behind the fastest frame: arrival - media time, minus the minimum
+        offsets = [t - ts * 1000.0 / SAMPLE_RATE for t, ts in self.arrivals]
+        base = min(offsets)
+        delays = [o - base for o in offsets]
+        self.stats.delays += delays
+        self.stats.frames += len(delays)
+        self.stats.late += sum(1 for d in delays if d > self.args.budget)
+        self.stats.turns += 1
+
+    def close(self):
+        if self.udp:
+            rx = self.udp.rx
+            self.stats.lost += rx.lost + rx.late
+            self.stats.repaired += rx.recovered
+            self.udp.close()
+        else:
+            self.stats.lost += self.ws_seq.lost
+
+
+async def run_mode(args, mode):
+    stats = ModeStats(mode)
+    async with websockets.connect(args.url, max_size=None, ping_interval=None) as ws:
+        run = Run(args, ws, stats)
+        rx = asyncio.create_task(run.receiver())
+        try:
+            if not await run.setup(mode):
+                log("⚠️", f"{mode}: no UDP bind echo, skipped")
+                return stats
+            for _ in range(args.turns):
+                await run.turn()
+                await asyncio.sleep(args.pause)
+        finally:
+            run.close()
+            rx.cancel()
+    return stats
+
+
+def report(results, budget):
+    print(f"\n{'mode':>8} {'turns':>5} {'fail':>4} {'pkts':>5} {'rep':>4} {'lost':>4} "
+          f"{'late':>4} {'loss%':>6} {'p50':>5} {'p95':>5} {'p99':>5} {'max':>5}")
+    for s in results:
+        expected = s.frames + s.lost
+        pct = 100.0 * (s.lost + s.late) / expected if expected else 0.0
+        print(f"{s.mode:>8} {s.turns:5d} {s.failed:4d} {s.frames:5d} {s.repaired:4d} {s.lost:4d} "
+              f"{s.late:4d} {pct:6.2f} {fmt_ms(percentile(s.delays, 50)):>5} "
+              f"{fmt_ms(percentile(s.delays, 95)):>5} {fmt_ms(percentile(s.delays, 99)):>5} "
+              f"{fmt_ms(max(s.delays) if s.delays else None):>5}")
+    print(f"\ndelay = ms behind the fastest frame of the turn; late = over {budget} ms "
+          f"(played past); loss% = lost + late")
+
+
+async def main():
+    ap = argparse.ArgumentParser(description="Downlink audio latency / loss: WS vs UDP")
+    ap.add_argument("--url", default="ws://127.0.0.1:8000/ws")
+    ap.add_argument("--modes", nargs="+", choices=MODES, default=list(MODES))
+    ap.add_argument("--turns", type=int, default=5, help="turns per mode")
+    ap.add_argument("--speech", type=float, default=1.0, help="uplink seconds per turn")
+    ap.add_argument("--budget", type=float, default=160.0, help="playout budget in ms")
+    ap.add_argument("--pause", type=float, default=0.5, help="seconds between turns")
+    ap.add_argument("--turn-timeout", type=float, default=60.0)
+    args = ap.parse_args()
+
+    results = []
+    for mode in args.modes:
+        log("🚀", f"{mode}: {args.turns} turns → {args.url}")
+        results.append(await run_mode(args, mode))
+    report(results, args.budget)
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,239 @@
+# =====================================================
+# UDP AUDIO (reference) - mirror of lib/network/UdpAudioLink, shared by
+# dummy_server.py (server side) and transport_bench.py (device side).
+# =====================================================
+#
+# One wire_protocol frame per datagram. The WebSocket stays the control
+# channel; only AUDIO moves here. With FLAG_RED the payload also carries the
+# previous packet (RFC 2198 style), so any single loss is repaired:
+#
+#   payload = [red_len u16][red_flags u8][previous payload][payload]
+#   previous packet: seq - 1, ts - samples_for_bytes(red_len)
+#
+# Binding:
+#   server → WS   UDP_OFFER [port u16][token u32]
+#   device → UDP  UDP_BIND [token]   every 200 ms until echoed
+#   server → UDP  UDP_BIND [token]   echo (both directions pass)
+#   device → WS   UDP_BIND [token]   audio moves to UDP; token 0 = back to WS
+
+import asyncio
+import os
+import struct
+
+import wire_protocol as wp
+
+RED_HEADER = struct.Struct("<HB")
+MAX_DATAGRAM = 1472  # Ethernet MTU - IP - UDP
+BIND_INTERVAL_S = 0.2
+BIND_ATTEMPTS = 10
+
+
+def new_token():
+    return int.from_bytes(os.urandom(4), "little") or 1
+
+
+def pack_bind(token):
+    return wp.pack_control(wp.UDP_BIND, token.to_bytes(4, "little"))
+
+
+def parse_bind(dgram):
+    """Token of a UDP_BIND datagram, or None."""
+    parsed = wp.parse(dgram)
+    if parsed is None or parsed[0] != wp.CONTROL:
+        return None
+    payload = parsed[5]
+    if len(payload) < 5 or payload[0] != wp.UDP_BIND:
+        return None
+    return int.from_bytes(payload[1:5], "little")
+
+
+class RedSender:
+    """Audio datagrams; with redundancy each one carries the previous payload."""
+
+    def __init__(self, redundancy=True):
+        self.redundancy = redundancy
+        self._prev = None  # (flags, payload) of the last packet of this stream
+
+    def pack(self, payload, seq, ts, flags, codec=wp.CODEC_ADPCM_IMA):
+        if flags & wp.FLAG_START:
+            self._prev = None
+        prev = self._prev if self.redundancy else None
+        if prev and wp.HEADER_SIZE + RED_HEADER.size + len(prev[1]) + len(payload) <= MAX_DATAGRAM:
+            body = RED_HEADER.pack(len(prev[1]), prev[0]) + prev[1] + bytes(payload)
+            dgram = wp.pack(wp.AUDIO, body, seq=seq, ts=ts, flags=flags | wp.FLAG_RED, codec=codec)
+        else:
+            dgram = wp.pack(wp.AUDIO, payload, seq=seq, ts=ts, flags=flags & ~wp.FLAG_RED, codec=codec)
+        self._prev = None if flags & wp.FLAG_EOS else (flags & ~wp.FLAG_RED, bytes(payload))
+        return dgram
+
+
+class RedReceiver:
+    """Audio in seq order, single losses repaired, late packets dropped
+    (same rules as UdpAudioLink::handleDatagram)."""
+
+    def __init__(self):
+        self.received = 0
+        self.recovered = 0
+        self.lost = 0
+        self.late = 0
+        self.used_red = False  # last datagram carried redundancy
+        self._expected = None
+
+    def feed(self, dgram):
+        """Return [(flags, codec, seq, ts, payload), ...] to play in order."""
+        parsed = wp.parse(dgram)
+        if parsed is None or parsed[0] != wp.AUDIO:
+            return []
+        _, flags, codec, seq, ts, payload = parsed
+        self.received += 1
+        self.used_red = bool(flags & wp.FLAG_RED)
+        out = []
+        if flags & wp.FLAG_RED:
+            if len(payload) < RED_HEADER.size:
+                return []
+            red_len, red_flags = RED_HEADER.unpack_from(payload)
+            red_flags &= ~wp.FLAG_RED
+            if RED_HEADER.size + red_len > len(payload):
+                return []
+            red = payload[RED_HEADER.size:RED_HEADER.size + red_len]
+            prev = (seq - 1) & 0xFFFF
+            if self._expected is not None:
+                missing = prev == self._expected
+            else:
+                missing = bool(red_flags & wp.FLAG_START)
+            if missing:
+                self.recovered += 1
+                red_ts = (ts - wp.samples_for_bytes(codec, red_len)) & 0xFFFFFFFF
+                out += self._deliver(red_flags, codec, prev, red_ts, red)
+            flags &= ~wp.FLAG_RED
+            payload = payload[RED_HEADER.size + red_len:]
+        return out + self._deliver(flags, codec, seq, ts, payload)
+
+    def _deliver(self, flags, codec, seq, ts, payload):
+        if flags & wp.FLAG_START:
+            self._expected = None
+        if self._expected is not None:
+            delta = (seq - self._expected) & 0xFFFF
+            if delta >= 0x8000:
+                self.late += 1  # the stream already moved past it
+                return []
+            self.lost += delta
+        self._expected = (seq + 1) & 0xFFFF
+        return [(flags, codec, seq, ts, payload)]
+
+
+# =====================================================
+# SERVER SIDE
+# =====================================================
+
+class Peer:
+    """One device bound (or being bound) to the server's audio port."""
+
+    def __init__(self, endpoint, token, on_audio):
+        self.endpoint = endpoint
+        self.token = token
+        self.on_audio = on_audio  # (flags, codec, seq, ts, payload)
+        self.addr = None          # learned from the bind probe
+        self.active = False       # device confirmed on the WS: send audio here
+        self.tx = RedSender()
+        self.rx = RedReceiver()
+
+    def send_audio(self, payload, seq, ts, flags, codec=wp.CODEC_ADPCM_IMA):
+        # Downlink redundancy mirrors what the device sends us
+        self.tx.redundancy = self.rx.used_red or self.rx.received == 0
+        self.endpoint.transport.sendto(self.tx.pack(payload, seq, ts, flags, codec), self.addr)
+
+
+class AudioEndpoint(asyncio.DatagramProtocol):
+    """Server audio port: binds devices by token, routes their datagrams."""
+
+    def __init__(self):
+        self.transport = None
+        self.by_token = {}
+        self.by_addr = {}
+
+    @classmethod
+    async def create(cls, host, port):
+        loop = asyncio.get_running_loop()
+        _, endpoint = await loop.create_datagram_endpoint(cls, local_addr=(host, port))
+        return endpoint
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def offer(self, on_audio):
+        peer = Peer(self, new_token(), on_audio)
+        self.by_token[peer.token] = peer
+        return peer
+
+    def release(self, peer):
+        self.by_token.pop(peer.token, None)
+        if peer.addr is not None and self.by_addr.get(peer.addr) is peer:
+            del self.by_addr[peer.addr]
+
+    def datagram_received(self, data, addr):
+        token = parse_bind(data)
+        if token is not None:
+            peer = self.by_token.get(token)
+            if peer is None:
+                return
+            if peer.addr is not None and peer.addr != addr:
+                self.by_addr.pop(peer.addr, None)  # device moved (NAT rebinding)
+            peer.addr = addr
+            self.by_addr[addr] = peer
+            self.transport.sendto(pack_bind(token), addr)
+            return
+        peer = self.by_addr.get(addr)
+        if peer is not None:
+            for item in peer.rx.feed(data):
+                peer.on_audio(*item)
+
+
+# =====================================================
+# DEVICE SIDE
+# =====================================================
+
+class DeviceLink(asyncio.DatagramProtocol):
+    """Device end of the audio port (what UdpAudioLink does on the ESP32)."""
+
+    def __init__(self, token, on_audio, redundancy):
+        self.token = token
+        self.on_audio = on_audio
+        self.transport = None
+        self.bound = asyncio.Event()
+        self.tx = RedSender(redundancy)
+        self.rx = RedReceiver()
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if not self.bound.is_set():
+            if parse_bind(data) == self.token:
+                self.bound.set()
+            return
+        for item in self.rx.feed(data):
+            self.on_audio(*item)
+
+    def send_audio(self, payload, seq, ts, flags, codec=wp.CODEC_ADPCM_IMA):
+        self.transport.sendto(self.tx.pack(payload, seq, ts, flags, codec))
+
+    def close(self):
+        if self.transport:
+            self.transport.close()
+
+
+async def bind_device(host, port, token, on_audio, redundancy=True):
+    """Probe until the server echoes the token. DeviceLink, or None (stay on WS)."""
+    loop = asyncio.get_running_loop()
+    _, link = await loop.create_datagram_endpoint(
+        lambda: DeviceLink(token, on_audio, redundancy), remote_addr=(host, port))
+    for _ in range(BIND_ATTEMPTS):
+        link.transport.sendto(pack_bind(token))
+        try:
+            await asyncio.wait_for(link.bound.wait(), BIND_INTERVAL_S)
+            return link
+        except asyncio.TimeoutError:
+            pass
+    link.close()
+    return None
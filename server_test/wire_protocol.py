@@ -0,0 +1,176 @@
+# =====================================================
+# WIRE PROTOCOL (reference) - mirror of lib/network/WireProtocol.hpp
+# =====================================================
+#
+# Header 12 bytes, little-endian:
+#   magic/version u8 | type u8 | flags u8 | codec u8 | seq u16 | len u16 | ts u32
+#
+# AUDIO ts = index of first sample (stream clock: ADPCM_IMA_HALF counts 2
+# per coded sample), other types = sender ms.
+# CONTROL payload = [code][args...]
+#
+# Flow control (FEATURE_CREDIT in HELLO args[1]): the device sends CREDIT
+# [limit u32 LE], a byte limit on AUDIO payload bytes cumulative over the
+# connection. Send only while total sent < limit (mod 2^32).
+#
+# Uplink codec switch (FEATURE_CODEC_SWITCH): the device may change codec
+# between any two AUDIO frames; decode each frame by its own codec byte,
+# ADPCM state carries across (see bitrate_sim.py for the controller).
+#
+# Barge-in (FEATURE_CANCEL): the device sends CANCEL [played seq u16]
+# [fence seq u16]. Stop the answer, then reply CANCELLED [last AUDIO seq
+# sent u16]; the device drops AUDIO up to that seq.
+#
+# Clock sync (FEATURE_CLOCK): answer PING with PONG [PING args][receive ms
+# u32][send ms u32], same clock as the header timestamps. CONTROL frames
+# with FLAG_SERVER_TIME carry the device's estimate of that clock: receive
+# ms - timestamp is the uplink one-way delay (see clock_sim.py).
+#
+# Continuous conversation: SPEAK_END [SPEAK_END_LISTEN] makes the device
+# open the next turn (LISTEN_START) by itself once the answer has played.
+# Without the flag, or after IDLE, it waits for the button again.
+#
+# Audio over UDP (FEATURE_UDP): one frame per datagram, same header. Binding
+# and the redundancy format are in udp_audio.py.
+
+import struct
+
+VERSION = 1
+MAGIC = 0xA0 | VERSION
+HEADER = struct.Struct("<BBBBHHI")
+HEADER_SIZE = HEADER.size  # 12
+
+# MsgType
+AUDIO = 0x01
+CONTROL = 0x02
+
+# Codec
+CODEC_NONE = 0
+CODEC_PCM16 = 1
+CODEC_ADPCM_IMA = 2
+CODEC_OPUS = 3
+CODEC_ADPCM_IMA_HALF = 4  # ADPCM at half the stream rate (8 kHz in a 16 kHz stream)
+
+# Flags
+FLAG_START = 1 << 0
+FLAG_EOS = 1 << 1
+FLAG_RED = 1 << 2  # UDP: payload also carries the previous packet
+FLAG_SERVER_TIME = 1 << 3  # device CONTROL: timestamp in server clock
+
+# Features (HELLO args[1])
+FEATURE_CREDIT = 1 << 0
+FEATURE_PING = 1 << 1
+FEATURE_UDP = 1 << 2
+FEATURE_CODEC_SWITCH = 1 << 3  # decodes any uplink codec, per frame
+FEATURE_CANCEL = 1 << 4  # stops an answer on CANCEL
+FEATURE_CLOCK = 1 << 5  # PONG adds server receive / send ms
+
+# SPEAK_END args[0] (optional)
+SPEAK_END_LISTEN = 1 << 0  # listen again once the answer has played
+
+# Control codes
+LISTEN_START = 0x01
+LISTEN_END = 0x02
+CREDIT = 0x03
+PING = 0x04
+UDP_BIND = 0x05
+CANCEL = 0x06
+HELLO = 0x10
+PROCESSING = 0x11
+SPEAK_START = 0x12
+SPEAK_END = 0x13
+IDLE = 0x14
+LISTEN = 0x15
+EMOTION = 0x16
+PONG = 0x17
+UDP_OFFER = 0x18
+CANCELLED = 0x19
+
+CONTROL_NAMES = {
+    LISTEN_START: "LISTEN_START", LISTEN_END: "LISTEN_END", CREDIT: "CREDIT", HELLO: "HELLO",
+    PROCESSING: "PROCESSING", SPEAK_START: "SPEAK_START", SPEAK_END: "SPEAK_END",
+    IDLE: "IDLE", LISTEN: "LISTEN", EMOTION: "EMOTION", PING: "PING", PONG: "PONG",
+    UDP_BIND: "UDP_BIND", UDP_OFFER: "UDP_OFFER", CANCEL: "CANCEL", CANCELLED: "CANCELLED",
+}
+
+CODEC_NAMES = {
+    CODEC_NONE: "none", CODEC_PCM16: "pcm16", CODEC_ADPCM_IMA: "adpcm-16k",
+    CODEC_OPUS: "opus", CODEC_ADPCM_IMA_HALF: "adpcm-8k",
+}
+
+
+def pack(msg_type, payload=b"", seq=0, ts=0, flags=0, codec=CODEC_NONE):
+    return HEADER.pack(MAGIC, msg_type, flags, codec, seq & 0xFFFF,
+                       len(payload), ts & 0xFFFFFFFF) + bytes(payload)
+
+
+def pack_control(code, args=b"", seq=0, ts_ms=0):
+    return pack(CONTROL, bytes([code]) + bytes(args), seq=seq, ts=ts_ms)
+
+
+def parse(frame):
+    """Return (type, flags, codec, seq, ts, payload) or None (legacy / invalid)."""
+    if len(frame) < HEADER_SIZE or frame[0] != MAGIC:
+        return None
+    magic, msg_type, flags, codec, seq, length, ts = HEADER.unpack_from(frame)
+    if HEADER_SIZE + length != len(frame):
+        return None
+    return msg_type, flags, codec, seq, ts, bytes(frame[HEADER_SIZE:])
+
+
+def credit_room(limit, sent):
+    """Bytes the server may still send under a CREDIT limit (wrap-aware)."""
+    room = (limit - sent) & 0xFFFFFFFF
+    return 0 if room >= 0x80000000 else room
+
+
+def samples_for_bytes(codec, n):
+    if codec == CODEC_PCM16:
+        return n // 2
+    if codec == CODEC_ADPCM_IMA:
+        return n * 2
+    if codec == CODEC_ADPCM_IMA_HALF:
+        return n * 4
+    return 0
+
+
+class SeqTracker:
+    """Wrap-aware gap counter (same rules as proto::SeqTracker): a seq
+    counted missing that turns up within WINDOW of the newest is taken back
+    from lost, exact duplicates only count as duplicates."""
+
+    WINDOW = 64
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.received = 0
+        self.lost = 0
+        self.late = 0
+        self.duplicate = 0
+        self._expected = None
+        self._missing = set()  # seqs counted lost, within WINDOW
+
+    def update(self, seq):
+        self.received += 1
+        if self._expected is None:
+            self._expected = (seq + 1) & 0xFFFF
+            return 0
+        delta = (seq - self._expected) & 0xFFFF
+        if delta >= 0x8000:  # behind expected
+            age = (self._expected - 1 - seq) & 0xFFFF
+            if age >= self.WINDOW:
+                self.late += 1  # too old to tell
+            elif seq in self._missing:
+                self._missing.discard(seq)
+                self.late += 1
+                self.lost -= 1
+            else:
+                self.duplicate += 1
+            return 0
+        self._missing.update((self._expected + i) & 0xFFFF for i in range(max(0, delta - self.WINDOW), delta))
+        self._expected = (seq + 1) & 0xFFFF
+        self._missing = {s for s in self._missing if (self._expected - 1 - s) & 0xFFFF < self.WINDOW}
+        self.lost += delta
+        return delta
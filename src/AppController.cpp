@@ -536,7 +536,7 @@ void AppController::processQueue()
                                         ota->writeChunk(data, size);
                                     } });
 
-                        network->onFirmwareComplete([this](bool success, const std::string &msg)
+                        network->onFirmwareComplete([this](bool success, std::string_view msg)
                                                     {
                                     if (success) {
                                         postEvent(event::AppEvent::OTA_FINISHED);
@@ -22,8 +22,11 @@
 #include "TouchInput.hpp"
 #include "Power.hpp"
 
-// ===== Codec =====
+// ===== Codec / DSP =====
 #include "AdpcmCodec.hpp"
+#include "NoiseSuppressor.hpp"
+#include "DriftCompensator.hpp"
+#include "TimeStretcher.hpp"
 
 #include "nvs_flash.h"
 #include "nvs.h"
@@ -383,12 +386,38 @@ bool DeviceProfile::setup(AppController &app)
     // --- Codec ---
     auto codec = std::make_unique<AdpcmCodec>();
 
+    // --- Uplink noise suppression (Wiener, 16 ms latency) ---
+    NoiseSuppressor::Config ns_cfg{};
+    ns_cfg.gain_floor = 0.1f; // max -20 dB, giữ tự nhiên cho ASR
+
     // Wire dependencies into AudioManager before init/start
     audio_mgr->setInput(std::move(mic));
     audio_mgr->setOutput(std::move(speaker));
     audio_mgr->setCodec(std::move(codec));
-
-    if (!audio_mgr->init())
+    audio_mgr->setNoiseSuppressor(std::make_unique<NoiseSuppressor>(ns_cfg));
+
+    // --- Downlink playout depth: drift and WSOLA share one target ---
+    constexpr uint32_t kPlayoutTargetMs = 160;
+
+    // --- Downlink clock drift (server pacing vs I2S, APLL off) ---
+    DriftCompensator::Config drift_cfg{};
+    drift_cfg.sample_rate = spk_cfg.sample_rate;
+    drift_cfg.target_fill_ms = kPlayoutTargetMs;
+    drift_cfg.max_ppm = 1000.0f;
+    audio_mgr->setDriftCompensator(std::make_unique<DriftCompensator>(drift_cfg));
+
+    // --- Downlink catch-up after stalls (+5..15%) / slow-down near underrun (-5%) ---
+    TimeStretcher::Config ts_cfg{};
+    ts_cfg.sample_rate = spk_cfg.sample_rate;
+    ts_cfg.target_ms = kPlayoutTargetMs;
+    audio_mgr->setTimeStretcher(std::make_unique<TimeStretcher>(ts_cfg));
+
+    AudioManager::Config audio_cfg{};
+    audio_cfg.prebuffer_ms = 120; // ≤ playout target, đủ che jitter gói đầu
+    audio_cfg.drain_pad_ms = 100; // ≥ I2S DMA 6 × 256 samples (96 ms)
+    audio_cfg.uplink_headroom = NetworkManager::UPLINK_HEADROOM; // gửi thẳng từ ring
+
+    if (!audio_mgr->init(audio_cfg))
     {
         ESP_LOGE(TAG, "AudioManager init failed");
         return false;
@@ -410,6 +439,13 @@ bool DeviceProfile::setup(AppController &app)
     // Thêm path nếu server yêu cầu, ví dụ: ws://13.239.36.114:8000/ws
     // Uvicorn/FastAPI thường khai báo endpoint WebSocket tại "/ws".
     net_cfg.ws_url = "ws://10.13.136.231:8000/ws";
+    // Ngoài lab dùng wss:// + CA của server (PEM tĩnh), ví dụ:
+    //   net_cfg.ws_url = "wss://ptalk.example.com/ws";
+    //   net_cfg.ws_ca_pem = server_ca_pem;
+
+    // Credit window: refilled every credit_interval_ms (40) → average depth
+    // ≈ playout target, far below the WSOLA catch-up threshold (target + 120)
+    net_cfg.downlink_window_ms = kPlayoutTargetMs + 40;
 
     if (!network_mgr->init(net_cfg))
     {
@@ -427,33 +463,52 @@ bool DeviceProfile::setup(AppController &app)
     // Push incoming binary (ADPCM) from WS into speaker ringbuffer
     // and drive InteractionState to SPEAKING while audio is arriving.
     StreamBufferHandle_t spk_sb = audio_mgr->getSpeakerEncodedBuffer();
-    network_mgr->setMicBuffer(audio_mgr->getMicEncodedBuffer()); // Uplink mic buffer
+    network_mgr->setMicBuffer(audio_mgr->getMicEncodedBuffer()); // Uplink mic ring
     AudioManager *audio_ptr = audio_mgr.get();                   // Capture pointer for disconnect handler
     NetworkManager *network_ptr = network_mgr.get();             // For session flag access
 
     network_mgr->onServerBinary([spk_sb, network_ptr](const uint8_t *data, size_t len)
                                 {
         if (!data || len == 0) return;
+        // Barge-in: from the press to the downlink fence, the cut answer
+        // still arrives here. The fence (cancelDownlink) takes over after.
         if (StateManager::instance().getInteractionState() == state::InteractionState::LISTENING) {
             return; 
         }
-        // Feed encoded data to AudioManager's downlink buffer
-        size_t written = xStreamBufferSend(spk_sb, data, len, pdMS_TO_TICKS(100));
+        // Audio lane: feed AudioManager's downlink buffer without waiting.
+        // This runs on NetworkLoop (WS receive); blocking here would hold every
+        // control queued behind it. With credit flow control the server
+        // never sends more than fits; a legacy server pacing faster than
+        // real time loses the overflow.
+        size_t written = xStreamBufferSend(spk_sb, data, len, 0);
         if (written != len) {
             static uint32_t drop_count = 0;
             if (++drop_count % 10 == 0) {
-                ESP_LOGW("Network", "ADPCM buffer full! Dropped %zu bytes (wanted %zu)", len - written, len);
+                ESP_LOGW("Network", "ADPCM buffer full! Dropped %zu bytes (wanted %zu)%s", len - written, len,
+                         network_ptr->isFlowControlActive() ? " despite credits" : "");
             }
         }
 
-        // Set SPEAKING only ONCE per TTS session (prevent state spam)
+        // Set SPEAKING only ONCE per TTS session (prevent state spam).
+        // The state change runs on the control lane, not on NetworkLoop.
         if (!network_ptr->isSpeakingSessionActive()) {
             network_ptr->startSpeakingSession();
-            auto& sm = StateManager::instance();
-            sm.setInteractionState(state::InteractionState::SPEAKING,
-                                   state::InputSource::SERVER_COMMAND);
+            network_ptr->postControl(proto::Control::SPEAK_START);
         } });
 
+    // Credit flow control: server bursts up to this depth, never overflows
+    network_mgr->setDownlinkProbe([audio_ptr]()
+                                  { return NetworkManager::DownlinkDepth{audio_ptr->downlinkQueuedMs(),
+                                                                         audio_ptr->downlinkFreeBytes()}; });
+
+    // Adaptive uplink: the codec task switches format at the next frame
+    network_mgr->onUplinkProfile([audio_ptr](const BitrateController::Profile &p)
+                                 { audio_ptr->setUplinkFormat(static_cast<uint8_t>(p.codec), p.half_rate); });
+
+    // Barge-in: speaker already silent, fence what is still on the wire
+    audio_mgr->onBargeIn([network_ptr](uint32_t unplayed_ms)
+                         { network_ptr->cancelDownlink(unplayed_ms); });
+
     // Handle WS disconnect - must cleanup to unblock speaker task
     network_mgr->onDisconnect([spk_sb, audio_ptr]()
                               {
@@ -471,26 +526,62 @@ bool DeviceProfile::setup(AppController &app)
                                    state::InputSource::SYSTEM);
         } });
 
-    // Optionally react to simple text control messages from server
-    network_mgr->onServerText([network_ptr](const std::string &msg)
-                              {
+    // TTS tail fully played → only now leave SPEAKING. An answer without
+    // audio (server error, empty reply) drains at once, still in PROCESSING.
+    audio_mgr->onPlaybackDrained([&app, audio_ptr]()
+                                 {
         auto& sm = StateManager::instance();
-        if (msg == "PROCESSING_START" || msg == "PROCESSING") {
+        const bool follow_up = audio_ptr->takeFollowUp();
+        const auto s = sm.getInteractionState();
+        if (s == state::InteractionState::SPEAKING || s == state::InteractionState::PROCESSING) {
+            // Continuous conversation: next turn right away, capture still running
+            if (follow_up) {
+                app.postEvent(event::AppEvent::SERVER_FORCE_LISTEN);
+                return;
+            }
+            sm.setInteractionState(state::InteractionState::IDLE,
+                                   state::InputSource::SERVER_COMMAND);
+        } });
+
+    // Server control: framed Control or legacy magic string (mapped in NetworkManager)
+    network_mgr->onServerControl([network_ptr, audio_ptr](proto::Control c, const uint8_t *args, size_t args_len)
+                                 {
+        auto& sm = StateManager::instance();
+        switch (c) {
+        case proto::Control::PROCESSING:
             sm.setInteractionState(state::InteractionState::PROCESSING,
                                    state::InputSource::SERVER_COMMAND);
-        } else if (msg == "LISTENING") {
+            break;
+        case proto::Control::LISTEN:
             sm.setInteractionState(state::InteractionState::LISTENING,
                                    state::InputSource::SERVER_COMMAND);
-        } else if (msg == "SPEAKING" || msg == "SPEAK_START") {
+            break;
+        case proto::Control::SPEAK_START:
             sm.setInteractionState(state::InteractionState::SPEAKING,
                                    state::InputSource::SERVER_COMMAND);
-        } else if (msg == "IDLE" || msg == "SPEAK_END" || msg == "DONE" || msg == "TTS_END") {
+            break;
+        case proto::Control::SPEAK_END:
             // Reset session flag to allow next TTS session
+            network_ptr->endSpeakingSession();
+            // Server wants the next turn once this answer has played
+            if (args_len >= 1 && (args[0] & proto::speak_end::LISTEN))
+                audio_ptr->armFollowUp();
+            // Drain the tail first; IDLE / next turn comes from onPlaybackDrained
+            audio_ptr->endOfStream();
+            break;
+        case proto::Control::IDLE:
             network_ptr->endSpeakingSession();
             sm.setInteractionState(state::InteractionState::IDLE,
                                    state::InputSource::SERVER_COMMAND);
+            break;
+        default:
+            break; // EMOTION đã xử lý trong NetworkManager
         } });
 
+    // Other text (JSON, debug) from server
+    network_mgr->onServerText([](std::string_view msg)
+                              { ESP_LOGD("Network", "Server text: %.*s", (int)msg.size(), msg.data()); });
+
     // =========================================================
     // STATE OBSERVER: Control WS immune mode during SPEAKING
     // =========================================================
@@ -504,11 +595,11 @@ bool DeviceProfile::setup(AppController &app)
                             {
     // 🟢 Vừa nhấn nút (Vào LISTENING)
     if (new_state == state::InteractionState::LISTENING && prev_interaction_state != state::InteractionState::LISTENING) {
-        network_ptr->sendText("START");
+        network_ptr->sendControl(proto::Control::LISTEN_START);
     }
     // 🔴 Vừa thả nút (Thoát LISTENING)
     else if (new_state != state::InteractionState::LISTENING && prev_interaction_state == state::InteractionState::LISTENING) {
-        network_ptr->sendText("END");
+        network_ptr->sendControl(proto::Control::LISTEN_END);
     }
 
     // Immune Mode duy trì kết nối (Giữ nguyên)
@@ -547,9 +638,10 @@ bool DeviceProfile::setup(AppController &app)
         return false;
     }
 
-    touch_input->onEvent([&app](TouchInput::Event e)
+    touch_input->onEvent([&app, audio_ptr](TouchInput::Event e)
                          {
         if (e == TouchInput::Event::PRESS) {
+            audio_ptr->noteUserInput(); // barge-in latency starts here
             app.postEvent(event::AppEvent::USER_BUTTON);
         }
         if (e == TouchInput::Event::RELEASE) {
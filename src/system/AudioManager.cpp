@@ -3,10 +3,15 @@
 #include "AudioInput.hpp"
 #include "AudioOutput.hpp"
 #include "AudioCodec.hpp"
+#include "NoiseSuppressor.hpp"
+#include "DriftCompensator.hpp"
+#include "TimeStretcher.hpp"
 #include "esp_wifi.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <cstring>
+#include <algorithm>
 
 static const char *TAG = "AudioManager";
 
@@ -39,12 +44,33 @@ void AudioManager::setCodec(std::unique_ptr<AudioCodec> cdc)
     codec = std::move(cdc);
 }
 
+void AudioManager::setNoiseSuppressor(std::unique_ptr<NoiseSuppressor> ns)
+{
+    noise_suppressor = std::move(ns);
+}
+
+void AudioManager::setDriftCompensator(std::unique_ptr<DriftCompensator> dc)
+{
+    drift_comp = std::move(dc);
+}
+
+void AudioManager::setTimeStretcher(std::unique_ptr<TimeStretcher> ts)
+{
+    time_stretch = std::move(ts);
+}
+
 // ============================================================================
 // Init / Start / Stop
 // ============================================================================
 bool AudioManager::init()
+{
+    return init(Config{});
+}
+
+bool AudioManager::init(const Config &cfg)
 {
     ESP_LOGI(TAG, "init()");
+    cfg_ = cfg;
 
     if (!input || !output || !codec)
     {
@@ -65,22 +91,30 @@ bool AudioManager::init()
         4 * 1024, // Buffer size
         1         // Trigger level (1 byte to unblock reader)
     );
-    sb_mic_encoded = xStreamBufferCreate(
-        32 * 1024,
-        1);
+    mic_encoded.init(MIC_ENCODED_BYTES, cfg_.uplink_headroom);
     sb_spk_pcm = xStreamBufferCreate(
-        8 * 1024,
+        SPK_PCM_BUFFER_BYTES,
         1);
     sb_spk_encoded = xStreamBufferCreate(
         16 * 1024, // Increased for better jitter tolerance
         1);
 
-    if (!sb_mic_pcm || !sb_mic_encoded || !sb_spk_pcm || !sb_spk_encoded)
+    if (!sb_mic_pcm || !mic_encoded.valid() || !sb_spk_pcm || !sb_spk_encoded)
     {
         ESP_LOGE(TAG, "Failed to create stream buffers");
         return false;
     }
 
+    if (!audio_events)
+    {
+        audio_events = xEventGroupCreate();
+        if (!audio_events)
+        {
+            ESP_LOGE(TAG, "Failed to create event group");
+            return false;
+        }
+    }
+
     // -------------------------------
     // Subscribe InteractionState
     // -------------------------------
@@ -100,6 +134,7 @@ void AudioManager::start()
     if (started)
         return;
     started = true;
+    xEventGroupClearBits(audio_events, EVT_EXIT);
 
     ESP_LOGI(TAG, "start()");
 
@@ -135,7 +170,7 @@ void AudioManager::start()
     xTaskCreatePinnedToCore(
         &AudioManager::spkTaskEntry,
         "AudioSpkTask",
-        4096, // Reduced stack - no longer doing decode
+        6144, // onPlaybackDrained → StateManager callbacks chạy trên task này
         this,
         6, // Priority 6 - below WiFi task (prio 23) to prevent beacon timeout
         &spk_task,
@@ -152,6 +187,7 @@ void AudioManager::stop()
     ESP_LOGW(TAG, "stop()");
 
     stopAll();
+    xEventGroupSetBits(audio_events, EVT_EXIT | EVT_SPK_KICK | EVT_CODEC_KICK); // wake idle tasks so they see !started
 
     // ✅ Allow tasks to exit themselves (they check `started` and self-delete)
     // Wait up to 1s for both tasks to terminate; then force delete as fallback.
@@ -188,11 +224,11 @@ bool AudioManager::allocateResources()
     ESP_LOGW(TAG, "Allocating Audio Stream Buffers...");
 
     sb_mic_pcm = xStreamBufferCreate(4 * 1024, 1);
-    sb_mic_encoded = xStreamBufferCreate(32 * 1024, 1);
-    sb_spk_pcm = xStreamBufferCreate(8 * 1024, 1);
+    mic_encoded.init(MIC_ENCODED_BYTES, cfg_.uplink_headroom);
+    sb_spk_pcm = xStreamBufferCreate(SPK_PCM_BUFFER_BYTES, 1);
     sb_spk_encoded = xStreamBufferCreate(16 * 1024, 1);
 
-    if (!sb_mic_pcm || !sb_mic_encoded || !sb_spk_pcm || !sb_spk_encoded)
+    if (!sb_mic_pcm || !mic_encoded.valid() || !sb_spk_pcm || !sb_spk_encoded)
     {
         ESP_LOGE(TAG, "Failed to allocate audio buffers - OUT OF RAM!");
         return false;
@@ -208,11 +244,7 @@ void AudioManager::freeResources()
         vStreamBufferDelete(sb_mic_pcm);
         sb_mic_pcm = nullptr;
     }
-    if (sb_mic_encoded)
-    {
-        vStreamBufferDelete(sb_mic_encoded);
-        sb_mic_encoded = nullptr;
-    }
+    mic_encoded.release();
     if (sb_spk_pcm)
     {
         vStreamBufferDelete(sb_spk_pcm);
@@ -226,15 +258,49 @@ void AudioManager::freeResources()
     ESP_LOGI(TAG, "AudioManager resources freed");
 }
 
+uint32_t AudioManager::downlinkQueuedMs() const
+{
+    if (!sb_spk_encoded || !sb_spk_pcm || !codec)
+        return 0;
+
+    size_t samples =
+        xStreamBufferBytesAvailable(sb_spk_encoded) * codec->pcmFrameSamples() / codec->encodedFrameBytes() +
+        xStreamBufferBytesAvailable(sb_spk_pcm) / sizeof(int16_t);
+    return static_cast<uint32_t>(samples * 1000 / codec->sampleRate());
+}
+
+size_t AudioManager::downlinkFreeBytes() const
+{
+    return sb_spk_encoded ? xStreamBufferSpacesAvailable(sb_spk_encoded) : 0;
+}
+
+void AudioManager::setUplinkFormat(uint8_t tag, bool half_rate)
+{
+    uplink_format = static_cast<uint16_t>(tag | (half_rate ? UPLINK_HALF_RATE : 0));
+}
+
 // ============================================================================
 // State handling
 // ============================================================================
 void AudioManager::handleInteractionState(state::InteractionState s,
                                           state::InputSource src)
 {
+    const state::InteractionState prev = last_state.exchange(s);
+
     switch (s)
     {
     case state::InteractionState::LISTENING:
+        // Answer playing or on its way: the new turn cuts it. Played out
+        // (follow-up turn) is not a barge-in.
+        if (prev == state::InteractionState::PROCESSING ||
+            ((speaking || prev == state::InteractionState::SPEAKING) && !playback_drained))
+        {
+            const uint32_t unplayed_ms = cancelPlayback();
+            startListening(src);
+            if (barge_in_cb)
+                barge_in_cb(unplayed_ms);
+            break;
+        }
         startListening(src);
         break;
 
@@ -266,10 +332,13 @@ void AudioManager::handleInteractionState(state::InteractionState s,
 // ============================================================================
 void AudioManager::startListening(state::InputSource src)
 {
-    if (listening)
+    // PROCESSING pauses capture but stays listening: a new turn resumes it
+    if (listening && (xEventGroupGetBits(audio_events) & EVT_CAPTURE))
         return;
 
-    ESP_LOGI(TAG, "Start listening (Interruption handled)");
+    // Follow-up turn: I2S still running, startCapture() below is a no-op
+    const bool warm = (xEventGroupClearBits(audio_events, EVT_WARM) & EVT_WARM) != 0;
+    ESP_LOGI(TAG, "Start listening (Interruption handled)%s", warm ? ", capture kept running" : "");
 
     // 1. Dừng ngay việc phát loa nếu đang nói
     if (speaking)
@@ -277,23 +346,20 @@ void AudioManager::startListening(state::InputSource src)
         stopSpeaking(); // Hàm này sẽ gọi output->stopPlayback()
     }
 
-    // 2. XÓA SẠCH các buffer âm thanh cũ của loa
-    xStreamBufferReset(sb_spk_encoded); // Xóa dữ liệu nén chưa kịp giải mã
-    xStreamBufferReset(sb_spk_pcm);     // Xóa dữ liệu PCM chưa kịp phát ra loa
-
-    // 3. Reset Codec để xóa bộ nhớ đệm của ADPCM (tránh tiếng nổ/rè cho câu sau)
-    if (codec)
-    {
-        codec->reset();
-    }
+    // 2. Audio cũ của loa còn trong buffer (câu bị cắt qua IDLE): fence.
+    // Codec / speaker task tự xóa buffer và reset decoder, không đụng từ
+    // task này. Barge-in đã raise fence trong cancelPlayback().
+    if (!(xEventGroupGetBits(audio_events) & EVT_FENCE) && downlinkQueuedMs() > 0)
+        raiseFence();
 
     current_source = src;
     listening = true;
     speaking = false;
 
-    // 4. Bắt đầu thu âm
+    // 3. Bắt đầu thu âm
 
     input->startCapture();
+    xEventGroupSetBits(audio_events, EVT_CAPTURE); // mic + codec thức ngay
 }
 
 void AudioManager::pauseListening()
@@ -301,6 +367,12 @@ void AudioManager::pauseListening()
     if (!listening)
         return;
     ESP_LOGI(TAG, "Pause listening");
+    xEventGroupClearBits(audio_events, EVT_CAPTURE);
+    if (conversation)
+    {
+        xEventGroupSetBits(audio_events, EVT_WARM); // next turn reuses the I2S
+        return;
+    }
     input->stopCapture();
 }
 
@@ -310,6 +382,7 @@ void AudioManager::stopListening()
         return;
     ESP_LOGI(TAG, "Stop listening");
     listening = false;
+    xEventGroupClearBits(audio_events, EVT_CAPTURE);
 
     input->stopCapture();
 }
@@ -319,7 +392,9 @@ void AudioManager::startSpeaking()
     if (speaking)
         return;
     ESP_LOGI(TAG, "Start speaking");
+    playback_drained = false;
     speaking = true;
+    xEventGroupSetBits(audio_events, EVT_SPEAK);
 
     // DO NOT reset codec here - it breaks ADPCM predictor continuity
     // Only reset when switching to a completely new audio stream/session
@@ -331,6 +406,8 @@ void AudioManager::stopSpeaking()
         return;
     ESP_LOGI(TAG, "Stop speaking");
     speaking = false;
+    xEventGroupClearBits(audio_events, EVT_SPEAK);
+    kickSpeaker();
     if (spk_playing)
     {
         output->stopPlayback();
@@ -338,10 +415,69 @@ void AudioManager::stopSpeaking()
     }
 }
 
+uint32_t AudioManager::cancelPlayback()
+{
+    const int64_t t0 = esp_timer_get_time();
+    const uint32_t unplayed_ms = downlinkQueuedMs();
+
+    // Silence first: zero the DMA ring, cut the write in progress
+    if (output)
+        output->flush();
+    const int64_t t1 = esp_timer_get_time();
+
+    // A cut answer has no follow-up: this press is the next turn
+    follow_up = false;
+    drained_us = 0;
+
+    // Then the stages drop their buffers (codec → speaker handshake)
+    raiseFence();
+
+    // Button → silence; a press more than 1 s old is not this one
+    const int64_t press = input_us.load();
+    const uint32_t here_us = static_cast<uint32_t>(t1 - t0);
+    const uint32_t total_us = press > 0 && t0 - press < 1000000 ? static_cast<uint32_t>(t1 - press) : here_us;
+    const uint32_t bound_us = output ? output->periodUs() : 0;
+    if (bound_us > 0 && total_us > bound_us)
+    {
+        ESP_LOGW(TAG, "Barge-in: silent %u us after the press, over one DMA period (%u us)",
+                 (unsigned)total_us, (unsigned)bound_us);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Barge-in: silent %u us after the press (%u us flush), %u ms unplayed dropped",
+                 (unsigned)total_us, (unsigned)here_us, (unsigned)unplayed_ms);
+    }
+    return unplayed_ms;
+}
+
+void AudioManager::raiseFence()
+{
+    ++downlink_epoch;
+    xEventGroupSetBits(audio_events, EVT_FENCE | EVT_SPK_KICK | EVT_CODEC_KICK);
+}
+
 void AudioManager::stopAll()
 {
+    // Conversation over: capture off for real
+    conversation = false;
+    follow_up = false;
+    drained_us = 0;
+    xEventGroupClearBits(audio_events, EVT_WARM);
     stopListening();
     stopSpeaking();
+    input->stopCapture(); // warm capture outside a turn (no-op if stopped)
+}
+
+void AudioManager::armFollowUp()
+{
+    if (power_saving)
+        return;
+    follow_up = true;
+    conversation = true;
+    // Started while the tail plays: no I2S start in the gap between turns
+    input->startCapture();
+    xEventGroupSetBits(audio_events, EVT_WARM);
+    ESP_LOGI(TAG, "Follow-up armed: listening again once the answer has played");
 }
 
 void AudioManager::setPowerSaving(bool enable)
@@ -351,6 +487,35 @@ void AudioManager::setPowerSaving(bool enable)
         stopAll();
 }
 
+void AudioManager::endOfStream()
+{
+    if (!speaking || power_saving)
+    {
+        // Không có gì đang phát → drained ngay
+        if (drained_cb)
+            drained_cb();
+        return;
+    }
+
+    ESP_LOGI(TAG, "End of stream - draining");
+    eos_encoded = true;
+}
+
+void AudioManager::onPlaybackDrained(std::function<void()> cb)
+{
+    drained_cb = std::move(cb);
+}
+
+void AudioManager::onBargeIn(std::function<void(uint32_t)> cb)
+{
+    barge_in_cb = std::move(cb);
+}
+
+void AudioManager::noteUserInput()
+{
+    input_us = esp_timer_get_time();
+}
+
 // ============================================================================
 // Tasks
 // ============================================================================
@@ -369,6 +534,33 @@ void AudioManager::spkTaskEntry(void *arg)
     static_cast<AudioManager *>(arg)->spkTaskLoop();
 }
 
+void AudioManager::waitForWork(EventBits_t bits)
+{
+    // Không clear bit: trạng thái, không phải sự kiện → mọi task chờ cùng thấy
+    xEventGroupWaitBits(audio_events, bits | EVT_EXIT, pdFALSE, pdFALSE, portMAX_DELAY);
+}
+
+void AudioManager::kickSpeaker()
+{
+    xEventGroupSetBits(audio_events, EVT_SPK_KICK);
+}
+
+void AudioManager::waitSpeaker(TickType_t ticks)
+{
+    // Sticky until consumed: a kick between the check and the wait is kept
+    xEventGroupWaitBits(audio_events, EVT_SPK_KICK, pdTRUE, pdFALSE, ticks);
+}
+
+void AudioManager::kickCodec()
+{
+    xEventGroupSetBits(audio_events, EVT_CODEC_KICK);
+}
+
+void AudioManager::waitCodec(TickType_t ticks)
+{
+    xEventGroupWaitBits(audio_events, EVT_CODEC_KICK, pdTRUE, pdFALSE, ticks);
+}
+
 // ============================================================================
 // MIC task: PCM → ENCODE → rb_mic_encoded
 // ============================================================================
@@ -378,15 +570,24 @@ void AudioManager::micTaskLoop()
 
     constexpr size_t PCM_FRAME = 256;
     int16_t pcm_buf[PCM_FRAME];
+    bool was_listening = false;
 
     while (started)
     {
-        if (!listening || power_saving)
+        const EventBits_t bits = xEventGroupGetBits(audio_events);
+        if (!listening || power_saving || !(bits & EVT_CAPTURE))
         {
-            // ESP_LOGI(TAG, "MIC loop: %s, power_saving=%d",
-            //          listening ? "listening" : "not listening",
-            //          power_saving.load());
-            vTaskDelay(pdMS_TO_TICKS(100));
+            was_listening = false;
+            if ((bits & EVT_WARM) && !power_saving)
+            {
+                // Between turns of a conversation: keep the DMA ring fresh,
+                // the next turn starts on current audio, not on the answer
+                if (input->readPcm(pcm_buf, PCM_FRAME) == 0)
+                    vTaskDelay(1);
+                continue;
+            }
+            // Idle / PROCESSING (capture paused): ngủ tới khi startListening()
+            waitForWork(EVT_CAPTURE | EVT_WARM);
             continue;
         }
 
@@ -400,6 +601,29 @@ void AudioManager::micTaskLoop()
             vTaskDelay(pdMS_TO_TICKS(5));
             continue;
         }
+
+        // Noise suppression runs only in this task → no locking needed.
+        // New turn: fresh stream history, the learned floor is kept (a turn
+        // often starts with speech, right after the answer played out).
+        if (noise_suppressor)
+        {
+            if (!was_listening)
+            {
+                noise_suppressor->reset();
+            }
+            noise_suppressor->process(pcm_buf, samples);
+        }
+        if (!was_listening)
+        {
+            const int64_t drained = drained_us.exchange(0);
+            if (drained > 0)
+            {
+                ESP_LOGI(TAG, "Follow-up turn: mic open %u ms after the answer played out",
+                         (unsigned)((esp_timer_get_time() - drained) / 1000));
+            }
+        }
+        was_listening = true;
+
         size_t bytes = samples * sizeof(int16_t);
 
         size_t sent = xStreamBufferSend(
@@ -434,54 +658,140 @@ void AudioManager::codecTaskLoop()
     int16_t pcm_out[1024]; // 64 ms PCM output
     bool new_decode_session = true;
 
+    // Uplink format in force. UNSET: the ring gets a mark before the first
+    // frame (a restarted task does not know what the reader expects).
+    constexpr uint16_t FORMAT_UNSET = 0xFFFF;
+    uint16_t format_applied = FORMAT_UNSET;
+    int16_t pcm_half[PCM_FRAME / 2];
+    bool was_capturing = false;
+
+    uint32_t epoch_seen = downlink_epoch.load();
+    pcm_epoch = epoch_seen;
+
+    constexpr size_t STAGE_CAP = sizeof(spk_pcm_buffer) / sizeof(int16_t) / 2;
+    int16_t *drift_out = spk_pcm_buffer;
+    int16_t *stretch_out = spk_pcm_buffer + STAGE_CAP;
+
+    // PCM → speaker. Bounded waits: after a fence or the end of SPEAKING
+    // the rest of the chunk is dropped, never pushed behind the fence.
+    auto sendPcm = [&](const int16_t *pcm, size_t samples)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(pcm);
+        size_t left = samples * sizeof(int16_t);
+        while (left > 0 && started && speaking && downlink_epoch.load() == epoch_seen)
+        {
+            const size_t n = xStreamBufferSend(sb_spk_pcm, p, left, pdMS_TO_TICKS(20));
+            p += n;
+            left -= n;
+            if (n > 0)
+                kickSpeaker();
+        }
+    };
+
     while (started)
     {
+        const bool decoding = speaking && !power_saving;
+        const bool capturing = xEventGroupGetBits(audio_events) & EVT_CAPTURE;
+        if (capturing && !was_capturing)
+        {
+            uplink_decimator.reset(); // new turn: no history from the last one
+        }
+        was_capturing = capturing;
+
+        const uint32_t epoch = downlink_epoch.load();
+        if (epoch != epoch_seen)
+        {
+            // Fence: the encoded queue and the decoder state belong to the
+            // cut answer. Ack once no stale PCM can leave this task.
+            epoch_seen = epoch;
+            while (xStreamBufferReceive(sb_spk_encoded, encoded, sizeof(encoded), 0) > 0)
+            {
+            }
+            new_decode_session = true; // decoder, drift, stretcher restart clean
+            eos_encoded = false;
+            pcm_epoch = epoch;
+            kickSpeaker();
+
+            // New PCM only after the speaker dropped the cut answer (it
+            // drops sb_spk_pcm until then). A newer fence wakes this too.
+            while (started && downlink_epoch.load() == epoch &&
+                   (xEventGroupGetBits(audio_events) & EVT_FENCE))
+            {
+                waitCodec(portMAX_DELAY);
+            }
+            continue;
+        }
+
+        if (!decoding && !new_decode_session)
+        {
+            // Vừa rời SPEAKING: bỏ phần downlink còn lại (một lần)
+            xStreamBufferReset(sb_spk_encoded);
+            xStreamBufferReset(sb_spk_pcm);
+            // codec->reset();
+            new_decode_session = true;
+            eos_encoded = false;
+        }
+
+        if (!decoding && !capturing && xStreamBufferIsEmpty(sb_mic_pcm))
+        {
+            // Không thu, không phát, mic PCM đã encode hết → ngủ
+            waitForWork(EVT_CAPTURE | EVT_SPEAK | EVT_CODEC_KICK);
+            // Consumed here: a fence bumped the epoch before the kick, the
+            // loop sees it on the next pass
+            xEventGroupClearBits(audio_events, EVT_CODEC_KICK);
+            continue;
+        }
+
         // =====================
         // ENCODE (MIC → SERVER)
         // =====================
         if (!speaking)
         {
+            // Data-driven while capturing; leftovers after pause are drained
+            // without blocking
             size_t pcm_bytes = xStreamBufferReceive(
                 sb_mic_pcm,
                 reinterpret_cast<uint8_t *>(pcm_in),
                 sizeof(pcm_in),
-                pdMS_TO_TICKS(10)
-
-            );
+                capturing ? pdMS_TO_TICKS(50) : 0);
 
             if (pcm_bytes == sizeof(pcm_in))
             {
+                // Format switch between two frames, marked in the ring. One
+                // mark in flight: until the reader passed the last one the
+                // current format goes on.
+                const uint16_t want = uplink_format.load();
+                if (want != format_applied &&
+                    mic_encoded.mark(static_cast<uint8_t>(want & 0xFF)))
+                {
+                    format_applied = want;
+                    uplink_decimator.reset();
+                }
+
+                const int16_t *pcm = pcm_in;
                 size_t samples = pcm_bytes / sizeof(int16_t);
+                if (format_applied != FORMAT_UNSET && (format_applied & UPLINK_HALF_RATE))
+                {
+                    samples = uplink_decimator.process(pcm_in, samples, pcm_half);
+                    pcm = pcm_half;
+                }
 
-                size_t enc_len = codec->encode(
-                    pcm_in,
-                    samples,
-                    encoded,
-                    sizeof(encoded));
+                size_t enc_len = format_applied == FORMAT_UNSET
+                                     ? 0 // ring not marked yet: drop the frame
+                                     : codec->encode(pcm, samples, encoded, sizeof(encoded));
                 // ESP_LOGD(TAG, "Encoded %zu PCM samples to %zu bytes", samples, enc_len);
                 if (enc_len > 0)
                 {
-                    xStreamBufferSend(
-                        sb_mic_encoded,
-                        encoded,
-                        enc_len,
-                        pdMS_TO_TICKS(10));
+                    // Full = uplink stalled: drop the whole frame, never half
+                    mic_encoded.write(encoded, enc_len);
                 }
             }
         }
         // =====================
         // DECODE (SERVER → SPK)
         // =====================
-        if (!speaking || power_saving)
-        {
-            xStreamBufferReset(sb_spk_encoded);
-            xStreamBufferReset(sb_spk_pcm);
-            // codec->reset();
-            new_decode_session = true;
-
-            vTaskDelay(pdMS_TO_TICKS(5));
+        if (!decoding)
             continue;
-        }
 
         size_t got = xStreamBufferReceive(
             sb_spk_encoded,
@@ -489,28 +799,86 @@ void AudioManager::codecTaskLoop()
             sizeof(encoded),
             pdMS_TO_TICKS(20));
 
-        if (got == sizeof(encoded))
+        if (got > 0 && downlink_epoch.load() != epoch_seen)
+            continue; // arrived across the fence
+
+        if (got == 0)
         {
-            if (new_decode_session)
+            // EOS marker: flag read first, so an empty buffer now means the
+            // last byte before it has been decoded → flush tail, pass it on
+            if (eos_encoded && xStreamBufferIsEmpty(sb_spk_encoded))
             {
-                codec->reset();
-                new_decode_session = false;
+                if (time_stretch)
+                {
+                    size_t tail = time_stretch->flush(stretch_out, STAGE_CAP);
+                    if (tail > 0)
+                    {
+                        sendPcm(stretch_out, tail);
+                    }
+                }
+                eos_encoded = false;
+                eos_pcm = true;
+                kickSpeaker();
             }
+            continue;
+        }
 
-            size_t out_samples = codec->decode(
-                encoded,
-                got,
-                pcm_out,
-                1024);
+        if (new_decode_session)
+        {
+            codec->reset();
+            if (drift_comp)
+            {
+                drift_comp->reset();
+            }
+            if (time_stretch)
+            {
+                time_stretch->reset();
+            }
+            new_decode_session = false;
+        }
+
+        // Any length: ADPCM decodes per byte, partial reads are not dropped
+        size_t out_samples = codec->decode(
+            encoded,
+            got,
+            pcm_out,
+            1024);
 
-            if (out_samples > 0)
+        // Fill ahead of the speaker, in samples (encoded + PCM)
+        size_t fill =
+            xStreamBufferBytesAvailable(sb_spk_encoded) * codec->pcmFrameSamples() / codec->encodedFrameBytes() +
+            xStreamBufferBytesAvailable(sb_spk_pcm) / sizeof(int16_t);
+
+        const int16_t *play = pcm_out;
+        if (out_samples > 0 && drift_comp)
+        {
+            out_samples = drift_comp->process(
+                play,
+                out_samples,
+                drift_out,
+                STAGE_CAP);
+            // Stretcher đang đuổi depth → giữ nguyên drift estimate
+            if (!time_stretch || !time_stretch->isAdjusting())
             {
-                xStreamBufferSend(
-                    sb_spk_pcm,
-                    reinterpret_cast<uint8_t *>(pcm_out),
-                    out_samples * sizeof(int16_t),
-                    portMAX_DELAY);
+                drift_comp->update(fill, out_samples);
             }
+            play = drift_out;
+        }
+
+        if (out_samples > 0 && time_stretch)
+        {
+            time_stretch->updateDepth(fill);
+            out_samples = time_stretch->process(
+                play,
+                out_samples,
+                stretch_out,
+                STAGE_CAP);
+            play = stretch_out;
+        }
+
+        if (out_samples > 0)
+        {
+            sendPcm(play, out_samples);
         }
     }
 
@@ -531,9 +899,41 @@ void AudioManager::spkTaskLoop()
 
     int16_t pcm_chunk[PCM_CHUNK_SAMPLES];
     bool i2s_started = false;
+    bool stream_done = false;      // tail played, chờ state rời SPEAKING
+    TickType_t first_data_tick = 0; // prebuffer timeout reference
+    uint32_t epoch_seen = downlink_epoch.load();
+
+    const uint32_t sample_rate = output->sampleRate();
+    const size_t prebuffer_bytes = std::min<size_t>(
+        static_cast<size_t>(cfg_.prebuffer_ms) * sample_rate / 1000 * sizeof(int16_t),
+        SPK_PCM_BUFFER_BYTES - PCM_CHUNK_BYTES);
 
     while (started)
     {
+        const uint32_t epoch = downlink_epoch.load();
+        if (epoch != epoch_seen)
+        {
+            // Fence: PCM queued so far is the cut answer. Drop until the
+            // codec task acked it, after that nothing stale can follow.
+            while (xStreamBufferReceive(sb_spk_pcm, reinterpret_cast<uint8_t *>(pcm_chunk),
+                                        PCM_CHUNK_BYTES, 0) > 0)
+            {
+            }
+            eos_pcm = false;
+            first_data_tick = 0;
+            if (pcm_epoch.load() != epoch)
+            {
+                waitSpeaker(portMAX_DELAY); // codec task kicks once it acked
+                continue;
+            }
+            epoch_seen = epoch;
+            xEventGroupClearBits(audio_events, EVT_FENCE);
+            if (downlink_epoch.load() != epoch)
+                xEventGroupSetBits(audio_events, EVT_FENCE); // raised meanwhile: keep it
+            kickCodec(); // it waits for this before writing new PCM
+            continue; // re-check: another fence may have come meanwhile
+        }
+
         if (!speaking || power_saving)
         {
             if (i2s_started)
@@ -541,12 +941,76 @@ void AudioManager::spkTaskLoop()
                 output->stopPlayback();
                 i2s_started = false;
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
+            stream_done = false;
+            first_data_tick = 0;
+            eos_pcm = false;
+            waitForWork(EVT_SPEAK | EVT_FENCE);
+            continue;
+        }
+
+        if (stream_done)
+        {
+            // Tail played: sleep until speaking ends (or a fence / exit)
+            waitSpeaker(portMAX_DELAY);
+            continue;
+        }
+
+        // EOS marker: read before the fill level (see eos_pcm)
+        const bool eos = eos_pcm;
+        const size_t queued = xStreamBufferBytesAvailable(sb_spk_pcm);
+
+        if (eos && queued == 0)
+        {
+            if (i2s_started)
+            {
+                // Đẩy phần đuôi ra khỏi DMA ring bằng silence rồi mới dừng
+                std::memset(pcm_chunk, 0, sizeof(pcm_chunk));
+                size_t pad = static_cast<size_t>(cfg_.drain_pad_ms) * sample_rate / 1000;
+                while (pad > 0)
+                {
+                    size_t n = std::min(pad, PCM_CHUNK_SAMPLES);
+                    output->writePcm(pcm_chunk, n);
+                    pad -= n;
+                }
+                output->stopPlayback();
+                i2s_started = false;
+            }
+
+            eos_pcm = false;
+            stream_done = true;
+            playback_drained = true;
+            if (follow_up)
+                drained_us = esp_timer_get_time(); // turn-to-turn gap starts
+            ESP_LOGI(TAG, "Playback drained");
+            if (drained_cb)
+                drained_cb();
+            continue;
+        }
+
+        if (queued == 0)
+        {
+            // Before the first block, or underrun: the codec task kicks on
+            // PCM and on EOS
+            waitSpeaker(portMAX_DELAY);
             continue;
         }
 
         if (!i2s_started)
         {
+            const TickType_t now = xTaskGetTickCount();
+            if (first_data_tick == 0)
+                first_data_tick = now;
+
+            // Watermark, or short utterance already complete, or server slow
+            const TickType_t timeout = pdMS_TO_TICKS(cfg_.prebuffer_timeout_ms);
+            const TickType_t waited = now - first_data_tick;
+            bool ready = queued >= prebuffer_bytes || eos || eos_encoded || waited >= timeout;
+            if (!ready)
+            {
+                waitSpeaker(timeout - waited); // next block, or the timeout
+                continue;
+            }
+
             if (!output->startPlayback())
             {
                 vTaskDelay(pdMS_TO_TICKS(10));
@@ -559,11 +1023,22 @@ void AudioManager::spkTaskLoop()
             sb_spk_pcm,
             reinterpret_cast<uint8_t *>(pcm_chunk),
             PCM_CHUNK_BYTES,
-            pdMS_TO_TICKS(100));
+            0); // queued > 0
+
+        if (got & 1)
+        {
+            // Writer chỉ gửi nguyên sample → byte còn lại đang tới
+            got += xStreamBufferReceive(
+                sb_spk_pcm,
+                reinterpret_cast<uint8_t *>(pcm_chunk) + got,
+                1,
+                pdMS_TO_TICKS(10));
+        }
 
-        if (got == PCM_CHUNK_BYTES)
+        // Partial chunks are played, not dropped
+        if (got >= sizeof(int16_t))
         {
-            output->writePcm(pcm_chunk, PCM_CHUNK_SAMPLES);
+            output->writePcm(pcm_chunk, got / sizeof(int16_t));
         }
     }
 
@@ -2,18 +2,25 @@
 
 #include <memory>
 #include <atomic>
+#include <functional>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/stream_buffer.h"
+#include "freertos/event_groups.h"
 
 #include "system/StateTypes.hpp"
 #include "system/StateManager.hpp"
+#include "SpanRing.hpp"
+#include "HalfbandDecimator.hpp"
 
 // Forward declarations
 class AudioInput;
 class AudioOutput;
 class AudioCodec;
+class NoiseSuppressor;
+class DriftCompensator;
+class TimeStretcher;
 
 /**
  * AudioManager
@@ -26,6 +33,24 @@ class AudioCodec;
 class AudioManager
 {
 public:
+    struct Config
+    {
+        // PCM queued before I2S starts (tránh underrun ở các frame đầu).
+        // Clamped to the PCM stream buffer.
+        uint32_t prebuffer_ms = 120;
+
+        // Start anyway if the watermark is not reached in time (slow server)
+        uint32_t prebuffer_timeout_ms = 400;
+
+        // Silence written after the tail so the I2S DMA ring plays it out
+        // before stopPlayback (≥ dma_buf_count × dma_buf_len)
+        uint32_t drain_pad_ms = 100;
+
+        // Writable bytes kept ahead of every uplink span, so the reader can
+        // put its frame header there (NetworkManager::UPLINK_HEADROOM)
+        size_t uplink_headroom = 0;
+    };
+
     AudioManager();
     ~AudioManager();
 
@@ -33,6 +58,7 @@ public:
     // Lifecycle
     // ------------------------------------------------------------------------
     bool init();
+    bool init(const Config &cfg);
     void start();
     void stop();
 
@@ -44,18 +70,73 @@ public:
     void setInput(std::unique_ptr<AudioInput> in);
     void setOutput(std::unique_ptr<AudioOutput> out);
     void setCodec(std::unique_ptr<AudioCodec> cdc);
+    // Optional uplink DSP stage (PCM in-place, before encode)
+    void setNoiseSuppressor(std::unique_ptr<NoiseSuppressor> ns);
+    // Optional downlink stage: server clock vs I2S clock drift correction
+    void setDriftCompensator(std::unique_ptr<DriftCompensator> dc);
+    // Optional downlink stage: WSOLA catch-up / slow-down on queue depth
+    void setTimeStretcher(std::unique_ptr<TimeStretcher> ts);
 
     // ------------------------------------------------------------------------
     // Stream buffer access (NetworkManager dùng)
     // ------------------------------------------------------------------------
-    StreamBufferHandle_t getMicEncodedBuffer() const { return sb_mic_encoded; }
+    // Object stable for the lifetime of AudioManager; storage follows
+    // allocateResources() / freeResources()
+    SpanRing *getMicEncodedBuffer() { return &mic_encoded; }
     StreamBufferHandle_t getSpeakerEncodedBuffer() const { return sb_spk_encoded; }
 
+    // Downlink depth for flow control (any task): audio queued ahead of the
+    // speaker (encoded + PCM) and space left for encoded bytes
+    uint32_t downlinkQueuedMs() const;
+    size_t downlinkFreeBytes() const;
+
+    /**
+     * Uplink format (any task, never blocks). The codec task switches at
+     * the next frame boundary and marks the mic ring there with `tag`
+     * (SpanRing::mark), so the reader knows which bytes are which.
+     * half_rate: PCM decimated 2:1 (HalfbandDecimator) before the encoder.
+     */
+    void setUplinkFormat(uint8_t tag, bool half_rate);
+
     // ------------------------------------------------------------------------
     // Power / control
     // ------------------------------------------------------------------------
     void setPowerSaving(bool enable);
 
+    // ------------------------------------------------------------------------
+    // Downlink end-of-stream
+    // ------------------------------------------------------------------------
+    // Server đã gửi hết audio của câu trả lời (TTS_END). Call after the last
+    // byte was written to the speaker encoded buffer.
+    void endOfStream();
+
+    // Fired (speaker task) once the tail has been decoded, played and the
+    // I2S stopped. Fired immediately if endOfStream() finds nothing playing.
+    void onPlaybackDrained(std::function<void()> cb);
+
+    // ------------------------------------------------------------------------
+    // Barge-in
+    // ------------------------------------------------------------------------
+    // A new turn cut the answer short (LISTENING from SPEAKING / PROCESSING).
+    // Fired on the state-change caller once the speaker is silent;
+    // unplayed_ms = downlink audio that was still queued on the device.
+    void onBargeIn(std::function<void(uint32_t unplayed_ms)> cb);
+
+    // Button press time (any task): barge-in latency is measured from it
+    void noteUserInput();
+
+    // ------------------------------------------------------------------------
+    // Continuous conversation
+    // ------------------------------------------------------------------------
+    // Server asked to listen again once this answer has played (SPEAK_END
+    // with speak_end::LISTEN). Capture stays on from here to the end of the
+    // conversation (IDLE): between turns the mic task reads and drops, the
+    // next LISTENING reuses the running I2S.
+    void armFollowUp();
+
+    // Drained callback: true once per armed answer
+    bool takeFollowUp() { return follow_up.exchange(false); }
+
 private:
     // ------------------------------------------------------------------------
     // State callback
@@ -73,6 +154,10 @@ private:
     void startSpeaking();
     void stopSpeaking();
 
+    // Silence now, then every downlink stage drops what it holds
+    // @return unplayed ms (encoded + PCM queued)
+    uint32_t cancelPlayback();
+
     void stopAll();
 
 private:
@@ -87,6 +172,19 @@ private:
     void codecTaskLoop();
     void spkTaskLoop();
 
+    // Idle tasks block here until one of `bits` (or EVT_EXIT) is set
+    void waitForWork(EventBits_t bits);
+
+    // Speaker: "look again" (PCM / EOS queued, fence acked, speaking
+    // changed, exit). Event, not state: waitSpeaker() consumes it.
+    void kickSpeaker();
+    void waitSpeaker(TickType_t ticks);
+
+    // Codec task: "look again" (fence raised, speaker dropped the cut PCM,
+    // exit). Same event semantics as the speaker kick.
+    void kickCodec();
+    void waitCodec(TickType_t ticks);
+
 private:
     // ------------------------------------------------------------------------
     // State
@@ -97,7 +195,51 @@ private:
     std::atomic<bool> power_saving{false};
     std::atomic<bool> spk_playing{false};
 
+    // End-of-stream marker. Set after the last write into a buffer, so
+    // "flag set && buffer empty" means everything before it was consumed.
+    std::atomic<bool> eos_encoded{false}; // network → codec (sb_spk_encoded)
+    std::atomic<bool> eos_pcm{false};     // codec → speaker (sb_spk_pcm)
+
+    // Downlink fence. cancelPlayback() bumps downlink_epoch; the codec task
+    // drops sb_spk_encoded + decoder state and acks in pcm_epoch once it
+    // will not write stale PCM any more; the speaker drops sb_spk_pcm until
+    // that ack, clears EVT_FENCE and kicks the codec, which writes no new
+    // PCM before that. Stream buffers carry no seq, the epoch stands in
+    // for it.
+    std::atomic<uint32_t> downlink_epoch{0};
+    std::atomic<uint32_t> pcm_epoch{0};
+    void raiseFence();
+    std::atomic<int64_t> input_us{0}; // last button press (esp_timer)
+    std::function<void(uint32_t)> barge_in_cb;
+
+    // Continuous conversation: capture kept warm from the first follow-up
+    // to IDLE; the turn-to-turn gap is measured drained → first mic frame
+    std::atomic<bool> conversation{false};
+    std::atomic<bool> follow_up{false};
+    std::atomic<bool> playback_drained{false}; // speaker: answer played out
+    std::atomic<int64_t> drained_us{0};        // 0 = no follow-up pending
+
+    // Requested uplink format: tag | UPLINK_HALF_RATE, applied by the codec task
+    static constexpr uint16_t UPLINK_HALF_RATE = 1 << 8;
+    std::atomic<uint16_t> uplink_format{0};
+
+    Config cfg_{};
+    std::function<void()> drained_cb;
+
     state::InputSource current_source = state::InputSource::UNKNOWN;
+    std::atomic<state::InteractionState> last_state{state::InteractionState::IDLE};
+
+    // ------------------------------------------------------------------------
+    // Task wakeups (thay cho vTaskDelay polling khi idle)
+    // ------------------------------------------------------------------------
+    static constexpr EventBits_t EVT_CAPTURE = 1 << 0; // mic đang thu
+    static constexpr EventBits_t EVT_SPEAK = 1 << 1;   // downlink active
+    static constexpr EventBits_t EVT_EXIT = 1 << 2;    // stop(): tasks thoát
+    static constexpr EventBits_t EVT_FENCE = 1 << 3;   // barge-in: drop downlink (speaker clears)
+    static constexpr EventBits_t EVT_WARM = 1 << 4;    // capture on between turns, mic drops
+    static constexpr EventBits_t EVT_SPK_KICK = 1 << 5; // speaker: look again (it clears)
+    static constexpr EventBits_t EVT_CODEC_KICK = 1 << 6; // codec: look again (it clears)
+    EventGroupHandle_t audio_events = nullptr;
 
     // ------------------------------------------------------------------------
     // Components
@@ -105,16 +247,26 @@ private:
     std::unique_ptr<AudioInput> input;
     std::unique_ptr<AudioOutput> output;
     std::unique_ptr<AudioCodec> codec;
+    std::unique_ptr<NoiseSuppressor> noise_suppressor;
+    std::unique_ptr<DriftCompensator> drift_comp;
+    std::unique_ptr<TimeStretcher> time_stretch;
 
     // ------------------------------------------------------------------------
     // Stream buffers (FreeRTOS - thread-safe, no race conditions)
     // ------------------------------------------------------------------------
     StreamBufferHandle_t sb_mic_pcm;     // PCM from mic
-    StreamBufferHandle_t sb_mic_encoded; // encoded uplink
+    SpanRing mic_encoded;                // encoded uplink (zero-copy read)
     StreamBufferHandle_t sb_spk_pcm;     // PCM to speaker
     StreamBufferHandle_t sb_spk_encoded; // encoded downlink
 
+    static constexpr size_t SPK_PCM_BUFFER_BYTES = 8 * 1024;
+    static constexpr size_t MIC_ENCODED_BYTES = 32 * 1024;
+
+    // Uplink half-rate profile (codec task only)
+    HalfbandDecimator uplink_decimator;
+
     // PCM decode buffer (static allocation to avoid heap alloc in task)
+    // Codec task: [0, 2048) drift resampler output, [2048, 4096) stretcher output
     int16_t spk_pcm_buffer[4096] = {};
 
     // ------------------------------------------------------------------------
@@ -1,33 +1,89 @@
 #include "NetworkManager.hpp"
 #include "WifiService.hpp"
 #include "WebSocketClient.hpp"
+#include "TlsSocket.hpp"
+#include "UdpAudioLink.hpp"
+#include "SpanRing.hpp"
+#include "JsonScan.hpp"
+#include "PerfectHash.hpp"
+#include "JsonWriter.hpp"
 
 #include "esp_mac.h"
-#include <sstream>
-#include <iomanip>
+#include "esp_timer.h"
+#include "esp_random.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
 #include "Version.hpp"
 
 #include "esp_log.h"
 
-std::string getDeviceMacID()
+// WiFi STA MAC, 12 hex chữ hoa (+ NUL)
+static void formatDeviceMacID(char (&out)[13])
 {
     uint8_t mac[6];
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
-    std::stringstream ss;
-    for (int i = 0; i < 6; ++i)
-    {
-        ss << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << (int)mac[i];
-    }
-    return ss.str();
+    std::snprintf(out, sizeof(out), "%02X%02X%02X%02X%02X%02X",
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 }
 
 static const char *TAG = "NetworkManager";
 
+static uint32_t nowMs()
+{
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+// Host part of ws://host[:port]/path (UDP audio goes to the same host)
+static bool hostFromUrl(std::string_view url, char (&out)[64])
+{
+    const size_t scheme = url.find("://");
+    if (scheme != std::string_view::npos)
+        url.remove_prefix(scheme + 3);
+    const size_t end = url.find_first_of(":/?");
+    if (end != std::string_view::npos)
+        url = url.substr(0, end);
+    if (url.empty() || url.size() >= sizeof(out))
+        return false;
+    std::memcpy(out, url.data(), url.size());
+    out[url.size()] = '\0';
+    return true;
+}
+
+// ms until a nowMs() deadline, 0 if due (wrap-safe)
+static uint32_t msUntil(uint32_t due_ms, uint32_t now)
+{
+    const int32_t left = static_cast<int32_t>(due_ms - now);
+    return left > 0 ? static_cast<uint32_t>(left) : 0;
+}
+
+static_assert(NetworkManager::UPLINK_HEADROOM >= proto::HEADER_SIZE + WebSocketClient::FRAME_HEADROOM,
+              "uplink headroom must fit proto + WS client headers");
+
 NetworkManager::NetworkManager() = default;
 
 NetworkManager::~NetworkManager()
 {
     stop();
+    if (uplink_task_handle)
+    {
+        vTaskDelete(uplink_task_handle); // parked: stop() ended its turn
+        uplink_task_handle = nullptr;
+    }
+    if (event_queue)
+    {
+        Event ev;
+        while (xQueueReceive(event_queue, &ev, 0) == pdTRUE)
+            delete[] ev.text;
+        vQueueDelete(event_queue);
+        event_queue = nullptr;
+    }
+    if (control_queue)
+    {
+        vQueueDelete(control_queue);
+        control_queue = nullptr;
+    }
 }
 
 // ============================================================================
@@ -46,8 +102,44 @@ bool NetworkManager::init()
         return false;
     }
 
+    if (event_queue == nullptr)
+    {
+        event_queue = xQueueCreate(EVENT_QUEUE_LEN, sizeof(Event));
+        if (!event_queue)
+        {
+            ESP_LOGE(TAG, "Failed to create event queue");
+            return false;
+        }
+    }
+
+    if (!loop_waker.init())
+    {
+        ESP_LOGE(TAG, "Failed to create NetworkLoop waker");
+        return false;
+    }
+
+    if (control_queue == nullptr)
+    {
+        control_queue = xQueueCreate(config_.control_queue_len, sizeof(ControlItem));
+        if (!control_queue)
+        {
+            ESP_LOGE(TAG, "Failed to create control queue");
+            return false;
+        }
+    }
+
     wifi->init();
-    ws->init();
+    ws->setRxBuffer(ws_rx_buf, sizeof(ws_rx_buf));
+    bitrate.setConfig(config_.bitrate);
+
+    // WS-level liveness for every server (feature::PING servers also get
+    // app-level PING with ms deadlines)
+    ws->setKeepalive(std::max<int>(1, config_.ping_interval_ms / 1000),
+                     std::max<int>(1, (config_.liveness_timeout_ms + 999) / 1000));
+
+    // Session token: same across reconnects, new per boot
+    std::snprintf(session_token, sizeof(session_token), "%08X%08X",
+                  (unsigned)esp_random(), (unsigned)esp_random());
 
     // Apply configured WS URL if provided
     if (!config_.ws_url.empty())
@@ -56,31 +148,46 @@ bool NetworkManager::init()
     }
 
     // --------------------------------------------------------------------
-    // WiFi Status Callback
+    // WiFi Status Callback (Wi-Fi event task → NetworkLoop)
     // --------------------------------------------------------------------
     wifi->onStatus([this](int status)
-                   { this->handleWifiStatus(status); });
+                   { this->post(Event::Type::WIFI_STATUS, status); });
 
     // --------------------------------------------------------------------
-    // WebSocket Status Callback
+    // WebSocket Status Callback (NetworkLoop, or a sender that lost the link)
     // --------------------------------------------------------------------
     ws->onStatus([this](int status)
-                 { this->handleWsStatus(status); });
+                 { this->post(Event::Type::WS_STATUS, status); });
 
     // --------------------------------------------------------------------
-    // WebSocket Message Callbacks
+    // WebSocket Message Callbacks (NetworkLoop, inside ws->poll())
     // --------------------------------------------------------------------
-    ws->onText([this](const std::string &msg)
+    ws->onText([this](std::string_view msg)
                { this->handleWsTextMessage(msg); });
 
-    ws->onBinary([this](const uint8_t *data, size_t len)
-                 { this->handleWsBinaryMessage(data, len); });
+    ws->onBinary([this](const uint8_t *data, size_t len, size_t offset, size_t total, bool last)
+                 { this->handleWsBinaryMessage(data, len, offset, total, last); });
+
+    // --------------------------------------------------------------------
+    // UDP audio link (UdpAudio task), bound only when the server offers it
+    // --------------------------------------------------------------------
+    if (config_.udp_audio && !udp)
+    {
+        udp = std::make_unique<UdpAudioLink>();
+        UdpAudioLink::Config udp_cfg;
+        udp_cfg.redundancy = config_.udp_redundancy;
+        udp->setConfig(udp_cfg);
+        udp->onAudio([this](const proto::Header &h, const uint8_t *payload, size_t len)
+                     { this->handleUdpAudio(h, payload, len); });
+        udp->onReady([this](bool ok, uint32_t token)
+                     { this->onUdpReady(ok, token); });
+    }
 
     // Đăng ký nhận thông báo trạng thái
     sub_interaction_id = StateManager::instance().subscribeInteraction(
-        [this](state::InteractionState s, state::InputSource src)
+        [this](state::InteractionState s, state::InputSource /*src*/)
         {
-            this->handleInteractionState(s);
+            this->post(Event::Type::INTERACTION, static_cast<int32_t>(s));
         });
 
     ESP_LOGI(TAG, "NetworkManager init OK");
@@ -105,49 +212,71 @@ void NetworkManager::start()
 
     ESP_LOGI(TAG, "NetworkManager start()");
 
-    // Prefer explicit credentials if provided in config
-    if (!config_.sta_ssid.empty() && !config_.sta_pass.empty())
+    // Event loop: owns the connection state from here on
+    if (task_handle == nullptr)
     {
-        wifi->connectWithCredentials(config_.sta_ssid.c_str(), config_.sta_pass.c_str());
-        publishState(state::ConnectivityState::CONNECTING_WIFI);
-        // Spawn retry task to open portal if connection fails
-        if (wifi_retry_task == nullptr)
+        TaskHandle_t th = nullptr;
+        BaseType_t rc = xTaskCreatePinnedToCore(
+            &NetworkManager::taskEntry,
+            "NetworkLoop",
+            10240, // WS receive path + TLS handshake (mbedTLS ECDHE / X.509) run here
+            this,
+            5,
+            &th,
+            tskNO_AFFINITY);
+        if (rc != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create NetworkLoop task (%d)", (int)rc);
+        }
+        else
         {
-            xTaskCreate(&NetworkManager::retryWifiTaskEntry, "wifi_retry", 4096, this, 5, &wifi_retry_task);
+            task_handle = th;
         }
     }
-    else
-    {
-        // Try auto-connect (saved creds). If available, still spawn retry task for fallback.
-        wifi->autoConnect();
-        publishState(state::ConnectivityState::CONNECTING_WIFI);
 
-        // Always spawn retry task - even with autoConnect, if WiFi fails to actually connect,
-        // we need the portal fallback after 5 seconds
-        if (wifi_retry_task == nullptr)
+    // Uplink worker: sleeps until LISTENING arms it; kept across stop/start
+    if (uplink_task_handle == nullptr)
+    {
+        BaseType_t rc = xTaskCreatePinnedToCore(
+            &NetworkManager::uplinkTaskEntry,
+            "WsUplink",
+            4096,
+            this,
+            5,
+            &uplink_task_handle,
+            1 // Core 1
+        );
+        if (rc != pdPASS)
         {
-            ESP_LOGI(TAG, "Spawning WiFi retry task for fallback to portal if connection fails");
-            xTaskCreate(&NetworkManager::retryWifiTaskEntry, "wifi_retry", 4096, this, 5, &wifi_retry_task);
+            ESP_LOGE(TAG, "Failed to create WsUplink task (%d)", (int)rc);
+            uplink_task_handle = nullptr;
         }
     }
 
-    // Spawn internal update task so callers don't need to tick manually
-    if (task_handle == nullptr)
+    // Control lane consumer: above NetworkLoop (prio 5) so a queued command
+    // preempts audio handling as soon as it is classified
+    if (control_task_handle == nullptr && control_queue)
     {
         BaseType_t rc = xTaskCreatePinnedToCore(
-            &NetworkManager::taskEntry,
-            "NetworkLoop",
-            8192, // Increased from 4096 to prevent stack overflow
+            &NetworkManager::controlTaskEntry,
+            "NetControl",
+            4096,
             this,
-            5,
-            &task_handle,
+            config_.control_task_prio,
+            &control_task_handle,
             tskNO_AFFINITY);
         if (rc != pdPASS)
         {
-            ESP_LOGE(TAG, "Failed to create NetworkLoop task (%d)", (int)rc);
-            task_handle = nullptr;
+            ESP_LOGE(TAG, "Failed to create NetControl task (%d)", (int)rc);
+            control_task_handle = nullptr;
         }
     }
+
+    // UDP audio link: parked until a server offers UDP
+    if (udp)
+        udp->start();
+
+    post(Event::Type::START);
 }
 
 void NetworkManager::stop()
@@ -158,170 +287,707 @@ void NetworkManager::stop()
 
     ESP_LOGW(TAG, "NetworkManager stop()");
 
+    // The loop closes the drivers itself and exits
+    bool loop_done = false;
+    if (task_handle && post(Event::Type::STOP))
+    {
+        for (int i = 0; i < 50 && task_handle; ++i)
+            vTaskDelay(pdMS_TO_TICKS(10));
+        loop_done = (task_handle == nullptr);
+    }
+    if (!loop_done)
+    {
+        // Loop stuck or never started: stop it and finish its queue here
+        // (nobody else owns the state now), so no stale STOP survives into
+        // the next start()
+        if (TaskHandle_t th = task_handle.exchange(nullptr))
+            vTaskDelete(th);
+        bool link_down = false;
+        Event ev;
+        while (event_queue && xQueueReceive(event_queue, &ev, 0) == pdTRUE)
+        {
+            handleEvent(ev);
+            delete[] ev.text;
+            link_down |= (ev.type == Event::Type::STOP);
+        }
+        if (!link_down)
+            shutdownLink();
+    }
+
+    if (control_task_handle)
+    {
+        TaskHandle_t th = control_task_handle;
+        control_task_handle = nullptr;
+        vTaskDelete(th);
+    }
+}
+
+void NetworkManager::shutdownLink()
+{
     ws_should_run = false;
     ws_running = false;
+    connect_pending = false;
+    fallback = Fallback::NONE;
+    udp_audio_active = false;
 
+    if (udp)
+        udp->unbind();
     if (ws)
         ws->close();
     if (wifi)
         wifi->disconnect();
+}
+
+// ============================================================================
+// EVENT LOOP
+// ============================================================================
+bool NetworkManager::post(Event::Type type, int32_t value, char *text)
+{
+    Event ev;
+    ev.type = type;
+    ev.value = value;
+    ev.text = text;
+
+    if (task_handle == nullptr)
+    {
+        // No loop (setup before start, after stop): the caller is the only owner
+        handleEvent(ev);
+        delete[] text;
+        return true;
+    }
 
-    if (task_handle)
+    if (!event_queue || xQueueSend(event_queue, &ev, 0) != pdTRUE)
     {
-        TaskHandle_t th = task_handle;
-        task_handle = nullptr;
-        vTaskDelete(th);
+        ESP_LOGE(TAG, "Event queue full, dropped event %d", (int)type);
+        delete[] text;
+        return false;
+    }
+    loop_waker.wake(); // the loop sleeps in select(), not on the queue
+    return true;
+}
+
+// "a\0b\0" in one allocation; nullptr if out of memory
+char *NetworkManager::copyText(std::string_view a, std::string_view b)
+{
+    char *p = new (std::nothrow) char[a.size() + b.size() + 2];
+    if (!p)
+        return nullptr;
+    std::memcpy(p, a.data(), a.size());
+    p[a.size()] = '\0';
+    std::memcpy(p + a.size() + 1, b.data(), b.size());
+    p[a.size() + 1 + b.size()] = '\0';
+    return p;
+}
+
+void NetworkManager::runLoop()
+{
+    while (runLoopOnce())
+    {
+    }
+}
+
+bool NetworkManager::runLoopOnce()
+{
+    // One wait for everything: WS socket, posted events (waker), deadlines.
+    // Bytes already decrypted inside TLS do not make the fd readable.
+    const uint32_t timeout = ws->hasBuffered() ? 0 : std::min(nextWakeMs(), ws->dueMs());
+    const uint8_t ready = net::waitReady(ws->fd(), true, ws->wantsWrite(), loop_waker.fd(), timeout);
+    if (ready & net::WOKEN)
+        loop_waker.drain(); // before the queue: a later post wakes again
+
+    Event ev;
+    while (xQueueReceive(event_queue, &ev, 0) == pdTRUE)
+    {
+        handleEvent(ev);
+        delete[] ev.text;
+        if (ev.type == Event::Type::STOP)
+            return false;
+    }
+
+    ws->poll(); // connect steps, frames → callbacks, WS keepalive
+    serviceTimers();
+    return true;
+}
+
+void NetworkManager::handleEvent(const Event &ev)
+{
+    switch (ev.type)
+    {
+    case Event::Type::START:
+        // Prefer explicit credentials if provided in config
+        if (wifi && !config_.sta_ssid.empty() && !config_.sta_pass.empty())
+            wifi->connectWithCredentials(config_.sta_ssid.c_str(), config_.sta_pass.c_str());
+        else if (wifi)
+            wifi->autoConnect(); // saved creds
+        publishState(state::ConnectivityState::CONNECTING_WIFI);
+
+        // Even with saved creds the connection may never come up
+        ESP_LOGI(TAG, "Starting WiFi retry phase (%u ms)", (unsigned)WIFI_FALLBACK_MS);
+        fallback = Fallback::WAIT_WIFI;
+        fallback_due_ms = nowMs() + WIFI_FALLBACK_MS;
+        break;
+
+    case Event::Type::STOP:
+        shutdownLink();
+        break;
+
+    case Event::Type::WIFI_STATUS:
+        handleWifiStatus(ev.value);
+        break;
+
+    case Event::Type::WS_STATUS:
+        handleWsStatus(ev.value);
+        break;
+
+    case Event::Type::INTERACTION:
+        handleInteractionState(static_cast<state::InteractionState>(ev.value));
+        break;
+
+    case Event::Type::SET_IMMUNE:
+        ws_immune_mode = ev.value != 0;
+        if (ws_immune_mode)
+        {
+            ESP_LOGI(TAG, "WS immune mode ENABLED - WS will ignore WiFi fluctuations");
+        }
+        else
+        {
+            ESP_LOGI(TAG, "WS immune mode DISABLED - normal WS behavior");
+        }
+        break;
+
+    case Event::Type::SET_CREDENTIALS:
+        if (wifi && ev.text)
+            wifi->connectWithCredentials(ev.text, ev.text + std::strlen(ev.text) + 1);
+        break;
+
+    case Event::Type::SET_WS_URL:
+        if (!ev.text)
+            break;
+        config_.ws_url = ev.text;
+        if (ws && !config_.ws_url.empty())
+            ws->setUrl(config_.ws_url);
+        break;
+
+    case Event::Type::SET_AP_SSID:
+        if (ev.text)
+            config_.ap_ssid = ev.text;
+        break;
+
+    case Event::Type::SET_DEVICE_LIMIT:
+        config_.ap_max_clients = static_cast<uint8_t>(ev.value);
+        break;
+
+    case Event::Type::STOP_PORTAL:
+        if (wifi)
+            wifi->stopCaptivePortal();
+        break;
+
+    case Event::Type::START_BLE_CONFIG:
+        if (ble_service)
+        {
+            ESP_LOGW(TAG, "Start BLE Config Mode now (RAM should be free)");
+            ble_service->init(config_.ap_ssid);
+            ble_service->start();
+        }
+        break;
     }
 }
 
 // ============================================================================
-// UPDATE LOOP
+// TIMERS
 // ============================================================================
-
-void NetworkManager::update(uint32_t dt_ms)
+void NetworkManager::serviceTimers()
 {
     if (!started)
         return;
 
-    tick_ms += dt_ms;
+    serviceCredits();
+    serviceLiveness();
+    serviceTelemetry();
+    serviceWifiFallback();
 
     // --------------------------------------------------------------------
     // Retry WebSocket nếu WiFi đã kết nối
     // --------------------------------------------------------------------
-    if (ws_should_run && !ws_running)
+    if (!ws_should_run || ws_running)
+        return;
+
+    const uint32_t now = nowMs();
+    if (msUntil(ws_retry_due_ms, now) > 0)
+        return;
+
+    if (connect_pending)
     {
-        if (ws_retry_timer > 0)
-        {
-            ws_retry_timer = (ws_retry_timer > dt_ms) ? (ws_retry_timer - dt_ms) : 0;
-            return;
-        }
+        // Neither OPEN nor CLOSE within connect_timeout_ms
+        connect_pending = false;
+        const uint32_t delay = nextBackoffMs();
+        ws_retry_due_ms = now + delay;
+        ESP_LOGW(TAG, "WS connect timeout → retry in %u ms", (unsigned)delay);
+        ws->abort(); // this CLOSED keeps the retry above
+        return;
+    }
 
-        ESP_LOGI(TAG, "NetworkManager → Trying WebSocket connect...");
-        publishState(state::ConnectivityState::CONNECTING_WS);
+    ESP_LOGI(TAG, "NetworkManager → Trying WebSocket connect (attempt %u)...",
+             (unsigned)reconnect_attempt + 1);
+    publishState(state::ConnectivityState::CONNECTING_WS);
 
-        // Ensure WS URL is configured before connecting
-        if (!config_.ws_url.empty())
-        {
-            ws->setUrl(config_.ws_url);
-        }
-        ws->connect();
+    // Ensure WS URL is configured before connecting
+    if (!config_.ws_url.empty())
+    {
+        ws->setUrl(config_.ws_url);
+    }
+    NetSocket *sock = wsSocketForUrl();
+    if (!sock)
+    {
+        const uint32_t delay = nextBackoffMs();
+        ws_retry_due_ms = now + delay;
+        ESP_LOGE(TAG, "No WS transport → retry in %u ms", (unsigned)delay);
+        return;
+    }
+    ws->setSocket(sock);
+    connect_pending = true;
+    ws_retry_due_ms = now + config_.connect_timeout_ms;
+    ws->connect(); // → CONNECTING, then ws->poll() steps it
+}
 
-        ws_retry_timer = 5000; // 5 second delay between reconnect attempts
+NetSocket *NetworkManager::wsSocketForUrl()
+{
+    if (!ws->urlIsSecure())
+        return &ws_plain;
+
+    if (!ws_tls)
+    {
+        // A few KB of mbedTLS config; the SSL record buffers (~20 KB) only
+        // while connected
+        ws_tls.reset(new (std::nothrow) TlsSocket());
+        if (!ws_tls)
+            return nullptr;
+        TlsSocket::Config tls_cfg;
+        tls_cfg.ca_pem = config_.ws_ca_pem;
+        tls_cfg.skip_cn_check = config_.ws_skip_cn_check;
+        tls_cfg.keep_session_in_rtc = config_.ws_tls_session_rtc;
+        ws_tls->setConfig(tls_cfg);
     }
+    return ws_tls.get();
 }
 
-void NetworkManager::taskEntry(void *arg)
+uint32_t NetworkManager::nextBackoffMs()
 {
-    auto *self = static_cast<NetworkManager *>(arg);
-    if (!self)
+    uint32_t cap = config_.reconnect_min_ms << std::min<uint8_t>(reconnect_attempt, 16);
+    cap = std::min(cap, config_.reconnect_max_ms);
+    if (reconnect_attempt < 16)
+        ++reconnect_attempt;
+
+    // Equal jitter: half keeps the spacing, half spreads a fleet that lost
+    // the same AP / server at the same instant
+    return cap / 2 + esp_random() % (cap / 2 + 1);
+}
+
+// ============================================================================
+// LIVENESS
+// ============================================================================
+void NetworkManager::serviceLiveness()
+{
+    if (!ws_running || !app_ping)
+        return;
+
+    const uint32_t now = nowMs();
+    const uint32_t silent = now - last_rx_ms.load();
+
+    if (silent >= config_.liveness_timeout_ms)
     {
-        vTaskDelete(nullptr);
+        // TCP may not notice for minutes (no RST from a dead AP / NAT)
+        ESP_LOGW(TAG, "Server silent for %u ms → reconnect", (unsigned)silent);
+        ws->abort(); // → handleWsStatus(CLOSED) → backoff
         return;
     }
 
-    TickType_t prev = xTaskGetTickCount();
-    for (;;)
+    // A clock server gets one per interval even on a busy link: the
+    // estimator wants steady samples
+    const bool due = silent >= config_.ping_interval_ms || clock_supported;
+    if (due && now - last_ping_ms >= config_.ping_interval_ms)
     {
-        if (!self->started.load())
-        {
-            vTaskDelete(nullptr);
-        }
-
-        TickType_t now = xTaskGetTickCount();
-        uint32_t dt_ms = (now - prev) * portTICK_PERIOD_MS;
-        prev = now;
+        uint8_t args[8];
+        proto::putU32(args, ++ping_nonce);
+        proto::putU32(args + 4, now);
+        sendControl(proto::Control::PING, args, sizeof(args));
+        last_ping_ms = now;
+    }
+}
 
-        self->update(dt_ms ? dt_ms : self->update_interval_ms);
+uint32_t NetworkManager::livenessDueMs() const
+{
+    const uint32_t now = nowMs();
+    const uint32_t silent = now - last_rx_ms.load();
+    if (silent >= config_.liveness_timeout_ms)
+        return 0;
 
-        vTaskDelay(pdMS_TO_TICKS(self->update_interval_ms));
+    uint32_t due = config_.liveness_timeout_ms - silent;
+    if (silent < config_.ping_interval_ms && !clock_supported)
+    {
+        due = std::min(due, config_.ping_interval_ms - silent);
+    }
+    else
+    {
+        const uint32_t since_ping = now - last_ping_ms;
+        due = std::min(due, since_ping >= config_.ping_interval_ms
+                                ? 0
+                                : config_.ping_interval_ms - since_ping);
     }
+    return due;
 }
 
 // ============================================================================
-// SET CREDENTIALS
+// LINK QUALITY PROBE
 // ============================================================================
-void NetworkManager::setCredentials(const std::string &ssid, const std::string &pass)
+void NetworkManager::onRttSample(uint32_t rtt)
 {
-    if (wifi)
+    rtt_ms = rtt;
+    const uint32_t srtt = srtt_ms.load();
+    if (srtt == 0)
     {
-        wifi->connectWithCredentials(ssid.c_str(), pass.c_str());
+        srtt_ms = std::max<uint32_t>(rtt, 1);
+        rttvar_ms = rtt / 2;
+        return;
     }
+    // RFC 6298: β = 1/4, α = 1/8
+    const uint32_t err = rtt > srtt ? rtt - srtt : srtt - rtt;
+    rttvar_ms = (3 * rttvar_ms.load() + err) / 4;
+    srtt_ms = std::max<uint32_t>((7 * srtt + rtt) / 8, 1);
 }
 
 // ============================================================================
-// SEND MESSAGE TO WS
+// CLOCK SYNC
 // ============================================================================
-bool NetworkManager::sendText(const std::string &text)
+// NetworkLoop, PONG of a feature::CLOCK server: [nonce][t1][t2][t3]
+void NetworkManager::onClockSample(const uint8_t *pong_args, uint32_t now)
 {
-    if (!ws_running)
-        return false;
-    return ws->sendText(text);
+    const uint32_t t1 = proto::getU32(pong_args + 4);
+    const uint32_t t2 = proto::getU32(pong_args + 8);
+    const uint32_t t3 = proto::getU32(pong_args + 12);
+    const bool first = !clock_sync.mapping().valid;
+    if (!clock_sync.onSample(t1, t2, t3, now))
+    {
+        ESP_LOGW(TAG, "Clock: inconsistent PONG stamps, sample dropped");
+        return;
+    }
+
+    const ClockSync::Mapping &m = clock_sync.mapping();
+    {
+        std::lock_guard<std::mutex> lock(clock_lock);
+        clock_map = m;
+    }
+    if (first)
+        ESP_LOGI(TAG, "Clock: synced to the server, ±%u ms", (unsigned)m.error_ms);
+    ESP_LOGD(TAG, "Clock: ±%u ms, skew %d ppm, up %d down %d ms", (unsigned)m.error_ms, (int)m.skew_ppm,
+             (int)clock_sync.uplinkMs(t1, t2), (int)clock_sync.downlinkMs(t3, now));
+
+    // PINGs sent during the turn (LISTENING → LISTEN_END): the probe ones
+    // waited behind the audio
+    const uint32_t start = turn_start_ms;
+    const uint32_t end = turn_end_ms;
+    if ((turn_listening || end != 0) && static_cast<int32_t>(t1 - start) >= 0 &&
+        (end == 0 || static_cast<int32_t>(t1 - end) <= 0))
+    {
+        turn_up_sum_ms += clock_sync.uplinkMs(t1, t2);
+        ++turn_up_count;
+    }
 }
 
-bool NetworkManager::sendBinary(const uint8_t *data, size_t len)
+ClockSync::Mapping NetworkManager::serverClock() const
 {
-    if (!ws_running)
-        return false;
-    return ws->sendBinary(data, len);
+    std::lock_guard<std::mutex> lock(clock_lock);
+    return clock_map;
 }
 
-// ============================================================================
-// CALLBACK REGISTRATION
-// ============================================================================
-void NetworkManager::onServerText(std::function<void(const std::string &)> cb)
+// NetworkLoop, first control of the answer (SPEAK_START), stamped by the
+// server when it sent it
+void NetworkManager::reportTurn(uint32_t answer_server_ms)
 {
-    on_text_cb = cb;
+    const uint32_t end = turn_end_ms.exchange(0);
+    const ClockSync::Mapping m = serverClock();
+    if (end == 0 || !m.valid)
+        return;
+
+    const uint32_t now = nowMs();
+    const uint32_t n = turn_up_count;
+    // No PING in the turn: the best exchange's half RTT
+    const int32_t up = n > 0 ? turn_up_sum_ms / static_cast<int32_t>(n) : static_cast<int32_t>(m.error_ms);
+    const int32_t down = static_cast<int32_t>(m.toServer(now) - answer_server_ms);
+    const int32_t server = static_cast<int32_t>(answer_server_ms - m.toServer(end)) - up;
+    const uint32_t total = now - end; // device clock only
+
+    ESP_LOGI(TAG, "Turn: %u ms to the answer = up %d + server %d + down %d ms (±%u, %u PINGs)",
+             (unsigned)total, (int)up, (int)server, (int)down, (unsigned)m.error_ms, (unsigned)n);
+
+    char buf[160];
+    json::Writer w(buf, sizeof(buf));
+    w.beginObject()
+        .key("type").str("turn")
+        .key("total_ms").integer(total)
+        .key("up_ms").integer(up)
+        .key("srv_ms").integer(server)
+        .key("down_ms").integer(down)
+        .key("err_ms").integer(m.error_ms)
+        .key("skew_ppm").integer(m.skew_ppm)
+        .key("t0").integer(turn_t0_ms)
+        .endObject();
+    if (w.ok())
+        sendText(w.view());
 }
 
-void NetworkManager::onServerBinary(std::function<void(const uint8_t *, size_t)> cb)
+void NetworkManager::recordUplinkDelay(uint32_t ms)
 {
-    on_binary_cb = cb;
+    up_delay_sum_ms += ms;
+    ++up_delay_count;
+    if (ms > up_delay_peak_ms.load())
+        up_delay_peak_ms = ms; // single writer (uplink task)
 }
 
-void NetworkManager::onDisconnect(std::function<void()> cb)
+uint32_t NetworkManager::telemetryDueMs() const
 {
-    on_disconnect_cb = cb;
+    const uint32_t elapsed = nowMs() - telemetry_ms;
+    return elapsed >= config_.telemetry_interval_ms ? 0 : config_.telemetry_interval_ms - elapsed;
 }
 
-void NetworkManager::setWSImmuneMode(bool immune)
+void NetworkManager::serviceTelemetry()
 {
-    ws_immune_mode = immune;
-    if (immune)
+    if (!ws_running || config_.telemetry_interval_ms == 0 || telemetryDueMs() > 0)
+        return;
+
+    const uint32_t now = nowMs();
+    const uint32_t period = std::max<uint32_t>(now - telemetry_ms, 1);
+    telemetry_ms = now;
+
+    // Close the period
+    pub_rx_bps = static_cast<uint32_t>(uint64_t(stat_rx_bytes.exchange(0)) * 8000 / period);
+    pub_tx_bps = static_cast<uint32_t>(uint64_t(stat_tx_bytes.exchange(0)) * 8000 / period);
+    const uint32_t n = up_delay_count.exchange(0);
+    const uint32_t sum = up_delay_sum_ms.exchange(0);
+    pub_up_delay_ms = n > 0 ? sum / n : 0;
+    pub_up_delay_max_ms = up_delay_peak_ms.exchange(0);
+    pub_rssi_dbm = wifi ? wifi->getRssi() : 0;
+    pub_ctrl_lat_max_us = ctrl_lat_peak_us.exchange(0);
+
+    // Probe PING: liveness only pings a quiet link, the RTT would go stale
+    // during a conversation
+    if (app_ping && now - last_ping_ms >= config_.ping_interval_ms)
     {
-        ESP_LOGI(TAG, "WS immune mode ENABLED - WS will ignore WiFi fluctuations");
+        uint8_t args[8];
+        proto::putU32(args, ++ping_nonce);
+        proto::putU32(args + 4, now);
+        sendControl(proto::Control::PING, args, sizeof(args));
+        last_ping_ms = now;
     }
-    else
+
+    const LinkStats st = getLinkStats();
+    ESP_LOGD(TAG, "Link: rtt %u/%u±%u ms, jitter %u us, upq %u/%u ms, rssi %d, rx %u tx %u bps, ctrl %u us",
+             (unsigned)st.rtt_ms, (unsigned)st.srtt_ms, (unsigned)st.rttvar_ms, (unsigned)st.jitter_us,
+             (unsigned)st.uplink_queue_ms, (unsigned)st.uplink_queue_max_ms, st.rssi_dbm,
+             (unsigned)st.rx_bps, (unsigned)st.tx_bps, (unsigned)st.control_latency_max_us);
+
+    // {"type":"telemetry",...}: ~290 B every period
+    char buf[336];
+    json::Writer w(buf, sizeof(buf));
+    w.beginObject()
+        .key("type").str("telemetry")
+        .key("rtt_ms").integer(st.rtt_ms)
+        .key("srtt_ms").integer(st.srtt_ms)
+        .key("rttvar_ms").integer(st.rttvar_ms)
+        .key("jitter_us").integer(st.jitter_us)
+        .key("upq_ms").integer(st.uplink_queue_ms)
+        .key("upq_max_ms").integer(st.uplink_queue_max_ms)
+        .key("rssi").integer(st.rssi_dbm)
+        .key("rx_bps").integer(st.rx_bps)
+        .key("tx_bps").integer(st.tx_bps)
+        .key("ctrl_max_us").integer(st.control_latency_max_us)
+        .key("ctrl_drops").integer(st.control_drops)
+        .key("udp").boolean(st.udp_audio)
+        .key("udp_rep").integer(st.udp_repaired)
+        .key("udp_lost").integer(st.udp_lost)
+        .key("prof").integer(st.uplink_profile)
+        .endObject();
+    if (w.ok())
+        sendText(w.view());
+}
+
+NetworkManager::LinkStats NetworkManager::getLinkStats() const
+{
+    LinkStats st;
+    st.rtt_ms = rtt_ms;
+    st.srtt_ms = srtt_ms;
+    st.rttvar_ms = rttvar_ms;
+    st.jitter_us = rx_jitter_us;
+    st.uplink_queue_ms = pub_up_delay_ms;
+    st.uplink_queue_max_ms = pub_up_delay_max_ms;
+    st.rssi_dbm = pub_rssi_dbm;
+    st.rx_bps = pub_rx_bps;
+    st.tx_bps = pub_tx_bps;
+    st.control_latency_max_us = pub_ctrl_lat_max_us;
+    st.control_drops = ctrl_drops;
+    st.udp_audio = udp_audio_active;
+    st.uplink_profile = pub_uplink_profile;
+    if (udp)
     {
-        ESP_LOGI(TAG, "WS immune mode DISABLED - normal WS behavior");
+        const UdpAudioLink::Stats us = udp->stats();
+        st.udp_repaired = us.rx_recovered;
+        st.udp_lost = us.rx_lost;
     }
+    return st;
 }
 
-// ============================================================================
-// RUNTIME CONFIG SETTERS
-// ============================================================================
-void NetworkManager::setWsUrl(const std::string &url)
+void NetworkManager::taskEntry(void *arg)
 {
-    config_.ws_url = url;
-    if (ws && !url.empty())
+    auto *self = static_cast<NetworkManager *>(arg);
+    if (self)
     {
-        ws->setUrl(url);
+        self->runLoop();
+        self->task_handle = nullptr; // stop() waits for this
     }
+    vTaskDelete(nullptr);
 }
 
-void NetworkManager::setApSsid(const std::string &apSsid)
+void NetworkManager::wakeLoop()
 {
-    config_.ap_ssid = apSsid;
+    loop_waker.wake(); // eventfd counter: repeated wakes coalesce
 }
 
-void NetworkManager::setDeviceLimit(uint8_t maxClients)
+uint32_t NetworkManager::nextWakeMs() const
 {
-    config_.ap_max_clients = maxClients;
+    const uint32_t now = nowMs();
+    uint32_t ms = UINT32_MAX; // nothing scheduled (== net::WAIT_FOREVER)
+    if (ws_should_run && !ws_running)
+    {
+        ms = msUntil(ws_retry_due_ms, now);
+    }
+    if (fallback != Fallback::NONE)
+    {
+        ms = std::min(ms, msUntil(fallback_due_ms, now));
+    }
+    if (credit_busy)
+    {
+        ms = std::min<uint32_t>(ms, config_.credit_interval_ms);
+    }
+    if (ws_running && app_ping)
+    {
+        ms = std::min(ms, livenessDueMs());
+    }
+    if (ws_running && config_.telemetry_interval_ms > 0)
+    {
+        ms = std::min(ms, telemetryDueMs());
+    }
+    return ms == UINT32_MAX ? net::WAIT_FOREVER : ms;
 }
 
 // ============================================================================
-// WIFI STATUS HANDLER
+// SET CREDENTIALS
 // ============================================================================
-//
+void NetworkManager::setCredentials(const std::string &ssid, const std::string &pass)
+{
+    if (char *text = copyText(ssid, pass))
+        post(Event::Type::SET_CREDENTIALS, 0, text);
+}
+
+// ============================================================================
+// SEND MESSAGE TO WS
+// ============================================================================
+bool NetworkManager::sendText(std::string_view text)
+{
+    if (!ws_running || !ws->sendText(text))
+        return false;
+    stat_tx_bytes += text.size();
+    return true;
+}
+
+bool NetworkManager::sendBinary(const uint8_t *data, size_t len)
+{
+    if (!ws_running || !ws->sendBinary(data, len))
+        return false;
+    stat_tx_bytes += len;
+    return true;
+}
+
+bool NetworkManager::sendControl(proto::Control c, const uint8_t *args, size_t args_len)
+{
+    if (!ws_running)
+        return false;
+
+    if (!framing_active)
+    {
+        const char *text = proto::controlToText(c);
+        return text ? sendText(text) : false;
+    }
+
+    // Server time once synced: the server reads the one-way delay off it
+    uint32_t ts = nowMs();
+    uint8_t flags = 0;
+    if (clock_supported)
+    {
+        const ClockSync::Mapping m = serverClock();
+        if (m.valid)
+        {
+            ts = m.toServer(ts);
+            flags = proto::flag::SERVER_TIME;
+        }
+    }
+
+    uint8_t frame[proto::HEADER_SIZE + 32];
+    size_t n = proto::writeControl(c, args, args_len, tx_ctrl_seq++, ts, frame, sizeof(frame), flags);
+    return n > 0 && sendBinary(frame, n);
+}
+
+// ============================================================================
+// CALLBACK REGISTRATION
+// ============================================================================
+void NetworkManager::onServerText(std::function<void(std::string_view)> cb)
+{
+    on_text_cb = cb;
+}
+
+void NetworkManager::onServerControl(std::function<void(proto::Control, const uint8_t *, size_t)> cb)
+{
+    on_control_cb = cb;
+}
+
+void NetworkManager::onServerBinary(std::function<void(const uint8_t *, size_t)> cb)
+{
+    on_binary_cb = cb;
+}
+
+void NetworkManager::onDisconnect(std::function<void()> cb)
+{
+    on_disconnect_cb = cb;
+}
+
+void NetworkManager::setWSImmuneMode(bool immune)
+{
+    post(Event::Type::SET_IMMUNE, immune ? 1 : 0);
+}
+
+// ============================================================================
+// RUNTIME CONFIG SETTERS
+// ============================================================================
+void NetworkManager::setWsUrl(const std::string &url)
+{
+    if (char *text = copyText(url))
+        post(Event::Type::SET_WS_URL, 0, text);
+}
+
+void NetworkManager::setApSsid(const std::string &apSsid)
+{
+    if (char *text = copyText(apSsid))
+        post(Event::Type::SET_AP_SSID, 0, text);
+}
+
+void NetworkManager::setDeviceLimit(uint8_t maxClients)
+{
+    post(Event::Type::SET_DEVICE_LIMIT, maxClients);
+}
+
+// ============================================================================
+// WIFI STATUS HANDLER
+// ============================================================================
+//
 // WifiService status code:
 //   0 = DISCONNECTED
 //   1 = CONNECTING
@@ -364,14 +1030,14 @@ void NetworkManager::handleWifiStatus(int status)
     case 2: // GOT_IP
         ESP_LOGI(TAG, "WiFi → GOT_IP");
 
-        if (wifi_retry_task)
-        {
-            vTaskDelete(wifi_retry_task);
-            wifi_retry_task = nullptr;
-        }
+        fallback = Fallback::NONE;
         wifi_ready = true;
         ws_should_run = true;
-        ws_retry_timer = 500; // Wait 500ms for WiFi to stabilize before WS connect
+        reconnect_attempt = 0;
+        connect_pending = false;
+        // Wait for WiFi to stabilize before WS connect. Jitter: after an AP
+        // reboot the whole fleet gets its IP at the same moment.
+        ws_retry_due_ms = nowMs() + 500 + esp_random() % 500;
 
         publishState(state::ConnectivityState::CONNECTING_WS);
         break;
@@ -394,6 +1060,7 @@ void NetworkManager::handleWsStatus(int status)
     switch (status)
     {
     case 0: // CLOSED
+    {
         if (ws_immune_mode)
         {
             ESP_LOGW(TAG, "WS → CLOSED during immune mode - forcing cleanup");
@@ -402,7 +1069,24 @@ void NetworkManager::handleWsStatus(int status)
         }
 
         ESP_LOGW(TAG, "WS → CLOSED");
+        // No attempt in flight (connect timeout already scheduled the retry)
+        const bool attempt_ended = ws_running || connect_pending;
+        if (ws_running)
+        {
+            link_lost_ms = nowMs();
+            // Connection that held for a while → start backoff from the bottom
+            if (link_lost_ms - ws_open_ms >= config_.liveness_timeout_ms)
+                reconnect_attempt = 0;
+        }
+        connect_pending = false;
         ws_running = false;
+        framing_active = false;
+        app_ping = false;
+        flow_control_active = false;
+        credit_busy = false;
+        udp_audio_active = false;
+        if (udp)
+            udp->unbind();
 
         // Notify disconnect callback to flush audio buffer
         if (on_disconnect_cb)
@@ -410,16 +1094,20 @@ void NetworkManager::handleWsStatus(int status)
             on_disconnect_cb();
         }
 
-        if (ws_should_run)
+        if (ws_should_run && attempt_ended)
         {
-            ws_retry_timer = 1500; // retry nhẹ nhàng
+            const uint32_t delay = nextBackoffMs();
+            ws_retry_due_ms = nowMs() + delay;
+            ESP_LOGI(TAG, "WS retry in %u ms", (unsigned)delay);
             publishState(state::ConnectivityState::CONNECTING_WS);
         }
-        else
+        else if (!ws_should_run)
         {
             publishState(state::ConnectivityState::OFFLINE);
         }
+        wakeUplink(); // uplink thấy !ws_running ngay
         break;
+    }
 
     case 1: // CONNECTING
         ESP_LOGI(TAG, "WS → CONNECTING");
@@ -428,21 +1116,74 @@ void NetworkManager::handleWsStatus(int status)
 
     case 2: // OPEN
         ESP_LOGI(TAG, "WS → OPEN");
+        ws_open_ms = nowMs();
+        if (link_lost_ms != 0)
+        {
+            ESP_LOGI(TAG, "Reconnected %u ms after link loss (%u attempts)",
+                     (unsigned)(ws_open_ms - link_lost_ms), (unsigned)reconnect_attempt);
+            link_lost_ms = 0;
+        }
+        connect_pending = false;
+        last_rx_ms = ws_open_ms;
+        last_ping_ms = ws_open_ms;
+        telemetry_ms = ws_open_ms;
+        stat_rx_bytes = 0;
+        stat_tx_bytes = 0;
+        rtt_ms = 0;
+        srtt_ms = 0; // new path: first PONG seeds the estimator again
         ws_running = true;
+        framing_active = false; // chờ HELLO của server
+        app_ping = false;
+        codec_switch = false;
+        cancel_supported = false;
+        clock_supported = false;
+        clock_sync.reset(); // maybe another server, another clock
+        {
+            std::lock_guard<std::mutex> lock(clock_lock);
+            clock_map = ClockSync::Mapping{};
+        }
+        turn_end_ms = 0;
+        rx_fence = FENCE_OFF; // new connection, new downlink seq space
+        rx_last_seq = 0;
+        flow_control_active = false;
+        rx_audio_bytes = 0;
+        rx_audio_codec = config_.downlink_codec;
+        ++ws_conn_gen; // the uplink worker restarts its seq / ts next turn
+        tx_ctrl_seq = 0;
+        if (!hostFromUrl(config_.ws_url, ws_host))
+            ws_host[0] = '\0'; // no UDP offer can be used
         publishState(state::ConnectivityState::ONLINE);
         // 1. Lấy thông tin
-        std::string device_id = getDeviceMacID();
-        std::string app_version = app_meta::APP_VERSION; // Thay bằng version thực tế của bạn
+        char device_id[13];
+        formatDeviceMacID(device_id);
 
         // 2. Tạo nội dung tin nhắn (Dạng JSON để server dễ đọc)
-        // Ví dụ: {"type":"identify", "device_id":"ABCDEF123456", "version":"1.0.2"}
-        std::string identity_msg = "{\"type\":\"identify\", \"device_id\":\"" + device_id +
-                                   "\", \"version\":\"" + app_version + "\"}";
+        // Ví dụ: {"type":"identify","device_id":"ABCDEF123456","version":"1.0.2",...}
+        char buf[160];
+        json::Writer w(buf, sizeof(buf));
+        w.beginObject()
+            .key("type").str("identify")
+            .key("device_id").str(device_id)
+            .key("version").str(app_meta::APP_VERSION)
+            .key("session").str(session_token);
+        if (config_.framing)
+        {
+            // Server hỗ trợ framing sẽ trả Control::HELLO
+            w.key("proto").integer(proto::VERSION);
+            if (udp)
+                w.key("udp").boolean(true); // may answer with UDP_OFFER
+        }
+        w.endObject();
 
         // 3. Gửi lên Server
-        sendText(identity_msg);
+        if (!w.ok())
+        {
+            ESP_LOGE(TAG, "Identify message does not fit (%u B)", (unsigned)sizeof(buf));
+            break;
+        }
+        sendText(w.view());
 
-        ESP_LOGI(TAG, "Identified to server: ID=%s, Ver=%s", device_id.c_str(), app_version.c_str());
+        ESP_LOGI(TAG, "Identified to server: ID=%s, Ver=%s", device_id, app_meta::APP_VERSION);
         break;
     }
 }
@@ -450,28 +1191,105 @@ void NetworkManager::handleWsStatus(int status)
 // ============================================================================
 // MESSAGE FROM WEBSOCKET
 // ============================================================================
-void NetworkManager::handleWsTextMessage(const std::string &msg)
+void NetworkManager::handleWsTextMessage(std::string_view msg)
 {
-    ESP_LOGI(TAG, "WS Text Message: %s", msg.c_str());
+    last_rx_ms = nowMs();
+    stat_rx_bytes += msg.size();
+    ESP_LOGD(TAG, "WS Text Message: %.*s", (int)msg.size(), msg.data());
 
-    // Try parsing emotion code if message is simple 2-char format
-    if (msg.length() == 2)
+    // Legacy server: 2-char emotion codes and magic strings → Control
+    if (msg.size() == 2)
     {
-        auto emotion = parseEmotionCode(msg);
-        StateManager::instance().setEmotionState(emotion);
-        ESP_LOGI(TAG, "Emotion code: %s → %d", msg.c_str(), (int)emotion);
-        // Don't return - still call on_text_cb for logging/debugging
+        postControl(proto::Control::EMOTION,
+                    reinterpret_cast<const uint8_t *>(msg.data()), 2);
+        return;
+    }
+
+    proto::Control c;
+    if (proto::controlFromText(msg, c))
+    {
+        postControl(c);
+        return;
     }
 
+    if (!msg.empty() && msg[0] == '{' && dispatchJsonCommand(msg))
+        return;
+
     if (on_text_cb)
         on_text_cb(msg);
 }
 
-void NetworkManager::handleWsBinaryMessage(const uint8_t *data, size_t len)
+// ============================================================================
+// JSON COMMANDS
+// ============================================================================
+// {"type":"control","cmd":"SPEAK_START"}
+// {"type":"emotion","code":"01"}
+// {"type":"firmware","ok":true,"msg":"..."}
+bool NetworkManager::dispatchJsonCommand(std::string_view msg)
+{
+    using Handler = void (NetworkManager::*)(const json::Doc &);
+    static constexpr auto kHandlers = phash::make<8, Handler>({
+        {"control", &NetworkManager::onJsonControl},
+        {"emotion", &NetworkManager::onJsonEmotion},
+        {"firmware", &NetworkManager::onJsonFirmware},
+    });
+    static_assert(kHandlers.valid, "JSON command types need a perfect seed");
+
+    json::Doc doc; // ~260 B on the NetworkLoop stack, no heap
+    if (!doc.parse(msg))
+        return false;
+
+    const Handler *h = kHandlers.find(doc.str("type"));
+    if (!h)
+        return false;
+
+    (this->**h)(doc);
+    return true;
+}
+
+void NetworkManager::onJsonControl(const json::Doc &doc)
+{
+    proto::Control c;
+    if (proto::controlFromText(doc.str("cmd"), c))
+        postControl(c);
+    else
+        ESP_LOGW(TAG, "Unknown JSON control: %.*s", (int)doc.str("cmd").size(), doc.str("cmd").data());
+}
+
+void NetworkManager::onJsonEmotion(const json::Doc &doc)
 {
+    std::string_view code = doc.str("code");
+    if (code.size() == 2)
+        postControl(proto::Control::EMOTION, reinterpret_cast<const uint8_t *>(code.data()), 2);
+}
+
+void NetworkManager::onJsonFirmware(const json::Doc &doc)
+{
+    bool ok = false;
+    doc.boolean("ok", ok);
+    std::string_view text = doc.str("msg");
+
+    ESP_LOGI(TAG, "Firmware download %s (%u bytes): %.*s", ok ? "done" : "failed",
+             (unsigned)firmware_bytes_received, (int)text.size(), text.data());
+    firmware_download_active = false;
+
+    // The app reacts with state changes: control task, like the other controls
+    uint8_t args[sizeof(ControlItem::args)];
+    args[0] = ok ? 1 : 0;
+    const size_t n = std::min(text.size(), sizeof(args) - 1);
+    std::memcpy(args + 1, text.data(), n);
+    postControl(CTRL_FIRMWARE_DONE, args, 1 + n);
+}
+
+void NetworkManager::handleWsBinaryMessage(const uint8_t *data, size_t len, size_t offset, size_t total,
+                                           bool last)
+{
+    last_rx_ms = nowMs();
+    stat_rx_bytes += len;
     // ESP_LOGI(TAG, "WS Binary Message (%zu bytes)", len);
 
-    // Check if this is firmware data during OTA download
+    // Check if this is firmware data during OTA download: a byte stream,
+    // every piece goes straight to the updater
     if (firmware_download_active)
     {
         firmware_bytes_received += len;
@@ -482,324 +1300,857 @@ void NetworkManager::handleWsBinaryMessage(const uint8_t *data, size_t len)
         {
             on_firmware_chunk_cb(data, len);
         }
+        return;
     }
-    else
+
+    // Messages above the WS rx buffer, or sent in several WS frames, arrive
+    // in pieces: the reader hands out AUDIO payload per piece (no
+    // reassembly copy). total 0 (fragmented): the proto header's length.
+    auto st = rx_frames.feed(data, len, offset, total,
+                             [this](const proto::Header &h, const uint8_t *slice, size_t n, bool first, bool last)
+                             { handleFramedPayload(h, slice, n, first, last); });
+
+    if (st == proto::FrameReader::Status::NOT_FRAMED)
     {
-        // Regular binary message
+        // Legacy headerless audio
         if (on_binary_cb)
         {
             on_binary_cb(data, len);
         }
     }
+    else if (st == proto::FrameReader::Status::INVALID && offset == 0)
+    {
+        ESP_LOGW(TAG, "Invalid framed message (%u bytes), dropped", (unsigned)total);
+    }
+    else if (st == proto::FrameReader::Status::MORE && last)
+    {
+        // WS message ended before the length of its proto header
+        ESP_LOGW(TAG, "Framed message cut at %u bytes, dropped", (unsigned)(offset + len));
+        rx_frames.reset();
+    }
 }
 
-// Task loop gửi dữ liệu lên Server
-void NetworkManager::uplinkTaskLoop()
+void NetworkManager::handleFramedPayload(const proto::Header &h, const uint8_t *slice, size_t len,
+                                         bool first, bool last)
 {
-    const size_t SEND_SIZE = 512;
-    uint8_t send_buf[SEND_SIZE];
-    size_t acc = 0;
-
-    while (started)
+    switch (h.type)
     {
-        bool is_listening = (StateManager::instance().getInteractionState() == state::InteractionState::LISTENING);
+    case proto::MsgType::AUDIO:
+        handleFramedAudio(h, slice, len, first, last);
+        break;
 
-        if (!ws_running)
+    case proto::MsgType::CONTROL:
+        // Whole payload (FrameReader stash)
+        if (len == 0)
             break;
-
-        // Nếu hết listening và buffer trống thì thoát
-        if (!is_listening && xStreamBufferIsEmpty(mic_encoded_sb) && acc == 0)
+        if (static_cast<proto::Control>(slice[0]) == proto::Control::HELLO && !framing_active)
+        {
+            const uint8_t features = len > 2 ? slice[2] : 0;
+            framing_active = true;
+            app_ping = (features & proto::feature::PING) != 0;
+            codec_switch = (features & proto::feature::CODEC_SWITCH) != 0;
+            cancel_supported = (features & proto::feature::CANCEL) != 0;
+            clock_supported = (features & proto::feature::CLOCK) != 0;
+            if ((features & proto::feature::CREDIT) && downlink_probe)
+            {
+                credit_granted = false;
+                flow_control_active = true;
+                wakeLoop(); // first grant right away: server may burst
+            }
+            ESP_LOGI(TAG, "Server speaks framed protocol v%u, features 0x%02X",
+                     len > 1 ? slice[1] : 0, features);
+        }
+        if (static_cast<proto::Control>(slice[0]) == proto::Control::UDP_OFFER)
+        {
+            handleUdpOffer(slice + 1, len - 1); // transport only, not for the app
             break;
+        }
+        if (static_cast<proto::Control>(slice[0]) == proto::Control::CANCELLED)
+        {
+            // The server stopped the answer: its last seq is the exact fence
+            if (len >= 3)
+            {
+                rx_fence_seq = proto::getU16(slice + 1);
+                uint8_t expected = FENCE_ACK;
+                if (rx_fence.compare_exchange_strong(expected, FENCE_SEQ))
+                {
+                    ESP_LOGI(TAG, "Answer cancelled after seq %u (%u ms after CANCEL)",
+                             (unsigned)rx_fence_seq.load(), (unsigned)(nowMs() - rx_fence_ms.load()));
+                }
+            }
+            break;
+        }
+        if (static_cast<proto::Control>(slice[0]) == proto::Control::SPEAK_START && clock_supported)
+            reportTurn(h.timestamp); // timed on arrival, like PONG
+        postControl(static_cast<proto::Control>(slice[0]), slice + 1, len - 1);
+        break;
+
+    default:
+        if (first)
+            ESP_LOGW(TAG, "Unknown frame type 0x%02X (%u bytes)", (unsigned)h.type, h.payload_len);
+        break;
+    }
+}
 
-        // Đọc dữ liệu: Chờ tối đa 100ms để gom đủ dữ liệu
-        // Việc Block ở đây không hề tốn CPU, giúp Task khác (Display) chạy thoải mái
-        size_t want = SEND_SIZE - acc;
-        size_t got = xStreamBufferReceive(mic_encoded_sb, send_buf + acc, want, pdMS_TO_TICKS(100));
+void NetworkManager::handleFramedAudio(const proto::Header &h, const uint8_t *slice, size_t len,
+                                       bool first, bool last)
+{
+    if (first)
+        rx_frame_fenced = fenceDrops(h);
 
-        if (got > 0)
+    if (first && !rx_frame_fenced)
+    {
+        if (h.flags & proto::flag::START)
         {
-            acc += got;
+            rx_audio_seq.reset();
+            rx_jitter.reset();
         }
+        rx_last_seq = h.seq;
+        rx_audio_codec = h.codec;
+        rx_last_samples = proto::samplesForBytes(h.codec, h.payload_len);
 
-        // Khi đủ 512 bytes thì gửi ngay lập tức
-        if (acc == SEND_SIZE)
+        uint16_t gap = rx_audio_seq.update(h.seq);
+        if (gap > 0)
         {
-            ws->sendBinary(send_buf, SEND_SIZE);
-            acc = 0;
-            // Không vTaskDelay ở đây để có thể gửi liên tiếp nếu buffer đang đầy
+            ESP_LOGW(TAG, "Downlink: %u packet(s) lost before seq %u", gap, h.seq);
         }
+        rx_jitter.update(h.timestamp, config_.codec_sample_rate,
+                         static_cast<uint32_t>(esp_timer_get_time() / 1000));
+        rx_jitter_us = static_cast<uint32_t>(rx_jitter.jitterMs() * 1000.0f);
+    }
+
+    if (len > 0 && on_binary_cb && !rx_frame_fenced)
+    {
+        on_binary_cb(slice, len);
+    }
 
-        // Đoạn vét buffer cuối cùng khi ngừng thu âm
-        if (!is_listening && acc > 0 && xStreamBufferIsEmpty(mic_encoded_sb))
+    // Counted after the write: a credit computed in between under-counts.
+    // Fenced bytes count too: the server counted them as sent.
+    rx_audio_bytes += len;
+    if (flow_control_active && !credit_busy)
+    {
+        wakeLoop(); // start refreshing credits
+    }
+
+    if (last && (h.flags & proto::flag::EOS) && !rx_frame_fenced)
+    {
+        ESP_LOGI(TAG, "Downlink stream: %u pkts, %u lost, %u late, %u dup, jitter %.1f ms",
+                 (unsigned)rx_audio_seq.received, (unsigned)rx_audio_seq.lost,
+                 (unsigned)rx_audio_seq.late, (unsigned)rx_audio_seq.duplicate, rx_jitter.jitterMs());
+    }
+}
+
+// ============================================================================
+// CONTROL LANE
+// ============================================================================
+// The WS receive path (NetworkLoop) only classifies: audio goes to the
+// speaker ring without waiting, controls are copied into the queue here.
+// Nothing the app does for a control (state change, subscribers, display)
+// runs on NetworkLoop.
+bool NetworkManager::postControl(proto::Control c, const uint8_t *args, size_t args_len)
+{
+    if (c == proto::Control::PONG)
+    {
+        // Timed on arrival: queueing would add to the RTT. Liveness already
+        // refreshed by the receive.
+        if (args_len >= 8)
         {
-            memset(send_buf + acc, 0, SEND_SIZE - acc);
-            ws->sendBinary(send_buf, SEND_SIZE);
-            break;
+            const uint32_t now = nowMs();
+            const uint32_t rtt = now - proto::getU32(args + 4);
+            onRttSample(rtt);
+            ESP_LOGD(TAG, "PONG #%u rtt %u ms", (unsigned)proto::getU32(args), (unsigned)rtt);
+            if (args_len >= 16 && clock_supported)
+                onClockSample(args, now);
         }
+        return true;
     }
-    // 4. Dọn dẹp an toàn
-    if (mic_encoded_sb)
+
+    ControlItem item;
+    item.posted_us = esp_timer_get_time();
+    item.code = c;
+    item.args_len = static_cast<uint8_t>(std::min(args_len, sizeof(item.args)));
+    if (args && item.args_len > 0)
+        std::memcpy(item.args, args, item.args_len);
+
+    if (!control_queue || xQueueSend(control_queue, &item, 0) != pdTRUE)
     {
-        xStreamBufferReset(mic_encoded_sb);
+        ++ctrl_drops;
+        ESP_LOGW(TAG, "Control lane full, dropped control 0x%02X", (unsigned)c);
+        return false;
     }
-    uplink_task_handle = nullptr;
-    ESP_LOGW(TAG, "Uplink task deleted");
-    vTaskDelete(nullptr);
+    return true;
 }
 
-void NetworkManager::uplinkTaskEntry(void *arg)
+void NetworkManager::controlTaskLoop()
+{
+    ControlItem item;
+    for (;;)
+    {
+        if (xQueueReceive(control_queue, &item, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        const uint32_t lat = static_cast<uint32_t>(esp_timer_get_time() - item.posted_us);
+        if (lat > ctrl_lat_peak_us.load())
+            ctrl_lat_peak_us = lat; // single writer (control task), reset per period
+
+        dispatchControl(item.code, item.args, item.args_len);
+    }
+}
+
+void NetworkManager::controlTaskEntry(void *arg)
 {
-    // Ép kiểu void* ngược lại thành con trỏ đối tượng
     auto *self = static_cast<NetworkManager *>(arg);
-    if (self)
+    if (self && self->control_queue)
     {
-        self->uplinkTaskLoop(); // Gọi hàm loop thực sự (hàm này không cần static)
+        self->controlTaskLoop();
     }
+    vTaskDelete(nullptr);
+}
+
+// Control task: app-level handling, in arrival order
+void NetworkManager::dispatchControl(proto::Control c, const uint8_t *args, size_t args_len)
+{
+    if (c == CTRL_FIRMWARE_DONE)
+    {
+        if (on_firmware_complete_cb && args_len >= 1)
+            on_firmware_complete_cb(args[0] != 0,
+                                    std::string_view(reinterpret_cast<const char *>(args + 1), args_len - 1));
+        return;
+    }
+
+    if (c == proto::Control::EMOTION && args_len >= 2)
+    {
+        auto emotion = parseEmotionCode(std::string_view(reinterpret_cast<const char *>(args), 2));
+        StateManager::instance().setEmotionState(emotion);
+        ESP_LOGI(TAG, "Emotion code: %c%c → %d", args[0], args[1], (int)emotion);
+    }
+
+    if (on_control_cb)
+        on_control_cb(c, args, args_len);
 }
 
 // ============================================================================
-// PUSH STATE TO STATEMANAGER
+// UDP AUDIO
 // ============================================================================
-void NetworkManager::publishState(state::ConnectivityState s)
+// NetworkLoop (WS receive path). The link binds on its own task; audio
+// moves only once the server echoed the bind (onUdpReady).
+void NetworkManager::handleUdpOffer(const uint8_t *args, size_t args_len)
 {
-    StateManager::instance().setConnectivityState(s);
+    if (!udp || !framing_active || args_len < 6 || ws_host[0] == '\0')
+        return;
+
+    const uint16_t port = static_cast<uint16_t>(args[0] | (args[1] << 8));
+    const uint32_t token = proto::getU32(args + 2);
+    udp_audio_active = false;
+    if (udp->bindTo(ws_host, port, token))
+    {
+        ESP_LOGI(TAG, "Server offers UDP audio on port %u", port);
+    }
 }
 
-void NetworkManager::handleInteractionState(state::InteractionState s)
+// UdpAudio task. Both directions checked: tell the server to move its audio
+// too. A link that failed later hands the audio back to the WS (token 0).
+void NetworkManager::onUdpReady(bool ok, uint32_t token)
 {
-    if (s == state::InteractionState::LISTENING)
+    uint8_t args[4];
+    if (ok)
     {
-        if (uplink_task_handle == nullptr)
-        {
-            ESP_LOGI(TAG, "Starting Uplink Task (State: LISTENING)");
-            xTaskCreatePinnedToCore(
-                &NetworkManager::uplinkTaskEntry,
-                "WsUplink",
-                4096,
-                this,
-                5,
-                &uplink_task_handle,
-                1 // Core 0
-            );
-        }
+        if (!ws_running)
+            return;
+        udp_rx_started = false;
+        udp_audio_active = true;
+        proto::putU32(args, token);
+        sendControl(proto::Control::UDP_BIND, args, sizeof(args));
+        ESP_LOGI(TAG, "Audio → UDP (redundancy %s), WS keeps control",
+                 config_.udp_redundancy ? "on" : "off");
+        return;
     }
-    else
+
+    if (udp_audio_active.exchange(false) && ws_running)
     {
-        // Khi không còn LISTENING, chúng ta không delete task từ đây
-        // mà để task loop tự kiểm tra và thoát để đảm bảo an toàn dữ liệu.
+        proto::putU32(args, 0);
+        sendControl(proto::Control::UDP_BIND, args, sizeof(args));
+        ESP_LOGW(TAG, "UDP audio failed, back to WS");
     }
 }
 
 // ============================================================================
-// OTA FIRMWARE UPDATE SUPPORT
+// BARGE-IN FENCE
 // ============================================================================
-bool NetworkManager::requestFirmwareUpdate(const std::string &version)
+// The speaker is already silent (AudioManager dropped its stages); this
+// keeps the rest of the cut answer, still on the wire, out of the
+// pipeline. With feature::CANCEL the server names its last seq, so the
+// next answer passes from its first frame on.
+void NetworkManager::cancelDownlink(uint32_t unplayed_ms)
 {
-    if (!ws || !ws->isConnected())
+    endSpeakingSession(); // the next answer raises SPEAKING again
+    if (!framing_active || !ws_running)
+        return; // legacy stream: no seq, only the LISTENING check in the sink
+
+    const uint16_t fence = rx_last_seq.load();
+    rx_fence_seq = fence;
+    rx_fence_ms = nowMs();
+    rx_fence = cancel_supported ? FENCE_ACK : FENCE_START;
+
+    // Played ≈ newest seq minus the frames still queued when it was cut
+    const uint32_t frame_samples = std::max<uint32_t>(rx_last_samples.load(), 1);
+    const uint32_t queued_frames =
+        (unplayed_ms * config_.codec_sample_rate / 1000 + frame_samples - 1) / frame_samples;
+    const uint16_t played = static_cast<uint16_t>(fence - queued_frames);
+
+    if (cancel_supported)
     {
-        ESP_LOGE(TAG, "WebSocket not connected, cannot request firmware");
+        uint8_t args[4];
+        proto::putU16(args, played);
+        proto::putU16(args + 2, fence);
+        sendControl(proto::Control::CANCEL, args, sizeof(args));
+    }
+    ESP_LOGI(TAG, "Barge-in: downlink fenced at seq %u, played ~%u (%u ms unplayed)%s",
+             (unsigned)fence, (unsigned)played, (unsigned)unplayed_ms,
+             cancel_supported ? "" : ", server without CANCEL: until next START");
+}
+
+// Downlink audio task (NetworkLoop or UdpAudio), once per frame
+bool NetworkManager::fenceDrops(const proto::Header &h)
+{
+    uint8_t fence = rx_fence.load();
+    if (fence == FENCE_OFF)
         return false;
+
+    if (fence == FENCE_ACK && nowMs() - rx_fence_ms.load() >= config_.cancel_ack_timeout_ms &&
+        rx_fence.compare_exchange_strong(fence, FENCE_START))
+    {
+        ESP_LOGW(TAG, "No CANCELLED from the server: downlink dropped until the next stream");
+        fence = FENCE_START;
     }
 
-    firmware_download_active = true;
-    firmware_bytes_received = 0;
+    bool drop = true;
+    if (fence == FENCE_SEQ)
+        drop = !proto::seqNewer(h.seq, rx_fence_seq.load());
+    else if (fence == FENCE_START)
+        drop = !(h.flags & proto::flag::START);
 
-    // Create request message (JSON format)
-    std::string request = "{\"action\":\"update_firmware\"";
-    if (!version.empty())
+    if (drop)
     {
-        request += ",\"version\":\"" + version + "\"";
+        ++rx_fence_dropped;
+        return true;
     }
-    request += "}";
 
-    ESP_LOGI(TAG, "Requesting firmware update: %s", request.c_str());
-    return sendText(request);
+    ESP_LOGI(TAG, "Downlink fence lifted at seq %u, %u stale frame(s) dropped",
+             h.seq, (unsigned)rx_fence_dropped);
+    rx_fence_dropped = 0;
+    rx_fence.compare_exchange_strong(fence, FENCE_OFF); // a newer cancel keeps its own
+    return false;
 }
 
-void NetworkManager::onFirmwareChunk(std::function<void(const uint8_t *, size_t)> cb)
+// UdpAudio task: packets in seq order, repaired ones included
+void NetworkManager::handleUdpAudio(const proto::Header &h, const uint8_t *payload, size_t len)
 {
-    on_firmware_chunk_cb = cb;
-}
+    last_rx_ms = nowMs();
+    stat_rx_bytes += proto::HEADER_SIZE + len;
 
-void NetworkManager::onFirmwareComplete(std::function<void(bool, const std::string &)> cb)
-{
-    on_firmware_complete_cb = cb;
+    // Credits count received payload bytes. A packet lost for good never
+    // arrives: count its bytes from the timestamp gap, or the server's
+    // window would shrink with every loss.
+    if (udp_rx_started && !(h.flags & proto::flag::START))
+    {
+        const int32_t gap = static_cast<int32_t>(h.timestamp - udp_rx_next_ts);
+        if (gap > 0)
+            rx_audio_bytes += proto::bytesForSamples(h.codec, static_cast<uint32_t>(gap));
+    }
+    udp_rx_started = true;
+    udp_rx_next_ts = h.timestamp + proto::samplesForBytes(h.codec, len);
+
+    handleFramedAudio(h, payload, len, true, true);
 }
 
-// Stop captive portal if running (used for low-battery mode)
-void NetworkManager::stopPortal()
+// ============================================================================
+// DOWNLINK CREDITS
+// ============================================================================
+// limit = received + room. Room already excludes bytes in flight (they are
+// not in our buffer yet but the server counted them as sent), so the server
+// can never overflow us. Room is bounded by the depth window, not just free
+// space, so a burst stays below the TimeStretcher catch-up threshold.
+void NetworkManager::serviceCredits()
 {
-    if (wifi)
+    if (!flow_control_active || !downlink_probe)
     {
-        wifi->stopCaptivePortal();
+        credit_busy = false;
+        return;
+    }
+
+    // Received first, then depth (see handleFramedAudio)
+    const uint32_t rx = rx_audio_bytes.load();
+    const DownlinkDepth d = downlink_probe();
+
+    const proto::Codec codec = rx_audio_codec.load();
+    const uint32_t window_ms = config_.downlink_window_ms;
+    const uint32_t room_ms = d.queued_ms < window_ms ? window_ms - d.queued_ms : 0;
+    size_t room = proto::bytesForSamples(codec,
+                                         room_ms * config_.codec_sample_rate / 1000);
+    room = std::min(room, d.free_bytes);
+    const uint32_t limit = rx + static_cast<uint32_t>(room);
+
+    credit_busy = d.queued_ms > 0;
+
+    // Only grow the limit, by at least 20 ms of audio (no control spam)
+    const size_t min_step = proto::bytesForSamples(codec, config_.codec_sample_rate / 50);
+    const int32_t advance = static_cast<int32_t>(limit - credit_limit);
+    if (credit_granted && advance < static_cast<int32_t>(min_step))
+        return;
+
+    uint8_t args[4];
+    proto::putU32(args, limit);
+    if (sendControl(proto::Control::CREDIT, args, sizeof(args)))
+    {
+        credit_limit = limit;
+        credit_granted = true;
     }
 }
 
 // ============================================================================
-// WIFI RETRY LOGIC
+// UPLINK WORKER
 // ============================================================================
-void NetworkManager::retryWifiTaskEntry(void *arg)
+// Sleeps between turns. SpanRing::waitReadable() uses the same task
+// notification, so a notification alone does not mean "armed".
+void NetworkManager::uplinkWorkerLoop()
 {
-    auto *self = static_cast<NetworkManager *>(arg);
-    if (self)
+    for (;;)
     {
-        self->retryWifiThenBLE();
+        while (!uplink_armed.exchange(false))
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        runUplinkTurn(static_cast<uint32_t>(esp_timer_get_time() - uplink_arm_us.load()));
     }
-    vTaskDelete(nullptr);
 }
 
-void NetworkManager::retryWifiThenPortal()
+// Một lượt gửi dữ liệu mic lên Server
+void NetworkManager::runUplinkTurn(uint32_t armed_us)
 {
-    const int max_retries = 10; // 5 seconds / 0.5s = 10 attempts
+#if INCLUDE_xTaskAbortDelay
+    const TickType_t UPLINK_WAIT = pdMS_TO_TICKS(1000);
+#else
+    const TickType_t UPLINK_WAIT = pdMS_TO_TICKS(100); // không có abort → poll
+#endif
 
-    ESP_LOGI(TAG, "Starting WiFi retry phase (5 seconds, 10 attempts)");
+    // Codec task vẫn có thể encode nốt PCM sau khi hết LISTENING
+    const TickType_t TAIL_GRACE = pdMS_TO_TICKS(20);
+    const TickType_t max_delay = pdMS_TO_TICKS(config_.uplink_max_delay_ms);
 
-    for (int attempt = 0; attempt < max_retries; attempt++)
+    if (!mic_encoded || !mic_encoded->valid() || mic_encoded->headroom() < UPLINK_HEADROOM)
     {
-        // Check if WiFi connected during retry
-        if (wifi && wifi->isConnected())
+        ESP_LOGE(TAG, "Uplink: mic ring missing or without %u bytes headroom", (unsigned)UPLINK_HEADROOM);
+        return;
+    }
+
+    // New connection, new uplink seq space and stream clock
+    const uint32_t gen = ws_conn_gen.load();
+    if (gen != tx_audio_gen)
+    {
+        tx_audio_gen = gen;
+        tx_audio_seq = 0;
+        tx_audio_ts = 0;
+    }
+
+    // Adaptive codec: the server must decode per frame, the encoder must
+    // follow (callback) and the profiles are ADPCM ones. Otherwise back to
+    // profile 0 if an earlier turn left another one in force.
+    const bool adaptive = config_.adaptive_bitrate && framing_active && codec_switch &&
+                          config_.uplink_codec == proto::Codec::ADPCM_IMA && uplink_profile_cb;
+    bitrate.setEnabled(adaptive);
+    bitrate.reset();
+    if (adaptive || uplink_profile_applied != 0xFF)
+        applyUplinkProfile();
+
+    // Codec of the bytes at the read position (SpanRing mark from the codec task)
+    auto spanCodec = [&]() -> proto::Codec
+    {
+        const uint8_t tag = mic_encoded->tag();
+        return tag ? static_cast<proto::Codec>(tag) : config_.uplink_codec;
+    };
+    size_t packet_bytes = uplinkPacketBytes(spanCodec());
+
+    // Packets are sent straight from the ring: the proto header goes into
+    // the headroom in front of the span, no staging copy
+    uint8_t empty_buf[UPLINK_HEADROOM];      // headroom for an empty EOS
+    size_t pending = 0;                      // readable bytes not yet sent
+    TickType_t oldest = 0;                   // arrival of the first pending byte
+    int64_t oldest_us = 0;                   // same, for the queue-delay stat
+    bool first_packet = true;
+    uint32_t packets = 0;
+    int64_t send_us = 0;
+    uint32_t last_age_ms = 0;                // last packet, for the bitrate controller
+    uint32_t last_send_ms = 0;
+    uint32_t probe_ms = nowMs();
+    uint32_t probe_nonce = 0;
+
+    auto sendSpan = [&](uint8_t *payload, size_t len, bool last, proto::Codec codec)
+    {
+        const int64_t t0 = esp_timer_get_time();
+        if (!framing_active)
         {
-            ESP_LOGI(TAG, "WiFi connected during retry phase - cancelling portal");
-            wifi_retry_task = nullptr;
-            return;
+            if (len > 0)
+                ws->sendBinaryInPlace(payload, len);
+        }
+        else
+        {
+            proto::Header h;
+            h.type = proto::MsgType::AUDIO;
+            h.flags = (first_packet ? proto::flag::START : 0) | (last ? proto::flag::EOS : 0);
+            h.codec = codec;
+            h.seq = tx_audio_seq++;
+            h.payload_len = static_cast<uint16_t>(len);
+            h.timestamp = tx_audio_ts;
+
+            if (udp_audio_active)
+            {
+                udp->sendAudio(h, payload, len); // a failed send is a lost packet
+            }
+            else
+            {
+                uint8_t *frame = payload - proto::HEADER_SIZE;
+                proto::writeHeader(h, frame, proto::HEADER_SIZE);
+                ws->sendBinaryInPlace(frame, proto::HEADER_SIZE + len);
+            }
+
+            if (first_packet && len > 0 && clock_supported)
+            {
+                // START frame's first sample: out of the encoder when the
+                // oldest pending byte arrived
+                const ClockSync::Mapping m = serverClock();
+                if (m.valid)
+                    turn_t0_ms = m.toServer(static_cast<uint32_t>(oldest_us / 1000));
+            }
+            tx_audio_ts += proto::samplesForBytes(codec, len); // stream clock for every codec
+            first_packet = false;
+        }
+        const int64_t t1 = esp_timer_get_time();
+        send_us += t1 - t0;
+        ++packets;
+        if (len > 0)
+        {
+            stat_tx_bytes += len + (framing_active ? proto::HEADER_SIZE : 0);
+            last_age_ms = static_cast<uint32_t>((t1 - oldest_us) / 1000);
+            last_send_ms = static_cast<uint32_t>((t1 - t0) / 1000);
+            recordUplinkDelay(last_age_ms);
+        }
+    };
+
+    // One controller sample per packet. The probe PINGs queue behind the
+    // audio in the socket send buffer: their RTT over the path minimum is
+    // the queueing the ring depth cannot show.
+    auto adapt = [&]()
+    {
+        const uint32_t now = nowMs();
+        if (app_ping && now - probe_ms >= config_.bitrate_probe_ms)
+        {
+            uint8_t args[8];
+            proto::putU32(args, 0x80000000u | ++probe_nonce); // not the NetworkLoop's nonces
+            proto::putU32(args + 4, now);
+            sendControl(proto::Control::PING, args, sizeof(args));
+            probe_ms = now;
+        }
+        bitrate.setRtt(rtt_ms);
+        bitrate.setRssi(pub_rssi_dbm);
+
+        const proto::Codec codec = spanCodec();
+        const uint32_t depth_ms = static_cast<uint32_t>(
+            uint64_t(proto::samplesForBytes(codec, mic_encoded->readable())) * 1000 / config_.codec_sample_rate);
+        if (bitrate.onPacket(now, last_age_ms, depth_ms, last_send_ms))
+            applyUplinkProfile();
+        packet_bytes = uplinkPacketBytes(codec);
+    };
+
+    // One packet from the read position: a span stops at the end of the
+    // ring storage, so a packet across the wrap goes out as two
+    auto sendNext = [&](size_t max_len, bool last_if_empty) -> size_t
+    {
+        uint8_t *span = nullptr;
+        size_t len = std::min(mic_encoded->peek(span), max_len);
+        if (len == 0)
+            return 0;
+        const proto::Codec codec = spanCodec(); // peek() stops at a format mark
+        sendSpan(span, len, last_if_empty && len == mic_encoded->readable(), codec);
+        mic_encoded->consume(len);
+        if (adaptive)
+            adapt();
+        return len;
+    };
+
+    ESP_LOGI(TAG, "Uplink: %u ms packets (%u bytes), max delay %u ms",
+             config_.uplink_packet_ms, (unsigned)packet_bytes, config_.uplink_max_delay_ms);
+
+    while (started)
+    {
+        bool is_listening = (StateManager::instance().getInteractionState() == state::InteractionState::LISTENING);
+
+        if (!ws_running)
+            break;
+
+        // Chờ dữ liệu mới: thức khi codec ghi hoặc khi wakeUplink() (hết
+        // LISTENING, WS đóng). Khi đang giữ một gói dở, chờ không quá flush
+        // deadline.
+        TickType_t wait = UPLINK_WAIT;
+        if (!is_listening)
+        {
+            wait = TAIL_GRACE;
+        }
+        else if (pending > 0)
+        {
+            TickType_t held = xTaskGetTickCount() - oldest;
+            wait = held >= max_delay ? 0 : max_delay - held;
         }
 
-        ESP_LOGI(TAG, "WiFi retry attempt %d/10", attempt + 1);
+        size_t avail = mic_encoded->waitReadable(pending, wait);
+        const bool got = avail > pending;
+        if (pending == 0 && avail > 0)
+        {
+            oldest = xTaskGetTickCount();
+            oldest_us = esp_timer_get_time();
+        }
+        pending = avail;
+
+        // Hết LISTENING và codec đã im: gửi hết, gói cuối đúng độ dài, không pad
+        if (!is_listening && !got)
+        {
+            bool sent_any = false;
+            while (sendNext(packet_bytes, true) > 0)
+                sent_any = true;
+            if (!sent_any && framing_active && !first_packet)
+                sendSpan(empty_buf + UPLINK_HEADROOM, 0, true, spanCodec()); // framed: EOS rỗng
+            break;
+        }
 
-        // Wait 500ms
-        vTaskDelay(pdMS_TO_TICKS(500));
+        // Đủ thời lượng gói, hoặc đã giữ quá lâu (→ gửi hết phần đang giữ)
+        const bool deadline = pending > 0 && xTaskGetTickCount() - oldest >= max_delay;
+        bool sent_any = false;
+        while (pending >= packet_bytes || (deadline && pending > 0))
+        {
+            size_t sent = sendNext(packet_bytes, false);
+            if (sent == 0)
+                break;
+            pending -= sent;
+            sent_any = true;
+            // Không vTaskDelay ở đây để có thể gửi liên tiếp nếu buffer đang đầy
+        }
+        if (sent_any)
+        {
+            oldest = xTaskGetTickCount(); // phần còn lại bắt đầu gói mới
+            oldest_us = esp_timer_get_time();
+        }
     }
 
-    // Check one final time after all retries
-    if (wifi && wifi->isConnected())
+    if (packets > 0)
     {
-        ESP_LOGI(TAG, "WiFi connected after retry phase - cancelling portal");
-        wifi_retry_task = nullptr;
-        return;
+        ESP_LOGI(TAG, "Uplink stream: %u pkts, %u us/pkt in send, %u frames dropped (ring full), armed in %u us, profile %s",
+                 (unsigned)packets, (unsigned)(send_us / packets), (unsigned)mic_encoded->dropped(),
+                 (unsigned)armed_us, bitrate.profile().name);
     }
 
-    // 5 seconds elapsed without connection - scan then open portal
-    ESP_LOGI(TAG, "WiFi retry phase complete - no connection. Scanning then opening portal...");
-
-    if (wifi)
-    {
-        // Disconnect STA first to allow scanning
-        wifi->disconnect();
-        vTaskDelay(pdMS_TO_TICKS(100)); // Brief delay to ensure WiFi is stopped
+    // 4. Dọn dẹp an toàn, worker ngủ chờ lượt sau
+    mic_encoded->reset();
+    ESP_LOGI(TAG, "Uplink turn ended");
+}
 
-        // Start STA mode and scan
-        wifi->ensureStaStarted();
-        vTaskDelay(pdMS_TO_TICKS(100)); // Brief delay before scanning
+size_t NetworkManager::uplinkPacketBytes(proto::Codec codec) const
+{
+    uint32_t samples = static_cast<uint32_t>(config_.uplink_packet_ms) * config_.codec_sample_rate / 1000;
+    size_t bytes = proto::bytesForSamples(codec, samples);
+    if (bytes == 0 || bytes > MAX_UPLINK_PACKET)
+        bytes = MAX_UPLINK_PACKET; // variable-size codec or too long a packet
+    return bytes;
+}
 
-        // Scan and cache networks before opening portal
-        wifi->scanAndCache();
+void NetworkManager::applyUplinkProfile()
+{
+    const size_t index = bitrate.profileIndex();
+    if (index == uplink_profile_applied)
+        return;
+    uplink_profile_applied = static_cast<uint8_t>(index);
+    pub_uplink_profile = static_cast<uint8_t>(index);
+
+    const BitrateController::Profile &p = bitrate.profile();
+    if (uplink_profile_cb)
+        uplink_profile_cb(p);
+    ESP_LOGI(TAG, "Uplink profile %s (latency %u ms, rtt %u ms)",
+             p.name, (unsigned)bitrate.latencyMs(), (unsigned)rtt_ms.load());
+}
 
-        // Open portal with stop_wifi_first=true to ensure clean state
-        wifi->startCaptivePortal(config_.ap_ssid, config_.ap_max_clients, true);
-        publishState(state::ConnectivityState::WIFI_PORTAL);
+void NetworkManager::wakeUplink()
+{
+#if INCLUDE_xTaskAbortDelay
+    TaskHandle_t th = uplink_task_handle;
+    if (th)
+    {
+        xTaskAbortDelay(th);
     }
-
-    wifi_retry_task = nullptr;
+#endif
 }
 
-void NetworkManager::retryWifiThenBLE()
+void NetworkManager::uplinkTaskEntry(void *arg)
 {
-    const int max_retries = 10;
+    // Ép kiểu void* ngược lại thành con trỏ đối tượng
+    auto *self = static_cast<NetworkManager *>(arg);
+    if (self)
+    {
+        self->uplinkWorkerLoop(); // Gọi hàm loop thực sự (hàm này không cần static)
+    }
+    vTaskDelete(nullptr);
+}
 
-    ESP_LOGI(TAG, "Starting WiFi retry phase (5 seconds)");
+// ============================================================================
+// PUSH STATE TO STATEMANAGER
+// ============================================================================
+void NetworkManager::publishState(state::ConnectivityState s)
+{
+    StateManager::instance().setConnectivityState(s);
+}
 
-    for (int i = 0; i < max_retries; i++)
+void NetworkManager::handleInteractionState(state::InteractionState s)
+{
+    if (s == state::InteractionState::LISTENING)
     {
-        if (wifi && wifi->isConnected())
+        // New turn for the latency report
+        turn_start_ms = nowMs();
+        turn_end_ms = 0;
+        turn_t0_ms = 0;
+        turn_up_sum_ms = 0;
+        turn_up_count = 0;
+        turn_listening = true;
+
+        // Arm the worker (created in start(), no task per turn)
+        uplink_arm_us = esp_timer_get_time();
+        uplink_armed = true;
+        if (uplink_task_handle)
         {
-            ESP_LOGI(TAG, "WiFi connected during retry");
-            wifi_retry_task = nullptr;
-            return;
+            xTaskNotifyGive(uplink_task_handle);
         }
-        vTaskDelay(pdMS_TO_TICKS(500));
     }
+    else
+    {
+        if (turn_listening.exchange(false))
+            turn_end_ms = nowMs() | 1; // 0 means no turn
 
-    if (wifi && wifi->isConnected())
+        // Khi không còn LISTENING, worker tự gửi nốt phần đuôi rồi ngủ lại
+        // (không dừng nó từ đây để đảm bảo an toàn dữ liệu).
+        wakeUplink();
+    }
+}
+
+// ============================================================================
+// OTA FIRMWARE UPDATE SUPPORT
+// ============================================================================
+bool NetworkManager::requestFirmwareUpdate(std::string_view version)
+{
+    if (!ws || !ws->isConnected())
     {
-        ESP_LOGI(TAG, "WiFi connected after retry");
-        wifi_retry_task = nullptr;
-        return;
+        ESP_LOGE(TAG, "WebSocket not connected, cannot request firmware");
+        return false;
     }
 
-    ESP_LOGW(TAG, "WiFi unavailable after retry - switching to BLE config mode");
+    // Create request message (JSON format)
+    char buf[96];
+    json::Writer w(buf, sizeof(buf));
+    w.beginObject().key("action").str("update_firmware");
+    if (!version.empty())
+    {
+        w.key("version").str(version);
+    }
+    w.endObject();
 
-    // 1. Dừng WiFi (quan trọng)
-    if (wifi)
+    if (!w.ok())
     {
-        wifi->disconnect();
-        vTaskDelay(pdMS_TO_TICKS(500));
+        ESP_LOGE(TAG, "Firmware request too long (version %u chars)", (unsigned)version.size());
+        return false;
     }
 
-    // TODO: nếu cần esp_wifi_deinit() để giải phóng RF cho BLE thì xử lý ở đây
+    firmware_download_active = true;
+    firmware_bytes_received = 0;
+
+    ESP_LOGI(TAG, "Requesting firmware update: %s", w.c_str());
+    return sendText(w.view());
+}
 
-    // 2. Bật BLE
-    //    if (ble_service) {
-    //         ble_service->init(config_.ap_ssid); // Dùng tên PTalk làm tên Bluetooth
-    //         ble_service->start();
-    //     }
+void NetworkManager::onFirmwareChunk(std::function<void(const uint8_t *, size_t)> cb)
+{
+    on_firmware_chunk_cb = cb;
+}
 
-    // 3. Publish state
-    publishState(state::ConnectivityState::CONFIG_BLE);
+void NetworkManager::onFirmwareComplete(std::function<void(bool, std::string_view)> cb)
+{
+    on_firmware_complete_cb = cb;
+}
 
-    wifi_retry_task = nullptr;
-    vTaskDelete(NULL);
+// Stop captive portal if running (used for low-battery mode)
+void NetworkManager::stopPortal()
+{
+    post(Event::Type::STOP_PORTAL);
 }
 
-void NetworkManager::startBLEConfigMode()
+// ============================================================================
+// WIFI FALLBACK (timer of the loop, no retry task)
+// ============================================================================
+void NetworkManager::serviceWifiFallback()
 {
-    if (ble_service)
+    if (fallback == Fallback::NONE || msUntil(fallback_due_ms, nowMs()) > 0)
+        return;
+
+    if (fallback == Fallback::WAIT_WIFI)
     {
-        ESP_LOGW(TAG, "Start BLE Config Mode now (RAM should be free)");
-        ble_service->init(config_.ap_ssid);
-        ble_service->start();
+        if (wifi && wifi->isConnected())
+        {
+            ESP_LOGI(TAG, "WiFi connected after retry");
+            fallback = Fallback::NONE;
+            return;
+        }
+
+        ESP_LOGW(TAG, "WiFi unavailable after retry - switching to BLE config mode");
+
+        // 1. Dừng WiFi (quan trọng), BLE chỉ sau khi WiFi đã dừng hẳn
+        if (wifi)
+            wifi->disconnect();
+        fallback = Fallback::STOP_WIFI;
+        fallback_due_ms = nowMs() + 500;
+        return;
     }
+
+    // TODO: nếu cần esp_wifi_deinit() để giải phóng RF cho BLE thì xử lý ở đây
+
+    // 2. Publish state: AppController frees audio RAM, then startBLEConfigMode()
+    fallback = Fallback::NONE;
+    publishState(state::ConnectivityState::CONFIG_BLE);
+}
+
+void NetworkManager::startBLEConfigMode()
+{
+    post(Event::Type::START_BLE_CONFIG);
 }
 // ============================================================================
 // EMOTION CODE PARSING
 // ============================================================================
-state::EmotionState NetworkManager::parseEmotionCode(const std::string &code)
+state::EmotionState NetworkManager::parseEmotionCode(std::string_view code)
 {
     // Map WebSocket emotion codes to EmotionState
     // Format expected: "01", "11", etc. (2-char codes)
-
-    if (code == "00" || code.empty())
-    {
+    static constexpr auto kEmotions = phash::make<16, state::EmotionState>({
+        {"00", state::EmotionState::NEUTRAL},
+        {"01", state::EmotionState::HAPPY},    // Happy, cheerful
+        {"02", state::EmotionState::ANGRY},    // Angry, urgent
+        {"03", state::EmotionState::EXCITED},  // Excited, enthusiastic
+        {"10", state::EmotionState::SAD},      // Sad, empathetic
+        {"12", state::EmotionState::CONFUSED}, // Confused, uncertain
+        {"13", state::EmotionState::CALM},     // Calm, soothing
+        {"99", state::EmotionState::THINKING}, // Thinking, processing
+    });
+    static_assert(kEmotions.valid, "emotion codes need a perfect seed");
+
+    if (code.empty())
         return state::EmotionState::NEUTRAL;
-    }
-    if (code == "01")
-    {
-        return state::EmotionState::HAPPY; // Happy, cheerful
-    }
-    if (code == "02")
-    {
-        return state::EmotionState::ANGRY; // Angry, urgent
-    }
-    if (code == "03")
-    {
-        return state::EmotionState::EXCITED; // Excited, enthusiastic
-    }
-    if (code == "10")
-    {
-        return state::EmotionState::SAD; // Sad, empathetic
-    }
-    if (code == "12")
-    {
-        return state::EmotionState::CONFUSED; // Confused, uncertain
-    }
-    if (code == "13")
-    {
-        return state::EmotionState::CALM; // Calm, soothing
-    }
-    if (code == "99")
-    {
-        return state::EmotionState::THINKING; // Thinking, processing
-    }
 
-    ESP_LOGW(TAG, "Unknown emotion code: %s", code.c_str());
+    if (const state::EmotionState *e = kEmotions.find(code))
+        return *e;
+
+    ESP_LOGW(TAG, "Unknown emotion code: %.*s", (int)code.size(), code.data());
     return state::EmotionState::NEUTRAL;
 }
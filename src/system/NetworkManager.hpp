@@ -1,20 +1,31 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <string_view>
 #include <atomic>
 #include <functional>
+#include <mutex>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 // #include "freertos/ringbuf.h"
 #include "freertos/stream_buffer.h"
 
 #include "system/StateTypes.hpp"
 #include "system/StateManager.hpp"
 #include "BluetoothService.hpp"
+#include "WireProtocol.hpp"
+#include "NetSocket.hpp"
+#include "BitrateController.hpp"
+#include "ClockSync.hpp"
 
 class WifiService;     // Low-level WiFi
 class WebSocketClient; // Low-level WebSocket
+class TlsSocket;       // wss:// transport (created on the first wss:// connect)
+class UdpAudioLink;    // Audio datagrams (optional, offered by the server)
+class SpanRing;        // Encoded mic ring (AudioManager)
+namespace json { class Doc; }
 
 /**
  * NetworkManager
@@ -29,6 +40,13 @@ class WebSocketClient; // Low-level WebSocket
  *  - Không scan wifi
  *  - Không xử lý portal HTML
  *  - Không chứa logic kết nối driver-level
+ *
+ * Threading: NetworkLoop là event loop duy nhất sở hữu trạng thái kết nối.
+ * It also drives the WebSocket: one select() on the WS socket, a waker fd
+ * and the nearest deadline, so receive callbacks run on NetworkLoop (no WS
+ * task). Wi-Fi callbacks and the public API below only post an Event
+ * (never block); retry, ping, credit and fallback deadlines are timers of
+ * the same loop. The send calls only touch atomics and the WS send lock.
  */
 class NetworkManager
 {
@@ -51,6 +69,107 @@ public:
 
         // WebSocket server endpoint
         std::string ws_url; // e.g. ws://192.168.1.100:8080/ws
+        // wss:// only: CA that signed the server certificate (static PEM)
+        const char *ws_ca_pem = nullptr;
+        bool ws_skip_cn_check = false; // certificate not issued for the URL host
+        // Keep the TLS session in RTC memory: resumed handshake after deep sleep
+        bool ws_tls_session_rtc = true;
+
+        // Framed binary protocol (WireProtocol). Advertised in identify;
+        // used only after the server answers with Control::HELLO.
+        bool framing = true;
+        proto::Codec uplink_codec = proto::Codec::ADPCM_IMA;
+        uint32_t codec_sample_rate = 16000;
+
+        // Uplink packetisation theo thời gian (20/40/60 ms), không theo codec
+        uint16_t uplink_packet_ms = 40;
+        // Max time the first byte of a packet may wait before it is sent
+        uint16_t uplink_max_delay_ms = 60;
+
+        // Downlink credit flow control (server HELLO with feature::CREDIT).
+        // Audio the server may keep queued ahead of the speaker, in the
+        // codec of the last downlink AUDIO header (downlink_codec before
+        // the first one).
+        uint16_t downlink_window_ms = 200;
+        proto::Codec downlink_codec = proto::Codec::ADPCM_IMA;
+        // Credit refresh period while downlink audio is queued
+        uint16_t credit_interval_ms = 40;
+
+        // Reconnect: exponential backoff with jitter, reset once a
+        // connection stayed up for liveness_timeout_ms
+        uint32_t reconnect_min_ms = 250;
+        uint32_t reconnect_max_ms = 30000;
+        uint32_t connect_timeout_ms = 5000; // no OPEN/CLOSE → attempt failed
+
+        // Dead-peer detection. Server with feature::PING: PING after ping_interval_ms without
+        // any frame from the server, reconnect after liveness_timeout_ms of
+        // silence. Legacy: WS-level ping/pong with the same (rounded) values.
+        uint32_t ping_interval_ms = 2000;
+        uint32_t liveness_timeout_ms = 6000;
+
+        // Link-quality probe: stats refresh + telemetry frame period.
+        // With feature::PING one probe PING per period keeps the RTT fresh
+        // while audio is flowing. 0 = no telemetry frame.
+        uint32_t telemetry_interval_ms = 10000;
+
+        // Control lane: server controls are queued by the WS receive path
+        // (NetworkLoop) and run on their own task, above it, so a state
+        // command is never stuck behind downlink audio
+        uint8_t control_queue_len = 16;
+        uint8_t control_task_prio = 6;
+
+        // Audio over UDP when the server offers it (feature::UDP): no TCP
+        // head-of-line stall on a lost segment. The WS stays the control
+        // channel and the fallback. Redundancy repeats each uplink packet in
+        // the next one (2x uplink bytes, any single loss repaired).
+        bool udp_audio = true;
+        bool udp_redundancy = true;
+
+        // Adaptive uplink codec (server HELLO with feature::CODEC_SWITCH, an
+        // ADPCM_IMA uplink, onUplinkProfile registered): BitrateController
+        // steps between ADPCM 16 kHz / 8 kHz to keep uplink latency bounded
+        bool adaptive_bitrate = true;
+        BitrateController::Config bitrate{};
+        // PING period while the uplink streams: the PONG waits behind the
+        // audio in the socket send buffer, its RTT shows that queue
+        uint32_t bitrate_probe_ms = 500;
+
+        // Barge-in: CANCELLED not back in time → drop downlink audio until
+        // the next stream START instead
+        uint32_t cancel_ack_timeout_ms = 2000;
+
+        // Server clock estimate (server with feature::CLOCK): a PING every
+        // ping_interval_ms even on a busy link, each PONG is one sample.
+        // Controls go out stamped in server time, each turn is reported
+        // split into uplink / server / downlink one-way times.
+        ClockSync::Config clock{};
+    };
+
+    // Downlink depth sample for credit flow control
+    struct DownlinkDepth
+    {
+        uint32_t queued_ms = 0;  // audio ahead of the speaker (encoded + PCM)
+        size_t free_bytes = 0;   // space left in the encoded buffer
+    };
+
+    // Link quality (query API + telemetry frame)
+    struct LinkStats
+    {
+        uint32_t rtt_ms = 0;              // last PING → PONG
+        uint32_t srtt_ms = 0;             // smoothed RTT (RFC 6298)
+        uint32_t rttvar_ms = 0;           // RTT variation
+        uint32_t jitter_us = 0;           // downlink inter-arrival jitter (RFC 3550)
+        uint32_t uplink_queue_ms = 0;     // mean age of mic audio when sent (last period)
+        uint32_t uplink_queue_max_ms = 0; // worst packet in the last period
+        int rssi_dbm = 0;                 // 0 = not associated
+        uint32_t rx_bps = 0;              // WS payload throughput, last period
+        uint32_t tx_bps = 0;
+        uint32_t control_latency_max_us = 0; // receive → control task, last period
+        uint32_t control_drops = 0;          // control lane full (since boot)
+        bool udp_audio = false;              // audio on UDP (WS carries control only)
+        uint32_t udp_repaired = 0;           // downlink packets rebuilt from redundancy (since boot)
+        uint32_t udp_lost = 0;               // downlink packets lost for good (since boot)
+        uint8_t uplink_profile = 0;          // BitrateController::PROFILES index
     };
 
     // ======================================================
@@ -63,12 +182,9 @@ public:
     void stop();
 
     // ======================================================
-    // External API
+    // External API (any task: posted to NetworkLoop)
     // ======================================================
 
-    /// Cập nhật mỗi chu kỳ AppController loop
-    void update(uint32_t dt_ms);
-
     /// Gán lại credentials khi user submit portal
     void setCredentials(const std::string &ssid, const std::string &pass);
 
@@ -77,19 +193,63 @@ public:
     void setApSsid(const std::string &apSsid);
     void setDeviceLimit(uint8_t maxClients);
 
-    // Set mic encoded stream buffer (for uplink audio task)
-    void setMicBuffer(StreamBufferHandle_t sb) { mic_encoded_sb = sb; }
+    // Set mic encoded ring (for uplink audio task). Create it with
+    // UPLINK_HEADROOM so packets are framed in place.
+    void setMicBuffer(SpanRing *ring) { mic_encoded = ring; }
+
+    // Proto header + WS client frame header (WebSocketClient::FRAME_HEADROOM)
+    static constexpr size_t UPLINK_HEADROOM = proto::HEADER_SIZE + 8;
 
     /// Gửi message lên server
-    bool sendText(const std::string &text);
+    bool sendText(std::string_view text);
     bool sendBinary(const uint8_t *data, size_t len);
 
-    /// Callback khi server gửi text message
-    void onServerText(std::function<void(const std::string &)> cb);
+    /// Gửi control: framed nếu server đã HELLO, ngược lại magic string cũ
+    bool sendControl(proto::Control c, const uint8_t *args = nullptr, size_t args_len = 0);
+
+    /// Queue a control for the control task, as if the server sent it.
+    /// Never blocks (any task); false if the lane is full.
+    bool postControl(proto::Control c, const uint8_t *args = nullptr, size_t args_len = 0);
 
-    /// Callback khi server gửi binary
+    /// True once the server confirmed the framed protocol (this connection)
+    bool isFramingActive() const { return framing_active; }
+
+    // Callbacks / buffers / probes below: register before start()
+
+    /// Callback khi server gửi text message (không phải control / JSON command).
+    /// The view points into the WS receive buffer: copy it to keep it.
+    /// Runs on NetworkLoop: must not block.
+    void onServerText(std::function<void(std::string_view)> cb);
+
+    /// Callback khi server gửi control (framed hoặc magic string cũ).
+    /// Runs on the control task, in arrival order.
+    void onServerControl(std::function<void(proto::Control, const uint8_t *, size_t)> cb);
+
+    /// Callback khi server gửi binary (audio lane). Runs on NetworkLoop:
+    /// write without waiting, drop when the ring is full.
     void onServerBinary(std::function<void(const uint8_t *, size_t)> cb);
 
+    /// Downlink depth probe (called from the network task). Without it no
+    /// credits are sent and the server paces in real time.
+    void setDownlinkProbe(std::function<DownlinkDepth()> probe) { downlink_probe = probe; }
+
+    /// Uplink codec profile change (adaptive bitrate). Runs on the uplink
+    /// worker: hand it to the encoder without blocking
+    /// (AudioManager::setUplinkFormat). Without it the profile never changes.
+    void onUplinkProfile(std::function<void(const BitrateController::Profile &)> cb) { uplink_profile_cb = cb; }
+
+    /// True when the server paces the downlink by our credits: a full
+    /// buffer is then a protocol error, not a reason to block
+    bool isFlowControlActive() const { return flow_control_active; }
+
+    /// Latest link-quality numbers (any task). Rates and queue delay are
+    /// refreshed every telemetry_interval_ms, RTT / jitter per sample.
+    LinkStats getLinkStats() const;
+
+    /// Device → server clock (any task). valid = false until the first
+    /// PONG of a feature::CLOCK server on this connection.
+    ClockSync::Mapping serverClock() const;
+
     /// Callback khi WebSocket disconnect (để flush buffer/reset state)
     void onDisconnect(std::function<void()> cb);
 
@@ -109,6 +269,11 @@ public:
     /// Mark end of speaking session (allows next TTS to trigger SPEAKING)
     void endSpeakingSession() { speaking_session_active = false; }
 
+    /// Barge-in (any task, speaker already silent): fence the downlink
+    /// receive path and ask the server to stop the answer (Control::CANCEL).
+    /// unplayed_ms: audio still queued on the device when it was cut.
+    void cancelDownlink(uint32_t unplayed_ms);
+
     // ======================================================
     // OTA Firmware Update Support
     // ======================================================
@@ -118,7 +283,7 @@ public:
      * @param version Version to request (optional, "" = latest)
      * @return true if request sent
      */
-    bool requestFirmwareUpdate(const std::string &version = "");
+    bool requestFirmwareUpdate(std::string_view version = {});
 
     /**
      * Callback when firmware data chunk received from server
@@ -127,9 +292,10 @@ public:
     void onFirmwareChunk(std::function<void(const uint8_t *, size_t)> cb);
 
     /**
-     * Callback when firmware download completes
+     * Callback when firmware download completes. Runs on the control task;
+     * msg is only valid during the call (server text, truncated to 62 B)
      */
-    void onFirmwareComplete(std::function<void(bool success, const std::string &msg)> cb);
+    void onFirmwareComplete(std::function<void(bool success, std::string_view msg)> cb);
 
     // Control captive portal explicitly
     void stopPortal();
@@ -141,37 +307,141 @@ public:
     /// Parse emotion code from WebSocket message
     /// @param code 2-character emotion code ("01", "11", etc.)
     /// @return EmotionState, or NEUTRAL if code not recognized
-    static state::EmotionState parseEmotionCode(const std::string &code);
+    static state::EmotionState parseEmotionCode(std::string_view code);
 
 private:
+    // Host replay of the loop (test/host/test_network_loop.cpp)
+    friend struct NetworkLoopReplay;
+
     // ======================================================
-    // Internal handlers
+    // Event loop (NetworkLoop task)
+    // ======================================================
+    struct Event
+    {
+        enum class Type : uint8_t
+        {
+            START,
+            STOP,
+            WIFI_STATUS,      // value = WifiService status
+            WS_STATUS,        // value = WebSocketClient status
+            INTERACTION,      // value = state::InteractionState
+            SET_IMMUNE,       // value = 0 / 1
+            SET_CREDENTIALS,  // text = "ssid\0pass"
+            SET_WS_URL,       // text
+            SET_AP_SSID,      // text
+            SET_DEVICE_LIMIT, // value
+            STOP_PORTAL,
+            START_BLE_CONFIG,
+        };
+        Type type = Type::START;
+        int32_t value = 0;
+        char *text = nullptr; // heap copy, freed by the loop
+    };
+    static constexpr UBaseType_t EVENT_QUEUE_LEN = 16;
+
+    // Never blocks; false (text freed) if the queue is full
+    bool post(Event::Type type, int32_t value = 0, char *text = nullptr);
+    static char *copyText(std::string_view a, std::string_view b = {});
+    void runLoop();
+    // One wake-up: wait, events, WS, timers. false once STOP was handled
+    bool runLoopOnce();
+    void handleEvent(const Event &ev);
+    // Deadlines: WS retry / connect timeout, Wi-Fi fallback, credits,
+    // liveness, telemetry
+    void serviceTimers();
+    // Close WS + Wi-Fi, forget the connection (STOP)
+    void shutdownLink();
+
+    // ======================================================
+    // Internal handlers (NetworkLoop)
     // ======================================================
     void handleWifiStatus(int status_code);
     void handleWsStatus(int status_code);
 
-    // Retry logic for initial WiFi connection
-    void retryWifiThenPortal();
-    void retryWifiThenBLE();
-    static void retryWifiTaskEntry(void *arg);
+    // No IP within WIFI_FALLBACK_MS of start → stop Wi-Fi, BLE config mode
+    void serviceWifiFallback();
+    static constexpr uint32_t WIFI_FALLBACK_MS = 5000;
 
     // Receive message from WebSocketClient
-    void handleWsTextMessage(const std::string &msg);
-    void handleWsBinaryMessage(const uint8_t *data, size_t len);
-
-    // Uplink task for sending microphone data
-    void uplinkTaskLoop();
+    void handleWsTextMessage(std::string_view msg);
+    // {"type":...} commands → static handler table. false = not a known command
+    bool dispatchJsonCommand(std::string_view msg);
+    void onJsonControl(const json::Doc &doc);
+    void onJsonEmotion(const json::Doc &doc);
+    void onJsonFirmware(const json::Doc &doc);
+    // One piece of a binary message (offset/total from the WS client)
+    void handleWsBinaryMessage(const uint8_t *data, size_t len, size_t offset, size_t total, bool last);
+    void handleFramedPayload(const proto::Header &h, const uint8_t *slice, size_t len, bool first, bool last);
+    void handleFramedAudio(const proto::Header &h, const uint8_t *slice, size_t len, bool first, bool last);
+    void dispatchControl(proto::Control c, const uint8_t *args, size_t args_len);
+
+    // UDP audio: offer (NetworkLoop), bind result + downlink (UdpAudio task)
+    void handleUdpOffer(const uint8_t *args, size_t args_len);
+    // Downlink fence: true = drop this frame (cut answer)
+    bool fenceDrops(const proto::Header &h);
+    void onUdpReady(bool ok, uint32_t token);
+    void handleUdpAudio(const proto::Header &h, const uint8_t *payload, size_t len);
+
+    // Control lane: NetworkLoop → queue → control task
+    struct ControlItem
+    {
+        int64_t posted_us;
+        proto::Control code;
+        uint8_t args_len;
+        uint8_t args[proto::FrameReader::STASH_SIZE - 1];
+    };
+    // Device-local code, never on the wire: args [ok u8][msg...]
+    static constexpr proto::Control CTRL_FIRMWARE_DONE = static_cast<proto::Control>(0xF0);
+    void controlTaskLoop();
+    static void controlTaskEntry(void *arg);
+    // Grant the server more downlink bytes once the device has drained some
+    void serviceCredits();
+
+    // PING when the server is quiet, abort the connection when it is dead
+    void serviceLiveness();
+    // ms until the next ping / liveness deadline (0 = due now)
+    uint32_t livenessDueMs() const;
+    // Next reconnect delay: min·2^attempt capped, equal jitter
+    uint32_t nextBackoffMs();
+
+    // Close the stats period: rates, RSSI, probe PING, telemetry frame
+    void serviceTelemetry();
+    uint32_t telemetryDueMs() const;
+    void onRttSample(uint32_t rtt);
+    void recordUplinkDelay(uint32_t ms);
+
+    // Clock sync: one PONG sample (NetworkLoop), turn report at the answer
+    void onClockSample(const uint8_t *pong_args, uint32_t now);
+    void reportTurn(uint32_t answer_server_ms);
+
+    // Uplink worker: one long-lived task, armed per LISTENING turn
+    void uplinkWorkerLoop();
+    // One turn: stream the mic ring until LISTENING ends (or the WS closes)
+    void runUplinkTurn(uint32_t armed_us);
     static void uplinkTaskEntry(void *arg);
+    // Unblock the uplink receive so it re-checks state (listening end, WS close)
+    void wakeUplink();
+    static constexpr size_t MAX_UPLINK_PACKET = 1024;
+    size_t uplinkPacketBytes(proto::Codec codec) const;
+    // Hand the controller's profile to the encoder if it changed
+    void applyUplinkProfile();
     // Push connectivity state lên StateManager
     void publishState(state::ConnectivityState s);
     void handleInteractionState(state::InteractionState s);
 
     static void taskEntry(void *arg);
 
+    // NetworkLoop chỉ thức khi có việc: event, WS socket hoặc deadline gần nhất
+    void wakeLoop();
+    uint32_t nextWakeMs() const;
+    // WS transport for the URL scheme (TlsSocket created on first use)
+    NetSocket *wsSocketForUrl();
+
 private:
-    TaskHandle_t task_handle = nullptr;
+    std::atomic<TaskHandle_t> task_handle{nullptr}; // cleared by the loop on exit
+    QueueHandle_t event_queue = nullptr;
+    NetWaker loop_waker; // post() / wakeLoop() → NetworkLoop out of select()
 
-    uint32_t update_interval_ms = 33; // ~30 FPS tick
     int sub_interaction_id = -1;
 
 private:
@@ -179,7 +449,14 @@ private:
     // Components
     // ======================================================
     std::unique_ptr<WifiService> wifi;
+    // WS transports + receive buffer: declared before ws, which uses them
+    // until it is destroyed
+    PlainSocket ws_plain;
+    std::unique_ptr<TlsSocket> ws_tls;
+    static constexpr size_t WS_RX_BUFFER = 2048; // larger messages arrive in pieces
+    uint8_t ws_rx_buf[WS_RX_BUFFER];
     std::unique_ptr<WebSocketClient> ws;
+    std::unique_ptr<UdpAudioLink> udp; // nullptr when config_.udp_audio is off
         // Bluetooth service for BLE config mode
     std::shared_ptr<BluetoothService> ble_service;
 
@@ -189,33 +466,148 @@ private:
     Config config_{}; // holds init-time configuration
 
     // ======================================================
-    // Runtime flags
+    // Runtime flags (NetworkLoop only, unless atomic)
     // ======================================================
     std::atomic<bool> started{false};
 
     // WiFi status flags
     bool wifi_ready = false; // đã có IP hay chưa
 
+    // Wi-Fi fallback: waiting for an IP, then Wi-Fi stopped before BLE
+    enum class Fallback : uint8_t
+    {
+        NONE,
+        WAIT_WIFI,
+        STOP_WIFI,
+    };
+    Fallback fallback = Fallback::NONE;
+    uint32_t fallback_due_ms = 0;
 
     // WS runtime control
     bool ws_should_run = false;           // Manager muốn WS chạy
-    bool ws_running = false;              // WS thực sự open chưa
+    std::atomic<bool> ws_running{false};  // WS thực sự open chưa (send paths read it)
     bool ws_immune_mode = false;          // Prevent WS close during critical operations (e.g. audio streaming)
-    bool speaking_session_active = false; // Prevent SPEAKING state spam per TTS session
+    std::atomic<bool> speaking_session_active{false}; // Prevent SPEAKING state spam per TTS session
+
+    // Framed protocol state (per connection)
+    std::atomic<bool> framing_active{false};
+    std::atomic<uint32_t> ws_conn_gen{0}; // ++ on every WS open (NetworkLoop)
+    // Uplink worker only: reset at turn start when ws_conn_gen moved
+    uint32_t tx_audio_gen = 0;
+    uint16_t tx_audio_seq = 0;
+    std::atomic<uint16_t> tx_ctrl_seq{0}; // any task sends controls
+    uint32_t tx_audio_ts = 0; // uplink sample clock
+    proto::FrameReader rx_frames; // NetworkLoop only
+    // Downlink audio task: NetworkLoop, or UdpAudio once the server moved
+    // its audio to UDP (never both at once)
+    proto::SeqTracker rx_audio_seq;
+    proto::JitterEstimator rx_jitter;
+
+    // Barge-in fence on the downlink receive path. Armed by cancelDownlink()
+    // (any task), checked per frame by the downlink audio task.
+    enum : uint8_t
+    {
+        FENCE_OFF,
+        FENCE_ACK,   // CANCEL sent: drop all until CANCELLED
+        FENCE_SEQ,   // drop seq ≤ rx_fence_seq
+        FENCE_START, // server without feature::CANCEL: drop until a START
+    };
+    std::atomic<uint8_t> rx_fence{FENCE_OFF};
+    std::atomic<uint16_t> rx_fence_seq{0};
+    std::atomic<uint32_t> rx_fence_ms{0};
+    std::atomic<bool> cancel_supported{false}; // HELLO feature::CANCEL
+    std::atomic<uint16_t> rx_last_seq{0};      // newest downlink AUDIO let through
+    std::atomic<uint32_t> rx_last_samples{0};  // its length (played-seq estimate)
+    bool rx_frame_fenced = false;              // WS frame in pieces: same verdict
+    uint32_t rx_fence_dropped = 0;
+
+    // UDP audio (per connection)
+    char ws_host[64] = {};                     // UDP peer = WS host (set at OPEN)
+    std::atomic<bool> udp_audio_active{false}; // bound: uplink audio goes by UDP
+    bool udp_rx_started = false;               // UdpAudio task only
+    uint32_t udp_rx_next_ts = 0;
+
+    // Reconnect / liveness
+    char session_token[17] = {};       // per boot; lets the server resume a turn
+    uint8_t reconnect_attempt = 0;
+    bool connect_pending = false;      // connect() issued, no OPEN/CLOSE yet
+    uint32_t link_lost_ms = 0;         // for the reconnect time log
+    uint32_t ws_open_ms = 0;
+    std::atomic<bool> app_ping{false};   // server answers PING (HELLO feature)
+    std::atomic<uint32_t> last_rx_ms{0}; // any frame from the server
+    uint32_t last_ping_ms = 0;
+    uint32_t ping_nonce = 0;
+
+    // Link-quality probe. Samples come from the WS receive path / uplink task,
+    // serviceTelemetry() closes a period on the network task.
+    std::atomic<uint32_t> rtt_ms{0};
+    std::atomic<uint32_t> srtt_ms{0};
+    std::atomic<uint32_t> rttvar_ms{0};
+    std::atomic<uint32_t> rx_jitter_us{0};
+    std::atomic<uint32_t> stat_rx_bytes{0};  // WS payload, reset per period
+    std::atomic<uint32_t> stat_tx_bytes{0};
+    std::atomic<uint32_t> up_delay_sum_ms{0};
+    std::atomic<uint32_t> up_delay_count{0};
+    std::atomic<uint32_t> up_delay_peak_ms{0};
+    std::atomic<uint32_t> pub_rx_bps{0};     // published at period end
+    std::atomic<uint32_t> pub_tx_bps{0};
+    std::atomic<uint32_t> pub_up_delay_ms{0};
+    std::atomic<uint32_t> pub_up_delay_max_ms{0};
+    std::atomic<int> pub_rssi_dbm{0};
+    std::atomic<uint32_t> ctrl_lat_peak_us{0}; // control task only
+    std::atomic<uint32_t> pub_ctrl_lat_max_us{0};
+    std::atomic<uint32_t> ctrl_drops{0};
+    uint32_t telemetry_ms = 0;               // start of the current period
+
+    // Downlink credits (per connection)
+    std::atomic<bool> flow_control_active{false};
+    std::atomic<uint32_t> rx_audio_bytes{0}; // AUDIO payload bytes received
+    std::atomic<proto::Codec> rx_audio_codec{proto::Codec::ADPCM_IMA}; // sizes the credits
+    uint32_t credit_limit = 0;               // last limit granted
+    bool credit_granted = false;             // first grant sent
+    std::atomic<bool> credit_busy{false};    // loop refreshes while audio is queued
+    std::function<DownlinkDepth()> downlink_probe = nullptr;
 
     //
-    StreamBufferHandle_t mic_encoded_sb = nullptr;
-    TaskHandle_t uplink_task_handle = nullptr;
-
-    // Retry timer (ms)
-    uint32_t ws_retry_timer = 0;
-
-    uint32_t tick_ms = 0;
+    SpanRing *mic_encoded = nullptr;
+    TaskHandle_t uplink_task_handle = nullptr; // created once in start()
+    std::atomic<bool> uplink_armed{false};      // LISTENING began, turn not started yet
+    std::atomic<int64_t> uplink_arm_us{0};      // for the turn-start latency
+
+    // Adaptive uplink codec
+    std::atomic<bool> codec_switch{false};       // server decodes any codec per frame (HELLO)
+    BitrateController bitrate;                   // uplink worker only
+    uint8_t uplink_profile_applied = 0xFF;       // uplink worker only (0xFF: never applied)
+    std::atomic<uint8_t> pub_uplink_profile{0};
+    std::function<void(const BitrateController::Profile &)> uplink_profile_cb = nullptr;
+
+    // Clock sync (per connection). NetworkLoop feeds the estimator, other
+    // tasks read the copy published under clock_lock.
+    std::atomic<bool> clock_supported{false}; // HELLO feature::CLOCK
+    ClockSync clock_sync;                     // NetworkLoop only
+    mutable std::mutex clock_lock;
+    ClockSync::Mapping clock_map;             // guarded by clock_lock
+
+    // One turn, in device ms: LISTENING → first control of the answer
+    std::atomic<bool> turn_listening{false};
+    std::atomic<uint32_t> turn_start_ms{0};
+    std::atomic<uint32_t> turn_end_ms{0};     // 0 = no answer awaited
+    std::atomic<uint32_t> turn_t0_ms{0};      // server ms of the START frame's first sample (0 = none)
+    std::atomic<int32_t> turn_up_sum_ms{0};   // uplink one-way of the turn's PINGs
+    std::atomic<uint32_t> turn_up_count{0};
+
+    // Control lane
+    QueueHandle_t control_queue = nullptr;
+    TaskHandle_t control_task_handle = nullptr;
+
+    // WS retry / connect-timeout deadline (nowMs clock)
+    uint32_t ws_retry_due_ms = 0;
 
     // ======================================================
     // App-level callbacks
     // ======================================================
-    std::function<void(const std::string &)> on_text_cb = nullptr;
+    std::function<void(std::string_view)> on_text_cb = nullptr;
+    std::function<void(proto::Control, const uint8_t *, size_t)> on_control_cb = nullptr;
     std::function<void(const uint8_t *, size_t)> on_binary_cb = nullptr;
     std::function<void()> on_disconnect_cb = nullptr;
 
@@ -223,12 +615,9 @@ private:
     // OTA Callbacks
     // ======================================================
     std::function<void(const uint8_t *, size_t)> on_firmware_chunk_cb = nullptr;
-    std::function<void(bool, const std::string &)> on_firmware_complete_cb = nullptr;
+    std::function<void(bool, std::string_view)> on_firmware_complete_cb = nullptr;
 
     // OTA state
-    bool firmware_download_active = false;
+    std::atomic<bool> firmware_download_active{false};
     uint32_t firmware_bytes_received = 0;
-
-    // WiFi retry state
-    TaskHandle_t wifi_retry_task = nullptr;
 };
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+
+/**
+ * Host tests: a failed CHECK prints and counts, the test's main() returns
+ * checkResult(). No framework, nothing to install besides a C++17 compiler.
+ */
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                      \
+    do                                                                   \
+    {                                                                    \
+        if (!(cond))                                                     \
+        {                                                                \
+            std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+            ++checkFailures();                                           \
+        }                                                                \
+    } while (0)
+
+inline int checkResult(const char *name)
+{
+    if (checkFailures())
+        std::printf("%s: %d check(s) FAILED\n", name, checkFailures());
+    else
+        std::printf("%s: ok\n", name);
+    return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+// Live host port for fleet_sim: see fleet_port.hpp
+#include "fleet_port.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "BluetoothService.hpp"
+#include "TlsSocket.hpp"
+#include "WifiService.hpp"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t g_index = 0;
+    std::mutex g_rng_lock;
+    std::mt19937 g_rng{0x5EED1234};
+    std::function<void(const char *)> g_log_cb;
+
+    // Wait deadline for a FreeRTOS timeout (portMAX_DELAY = none)
+    Clock::time_point deadlineFor(TickType_t ticks)
+    {
+        if (ticks == portMAX_DELAY)
+            return Clock::time_point::max();
+        return Clock::now() + std::chrono::milliseconds(int64_t(ticks) * portTICK_PERIOD_MS);
+    }
+
+    template <typename Lock, typename Pred>
+    bool waitUntil(std::condition_variable &cv, Lock &lk, Clock::time_point due, Pred pred)
+    {
+        if (due == Clock::time_point::max())
+        {
+            cv.wait(lk, pred);
+            return true;
+        }
+        return cv.wait_until(lk, due, pred);
+    }
+} // namespace
+
+namespace fleet
+{
+    void setDevice(uint32_t index, uint32_t seed)
+    {
+        g_index = index;
+        std::lock_guard<std::mutex> lk(g_rng_lock);
+        g_rng.seed(seed * 100003u + index);
+    }
+
+    void onLog(std::function<void(const char *)> cb) { g_log_cb = std::move(cb); }
+} // namespace fleet
+
+void hostLog(char level, const char *tag, const char *fmt, ...)
+{
+    if (!g_log_cb)
+        return;
+    char line[256];
+    int n = std::snprintf(line, sizeof(line), "%c %s: ", level, tag);
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(line + n, sizeof(line) - n, fmt, ap);
+    va_end(ap);
+    g_log_cb(line);
+}
+
+// ============================================================================
+// ESP-IDF
+// ============================================================================
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+uint32_t esp_random()
+{
+    std::lock_guard<std::mutex> lk(g_rng_lock);
+    return g_rng();
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t)
+{
+    mac[0] = 0x51;
+    for (int i = 1; i < 6; ++i)
+        mac[i] = uint8_t(uint64_t(g_index) >> (8 * (5 - i)));
+    return ESP_OK;
+}
+
+// ============================================================================
+// FreeRTOS: a task is a detached thread. vTaskDelete() of another task
+// parks it for good (its thread stays blocked, the handle stays valid).
+// ============================================================================
+struct HostTask
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notify = 0;
+    bool blocked = false; // in vTaskDelay / ulTaskNotifyTake: xTaskAbortDelay applies
+    bool aborted = false;
+    bool deleted = false;
+};
+
+static thread_local HostTask *t_self = nullptr;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+    HostTask *task = new HostTask; // never freed: handles outlive their task
+    if (handle)
+        *handle = task;
+    std::thread([task, fn, arg]
+                {
+                    t_self = task;
+                    fn(arg);
+                })
+        .detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    HostTask *task = handle ? static_cast<HostTask *>(handle) : t_self;
+    if (!task)
+        return;
+    std::lock_guard<std::mutex> lk(task->lock);
+    task->deleted = true; // the entry function returns right after a self-delete
+}
+
+// Block the calling task until pred, the deadline or xTaskAbortDelay.
+// false on timeout / abort. A deleted task never comes back.
+template <typename Pred>
+static bool taskWait(HostTask *task, std::unique_lock<std::mutex> &lk, Clock::time_point due, Pred pred)
+{
+    task->blocked = true;
+    const bool ok = waitUntil(task->cv, lk, due, [&]
+                              { return !task->deleted && (task->aborted || pred()); });
+    task->blocked = false;
+    if (task->aborted)
+    {
+        task->aborted = false;
+        return false;
+    }
+    if (task->deleted)
+        task->cv.wait(lk, []
+                      { return false; });
+    return ok;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (!t_self)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(int64_t(ticks) * portTICK_PERIOD_MS));
+        return;
+    }
+    std::unique_lock<std::mutex> lk(t_self->lock);
+    taskWait(t_self, lk, deadlineFor(ticks), []
+             { return false; });
+}
+
+TickType_t xTaskGetTickCount() { return TickType_t(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return t_self; }
+
+BaseType_t xTaskAbortDelay(TaskHandle_t handle)
+{
+    HostTask *task = static_cast<HostTask *>(handle);
+    std::lock_guard<std::mutex> lk(task->lock);
+    if (!task->blocked)
+        return pdFAIL;
+    task->aborted = true;
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    HostTask *task = t_self;
+    std::unique_lock<std::mutex> lk(task->lock);
+    if (!taskWait(task, lk, deadlineFor(ticks), [task]
+                  { return task->notify > 0; }))
+        return 0;
+    const uint32_t value = task->notify;
+    task->notify = clear ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    HostTask *task = static_cast<HostTask *>(handle);
+    std::lock_guard<std::mutex> lk(task->lock);
+    ++task->notify;
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+struct HostQueue
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t q = new HostQueue;
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lk(q->lock);
+    if (!waitUntil(q->cv, lk, deadlineFor(ticks), [q]
+                   { return q->items.size() < q->length; }))
+        return pdFALSE;
+    const uint8_t *p = static_cast<const uint8_t *>(item);
+    q->items.emplace_back(p, p + q->item_size);
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lk(q->lock);
+    if (!waitUntil(q->cv, lk, deadlineFor(ticks), [q]
+                   { return !q->items.empty(); }))
+        return pdFALSE;
+    std::memcpy(item, q->items.front().data(), q->item_size);
+    q->items.pop_front();
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lk(q->lock);
+    return UBaseType_t(q->items.size());
+}
+
+// A deleted task may still be parked in xQueueReceive: keep the queue
+void vQueueDelete(QueueHandle_t) {}
+
+// ============================================================================
+// Drivers: Wi-Fi always gets an IP, no BLE, no TLS
+// ============================================================================
+void WifiService::init() {}
+bool WifiService::autoConnect()
+{
+    connected = true;
+    if (status_cb)
+        status_cb(2); // GOT_IP
+    return true;
+}
+void WifiService::connectWithCredentials(const char *, const char *) { autoConnect(); }
+void WifiService::disconnect() { connected = false; }
+void WifiService::stopCaptivePortal() {}
+int WifiService::getRssi() const { return connected ? -55 : 0; }
+
+BluetoothService::BluetoothService() = default;
+BluetoothService::~BluetoothService() = default;
+bool BluetoothService::init(const std::string &) { return false; }
+bool BluetoothService::start() { return false; }
+
+TlsSessionCache::TlsSessionCache() = default;
+TlsSessionCache::~TlsSessionCache() = default;
+TlsSocket::TlsSocket() = default;
+TlsSocket::~TlsSocket() = default;
+void TlsSocket::setConfig(const Config &) {}
+bool TlsSocket::connectStart(const char *, uint16_t)
+{
+    ESP_LOGE("fleet", "wss:// is not supported on the host");
+    return false;
+}
+NetSocket::Step TlsSocket::connectStep() { return Step::FAILED; }
+int TlsSocket::readSome(uint8_t *, size_t) { return -1; }
+int TlsSocket::writeSome(const IoSlice *, size_t) { return -1; }
+void TlsSocket::disconnect() {}
+size_t TlsSocket::buffered() const { return 0; }
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/**
+ * Live host port of NetworkManager for fleet_sim (fleet_port.cpp, headers
+ * in stubs/): FreeRTOS tasks on std::thread with blocking queues, task
+ * notifications and xTaskAbortDelay; esp_timer on the monotonic clock;
+ * Wi-Fi that has an IP as soon as it is asked to connect. The WebSocket is
+ * the real client (host_ws), wss:// is not available (no TlsSocket).
+ */
+namespace fleet
+{
+    // This process is device `index`: STA MAC 51:xx:xx:xx:xx:xx (index in
+    // the low 40 bits), esp_random() seeded from (seed, index)
+    void setDevice(uint32_t index, uint32_t seed);
+
+    // Every ESP_LOGx line of the firmware code ("W NetworkManager: ..."),
+    // on the task that logged it
+    void onLog(std::function<void(const char *line)> cb);
+} // namespace fleet
@@ -0,0 +1,691 @@
+// Fleet simulator: N virtual devices talking to one server at once (load
+// test). Each device is a process running the firmware's own network stack
+// on the host (fleet_port.cpp): NetworkManager with its event loop, uplink
+// worker and control lane, the real WebSocketClient, StateManager driving
+// the turns the way DeviceProfile wires it, AdpcmCodec encoding the mic in
+// real time into the SpanRing the uplink sends from. The speaker is a
+// playout model that drains in real time and answers the credit probe.
+//
+// Turns replay slices of WAV files (16 kHz mono 16-bit) with push-to-talk
+// timing: think time, reaction delay after the press, release delay after
+// speech ends.
+//
+// Report: per-device and fleet turn latency percentiles (release → first
+// downlink audio), failed turns, downlink loss / playout underruns / drops,
+// reconnects. server_test/fleet_sim.py is the Python fallback for machines
+// without a C++ toolchain; this target is the reference.
+//
+//   fleet_sim --url ws://127.0.0.1:8000/ws --devices 200 --turns 5
+#include "AdpcmCodec.hpp"
+#include "NetworkManager.hpp"
+#include "SpanRing.hpp"
+#include "StateManager.hpp"
+#include "fleet_port.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// =====================================================
+// DEVICE CONSTANTS (mirror of AudioManager / DeviceProfile)
+// =====================================================
+static constexpr uint32_t SAMPLE_RATE = 16000;
+static constexpr size_t FRAME_SAMPLES = 256;        // codec task frame (16 ms)
+static constexpr uint32_t BYTES_PER_MS = 8;         // ADPCM 4 bit at 16 kHz
+static constexpr size_t MIC_ENCODED_BYTES = 32 * 1024;
+static constexpr size_t SPK_ENCODED_BYTES = 16 * 1024;
+static constexpr uint32_t PLAYOUT_TARGET_MS = 160;  // kPlayoutTargetMs
+static constexpr uint32_t PREBUFFER_MS = 120;       // AudioManager::Config
+static constexpr int64_t PREBUFFER_TIMEOUT_MS = 400;
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct Args
+{
+    std::string url = "ws://127.0.0.1:8000/ws";
+    int devices = 20;
+    int turns = 3;
+    std::vector<std::string> wav;
+    double utterance_min_s = 1.5;
+    double utterance_max_s = 4.0;
+    double think_s = 6.0;
+    double ramp_s = 10.0;
+    double turn_timeout_s = 20.0;
+    double duration_s = 0; // 0 = no limit
+    uint32_t seed = 1;
+    bool summary = false;
+    bool verbose = false;
+};
+
+// =====================================================
+// UTTERANCES (loaded once, shared by every device after fork)
+// =====================================================
+static bool loadWav(const std::string &path, std::vector<int16_t> &pcm)
+{
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        std::fprintf(stderr, "%s: cannot open\n", path.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    std::fclose(f);
+
+    auto u16 = [&](size_t o) { return uint32_t(data[o] | data[o + 1] << 8); };
+    auto u32 = [&](size_t o) { return u16(o) | u16(o + 2) << 16; };
+    if (data.size() < 12 || std::memcmp(data.data(), "RIFF", 4) || std::memcmp(data.data() + 8, "WAVE", 4))
+    {
+        std::fprintf(stderr, "%s: not a WAV file\n", path.c_str());
+        return false;
+    }
+    bool format_ok = false;
+    for (size_t o = 12; o + 8 <= data.size();)
+    {
+        const uint32_t len = u32(o + 4);
+        const size_t body = o + 8;
+        if (body + len > data.size())
+            break;
+        if (!std::memcmp(data.data() + o, "fmt ", 4) && len >= 16)
+        {
+            format_ok = u16(body) == 1 && u16(body + 2) == 1 && u32(body + 4) == SAMPLE_RATE && u16(body + 14) == 16;
+        }
+        else if (!std::memcmp(data.data() + o, "data", 4))
+        {
+            if (!format_ok)
+                break;
+            pcm.resize(len / 2);
+            for (size_t i = 0; i < pcm.size(); ++i)
+                pcm[i] = int16_t(u16(body + 2 * i));
+            return !pcm.empty();
+        }
+        o = body + len + (len & 1);
+    }
+    std::fprintf(stderr, "%s: need 16 kHz mono 16-bit PCM\n", path.c_str());
+    return false;
+}
+
+// =====================================================
+// SPEAKER (AudioManager stand-in): encoded bytes drain in real time once
+// the prebuffer is in (or the prebuffer timeout ran out, or SPEAK_END);
+// from then on the I2S runs until the answer is over, a dry buffer plays
+// silence
+// =====================================================
+class Playout
+{
+public:
+    // NetworkLoop: false = did not fit (dropped)
+    bool write(size_t len)
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        drainLocked();
+        if (queued_ + len > SPK_ENCODED_BYTES)
+            return false;
+        if (!playing_ && first_data_ms_ < 0)
+            first_data_ms_ = nowMs();
+        queued_ += len;
+        if (!playing_ && queued_ >= PREBUFFER_MS * BYTES_PER_MS)
+            startLocked(nowMs());
+        return true;
+    }
+
+    NetworkManager::DownlinkDepth depth()
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        drainLocked();
+        return {uint32_t(queued_ / BYTES_PER_MS), SPK_ENCODED_BYTES - size_t(queued_)};
+    }
+
+    // SPEAK_END: play the tail, drained() once it is out
+    void endOfStream()
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        drainLocked();
+        eos_ = true;
+        if (!playing_)
+            startLocked(nowMs());
+    }
+
+    bool drained()
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        drainLocked();
+        return eos_ && queued_ == 0;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        queued_ = 0;
+        playing_ = false;
+        eos_ = false;
+        first_data_ms_ = -1;
+    }
+
+    uint32_t underruns() const { return underruns_; }
+
+private:
+    void startLocked(int64_t at_ms)
+    {
+        playing_ = true;
+        dry_ = false;
+        drain_at_ms_ = at_ms;
+    }
+
+    void drainLocked()
+    {
+        const int64_t t = nowMs();
+        if (!playing_ && first_data_ms_ >= 0 && t - first_data_ms_ >= PREBUFFER_TIMEOUT_MS)
+            startLocked(first_data_ms_ + PREBUFFER_TIMEOUT_MS); // server slow: play what is there
+        if (!playing_)
+            return;
+        queued_ -= double(t - drain_at_ms_) * BYTES_PER_MS;
+        drain_at_ms_ = t;
+        if (queued_ > 0)
+        {
+            dry_ = false;
+        }
+        else
+        {
+            queued_ = 0;
+            if (!eos_ && !dry_)
+                ++underruns_; // ran dry mid-answer
+            dry_ = true;
+        }
+    }
+
+    std::mutex lock_;
+    double queued_ = 0;
+    int64_t drain_at_ms_ = 0;
+    int64_t first_data_ms_ = -1;
+    bool playing_ = false;
+    bool dry_ = false;
+    bool eos_ = false;
+    std::atomic<uint32_t> underruns_{0};
+};
+
+// =====================================================
+// DEVICE (one process)
+// =====================================================
+struct DeviceStats
+{
+    std::vector<uint32_t> latencies; // release → first downlink audio, ms
+    uint32_t turns_ok = 0;
+    uint32_t turns_failed = 0;     // no answer in time / link lost
+    uint32_t lost = 0;             // downlink packets missing (seq gaps)
+    uint32_t underruns = 0;        // playout ran dry mid-answer
+    uint32_t overflow = 0;         // downlink bytes dropped, speaker buffer full
+    uint32_t mic_dropped = 0;      // mic frames dropped, uplink ring full
+    uint32_t reconnects = 0;       // back online after a link loss
+    uint32_t connect_failures = 0; // WS attempts that never opened
+};
+
+static std::string deviceId(uint32_t index)
+{
+    char id[16];
+    std::snprintf(id, sizeof(id), "51%010X", index);
+    return id;
+}
+
+static DeviceStats runDevice(uint32_t index, const Args &args, const std::vector<std::vector<int16_t>> &clips,
+                             int64_t deadline_ms)
+{
+    using state::InteractionState;
+    fleet::setDevice(index, args.seed);
+    std::mt19937 rng(args.seed * 100003u + index);
+    auto uniform = [&](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    auto expired = [&] { return deadline_ms && nowMs() >= deadline_ms; };
+
+    const std::string id = deviceId(index);
+    std::atomic<uint32_t> lost{0}, attempts{0}, overflow{0};
+    fleet::onLog([&](const char *line)
+                 {
+        unsigned gap;
+        if (std::sscanf(line, "W NetworkManager: Downlink: %u packet(s) lost", &gap) == 1)
+            lost += gap;
+        else if (std::strstr(line, "Trying WebSocket connect"))
+            ++attempts;
+        if (args.verbose)
+            std::fprintf(stderr, "[%s] %s\n", id.c_str(), line); });
+
+    auto &sm = StateManager::instance();
+    SpanRing mic;
+    mic.init(MIC_ENCODED_BYTES, NetworkManager::UPLINK_HEADROOM);
+    Playout spk;
+
+    NetworkManager nm;
+    NetworkManager::Config cfg;
+    cfg.ws_url = args.url;
+    cfg.udp_audio = false; // WS only, like a device behind a UDP-hostile NAT
+    cfg.downlink_window_ms = PLAYOUT_TARGET_MS + 40;
+    if (!nm.init(cfg))
+        return {};
+    NetworkManager *network = &nm;
+
+    // Turn being timed (ms, 0 = none)
+    std::atomic<int64_t> release_ms{0}, first_audio_ms{0};
+
+    // --- Network → speaker, as DeviceProfile wires it ---
+    nm.setMicBuffer(&mic);
+    nm.onServerBinary([&, network](const uint8_t *data, size_t len)
+                      {
+        if (!data || len == 0)
+            return;
+        if (StateManager::instance().getInteractionState() == InteractionState::LISTENING)
+            return; // barge-in: the cut answer is not played
+        if (!spk.write(len))
+            overflow += len;
+        if (release_ms && !first_audio_ms)
+            first_audio_ms = nowMs();
+        if (!network->isSpeakingSessionActive()) {
+            network->startSpeakingSession();
+            network->postControl(proto::Control::SPEAK_START);
+        } });
+    nm.setDownlinkProbe([&]
+                        { return spk.depth(); });
+    nm.onDisconnect([&]
+                    {
+        spk.clear();
+        if (StateManager::instance().getInteractionState() == InteractionState::SPEAKING)
+            StateManager::instance().setInteractionState(InteractionState::IDLE, state::InputSource::SYSTEM); });
+    nm.onServerControl([&, network](proto::Control c, const uint8_t *, size_t)
+                       {
+        auto &sm = StateManager::instance();
+        switch (c) {
+        case proto::Control::PROCESSING:
+            sm.setInteractionState(InteractionState::PROCESSING, state::InputSource::SERVER_COMMAND);
+            break;
+        case proto::Control::SPEAK_START:
+            sm.setInteractionState(InteractionState::SPEAKING, state::InputSource::SERVER_COMMAND);
+            break;
+        case proto::Control::SPEAK_END:
+            network->endSpeakingSession();
+            spk.endOfStream(); // IDLE once drained (turn loop below)
+            break;
+        case proto::Control::IDLE:
+            network->endSpeakingSession();
+            sm.setInteractionState(InteractionState::IDLE, state::InputSource::SERVER_COMMAND);
+            break;
+        default:
+            break;
+        } });
+
+    // Press / release → LISTEN_START / LISTEN_END, immune while speaking
+    InteractionState prev = InteractionState::IDLE;
+    sm.subscribeInteraction([&, network](InteractionState s, state::InputSource)
+                            {
+        if (s == InteractionState::LISTENING && prev != InteractionState::LISTENING)
+            network->sendControl(proto::Control::LISTEN_START);
+        else if (s != InteractionState::LISTENING && prev == InteractionState::LISTENING)
+            network->sendControl(proto::Control::LISTEN_END);
+        network->setWSImmuneMode(s == InteractionState::SPEAKING);
+        prev = s; });
+
+    std::atomic<uint32_t> onlines{0};
+    sm.subscribeConnectivity([&](state::ConnectivityState s)
+                             {
+        if (s == state::ConnectivityState::ONLINE)
+            ++onlines; });
+    auto online = [&] { return sm.getConnectivityState() == state::ConnectivityState::ONLINE; };
+
+    // Wait for cond, polled every 10 ms; false on timeout_ms, link loss
+    // (when needed) or the run deadline
+    auto waitFor = [&](auto cond, int64_t timeout_ms, bool need_link)
+    {
+        const int64_t end = nowMs() + timeout_ms;
+        while (!cond())
+        {
+            if (nowMs() >= end || expired() || (need_link && !online()))
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    };
+
+    DeviceStats st;
+    std::this_thread::sleep_for(std::chrono::duration<double>(uniform(0, args.ramp_s)));
+    nm.start();
+
+    AdpcmCodec codec(SAMPLE_RATE);
+    std::vector<int16_t> pcm;
+    uint8_t frame[FRAME_SAMPLES / 2];
+    const size_t min_samples = size_t(args.utterance_min_s * SAMPLE_RATE);
+    const size_t max_samples = size_t(args.utterance_max_s * SAMPLE_RATE);
+
+    for (int done = 0; done < args.turns && !expired(); ++done)
+    {
+        if (!waitFor(online, INT32_MAX, false))
+            break;
+        const double think = std::exponential_distribution<double>(1.0 / args.think_s)(rng);
+        std::this_thread::sleep_for(std::chrono::duration<double>(std::max(1.0, think)));
+        if (!waitFor(online, INT32_MAX, false))
+            break;
+
+        // Press, reaction delay, speech, release delay
+        const std::vector<int16_t> &clip = clips[rng() % clips.size()];
+        const size_t n = std::min(clip.size(), size_t(uniform(double(min_samples), double(max_samples))));
+        const size_t from = size_t(uniform(0, double(clip.size() - n)));
+        pcm.assign(size_t(uniform(200, 500) * SAMPLE_RATE / 1000), 0);
+        pcm.insert(pcm.end(), clip.begin() + from, clip.begin() + from + n);
+        pcm.resize(pcm.size() + size_t(uniform(150, 400) * SAMPLE_RATE / 1000), 0);
+
+        release_ms = 0;
+        first_audio_ms = 0;
+        spk.clear();
+        codec.reset();
+        sm.setInteractionState(InteractionState::LISTENING, state::InputSource::BUTTON);
+
+        // Codec task: a frame into the mic ring every 16 ms of real time
+        const int64_t t0 = nowMs();
+        bool linked = true;
+        for (size_t off = 0; off + FRAME_SAMPLES <= pcm.size() && linked; off += FRAME_SAMPLES)
+        {
+            const int64_t due = t0 + int64_t(off + FRAME_SAMPLES) * 1000 / SAMPLE_RATE;
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::max<int64_t>(0, due - nowMs())));
+            const size_t len = codec.encode(pcm.data() + off, FRAME_SAMPLES, frame, sizeof(frame));
+            mic.write(frame, len); // full ring: counted by mic.dropped()
+            linked = online();
+        }
+
+        // Release: the uplink worker sends the tail with EOS
+        sm.setInteractionState(InteractionState::PROCESSING, state::InputSource::BUTTON);
+        release_ms = nowMs();
+
+        const int64_t timeout_ms = int64_t(args.turn_timeout_s * 1000);
+        bool ok = linked && waitFor([&] { return first_audio_ms != 0; }, timeout_ms, true);
+        // The answer has played: server IDLE, or SPEAK_END and the tail out
+        // (DeviceProfile's onPlaybackDrained)
+        ok = ok && waitFor([&]
+                           {
+            if (spk.drained() && sm.getInteractionState() != InteractionState::IDLE)
+                sm.setInteractionState(InteractionState::IDLE, state::InputSource::SERVER_COMMAND);
+            return sm.getInteractionState() == InteractionState::IDLE; },
+                           timeout_ms * 4, true);
+        if (ok)
+        {
+            ++st.turns_ok;
+            st.latencies.push_back(uint32_t(first_audio_ms - release_ms));
+        }
+        else
+        {
+            ++st.turns_failed;
+            network->endSpeakingSession();
+            sm.setInteractionState(InteractionState::IDLE, state::InputSource::SYSTEM);
+        }
+        release_ms = 0;
+    }
+
+    nm.stop();
+    st.lost = lost;
+    st.underruns = spk.underruns();
+    st.overflow = overflow;
+    st.mic_dropped = mic.dropped();
+    st.reconnects = onlines > 1 ? onlines - 1 : 0;
+    st.connect_failures = attempts > onlines ? attempts - onlines : 0;
+    return st;
+}
+
+// =====================================================
+// FLEET: one process per device, stats back over a pipe
+// =====================================================
+static bool writeStats(FILE *f, const DeviceStats &s)
+{
+    std::fprintf(f, "%u %u %u %u %u %u %u %u %zu", s.turns_ok, s.turns_failed, s.lost, s.underruns, s.overflow,
+                 s.mic_dropped, s.reconnects, s.connect_failures, s.latencies.size());
+    for (uint32_t v : s.latencies)
+        std::fprintf(f, " %u", v);
+    std::fputc('\n', f);
+    return std::fflush(f) == 0;
+}
+
+static bool readStats(FILE *f, DeviceStats &s)
+{
+    size_t n = 0;
+    if (std::fscanf(f, "%u %u %u %u %u %u %u %u %zu", &s.turns_ok, &s.turns_failed, &s.lost, &s.underruns,
+                    &s.overflow, &s.mic_dropped, &s.reconnects, &s.connect_failures, &n) != 9)
+        return false;
+    s.latencies.resize(n);
+    for (uint32_t &v : s.latencies)
+        if (std::fscanf(f, "%u", &v) != 1)
+            return false;
+    return true;
+}
+
+static double percentile(std::vector<uint32_t> v, double p)
+{
+    if (v.empty())
+        return NAN;
+    std::sort(v.begin(), v.end());
+    const double k = (v.size() - 1) * p / 100.0;
+    const size_t lo = size_t(k);
+    const size_t hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (k - lo);
+}
+
+static std::string fmtMs(double v)
+{
+    char s[16];
+    if (std::isnan(v))
+        return "   -";
+    std::snprintf(s, sizeof(s), "%4.0f", v);
+    return s;
+}
+
+static void report(const std::vector<DeviceStats> &devices, const std::vector<bool> &reported, double elapsed_s,
+                   bool per_device)
+{
+    if (per_device)
+    {
+        std::printf("\n%12s %4s %4s %5s %5s %5s %5s %5s %5s %5s %5s %5s\n", "device", "ok", "fail", "p50", "p90",
+                    "p99", "lost", "under", "drop", "mdrop", "recon", "cfail");
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            const DeviceStats &s = devices[i];
+            if (!reported[i])
+            {
+                std::printf("%12s  no report (device process failed)\n", deviceId(i).c_str());
+                continue;
+            }
+            std::printf("%12s %4u %4u %5s %5s %5s %5u %5u %5u %5u %5u %5u\n", deviceId(i).c_str(), s.turns_ok,
+                        s.turns_failed, fmtMs(percentile(s.latencies, 50)).c_str(),
+                        fmtMs(percentile(s.latencies, 90)).c_str(), fmtMs(percentile(s.latencies, 99)).c_str(),
+                        s.lost, s.underruns, s.overflow, s.mic_dropped, s.reconnects, s.connect_failures);
+        }
+    }
+
+    DeviceStats t;
+    double worst_p95 = NAN;
+    for (const DeviceStats &s : devices)
+    {
+        t.latencies.insert(t.latencies.end(), s.latencies.begin(), s.latencies.end());
+        t.turns_ok += s.turns_ok;
+        t.turns_failed += s.turns_failed;
+        t.lost += s.lost;
+        t.underruns += s.underruns;
+        t.overflow += s.overflow;
+        t.mic_dropped += s.mic_dropped;
+        t.reconnects += s.reconnects;
+        t.connect_failures += s.connect_failures;
+        const double p95 = percentile(s.latencies, 95);
+        if (!std::isnan(p95) && !(p95 <= worst_p95))
+            worst_p95 = p95;
+    }
+    const size_t missing = std::count(reported.begin(), reported.end(), false);
+    std::printf("\nFleet: %zu devices, %.1f s%s\n", devices.size(), elapsed_s,
+                missing ? (" (" + std::to_string(missing) + " without a report)").c_str() : "");
+    std::printf("  turns      %u ok, %u failed\n", t.turns_ok, t.turns_failed);
+    std::printf("  latency    p50 %s ms  p90 %s ms  p99 %s ms  max %s ms\n", fmtMs(percentile(t.latencies, 50)).c_str(),
+                fmtMs(percentile(t.latencies, 90)).c_str(), fmtMs(percentile(t.latencies, 99)).c_str(),
+                fmtMs(percentile(t.latencies, 100)).c_str());
+    std::printf("  worst device p95 %s ms\n", fmtMs(worst_p95).c_str());
+    std::printf("  downlink   %u pkts lost, %u underruns, %u bytes dropped\n", t.lost, t.underruns, t.overflow);
+    std::printf("  uplink     %u mic frames dropped\n", t.mic_dropped);
+    std::printf("  link       %u reconnects, %u failed connects\n", t.reconnects, t.connect_failures);
+}
+
+static void usage()
+{
+    std::printf("usage: fleet_sim [--url URL] [--devices N] [--turns N] [--wav FILE...]\n"
+                "                 [--utterance MIN MAX] [--think S] [--ramp S] [--turn-timeout S]\n"
+                "                 [--duration S] [--seed N] [--summary] [--verbose]\n"
+                "  --url           server (default ws://127.0.0.1:8000/ws, ws:// only)\n"
+                "  --devices       simulated devices, one process each (default 20)\n"
+                "  --turns         turns per device (default 3)\n"
+                "  --wav           16 kHz mono 16-bit utterance sources\n"
+                "  --utterance     speech length range in seconds (default 1.5 4.0)\n"
+                "  --think         mean seconds between turns (default 6)\n"
+                "  --ramp          spread device start over N seconds (default 10)\n"
+                "  --turn-timeout  seconds to first answer audio (default 20)\n"
+                "  --duration      stop after N seconds (default 0 = no limit)\n"
+                "  --summary       fleet totals only\n"
+                "  --verbose       firmware log of every device on stderr\n");
+}
+
+static bool parseArgs(int argc, char **argv, Args &a)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string opt = argv[i];
+        auto value = [&]() -> const char *
+        { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *v = nullptr;
+        if (opt == "--summary")
+            a.summary = true;
+        else if (opt == "--verbose")
+            a.verbose = true;
+        else if (opt == "--wav")
+        {
+            while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0)
+                a.wav.push_back(argv[++i]);
+            if (a.wav.empty())
+                return false;
+        }
+        else if (opt == "--utterance")
+        {
+            const char *lo = value(), *hi = value();
+            if (!lo || !hi)
+                return false;
+            a.utterance_min_s = std::atof(lo);
+            a.utterance_max_s = std::atof(hi);
+        }
+        else if (!(v = value()))
+            return false;
+        else if (opt == "--url")
+            a.url = v;
+        else if (opt == "--devices")
+            a.devices = std::atoi(v);
+        else if (opt == "--turns")
+            a.turns = std::atoi(v);
+        else if (opt == "--think")
+            a.think_s = std::atof(v);
+        else if (opt == "--ramp")
+            a.ramp_s = std::atof(v);
+        else if (opt == "--turn-timeout")
+            a.turn_timeout_s = std::atof(v);
+        else if (opt == "--duration")
+            a.duration_s = std::atof(v);
+        else if (opt == "--seed")
+            a.seed = uint32_t(std::strtoul(v, nullptr, 10));
+        else
+            return false;
+    }
+    return a.devices > 0 && a.turns >= 0 && a.think_s > 0 && a.ramp_s >= 0 &&
+           a.utterance_min_s > 0 && a.utterance_max_s >= a.utterance_min_s;
+}
+
+int main(int argc, char **argv)
+{
+    Args args;
+    if (!parseArgs(argc, argv, args))
+    {
+        usage();
+        return 2;
+    }
+    if (args.wav.empty())
+        args.wav.push_back(FLEET_DEFAULT_WAV);
+
+    std::vector<std::vector<int16_t>> clips(args.wav.size());
+    for (size_t i = 0; i < args.wav.size(); ++i)
+        if (!loadWav(args.wav[i], clips[i]))
+            return 2;
+
+    std::printf("fleet_sim: %d devices x %d turns -> %s\n", args.devices, args.turns, args.url.c_str());
+    std::fflush(stdout);
+    const int64_t t0 = nowMs();
+    const int64_t deadline_ms = args.duration_s > 0 ? t0 + int64_t(args.duration_s * 1000) : 0;
+
+    // Fork before any thread exists: every device gets its own
+    // StateManager, drivers and tasks
+    std::vector<pid_t> pids(args.devices, -1);
+    std::vector<FILE *> pipes(args.devices, nullptr);
+    for (int i = 0; i < args.devices; ++i)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            std::perror("pipe");
+            break;
+        }
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            for (int j = 0; j < i; ++j)
+                std::fclose(pipes[j]);
+            close(fds[0]);
+            if (!args.verbose)
+            {
+                // WebSocketClient logs to stderr on the host
+                const int null_fd = open("/dev/null", O_WRONLY);
+                dup2(null_fd, STDERR_FILENO);
+            }
+            FILE *out = fdopen(fds[1], "w");
+            const bool ok = out && writeStats(out, runDevice(uint32_t(i), args, clips, deadline_ms));
+            _exit(ok ? 0 : 1); // tasks still parked: no static destructors
+        }
+        close(fds[1]);
+        if (pid < 0)
+        {
+            std::perror("fork");
+            close(fds[0]);
+            break;
+        }
+        pids[i] = pid;
+        pipes[i] = fdopen(fds[0], "r");
+    }
+
+    std::vector<DeviceStats> devices(args.devices);
+    std::vector<bool> reported(args.devices, false);
+    for (int i = 0; i < args.devices; ++i)
+    {
+        if (pids[i] < 0)
+            continue;
+        reported[i] = pipes[i] && readStats(pipes[i], devices[i]);
+        if (pipes[i])
+            std::fclose(pipes[i]);
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+    }
+
+    report(devices, reported, (nowMs() - t0) / 1000.0, !args.summary);
+    return std::count(reported.begin(), reported.end(), false) ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+// Host fakes for the NetworkManager replay: see host_fakes.hpp
+#include "host_fakes.hpp"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "BluetoothService.hpp"
+#include "TlsSocket.hpp"
+#include "WebSocketClient.hpp"
+#include "WifiService.hpp"
+
+namespace
+{
+    std::mutex g_lock;
+    std::atomic<int64_t> g_now_us{1000000};
+    std::vector<std::string> g_calls;
+    std::vector<std::string> g_log;
+    bool g_verbose = false;
+
+    void record(const std::string &call)
+    {
+        std::lock_guard<std::mutex> lk(g_lock);
+        g_calls.push_back(call);
+    }
+} // namespace
+
+namespace host
+{
+    int64_t nowUs() { return g_now_us.load(); }
+    void advanceMs(uint32_t ms) { g_now_us += int64_t(ms) * 1000; }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(g_lock);
+        g_calls.clear();
+        g_log.clear();
+    }
+
+    int calls(const std::string &prefix)
+    {
+        std::lock_guard<std::mutex> lk(g_lock);
+        int n = 0;
+        for (const std::string &c : g_calls)
+            n += c.compare(0, prefix.size(), prefix) == 0;
+        return n;
+    }
+
+    int logCount(const std::string &needle)
+    {
+        std::lock_guard<std::mutex> lk(g_lock);
+        int n = 0;
+        for (const std::string &l : g_log)
+            n += l.find(needle) != std::string::npos;
+        return n;
+    }
+
+    bool logged(const std::string &needle) { return logCount(needle) > 0; }
+
+    void setVerbose(bool on) { g_verbose = on; }
+} // namespace host
+
+void hostLog(char level, const char *tag, const char *fmt, ...)
+{
+    char line[256];
+    int n = std::snprintf(line, sizeof(line), "%c %s: ", level, tag);
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(line + n, sizeof(line) - n, fmt, ap);
+    va_end(ap);
+    std::lock_guard<std::mutex> lk(g_lock);
+    g_log.emplace_back(line);
+    if (g_verbose)
+        std::printf("  [%6lld ms] %s\n", (long long)(g_now_us / 1000), line);
+}
+
+// ============================================================================
+// ESP-IDF
+// ============================================================================
+int64_t esp_timer_get_time() { return g_now_us.load(); }
+uint32_t esp_random() { return 0x5EED1234; }
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t)
+{
+    for (int i = 0; i < 6; ++i)
+        mac[i] = uint8_t(0xA0 + i);
+    return ESP_OK;
+}
+
+// ============================================================================
+// FreeRTOS: queues never block, tasks never run, delays move the clock
+// ============================================================================
+struct HostQueue
+{
+    std::mutex lock;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t q = new HostQueue;
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t)
+{
+    std::lock_guard<std::mutex> lk(q->lock);
+    if (q->items.size() >= q->length)
+        return pdFALSE;
+    const uint8_t *p = static_cast<const uint8_t *>(item);
+    q->items.emplace_back(p, p + q->item_size);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t)
+{
+    std::lock_guard<std::mutex> lk(q->lock);
+    if (q->items.empty())
+        return pdFALSE;
+    std::memcpy(item, q->items.front().data(), q->item_size);
+    q->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lk(q->lock);
+    return UBaseType_t(q->items.size());
+}
+
+void vQueueDelete(QueueHandle_t q) { delete q; }
+
+static int g_task_token;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *name, uint32_t, void *, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+    record(std::string("task:") + name);
+    if (handle)
+        *handle = &g_task_token;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t ticks) { g_now_us += int64_t(ticks) * portTICK_PERIOD_MS * 1000; }
+TickType_t xTaskGetTickCount() { return TickType_t(g_now_us / 1000 / portTICK_PERIOD_MS); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+BaseType_t xTaskAbortDelay(TaskHandle_t) { return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+
+// ============================================================================
+// Drivers: record the call, the test plays the driver's events
+// ============================================================================
+void WifiService::init() { record("wifi.init"); }
+bool WifiService::autoConnect()
+{
+    record("wifi.autoConnect");
+    return true;
+}
+void WifiService::connectWithCredentials(const char *ssid, const char *pass)
+{
+    record(std::string("wifi.connect:") + ssid + "/" + pass);
+}
+void WifiService::disconnect()
+{
+    record("wifi.disconnect");
+    connected = false;
+}
+void WifiService::stopCaptivePortal() { record("wifi.stopPortal"); }
+int WifiService::getRssi() const { return -50; }
+
+WebSocketClient::WebSocketClient() = default;
+WebSocketClient::~WebSocketClient() = default;
+void WebSocketClient::setSocket(NetSocket *s) { sock = s; }
+void WebSocketClient::setRxBuffer(uint8_t *buf, size_t cap)
+{
+    rx_buf = buf;
+    rx_cap = cap;
+}
+void WebSocketClient::setUrl(const std::string &url)
+{
+    ws_url = url;
+    secure = url.compare(0, 6, "wss://") == 0;
+}
+void WebSocketClient::setKeepalive(int, int) {}
+void WebSocketClient::connect() { record("ws.connect"); }
+void WebSocketClient::close() { record("ws.close"); }
+void WebSocketClient::abort() { record("ws.abort"); }
+int WebSocketClient::fd() const { return -1; }
+bool WebSocketClient::hasBuffered() const { return false; }
+void WebSocketClient::poll() {}
+uint32_t WebSocketClient::dueMs() const { return net::WAIT_FOREVER; }
+bool WebSocketClient::sendText(std::string_view msg)
+{
+    record("ws.text:" + std::string(msg));
+    return true;
+}
+bool WebSocketClient::sendBinary(const uint8_t *, size_t len)
+{
+    record("ws.bin:" + std::to_string(len));
+    return true;
+}
+bool WebSocketClient::sendBinaryInPlace(uint8_t *, size_t len)
+{
+    record("ws.bin:" + std::to_string(len));
+    return true;
+}
+void WebSocketClient::onStatus(std::function<void(int)> cb) { status_cb = cb; }
+void WebSocketClient::onText(std::function<void(std::string_view)> cb) { text_cb = cb; }
+void WebSocketClient::onBinary(std::function<void(const uint8_t *, size_t, size_t, size_t, bool)> cb) { binary_cb = cb; }
+
+BluetoothService::BluetoothService() = default;
+BluetoothService::~BluetoothService() = default;
+bool BluetoothService::init(const std::string &name)
+{
+    record("ble.init:" + name);
+    return true;
+}
+bool BluetoothService::start()
+{
+    record("ble.start");
+    return true;
+}
+
+TlsSessionCache::TlsSessionCache() = default;
+TlsSessionCache::~TlsSessionCache() = default;
+TlsSocket::TlsSocket() { record("tls.new"); }
+TlsSocket::~TlsSocket() = default;
+void TlsSocket::setConfig(const Config &) {}
+bool TlsSocket::connectStart(const char *, uint16_t) { return false; }
+NetSocket::Step TlsSocket::connectStep() { return Step::FAILED; }
+int TlsSocket::readSome(uint8_t *, size_t) { return -1; }
+int TlsSocket::writeSome(const IoSlice *, size_t) { return -1; }
+void TlsSocket::disconnect() {}
+size_t TlsSocket::buffered() const { return 0; }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Host fakes of the NetworkManager replay (host_fakes.cpp, headers in
+ * stubs/): a fake clock that moves only when the test moves it, FreeRTOS
+ * queues and tasks that are created but never run, Wi-Fi / WS / BLE / TLS
+ * drivers that record their calls. The test injects the drivers' events.
+ */
+namespace host
+{
+    // esp_timer_get_time() / xTaskGetTickCount() clock
+    int64_t nowUs();
+    void advanceMs(uint32_t ms);
+
+    // Driver calls in order ("wifi.connect:ssid/pass", "ws.connect", ...)
+    // and log lines ("W NetworkManager: ..."); thread-safe
+    void clear();
+    int calls(const std::string &prefix);
+    bool logged(const std::string &needle);
+    int logCount(const std::string &needle);
+
+    // Echo log lines to stdout as they come
+    void setVerbose(bool on);
+} // namespace host
@@ -0,0 +1,15 @@
+#pragma once
+// Host stand-in (test/host/stubs): BLE types of BluetoothService.hpp
+#include <stdint.h>
+#include "esp_err.h"
+typedef int esp_gap_ble_cb_event_t;
+typedef union
+{
+    int unused;
+} esp_ble_gap_cb_param_t;
+typedef int esp_gatts_cb_event_t;
+typedef uint8_t esp_gatt_if_t;
+typedef union
+{
+    int unused;
+} esp_ble_gatts_cb_param_t;
@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+#include <stdint.h>
+#include "esp_err.h"
+typedef const char *esp_event_base_t;
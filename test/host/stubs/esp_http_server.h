@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+typedef void *httpd_handle_t;
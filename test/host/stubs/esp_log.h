@@ -0,0 +1,15 @@
+#pragma once
+// Host stand-in (test/host/stubs): every line goes to hostLog(), the test
+// searches it. Replaces the fprintf macros of NetPort.hpp.
+void hostLog(char level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#undef ESP_LOGE
+#undef ESP_LOGW
+#undef ESP_LOGI
+#undef ESP_LOGD
+#undef ESP_LOGV
+#define ESP_LOGE(tag, fmt, ...) hostLog('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) hostLog('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) hostLog('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) hostLog('D', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) hostLog('V', tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+#include <stdint.h>
+uint32_t esp_random();
@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in (test/host/stubs): the fake clock of the replay
+#include <stdint.h>
+int64_t esp_timer_get_time();
@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+#include "esp_err.h"
+typedef struct esp_netif_obj esp_netif_t;
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in (test/host/stubs): 10 ms ticks like the device
+#include <stddef.h>
+#include <stdint.h>
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(ms) ((TickType_t)((ms) / portTICK_PERIOD_MS))
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define INCLUDE_xTaskAbortDelay 1
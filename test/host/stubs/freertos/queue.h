@@ -0,0 +1,9 @@
+#pragma once
+// Host stand-in (test/host/stubs): thread-safe, never blocks
+#include "FreeRTOS.h"
+typedef struct HostQueue *QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+void vQueueDelete(QueueHandle_t q);
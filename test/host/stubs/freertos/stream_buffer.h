@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in (test/host/stubs): type only
+#include "FreeRTOS.h"
+typedef struct HostStreamBuffer *StreamBufferHandle_t;
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in (test/host/stubs): POSIX sockets
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+typedef struct mbedtls_ctr_drbg_context
+{
+    int unused;
+} mbedtls_ctr_drbg_context;
@@ -0,0 +1,16 @@
+#pragma once
+// Host stand-in (test/host/stubs): the types TlsSocket.hpp holds
+#include <stddef.h>
+#include <stdint.h>
+typedef struct mbedtls_ssl_session
+{
+    int unused;
+} mbedtls_ssl_session;
+typedef struct mbedtls_ssl_config
+{
+    int unused;
+} mbedtls_ssl_config;
+typedef struct mbedtls_ssl_context
+{
+    int unused;
+} mbedtls_ssl_context;
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in (test/host/stubs)
+typedef struct mbedtls_x509_crt
+{
+    int unused;
+} mbedtls_x509_crt;
@@ -0,0 +1,388 @@
+// BitrateController: the bandwidth traces of server_test/bitrate_sim.py
+// replayed through the same uplink model (codec task, mic ring, 40 ms
+// packets, lwIP send buffer, probe PINGs, RSSI), run on the C++ code.
+// Fixed 16 kHz ADPCM against the adaptive controller: the adaptive run
+// keeps the end-to-end latency bound where the trace leaves room for it and
+// takes the profile decisions the model documents.
+#include "BitrateController.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+static constexpr int FRAME_MS = 16;                               // codec task: 256 samples
+static constexpr int PACKET_MS = 40;                              // uplink_packet_ms
+static constexpr int MAX_DELAY_MS = 60;                           // uplink_max_delay_ms
+static constexpr int RING_BYTES = 32 * 1024 - 20;                 // MIC_ENCODED_BYTES - UPLINK_HEADROOM
+static constexpr int SND_BUF = 5744;                              // CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+static constexpr int WIRE_OVERHEAD = proto::HEADER_SIZE + 8 + 40; // + WS + TCP/IP
+static constexpr int PROBE_MS = 500;                              // bitrate_probe_ms
+static constexpr int RSSI_PERIOD_MS = 10000;                      // telemetry_interval_ms
+static constexpr int DELAY_MS = 20;                               // one-way base delay
+
+// E2E adds the packet time and the link delay to the controller target
+static constexpr int BUDGET_MS = 200 + PACKET_MS + DELAY_MS;
+
+static double bytesPerMs(size_t profile) { return BitrateController::PROFILES[profile].bitrate_bps / 8000.0; }
+static int frameBytes(size_t profile) { return int(BitrateController::PROFILES[profile].bitrate_bps * FRAME_MS / 8000); }
+static int packetBytes(size_t profile) { return int(PACKET_MS * bytesPerMs(profile)); }
+
+// (t_s, kbps, rssi_dbm), linear in between
+struct Point
+{
+    double t, kbps, rssi;
+};
+using Trace = std::vector<Point>;
+
+static void sample(const Trace &trace, double t_s, double &kbps, double &rssi)
+{
+    kbps = trace.back().kbps;
+    rssi = trace.back().rssi;
+    if (t_s <= trace[0].t)
+    {
+        kbps = trace[0].kbps;
+        rssi = trace[0].rssi;
+        return;
+    }
+    for (size_t i = 1; i < trace.size(); ++i)
+    {
+        const Point &a = trace[i - 1], &b = trace[i];
+        if (t_s <= b.t)
+        {
+            const double f = b.t > a.t ? (t_s - a.t) / (b.t - a.t) : 1.0;
+            kbps = a.kbps + (b.kbps - a.kbps) * f;
+            rssi = a.rssi + (b.rssi - a.rssi) * f;
+            return;
+        }
+    }
+}
+
+static double percentile(std::vector<int> v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    const double k = (v.size() - 1) * p / 100.0;
+    const size_t lo = size_t(k);
+    const size_t hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (k - lo);
+}
+
+struct Result
+{
+    std::vector<int> latency; // per delivered packet, ms
+    int time_in[BitrateController::PROFILE_COUNT] = {};
+    int dropped_frames = 0;
+    uint32_t switches = 0;
+    size_t final_profile = 0;
+    size_t worst_profile = 0;
+
+    double p(double pct) const { return percentile(latency, pct); }
+    int max() const { return latency.empty() ? 0 : *std::max_element(latency.begin(), latency.end()); }
+};
+
+static Result simulate(const Trace &trace, bool adaptive, bool opus)
+{
+    BitrateController::Config cfg;
+    cfg.opus = opus;
+    BitrateController ctl(cfg);
+    ctl.setEnabled(adaptive);
+    Result res;
+
+    struct Frame
+    {
+        size_t tag;
+        int left, capture;
+    };
+    struct Packet
+    {
+        int wire_left, capture;
+    };
+    struct Mark
+    {
+        long pos;
+        size_t tag;
+    };
+    std::deque<Frame> ring; // tail first
+    int ring_bytes = 0;
+    std::deque<Mark> marks; // pending format change (1 in flight)
+    long written = 0, consumed = 0;
+    size_t applied = 0;  // codec task format
+    size_t read_tag = 0; // format at the ring tail
+
+    int pending_since = -1; // oldest pending byte (uplink "oldest")
+    bool blocked = false;   // a send waits for room
+    Packet blocked_pkt{};
+    int blocked_since = 0;
+    std::deque<Packet> snd; // in the socket
+    int snd_bytes = 0;
+    double credit = 0; // fractional link bytes
+
+    std::deque<std::pair<int, uint32_t>> pongs; // (arrival ms, rtt)
+
+    auto afterSend = [&](int now, int send_ms, int capture)
+    {
+        const int depth = int(ring_bytes / bytesPerMs(read_tag));
+        ctl.onPacket(now, now - capture, depth, send_ms);
+        res.worst_profile = std::max(res.worst_profile, ctl.profileIndex());
+    };
+
+    const int duration_ms = int(trace.back().t * 1000);
+    for (int t = 0; t < duration_ms; ++t)
+    {
+        double kbps, trace_rssi;
+        sample(trace, t / 1000.0, kbps, trace_rssi);
+        const double cap = kbps / 8.0; // bytes per ms
+
+        // ---- probe: PING behind the queued audio, RTT on PONG ------------
+        if (t % PROBE_MS == 0)
+        {
+            const int rtt = 2 * DELAY_MS + int(snd_bytes / std::max(cap, 0.001));
+            pongs.emplace_back(t + rtt, rtt);
+        }
+        while (!pongs.empty() && pongs.front().first <= t)
+        {
+            ctl.setRtt(pongs.front().second);
+            pongs.pop_front();
+        }
+        if (t % RSSI_PERIOD_MS == 0)
+            ctl.setRssi(int(std::nearbyint(trace_rssi)));
+
+        // ---- codec task: one frame per 16 ms -----------------------------
+        if (t % FRAME_MS == 0)
+        {
+            const size_t want = ctl.profileIndex();
+            if (want != applied && marks.empty())
+            {
+                marks.push_back({written, want});
+                applied = want;
+            }
+            const int n = frameBytes(applied);
+            if (ring_bytes + n > RING_BYTES)
+            {
+                ++res.dropped_frames;
+            }
+            else
+            {
+                ring.push_back({applied, n, t});
+                ring_bytes += n;
+                written += n;
+            }
+            res.time_in[applied] += FRAME_MS;
+        }
+
+        // ---- link: drain the socket buffer -------------------------------
+        credit += cap;
+        while (!snd.empty() && credit >= 1)
+        {
+            const int take = std::min(snd.front().wire_left, int(credit));
+            snd.front().wire_left -= take;
+            snd_bytes -= take;
+            credit -= take;
+            if (snd.front().wire_left == 0)
+            {
+                res.latency.push_back(t + DELAY_MS - snd.front().capture);
+                snd.pop_front();
+            }
+        }
+        if (snd.empty())
+            credit = std::min(credit, cap); // idle link: no saved-up burst
+
+        // ---- uplink worker -----------------------------------------------
+        if (blocked)
+        {
+            if (SND_BUF - snd_bytes < blocked_pkt.wire_left)
+                continue;
+            snd.push_back(blocked_pkt);
+            snd_bytes += blocked_pkt.wire_left;
+            blocked = false;
+            afterSend(t, t - blocked_since, blocked_pkt.capture);
+            pending_since = ring_bytes ? t : -1;
+        }
+
+        if (ring_bytes && pending_since < 0)
+            pending_since = t;
+
+        while (ring_bytes && !blocked)
+        {
+            if (!marks.empty() && marks.front().pos == consumed)
+            {
+                read_tag = marks.front().tag;
+                marks.pop_front();
+            }
+            const int pb = packetBytes(read_tag);
+            if (ring_bytes < pb && t - pending_since < MAX_DELAY_MS)
+                break;
+            // One span: up to a packet, never across the next mark
+            long limit = pb;
+            if (!marks.empty())
+                limit = std::min(limit, marks.front().pos - consumed);
+            int take = 0, first_capture = -1;
+            while (!ring.empty() && take < limit)
+            {
+                Frame &f = ring.front();
+                if (first_capture < 0)
+                    first_capture = f.capture;
+                const int n = int(std::min<long>(f.left, limit - take));
+                f.left -= n;
+                take += n;
+                if (f.left == 0)
+                    ring.pop_front();
+            }
+            ring_bytes -= take;
+            consumed += take;
+            const Packet pkt{take + WIRE_OVERHEAD, first_capture};
+            if (SND_BUF - snd_bytes >= pkt.wire_left)
+            {
+                snd.push_back(pkt);
+                snd_bytes += pkt.wire_left;
+                afterSend(t, 0, pkt.capture);
+                pending_since = ring_bytes ? t : -1;
+            }
+            else
+            {
+                blocked = true;
+                blocked_pkt = pkt;
+                blocked_since = t;
+            }
+        }
+    }
+
+    res.switches = ctl.switches();
+    res.final_profile = ctl.profileIndex();
+    return res;
+}
+
+static void report(const char *name, const char *mode, const Result &r)
+{
+    const int over = int(std::count_if(r.latency.begin(), r.latency.end(), [](int v)
+                                       { return v > BUDGET_MS; }));
+    std::printf("%-6s %-8s p50 %5.0f p95 %5.0f max %5d >budget %5.1f%% drops %3d sw %2u  profile %zu..%zu\n",
+                name, mode, r.p(50), r.p(95), r.max(), 100.0 * over / std::max<size_t>(r.latency.size(), 1),
+                r.dropped_frames, (unsigned)r.switches, r.final_profile, r.worst_profile);
+}
+
+static Trace stepTrace(double low_kbps)
+{
+    return {{0, 300, -60}, {10, 300, -60}, {10.1, low_kbps, -60}, {40, low_kbps, -60}, {40.1, 300, -60}, {60, 300, -60}};
+}
+
+int main()
+{
+    // Good Wi-Fi: never leaves the best profile
+    {
+        const Trace steady = {{0, 400, -55}, {60, 400, -55}};
+        const Result fixed = simulate(steady, false, false);
+        const Result r = simulate(steady, true, false);
+        report("steady", "fixed", fixed);
+        report("steady", "adaptive", r);
+        CHECK(r.switches == 0 && r.worst_profile == 0);
+        CHECK(r.max() == fixed.max() && r.max() <= BUDGET_MS);
+        CHECK(r.dropped_frames == 0);
+    }
+
+    // Congestion step below 16 kHz ADPCM and back: one step down, one probe
+    // up once the link is back, the bound held
+    {
+        const Result fixed = simulate(stepTrace(55), false, false);
+        const Result r = simulate(stepTrace(55), true, false);
+        report("step", "fixed", fixed);
+        report("step", "adaptive", r);
+        CHECK(fixed.dropped_frames > 0 && fixed.p(95) > 10 * BUDGET_MS);
+        CHECK(r.dropped_frames == 0);
+        CHECK(r.p(95) <= BUDGET_MS);
+        CHECK(r.switches == 2 && r.worst_profile == 1 && r.final_profile == 0);
+        CHECK(r.time_in[0] > 0 && r.time_in[1] > 0);
+    }
+
+    // Walking away from the AP and back: weak RSSI and a thin link, the
+    // whole run within the bound
+    {
+        const Trace fade = {{0, 250, -55}, {30, 40, -82}, {60, 250, -55}};
+        const Result fixed = simulate(fade, false, false);
+        const Result r = simulate(fade, true, false);
+        report("fade", "fixed", fixed);
+        report("fade", "adaptive", r);
+        CHECK(fixed.p(95) > BUDGET_MS);
+        CHECK(r.max() <= BUDGET_MS);
+        CHECK(r.switches == 2 && r.worst_profile == 1 && r.final_profile == 0);
+    }
+
+    // Contention flapping around the 16 kHz wire rate: probe backoff keeps
+    // the switches down, the median within the bound
+    {
+        Trace flap;
+        for (int t = 0; t <= 60; t += 5)
+            flap.push_back({double(t), (t / 5) % 2 == 0 ? 110.0 : 50.0, -65});
+        const Result fixed = simulate(flap, false, false);
+        const Result r = simulate(flap, true, false);
+        report("flap", "fixed", fixed);
+        report("flap", "adaptive", r);
+        CHECK(r.p(50) <= BUDGET_MS);
+        CHECK(r.p(95) < fixed.p(95) / 2);
+        CHECK(r.switches <= 12); // a switch per 5 s half period would be 24
+        CHECK(r.worst_profile == 1);
+    }
+
+    // Capacity under even 8 kHz ADPCM: without Opus the controller floors at
+    // profile 1; with Opus it steps to profile 2 and recovers
+    {
+        const Result fixed = simulate(stepTrace(35), false, false);
+        const Result no_opus = simulate(stepTrace(35), true, false);
+        const Result r = simulate(stepTrace(35), true, true);
+        report("cliff", "fixed", fixed);
+        report("cliff", "adaptive", no_opus);
+        report("cliff", "opus", r);
+        CHECK(no_opus.worst_profile == 1);
+        CHECK(no_opus.dropped_frames == 0);
+        CHECK(r.worst_profile == 2 && r.time_in[2] > 0 && r.final_profile == 0);
+        CHECK(r.dropped_frames == 0);
+        CHECK(r.p(50) <= BUDGET_MS);
+        CHECK(r.p(95) < no_opus.p(95) / 4);
+    }
+
+    // Decisions one at a time
+    {
+        BitrateController::Config cfg;
+        uint32_t now = 0;
+        auto run = [&](BitrateController &c, uint32_t ms, uint32_t depth)
+        {
+            bool changed = false;
+            for (uint32_t end = now + ms; now < end; now += PACKET_MS)
+                changed |= c.onPacket(now, 20, depth, 0);
+            return changed;
+        };
+        const uint32_t BAD = 200, GOOD = 10; // ring depth, ms
+
+        // Weak RSSI: profile 1 on the next packet, no hold
+        BitrateController weak(cfg);
+        weak.setRssi(-85);
+        CHECK(weak.onPacket(0, 20, GOOD, 0) && weak.profileIndex() == 1);
+
+        // Disabled: pinned to profile 0
+        BitrateController off(cfg);
+        off.setEnabled(false);
+        CHECK(!run(off, 2000, BAD) && off.profileIndex() == 0);
+
+        // Congested for down_hold_ms → down; good for up_hold_ms → probe up;
+        // a probe that fails within probe_ms doubles the next hold
+        BitrateController c(cfg);
+        now = 0;
+        c.setRtt(40);
+        CHECK(!run(c, cfg.down_hold_ms - PACKET_MS, BAD));
+        CHECK(run(c, 2 * PACKET_MS, BAD) && c.profileIndex() == 1);
+        CHECK(!run(c, cfg.settle_ms - PACKET_MS, BAD) && c.profileIndex() == 1); // settling
+        CHECK(!run(c, cfg.up_hold_ms, GOOD) && c.profileIndex() == 1);
+        CHECK(run(c, 2 * PACKET_MS, GOOD) && c.profileIndex() == 0);
+        run(c, cfg.settle_ms, GOOD);
+        CHECK(run(c, cfg.down_hold_ms + PACKET_MS, BAD) && c.profileIndex() == 1);
+        run(c, cfg.settle_ms, GOOD);
+        CHECK(!run(c, 2 * cfg.up_hold_ms - 2 * PACKET_MS, GOOD) && c.profileIndex() == 1);
+        CHECK(run(c, 3 * PACKET_MS, GOOD) && c.profileIndex() == 0);
+        CHECK(c.switches() == 4);
+    }
+
+    return checkResult("test_bitrate_controller");
+}
@@ -0,0 +1,147 @@
+// ClockSync: PING / PONG exchanges with known clocks and asymmetric,
+// congested paths (the scenarios of server_test/clock_sim.py, run on the
+// C++ code). The device's view of the server clock and the uplink one-way
+// stay within the error bound it reports, the skew converges.
+#include "ClockSync.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+static constexpr double PING_MS = 2000;  // ping_interval_ms
+static constexpr double PROBE_MS = 500;  // bitrate_probe_ms, during a turn
+static constexpr double DURATION_MS = 300000;
+static constexpr double TURN_EVERY_MS = 20000; // a 6 s turn every 20 s
+static constexpr double TURN_MS = 6000;
+static constexpr int SKEW_TOLERANCE_PPM = 25; // at the end of the run
+
+// up / down: fixed one-way ms, jitter: ± ms per direction, queue: uplink
+// queueing during turns (max ms), skew: server ppm
+struct Scenario
+{
+    const char *name;
+    double up, down, jitter, queue;
+    int skew;
+    uint32_t offset = 123456789; // server - device at t = 0
+    uint32_t start = 1000;       // device clock at t = 0
+};
+
+struct Result
+{
+    int checks = 0;
+    int up_checks = 0;
+    double worst = 0;    // |error| - bound, ms (> 1 fails)
+    double up_worst = 0; // same, uplink one-way
+    int max_err = 0;
+    uint32_t max_bound = 0;
+    int round_trip = 0; // toDevice(toServer(x)) != x
+    int skew = 0;
+};
+
+static Result simulate(const Scenario &sc)
+{
+    std::mt19937 rng(49);
+    auto uniform = [&](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+
+    // Exact clocks from device time t (ms since start), u32 like the stamps
+    auto deviceAt = [&](double t) { return static_cast<uint32_t>(static_cast<uint64_t>(sc.start + t)); };
+    auto serverAt = [&](double t)
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(double(sc.start) + t + sc.offset + t * sc.skew / 1e6));
+    };
+    auto inTurn = [](double t) { return std::fmod(t, TURN_EVERY_MS) >= TURN_EVERY_MS - TURN_MS; };
+
+    ClockSync cs;
+    Result r;
+    double next_ping = 0, next_check = 0;
+    struct UpSample
+    {
+        int32_t est, truth;
+    };
+    UpSample turn_up[static_cast<size_t>(TURN_MS / PROBE_MS) + 1];
+    size_t turn_up_n = 0;
+
+    for (double t = 0; t < DURATION_MS; t += 1.0)
+    {
+        if (t >= next_ping)
+        {
+            double up = sc.up + uniform(-sc.jitter, sc.jitter);
+            if (inTurn(t) && sc.queue > 0)
+                up += uniform(0, sc.queue); // PINGs wait behind uplink audio
+            const double down = sc.down + uniform(-sc.jitter, sc.jitter);
+            const double hold = uniform(0, 2);
+            const uint32_t t1 = deviceAt(t);
+            const uint32_t t2 = serverAt(t + up);
+            const uint32_t t3 = serverAt(t + up + hold);
+            const uint32_t t4 = deviceAt(t + up + hold + down);
+            CHECK(cs.onSample(t1, t2, t3, t4));
+            if (inTurn(t) && turn_up_n < sizeof(turn_up) / sizeof(turn_up[0]))
+                turn_up[turn_up_n++] = {cs.uplinkMs(t1, t2), static_cast<int32_t>(t2 - serverAt(t))};
+            next_ping = t + (inTurn(t) ? PROBE_MS : PING_MS);
+        }
+
+        const ClockSync::Mapping &m = cs.mapping();
+        if (m.valid && t >= next_check)
+        {
+            const uint32_t dev = deviceAt(t);
+            const int err = std::abs(static_cast<int32_t>(m.toServer(dev) - serverAt(t)));
+            ++r.checks;
+            r.max_err = std::max(r.max_err, err);
+            r.max_bound = std::max(r.max_bound, m.error_ms);
+            r.worst = std::max(r.worst, double(err) - m.error_ms);
+            r.round_trip += std::abs(static_cast<int32_t>(m.toDevice(m.toServer(dev)) - dev)) > 1;
+            next_check = t + 1000;
+        }
+
+        if (!inTurn(t) && turn_up_n > 0)
+        {
+            for (size_t i = 0; i < turn_up_n; ++i)
+            {
+                ++r.up_checks;
+                r.up_worst = std::max(r.up_worst, double(std::abs(turn_up[i].est - turn_up[i].truth)) - m.error_ms);
+            }
+            turn_up_n = 0;
+        }
+    }
+    r.skew = cs.mapping().skew_ppm;
+    return r;
+}
+
+int main()
+{
+    const Scenario scenarios[] = {
+        {"symmetric", 20, 20, 2, 0, 0},
+        {"asymmetric", 45, 5, 2, 0, 0},
+        {"congested", 15, 15, 3, 400, 30},
+        {"skewed", 10, 25, 5, 150, -200},
+        {"wrap", 8, 8, 1, 80, 60, 0xFFFFFFFFu - 30000, 0xFFFFFFFFu - 60000},
+    };
+
+    for (const Scenario &sc : scenarios)
+    {
+        const Result r = simulate(sc);
+        std::printf("%-10s %3d checks, max err %3d ms, bound %3u ms, skew %4d / %4d ppm, %3d uplink checks\n",
+                    sc.name, r.checks, r.max_err, (unsigned)r.max_bound, r.skew, sc.skew, r.up_checks);
+        CHECK(r.checks > 0 && r.up_checks > 0);
+        CHECK(r.worst <= 1.0);    // 1 ms: stamp resolution
+        CHECK(r.up_worst <= 1.0);
+        CHECK(r.round_trip == 0);
+        CHECK(std::abs(r.skew - sc.skew) <= SKEW_TOLERANCE_PPM);
+    }
+
+    // Inconsistent stamps are rejected, reset() forgets the server
+    {
+        ClockSync cs;
+        CHECK(!cs.onSample(1000, 5000, 4000, 1100)); // server sent before it received
+        CHECK(!cs.onSample(1000, 5000, 5300, 1100)); // held longer than the round trip
+        CHECK(!cs.mapping().valid);
+        CHECK(cs.onSample(1000, 5010, 5011, 1021));
+        CHECK(cs.mapping().valid && cs.mapping().toServer(1010) == 5010);
+        cs.reset();
+        CHECK(!cs.mapping().valid && cs.samples() == 0);
+    }
+
+    return checkResult("test_clock_sync");
+}
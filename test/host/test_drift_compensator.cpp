@@ -0,0 +1,107 @@
+// DriftCompensator: 10 min of downlink where the server clock and the I2S
+// clock disagree. The fill ahead of the speaker must stay put with the
+// compensator in the decode path and wander off without it.
+#include "DriftCompensator.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+static constexpr size_t RATE = 16000;
+static constexpr size_t PACKET = 1024;    // samples per server packet (64 ms)
+static constexpr size_t PCM_CAP = 4096;   // sb_spk_pcm (8 KB), in samples
+static constexpr size_t PREBUFFER = 2560; // 160 ms, the shared playout target
+
+struct Run
+{
+    size_t span = 0; // max - min fill after the first minute
+    size_t underruns = 0;
+    float drift_ppm = 0;
+};
+
+// ppm: I2S clock relative to the server's. Time steps of 1 ms.
+static Run simulate(int ppm, bool compensate)
+{
+    std::mt19937 rng(27 + ppm);
+    std::uniform_real_distribution<double> jitter(0.0, 30.0);
+
+    DriftCompensator dc;
+    std::vector<int16_t> in(PACKET, 0), out(dc.maxOutputSamples(PACKET));
+
+    const double consume_per_ms = RATE * (1.0 + ppm * 1e-6) / 1000.0;
+    double next_arrival = jitter(rng);
+    size_t packets = 0;
+    size_t encoded = 0, pcm = 0;
+    double owed = 0; // fractional samples the speaker still has to take
+    bool playing = false;
+    size_t lo = SIZE_MAX, hi = 0;
+    Run r;
+
+    for (size_t ms = 0; ms < 10 * 60 * 1000; ++ms)
+    {
+        // Server: one packet per 64 ms of its clock, TCP keeps the order
+        while (next_arrival <= double(ms))
+        {
+            encoded += PACKET;
+            ++packets;
+            next_arrival = std::max(next_arrival, packets * 64.0 + jitter(rng));
+        }
+
+        // Codec task: decode while the PCM ring has room
+        while (encoded >= PACKET && pcm + out.size() <= PCM_CAP)
+        {
+            const size_t fill = encoded + pcm;
+            encoded -= PACKET;
+            size_t n = PACKET;
+            if (compensate)
+            {
+                n = dc.process(in.data(), PACKET, out.data(), out.size());
+                dc.update(fill, n);
+            }
+            pcm += n;
+        }
+
+        // Speaker: I2S clock, after the prebuffer
+        if (!playing && encoded + pcm >= PREBUFFER)
+            playing = true;
+        if (playing)
+        {
+            owed += consume_per_ms;
+            const size_t take = size_t(owed);
+            owed -= take;
+            if (take > pcm)
+                ++r.underruns;
+            pcm -= std::min(take, pcm);
+        }
+
+        if (ms >= 60 * 1000)
+        {
+            lo = std::min(lo, encoded + pcm);
+            hi = std::max(hi, encoded + pcm);
+        }
+    }
+    r.span = hi - lo;
+    r.drift_ppm = dc.driftPpm();
+    return r;
+}
+
+int main()
+{
+    for (int ppm : {-500, 0, 500})
+    {
+        const Run on = simulate(ppm, true);
+        const Run off = simulate(ppm, false);
+        std::printf("I2S %+4d ppm: fill span %5zu samples compensated (drift %+.0f ppm, %zu underruns), "
+                    "%5zu without (%zu underruns)\n",
+                    ppm, on.span, on.drift_ppm, on.underruns, off.span, off.underruns);
+        CHECK(on.underruns == 0);
+        CHECK(on.span < 2400);
+        CHECK(std::abs(on.drift_ppm + ppm) < 60); // the estimate is the drift
+        // Uncompensated: the buffer fills up, or runs dry
+        if (ppm != 0)
+            CHECK(off.span > 3500 || off.underruns > 0);
+    }
+    return checkResult("test_drift_compensator");
+}
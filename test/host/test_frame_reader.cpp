@@ -0,0 +1,184 @@
+// proto::FrameReader: random streams of framed AUDIO / CONTROL and legacy
+// raw messages, cut into pieces of 1..16 B or up to 4 KB, must give the
+// same payloads as whole messages; broken streams are dropped and the
+// reader recovers on the next message. Without a total (WS message in
+// several frames) the header's length is used.
+#include "WireProtocol.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace proto;
+
+using Bytes = std::vector<uint8_t>;
+
+struct Result
+{
+    Bytes audio;
+    std::vector<Bytes> controls;
+    Bytes legacy;
+    int firsts = 0;
+    int lasts = 0;
+    int invalid = 0;
+
+    bool operator==(const Result &o) const
+    {
+        return audio == o.audio && controls == o.controls && legacy == o.legacy &&
+               firsts == o.firsts && lasts == o.lasts && invalid == o.invalid;
+    }
+};
+
+// sized = false: total 0, as for a WS message sent in several frames
+static FrameReader::Status feedMessage(FrameReader &fr, const Bytes &msg, size_t chunk, Result &got,
+                                       bool sized = true)
+{
+    FrameReader::Status st = FrameReader::Status::MORE;
+    size_t off = 0;
+    do
+    {
+        const size_t n = std::min(chunk, msg.size() - off);
+        st = fr.feed(msg.data() + off, n, off, sized ? msg.size() : 0,
+                     [&](const Header &h, const uint8_t *s, size_t len, bool first, bool last)
+                     {
+                         if (h.type == MsgType::AUDIO)
+                         {
+                             got.audio.insert(got.audio.end(), s, s + len);
+                             got.firsts += first;
+                             got.lasts += last;
+                         }
+                         else
+                         {
+                             got.controls.emplace_back(s, s + len);
+                         }
+                     });
+        if (st == FrameReader::Status::NOT_FRAMED)
+            got.legacy.insert(got.legacy.end(), msg.data() + off, msg.data() + off + n);
+        if (st == FrameReader::Status::INVALID)
+            ++got.invalid;
+        off += n;
+    } while (off < msg.size());
+    return st;
+}
+
+static void randomStreams()
+{
+    std::mt19937 rng(40);
+    size_t pieces = 0;
+    int failures = 0;
+    for (int iter = 0; iter < 5000; ++iter)
+    {
+        std::vector<Bytes> stream;
+        Result expect;
+        const int messages = 1 + rng() % 6;
+        for (int m = 0; m < messages; ++m)
+        {
+            const int kind = rng() % 4;
+            Bytes msg;
+            if (kind <= 1)
+            {
+                // AUDIO up to 20 KB, some empty EOS frames
+                const size_t len = rng() % 5 == 0 ? 0 : rng() % 20000;
+                Header h;
+                h.type = MsgType::AUDIO;
+                h.codec = Codec::ADPCM_IMA;
+                h.seq = static_cast<uint16_t>(m);
+                h.payload_len = static_cast<uint16_t>(len);
+                h.flags = len == 0 ? flag::EOS : 0;
+                msg.resize(HEADER_SIZE + len);
+                writeHeader(h, msg.data(), HEADER_SIZE);
+                for (size_t i = 0; i < len; ++i)
+                    msg[HEADER_SIZE + i] = static_cast<uint8_t>(rng());
+                expect.audio.insert(expect.audio.end(), msg.begin() + HEADER_SIZE, msg.end());
+                ++expect.firsts;
+                ++expect.lasts;
+            }
+            else if (kind == 2)
+            {
+                uint8_t args[32];
+                const size_t argc = rng() % 33;
+                for (size_t i = 0; i < argc; ++i)
+                    args[i] = static_cast<uint8_t>(rng());
+                msg.resize(HEADER_SIZE + 1 + argc);
+                msg.resize(writeControl(Control::CREDIT, args, argc, static_cast<uint16_t>(m), 0,
+                                        msg.data(), msg.size()));
+                expect.controls.emplace_back(msg.begin() + HEADER_SIZE, msg.end());
+            }
+            else
+            {
+                // Legacy headerless audio: first byte is not the magic
+                msg.resize(1 + rng() % 9000);
+                for (auto &b : msg)
+                    b = static_cast<uint8_t>(rng());
+                msg[0] = 0x11;
+                expect.legacy.insert(expect.legacy.end(), msg.begin(), msg.end());
+            }
+            stream.push_back(std::move(msg));
+        }
+
+        const size_t chunk = iter % 3 == 0 ? 1 + rng() % 16 : 1 + rng() % 4096;
+        const bool sized = iter % 4 != 1;
+        FrameReader fr;
+        Result got;
+        for (const Bytes &msg : stream)
+        {
+            feedMessage(fr, msg, chunk, got, sized);
+            pieces += (msg.size() + chunk - 1) / chunk;
+        }
+        if (!(got == expect) && failures++ < 5)
+            std::printf("FAIL random stream %d (pieces of %zu%s)\n", iter, chunk, sized ? "" : ", no total");
+    }
+    std::printf("random streams: %d failures, %zu pieces\n", failures, pieces);
+    CHECK(failures == 0);
+}
+
+static void brokenStreams()
+{
+    FrameReader fr;
+    int calls = 0;
+    const FrameReader::Handler count = [&](const Header &, const uint8_t *, size_t, bool, bool)
+    { ++calls; };
+
+    // CONTROL larger than the stash: dropped, in every piece
+    uint8_t big[HEADER_SIZE + 100] = {};
+    Header h;
+    h.type = MsgType::CONTROL;
+    h.payload_len = 100;
+    writeHeader(h, big, HEADER_SIZE);
+    CHECK(fr.feed(big, 50, 0, sizeof(big), count) == FrameReader::Status::INVALID);
+    CHECK(fr.feed(big + 50, sizeof(big) - 50, 50, sizeof(big), count) == FrameReader::Status::INVALID);
+    CHECK(calls == 0);
+
+    // A missing piece: the first slice went out, the rest is dropped
+    uint8_t audio[HEADER_SIZE + 100] = {};
+    h.type = MsgType::AUDIO;
+    writeHeader(h, audio, HEADER_SIZE);
+    CHECK(fr.feed(audio, 40, 0, sizeof(audio), count) == FrameReader::Status::MORE);
+    CHECK(calls == 1);
+    CHECK(fr.feed(audio + 60, 40, 60, sizeof(audio), count) == FrameReader::Status::INVALID);
+    CHECK(fr.feed(audio + 100, 12, 100, sizeof(audio), count) == FrameReader::Status::INVALID);
+    CHECK(calls == 1);
+
+    // Recovers on the next message
+    CHECK(fr.feed(audio, sizeof(audio), 0, sizeof(audio), count) == FrameReader::Status::DONE);
+    CHECK(calls == 2);
+
+    // No total: a message longer than its header says is dropped
+    h.payload_len = 50;
+    writeHeader(h, audio, HEADER_SIZE);
+    CHECK(fr.feed(audio, 30, 0, 0, count) == FrameReader::Status::MORE);
+    CHECK(fr.feed(audio + 30, sizeof(audio) - 30, 30, 0, count) == FrameReader::Status::INVALID);
+    CHECK(calls == 3);
+
+    // Magic byte but the length does not match: legacy data, passed through
+    CHECK(fr.feed(audio, sizeof(audio), 0, sizeof(audio), count) == FrameReader::Status::NOT_FRAMED);
+    CHECK(calls == 3);
+}
+
+int main()
+{
+    randomStreams();
+    brokenStreams();
+    return checkResult("test_frame_reader");
+}
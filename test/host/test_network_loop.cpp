@@ -0,0 +1,296 @@
+// NetworkManager loop on the host: the real runLoopOnce() / handleEvent()
+// / serviceTimers() driven by a fake clock, with the Wi-Fi / WS / BLE
+// drivers replaced by recorders (host_fakes.cpp). Driver events are posted
+// the way their callbacks post them; the loop must sleep until the next
+// deadline and act on it (fallback to BLE, connect timeout, backoff,
+// immune mode).
+#include "NetworkManager.hpp"
+#include "StateManager.hpp"
+#include "check.hpp"
+#include "host_fakes.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct NetworkLoopReplay
+{
+    using Type = NetworkManager::Event::Type;
+
+    NetworkManager &nm;
+    int wakeups = 0;
+
+    // What the driver callbacks do; false if the queue was full
+    bool post(Type type, int32_t value = 0) { return nm.post(type, value); }
+
+    // The task body: runLoop() until STOP, on the caller's thread
+    void runTask()
+    {
+        nm.runLoop();
+        nm.task_handle = nullptr;
+    }
+
+    // Runs the loop for ms of fake time: a wake-up per posted event or due
+    // deadline, the clock jumps between them
+    void run(uint32_t ms)
+    {
+        const int64_t end_us = host::nowUs() + int64_t(ms) * 1000;
+        while (nm.task_handle)
+        {
+            if (uxQueueMessagesWaiting(nm.event_queue) == 0)
+            {
+                const uint32_t step = nm.nextWakeMs();
+                const int64_t left_ms = (end_us - host::nowUs()) / 1000;
+                if (step == net::WAIT_FOREVER || int64_t(step) > left_ms)
+                    break;
+                host::advanceMs(step);
+            }
+            ++wakeups;
+            if (!nm.runLoopOnce())
+                nm.task_handle = nullptr; // taskEntry does the same
+        }
+        if (end_us > host::nowUs())
+            host::advanceMs(uint32_t((end_us - host::nowUs()) / 1000));
+    }
+
+    bool wsShouldRun() const { return nm.ws_should_run; }
+    bool connectPending() const { return nm.connect_pending; }
+    bool fallbackIdle() const { return nm.fallback == NetworkManager::Fallback::NONE; }
+    bool uplinkArmed() const { return nm.uplink_armed; }
+    void takeTurn() { nm.uplink_armed = false; } // what the worker does
+    uint32_t nextWakeMs() const { return nm.nextWakeMs(); }
+    bool loopRunning() const { return nm.task_handle != nullptr; }
+    UBaseType_t queued() const { return uxQueueMessagesWaiting(nm.event_queue); }
+    bool wakePending() const
+    {
+        return net::waitReady(-1, false, false, nm.loop_waker.fd(), 0) & net::WOKEN;
+    }
+};
+
+using Type = NetworkLoopReplay::Type;
+
+static std::vector<state::ConnectivityState> g_states;
+
+static bool lastState(state::ConnectivityState s)
+{
+    return !g_states.empty() && g_states.back() == s;
+}
+
+static NetworkManager::Config testConfig()
+{
+    NetworkManager::Config cfg;
+    cfg.ws_url = "ws://192.168.1.100:8080/ws";
+    cfg.telemetry_interval_ms = 0; // idle means idle
+    return cfg;
+}
+
+// No IP within WIFI_FALLBACK_MS: Wi-Fi stopped, BLE config after it
+static void fallbackToBle()
+{
+    host::clear();
+    g_states.clear();
+    NetworkManager nm;
+    CHECK(nm.init(testConfig()));
+    nm.setBluetoothService(std::make_shared<BluetoothService>());
+    nm.start();
+    NetworkLoopReplay r{nm};
+
+    r.run(4900);
+    CHECK(host::calls("wifi.autoConnect") == 1);
+    CHECK(host::calls("wifi.disconnect") == 0);
+    CHECK(lastState(state::ConnectivityState::CONNECTING_WIFI));
+
+    r.run(700);
+    CHECK(host::calls("wifi.disconnect") == 1);
+    CHECK(host::logged("switching to BLE config mode"));
+    CHECK(lastState(state::ConnectivityState::CONFIG_BLE));
+    CHECK(r.fallbackIdle());
+    CHECK(r.wakeups <= 4); // START, fallback due, Wi-Fi stopped: no polling
+    CHECK(r.nextWakeMs() == net::WAIT_FOREVER);
+
+    nm.startBLEConfigMode();
+    r.run(10);
+    CHECK(host::calls("ble.init:") == 1 && host::calls("ble.start") == 1);
+
+    nm.stop();
+    CHECK(host::calls("ws.close") == 1);
+}
+
+// GOT_IP → connect after the jitter; timeout, backoff, OPEN, CLOSE, retry
+static void connectAndRetry()
+{
+    host::clear();
+    g_states.clear();
+    NetworkManager nm;
+    CHECK(nm.init(testConfig()));
+    nm.start();
+    NetworkLoopReplay r{nm};
+
+    r.run(1000);
+    r.post(Type::WIFI_STATUS, 2);
+    r.run(499);
+    CHECK(host::calls("ws.connect") == 0);
+    CHECK(lastState(state::ConnectivityState::CONNECTING_WS));
+    r.run(500); // jitter < 500 ms
+    CHECK(host::calls("ws.connect") == 1);
+    CHECK(r.connectPending());
+    CHECK(host::calls("wifi.disconnect") == 0); // fallback cancelled by the IP
+
+    // Neither OPEN nor CLOSE: timeout, abort, backoff, then a new attempt
+    r.run(5000);
+    CHECK(host::logged("WS connect timeout"));
+    CHECK(host::calls("ws.abort") == 1);
+    r.post(Type::WS_STATUS, 0); // the abort's CLOSED keeps the retry
+    r.run(10);
+    CHECK(host::logCount("WS retry in") == 0);
+    const int wakeups = r.wakeups;
+    r.run(600); // backoff ≤ reconnect_min_ms << 1
+    CHECK(host::calls("ws.connect") == 2);
+    CHECK(r.wakeups - wakeups <= 2);
+
+    // OPEN: identify, online, nothing left to wake for
+    r.post(Type::WS_STATUS, 2);
+    r.run(10);
+    CHECK(host::logged("WS → OPEN"));
+    CHECK(host::calls("ws.text:{\"type\":\"identify\"") == 1);
+    CHECK(lastState(state::ConnectivityState::ONLINE));
+    CHECK(!r.connectPending());
+    CHECK(r.nextWakeMs() == net::WAIT_FOREVER);
+    const int idle = r.wakeups;
+    r.run(60000);
+    CHECK(r.wakeups == idle);
+
+    // Server closes: retry with backoff, same connection policy
+    r.post(Type::WS_STATUS, 0);
+    r.run(10);
+    CHECK(host::logCount("WS retry in") == 1);
+    CHECK(lastState(state::ConnectivityState::CONNECTING_WS));
+    r.run(1000);
+    CHECK(host::calls("ws.connect") == 3);
+
+    nm.stop();
+    CHECK(host::calls("ws.close") >= 1);
+    CHECK(host::calls("wifi.disconnect") == 1);
+}
+
+// Immune mode: a Wi-Fi drop during a turn leaves the WS alone
+static void immuneMode()
+{
+    host::clear();
+    g_states.clear();
+    NetworkManager nm;
+    CHECK(nm.init(testConfig()));
+    nm.start();
+    NetworkLoopReplay r{nm};
+
+    r.post(Type::WIFI_STATUS, 2);
+    r.run(1000);
+    r.post(Type::WS_STATUS, 2);
+    r.run(10);
+    CHECK(lastState(state::ConnectivityState::ONLINE));
+
+    // Ordered with the drop: immune first, then the drop
+    nm.setWSImmuneMode(true);
+    r.post(Type::WIFI_STATUS, 0);
+    r.run(10);
+    CHECK(host::calls("ws.close") == 0);
+    CHECK(r.wsShouldRun());
+    CHECK(lastState(state::ConnectivityState::ONLINE));
+
+    nm.setWSImmuneMode(false);
+    r.post(Type::WIFI_STATUS, 0);
+    r.run(10);
+    CHECK(host::calls("ws.close") == 1);
+    CHECK(!r.wsShouldRun());
+    CHECK(lastState(state::ConnectivityState::OFFLINE));
+
+    nm.stop();
+}
+
+// A post wakes the loop; LISTENING arms the uplink worker created in start()
+static void wakeAndTurns()
+{
+    host::clear();
+    g_states.clear();
+    NetworkManager nm;
+    CHECK(nm.init(testConfig()));
+    nm.start();
+    NetworkLoopReplay r{nm};
+    r.run(10);
+
+    for (int turn = 0; turn < 3; ++turn)
+    {
+        nm.setWSImmuneMode(true); // any post
+        CHECK(r.wakePending());
+        r.post(Type::INTERACTION, static_cast<int32_t>(state::InteractionState::LISTENING));
+        r.run(10);
+        CHECK(r.uplinkArmed());
+        CHECK(!r.wakePending()); // drained
+        r.takeTurn();
+        r.post(Type::INTERACTION, static_cast<int32_t>(state::InteractionState::IDLE));
+        r.run(10);
+        CHECK(!r.uplinkArmed());
+    }
+    CHECK(host::calls("task:WsUplink") == 1);
+    CHECK(host::calls("task:NetworkLoop") == 1);
+
+    nm.stop();
+}
+
+// Drivers post from their own threads while the loop runs on another one
+static void concurrentPosts()
+{
+    host::clear();
+    g_states.clear();
+    NetworkManager nm;
+    CHECK(nm.init(testConfig()));
+    nm.start();
+    NetworkLoopReplay r{nm};
+
+    std::thread loop([&]
+                     { r.runTask(); });
+
+    constexpr int POSTS = 300;
+    std::atomic<int> dropped{0};
+    auto poster = [&](Type type, int32_t a, int32_t b)
+    {
+        for (int i = 0; i < POSTS; ++i)
+        {
+            while (!r.post(type, i % 2 ? a : b))
+            {
+                ++dropped; // queue full: the driver tries again
+                std::this_thread::yield();
+            }
+        }
+    };
+    std::thread wifi(poster, Type::WIFI_STATUS, 1, 2);
+    std::thread ws(poster, Type::WS_STATUS, 1, 0);
+    std::thread immune(poster, Type::SET_IMMUNE, 0, 1);
+    wifi.join();
+    ws.join();
+    immune.join();
+
+    r.post(Type::STOP);
+    loop.join();
+    CHECK(!r.loopRunning());
+    CHECK(r.queued() == 0);
+    CHECK(host::logCount("WiFi → GOT_IP") == POSTS / 2);
+    CHECK(host::logCount("WS → CONNECTING") == POSTS / 2);
+    std::printf("concurrent posts: %d x 3, %d retried on a full queue\n", POSTS, dropped.load());
+
+    nm.stop();
+}
+
+int main()
+{
+    StateManager::instance().subscribeConnectivity([](state::ConnectivityState s)
+                                                   { g_states.push_back(s); });
+
+    fallbackToBle();
+    connectAndRetry();
+    immuneMode();
+    wakeAndTurns();
+    concurrentPosts();
+    return checkResult("test_network_loop");
+}
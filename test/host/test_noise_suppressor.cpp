@@ -0,0 +1,169 @@
+// NoiseSuppressor: passthrough paths are exact, and tone bursts in white
+// noise come out with a better SNR than they went in. The floor survives a
+// turn boundary and follows a louder room.
+#include "NoiseSuppressor.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr size_t RATE = 16000;
+
+// Feed in blocks of odd sizes, like the MIC task's partial reads
+static std::vector<int16_t> run(NoiseSuppressor &ns, std::vector<int16_t> x)
+{
+    static const size_t blocks[] = {256, 100, 37, 512, 1};
+    size_t i = 0, b = 0;
+    while (i < x.size())
+    {
+        const size_t n = std::min(blocks[b++ % 5], x.size() - i);
+        ns.process(&x[i], n);
+        i += n;
+    }
+    return x;
+}
+
+static double snrDb(const std::vector<int16_t> &clean, const std::vector<int16_t> &y,
+                    size_t delay, size_t from)
+{
+    double sig = 0, err = 0;
+    for (size_t n = from; n + delay < y.size(); ++n)
+    {
+        const double c = clean[n];
+        const double e = y[n + delay] - c;
+        sig += c * c;
+        err += e * e;
+    }
+    return 10.0 * std::log10(sig / err);
+}
+
+int main()
+{
+    std::mt19937 rng(26);
+    std::normal_distribution<double> white(0.0, 1.0);
+
+    // 4 s: 300 ms tone bursts (3 harmonics) every 700 ms, noise throughout
+    const size_t N = 4 * RATE;
+    std::vector<int16_t> clean(N), noisy(N);
+    double sig = 0, noise = 0;
+    std::vector<double> w(N);
+    for (size_t n = 0; n < N; ++n)
+    {
+        const bool on = n > RATE / 2 && (n % (RATE * 7 / 10)) < RATE * 3 / 10;
+        const double t = double(n) / RATE;
+        const double s = on ? 3000.0 * (std::sin(2 * PI * 220 * t) + 0.5 * std::sin(2 * PI * 440 * t) +
+                                        0.25 * std::sin(2 * PI * 660 * t))
+                            : 0.0;
+        clean[n] = int16_t(s);
+        w[n] = white(rng);
+        sig += s * s;
+        noise += w[n] * w[n];
+    }
+    // 7 dB input SNR
+    const double gain = std::sqrt(sig / noise / std::pow(10.0, 0.7));
+    for (size_t n = 0; n < N; ++n)
+        noisy[n] = int16_t(std::lround(std::clamp(clean[n] + gain * w[n], -32768.0, 32767.0)));
+
+    // Disabled: untouched, no delay
+    {
+        NoiseSuppressor::Config cfg;
+        cfg.enabled = false;
+        NoiseSuppressor ns(cfg);
+        CHECK(ns.latencySamples() == 0);
+        CHECK(run(ns, noisy) == noisy);
+    }
+
+    // Gain pinned to 1: sqrt-Hann WOLA reconstructs exactly, one frame late
+    {
+        NoiseSuppressor::Config cfg;
+        cfg.gain_floor = 1.0f;
+        NoiseSuppressor ns(cfg);
+        const size_t d = ns.latencySamples();
+        CHECK(d == NoiseSuppressor::FRAME);
+        const std::vector<int16_t> y = run(ns, noisy);
+        size_t off = 0;
+        for (size_t n = 0; n + d < N; ++n)
+            off += std::abs(y[n + d] - noisy[n]) > 1;
+        std::printf("passthrough: %zu samples off by more than 1 LSB\n", off);
+        CHECK(off == 0);
+    }
+
+    // Suppression: skip the first 0.5 s (noise floor learning)
+    {
+        NoiseSuppressor ns;
+        const std::vector<int16_t> y = run(ns, noisy);
+        const size_t d = ns.latencySamples();
+        const double in = snrDb(clean, noisy, 0, RATE / 2);
+        const double out = snrDb(clean, y, d, RATE / 2);
+        std::printf("SNR in %.1f dB, out %.1f dB\n", in, out);
+        CHECK(out > in + 8.0);
+
+        // resetNoiseFloor() relearns: a second pass does as well as the first
+        ns.reset();
+        ns.resetNoiseFloor();
+        const std::vector<int16_t> y2 = run(ns, noisy);
+        CHECK(y2 == y);
+    }
+
+    // Next turn starts with speech: reset() keeps the floor, the start of
+    // the utterance is not learned as noise
+    {
+        const size_t T = RATE * 3 / 10;
+        std::vector<int16_t> speech(clean.begin() + RATE / 2 + 1, clean.begin() + RATE / 2 + 1 + T);
+        std::vector<int16_t> turn(T);
+        for (size_t n = 0; n < T; ++n)
+            turn[n] = int16_t(std::lround(std::clamp(speech[n] + gain * white(rng), -32768.0, 32767.0)));
+
+        NoiseSuppressor kept;
+        run(kept, noisy);
+        kept.reset();
+        NoiseSuppressor relearned;
+        run(relearned, noisy);
+        relearned.reset();
+        relearned.resetNoiseFloor();
+
+        const size_t d = kept.latencySamples();
+        const double in = snrDb(speech, turn, 0, 0);
+        const double out_kept = snrDb(speech, run(kept, turn), d, 0);
+        const double out_relearned = snrDb(speech, run(relearned, turn), d, 0);
+        std::printf("speech first: SNR in %.1f dB, floor kept %.1f dB, relearned %.1f dB\n",
+                    in, out_kept, out_relearned);
+        CHECK(out_kept > in + 3.0);
+        CHECK(out_kept > out_relearned + 3.0);
+    }
+
+    // The room gets 12 dB louder mid-session: the floor follows within
+    // the minimum-statistics window (without it every bin looks like speech)
+    {
+        const size_t L = 3 * RATE;
+        std::vector<int16_t> loud(L);
+        for (size_t n = 0; n < L; ++n)
+            loud[n] = int16_t(std::lround(std::clamp(4.0 * gain * white(rng), -32768.0, 32767.0)));
+        auto attenuation = [&](uint16_t window)
+        {
+            NoiseSuppressor::Config cfg;
+            cfg.min_window_frames = window;
+            NoiseSuppressor ns(cfg);
+            run(ns, noisy);
+            const std::vector<int16_t> y = run(ns, loud);
+            double e_in = 0, e_out = 0;
+            for (size_t n = 2 * RATE; n < L; ++n)
+            {
+                e_in += double(loud[n]) * loud[n];
+                e_out += double(y[n]) * y[n];
+            }
+            return 10.0 * std::log10(e_in / e_out);
+        };
+        const double att = attenuation(NoiseSuppressor::Config{}.min_window_frames);
+        const double stale = attenuation(UINT16_MAX);
+        std::printf("louder room: %.1f dB attenuation in the last second, %.1f dB without the window\n",
+                    att, stale);
+        CHECK(att > 6.0);
+        CHECK(att > stale + 4.0);
+    }
+
+    return checkResult("test_noise_suppressor");
+}
@@ -0,0 +1,89 @@
+// proto::SeqTracker: gaps count as lost, a late arrival of a missing seq
+// takes it back, duplicates never hide a real loss, 16-bit wrap.
+#include "WireProtocol.hpp"
+#include "check.hpp"
+
+#include <initializer_list>
+
+using proto::SeqTracker;
+
+static SeqTracker feed(std::initializer_list<int> seqs)
+{
+    SeqTracker t;
+    for (int s : seqs)
+        t.update(static_cast<uint16_t>(s));
+    return t;
+}
+
+int main()
+{
+    {
+        const SeqTracker t = feed({0, 1, 2, 3});
+        CHECK(t.received == 4 && t.lost == 0 && t.late == 0 && t.duplicate == 0);
+    }
+    {
+        SeqTracker t;
+        t.update(10);
+        CHECK(t.update(14) == 3);
+        CHECK(t.lost == 3);
+    }
+    // Reordered: 2 comes after 3 → not lost
+    {
+        const SeqTracker t = feed({0, 1, 3, 2, 4});
+        CHECK(t.lost == 0 && t.late == 1 && t.duplicate == 0);
+    }
+    // Duplicates of received frames do not cancel the real loss of 5
+    {
+        const SeqTracker t = feed({0, 1, 2, 3, 4, 6, 3, 4, 6, 7});
+        CHECK(t.lost == 1);
+        CHECK(t.late == 0 && t.duplicate == 3);
+    }
+    // A missing seq counts back once, its duplicate after that is a duplicate
+    {
+        const SeqTracker t = feed({0, 3, 1, 1, 2, 2});
+        CHECK(t.lost == 0 && t.late == 2 && t.duplicate == 2);
+    }
+    // Duplicate of the newest
+    {
+        const SeqTracker t = feed({0, 1, 1});
+        CHECK(t.lost == 0 && t.duplicate == 1);
+    }
+    // Wrap: 65534, 65535, (0 lost), 1, then 0 late
+    {
+        SeqTracker t = feed({65534, 65535, 1});
+        CHECK(t.lost == 1);
+        t.update(0);
+        CHECK(t.lost == 0 && t.late == 1);
+    }
+    // Large gap: only the last WINDOW seqs can be taken back
+    {
+        SeqTracker t;
+        t.update(0);
+        t.update(1000); // 999 lost
+        CHECK(t.lost == 999);
+        t.update(1000 - SeqTracker::WINDOW + 1); // newest-but-63: in the window
+        CHECK(t.lost == 998 && t.late == 1);
+        t.update(5); // too old to tell
+        CHECK(t.lost == 998 && t.late == 2 && t.duplicate == 0);
+    }
+    // The window follows the newest seq
+    {
+        SeqTracker t;
+        t.update(0);
+        t.update(2); // 1 lost
+        for (int s = 3; s < 3 + SeqTracker::WINDOW; ++s)
+            t.update(static_cast<uint16_t>(s));
+        t.update(1); // fell out of the window
+        CHECK(t.lost == 1 && t.late == 1);
+    }
+    // reset() forgets everything
+    {
+        SeqTracker t = feed({0, 5, 5});
+        t.reset();
+        t.update(100);
+        t.update(101);
+        CHECK(t.received == 2 && t.lost == 0 && t.late == 0 && t.duplicate == 0);
+    }
+
+    return checkResult("test_seq_tracker");
+}
@@ -0,0 +1,168 @@
+// TimeStretcher: speed 1.0 is sample-exact, other speeds change the length
+// by the set factor and keep the pitch, going back to 1.0 continues the
+// input without a jump, flush() loses no samples, the depth policy picks
+// the speeds.
+#include "TimeStretcher.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr size_t RATE = 16000;
+
+// Voiced-like test signal: 7 harmonics, f0 gliding 110..170 Hz
+static std::vector<int16_t> harmonic(size_t n)
+{
+    std::vector<int16_t> x(n);
+    double ph = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double f0 = 140 + 30 * std::sin(2 * PI * 0.7 * i / RATE);
+        ph += 2 * PI * f0 / RATE;
+        double s = 0;
+        for (int h = 1; h < 8; ++h)
+            s += std::sin(h * ph) / h;
+        x[i] = int16_t(6000 * s);
+    }
+    return x;
+}
+
+// Pitch period (samples) by autocorrelation over 50 ms at off
+static int period(const std::vector<int16_t> &v, size_t off)
+{
+    int best = 0;
+    double best_sum = -1e30;
+    for (int lag = 40; lag < 200; ++lag)
+    {
+        double s = 0;
+        for (size_t n = 0; n < 800; ++n)
+            s += double(v[off + n]) * v[off + n + lag];
+        if (s > best_sum)
+        {
+            best_sum = s;
+            best = lag;
+        }
+    }
+    return best;
+}
+
+static std::vector<int16_t> stretch(TimeStretcher &ts, const std::vector<int16_t> &x, size_t block)
+{
+    std::vector<int16_t> y;
+    std::vector<int16_t> out(block * 2 + TimeStretcher::MAX_FRAME);
+    for (size_t i = 0; i < x.size(); i += block)
+    {
+        const size_t n = ts.process(&x[i], std::min(block, x.size() - i), out.data(), out.size());
+        y.insert(y.end(), out.begin(), out.begin() + n);
+    }
+    return y;
+}
+
+int main()
+{
+    const std::vector<int16_t> x = harmonic(10 * RATE);
+
+    // 1.0: search skipped, output is the input (one frame behind),
+    // bit-exact from the first sample: no fade-in
+    {
+        TimeStretcher ts;
+        const std::vector<int16_t> y = stretch(ts, x, 1024);
+        CHECK(y.size() + TimeStretcher::MAX_FRAME >= x.size());
+        CHECK(!y.empty() && std::equal(y.begin(), y.end(), x.begin()));
+    }
+
+    // Catch-up and slowdown speeds: length ratio within 0.5%, pitch kept
+    for (float speed : {0.95f, 1.05f, 1.10f, 1.15f})
+    for (size_t block : {size_t(1024), size_t(333)})
+    {
+        TimeStretcher ts;
+        ts.setSpeed(speed);
+        const std::vector<int16_t> y = stretch(ts, x, block);
+        const double ratio = double(x.size()) / y.size();
+        const int p_in = period(x, RATE / 2);
+        const int p_out = period(y, size_t(RATE / 2 / speed));
+        std::printf("speed %.2f, blocks of %4zu: length ratio %.4f, period in %d out %d samples\n",
+                    speed, block, ratio, p_in, p_out);
+        CHECK(std::fabs(ratio / speed - 1.0) < 0.005);
+        CHECK(std::abs(p_in - p_out) <= 1);
+    }
+
+    // End of stream: process() + flush() at 1.0 hand back every sample, in
+    // order, for streams shorter than a frame and not a multiple of a block.
+    // The stretcher is reused across streams, as the codec task does.
+    {
+        TimeStretcher ts;
+        std::vector<int16_t> tail(TimeStretcher::IN_CAPACITY);
+        for (size_t len : {size_t(100), size_t(3000), size_t(16037)})
+        {
+            for (size_t block : {size_t(1024), size_t(333)})
+            {
+                const std::vector<int16_t> in(x.begin(), x.begin() + len);
+                std::vector<int16_t> y = stretch(ts, in, block);
+                const size_t n = ts.flush(tail.data(), tail.size());
+                y.insert(y.end(), tail.begin(), tail.begin() + n);
+                std::printf("flush: %zu in, %zu out (blocks of %zu)\n", len, y.size(), block);
+                CHECK(y.size() == len && std::equal(y.begin(), y.end(), in.begin()));
+            }
+        }
+        CHECK(ts.flush(tail.data(), tail.size()) == 0); // nothing left
+    }
+
+    // 1.1 → 1.0 (end of a catch-up): the first frame at 1.0 continues the
+    // last stretched one, then the output is the input again, bit-exact at
+    // a fixed offset; no step larger than the signal's own at the switch
+    for (size_t block : {size_t(1024), size_t(333)})
+    {
+        TimeStretcher ts;
+        ts.setSpeed(1.10f);
+        const size_t half = 3 * RATE;
+        std::vector<int16_t> y = stretch(ts, std::vector<int16_t>(x.begin(), x.begin() + half), block);
+        const size_t switched = y.size();
+        ts.setSpeed(1.0f);
+        const std::vector<int16_t> y2 = stretch(ts, std::vector<int16_t>(x.begin() + half, x.end()), block);
+        y.insert(y.end(), y2.begin(), y2.end());
+
+        int max_dx = 0, max_dy = 0;
+        for (size_t n = 1; n < x.size(); ++n)
+            max_dx = std::max(max_dx, std::abs(x[n] - x[n - 1]));
+        for (size_t n = switched - 1000; n < switched + 2000; ++n)
+            max_dy = std::max(max_dy, std::abs(y[n] - y[n - 1]));
+
+        // Offset of the input that plays after the switch
+        const size_t probe = switched + 1000;
+        size_t offset = 0;
+        for (size_t o = probe; o < probe + RATE && !offset; ++o) // 1.1 ran ahead
+            if (std::equal(y.begin() + probe, y.begin() + probe + 320, x.begin() + o))
+                offset = o - probe;
+        size_t exact = 0;
+        for (size_t n = switched; n < y.size() && n + offset < x.size(); ++n)
+            exact += y[n] == x[n + offset];
+        std::printf("1.10 -> 1.00, blocks of %4zu: max step %d (input %d), %zu of %zu samples exact after the switch\n",
+                    block, max_dy, max_dx, exact, y.size() - switched);
+        CHECK(offset > 0);
+        CHECK(max_dy <= max_dx);
+        CHECK(exact == y.size() - switched);
+    }
+
+    // Depth policy: deep queue → catch up, shallow → slow down, target → 1.0
+    {
+        TimeStretcher::Config cfg;
+        TimeStretcher ts(cfg);
+        const size_t ms = RATE / 1000;
+        ts.updateDepth((cfg.target_ms + cfg.catchup_above_ms + 200) * ms);
+        CHECK(ts.speed() >= 1.0f + cfg.min_catchup && ts.speed() <= 1.0f + cfg.max_catchup);
+        CHECK(ts.isAdjusting());
+        ts.updateDepth((cfg.target_ms + cfg.catchup_above_ms / 2) * ms); // hysteresis: keeps going
+        CHECK(ts.speed() > 1.0f);
+        ts.updateDepth(cfg.target_ms * ms);
+        CHECK(ts.speed() == 1.0f);
+        ts.updateDepth((cfg.underrun_below_ms - 10) * ms);
+        CHECK(ts.speed() == 1.0f - cfg.slowdown);
+        ts.updateDepth(cfg.target_ms * ms);
+        CHECK(ts.speed() == 1.0f && !ts.isAdjusting());
+    }
+
+    return checkResult("test_time_stretcher");
+}
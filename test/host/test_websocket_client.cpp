@@ -0,0 +1,516 @@
+// WebSocketClient over PlainSocket against a local server thread: the
+// upgrade (Sec-WebSocket-Accept checked both ways), frames split at any
+// byte, messages larger than the rx buffer, messages in several frames
+// with a ping between them, ping → pong, client frames masked, close
+// handshake; a wrong Accept or a refused upgrade never opens.
+#include "NetSocket.hpp"
+#include "WebSocketClient.hpp"
+#include "WireProtocol.hpp"
+#include "check.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+
+// ============================================================================
+// Server side: its own SHA-1 / base64, blocking sockets
+// ============================================================================
+static uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+static Bytes sha1(const std::string &msg)
+{
+    Bytes m(msg.begin(), msg.end());
+    const uint64_t bits = uint64_t(m.size()) * 8;
+    m.push_back(0x80);
+    while (m.size() % 64 != 56)
+        m.push_back(0);
+    for (int i = 7; i >= 0; --i)
+        m.push_back(uint8_t(bits >> (8 * i)));
+
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    for (size_t off = 0; off < m.size(); off += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = uint32_t(m[off + 4 * i]) << 24 | uint32_t(m[off + 4 * i + 1]) << 16 |
+                   uint32_t(m[off + 4 * i + 2]) << 8 | m[off + 4 * i + 3];
+        for (int i = 16; i < 80; ++i)
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            const uint32_t f = i < 20 ? (b & c) | (~b & d) : i < 40 ? b ^ c ^ d : i < 60 ? (b & c) | (b & d) | (c & d) : b ^ c ^ d;
+            const uint32_t k = i < 20 ? 0x5A827999 : i < 40 ? 0x6ED9EBA1 : i < 60 ? 0x8F1BBCDC : 0xCA62C1D6;
+            const uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    Bytes out(20);
+    for (int i = 0; i < 20; ++i)
+        out[i] = uint8_t(h[i / 4] >> (24 - 8 * (i % 4)));
+    return out;
+}
+
+static std::string base64(const Bytes &in)
+{
+    static const char A[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < in.size(); i += 3)
+    {
+        const uint32_t v = uint32_t(in[i]) << 16 | (i + 1 < in.size() ? uint32_t(in[i + 1]) << 8 : 0) |
+                           (i + 2 < in.size() ? in[i + 2] : 0);
+        out += A[(v >> 18) & 63];
+        out += A[(v >> 12) & 63];
+        out += i + 1 < in.size() ? A[(v >> 6) & 63] : '=';
+        out += i + 2 < in.size() ? A[v & 63] : '=';
+    }
+    return out;
+}
+
+static std::string acceptFor(const std::string &key)
+{
+    return base64(sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+static bool sendAll(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len > 0)
+    {
+        const ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+static bool recvAll(int fd, uint8_t *out, size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = ::recv(fd, out, len, 0);
+        if (n <= 0)
+            return false;
+        out += n;
+        len -= size_t(n);
+    }
+    return true;
+}
+
+// Unmasked server frame
+static Bytes frame(uint8_t op, const Bytes &payload, bool fin = true)
+{
+    Bytes f{uint8_t((fin ? 0x80 : 0x00) | op)};
+    if (payload.size() < 126)
+    {
+        f.push_back(uint8_t(payload.size()));
+    }
+    else if (payload.size() <= 0xFFFF)
+    {
+        f.push_back(126);
+        f.push_back(uint8_t(payload.size() >> 8));
+        f.push_back(uint8_t(payload.size()));
+    }
+    else
+    {
+        f.push_back(127);
+        for (int i = 7; i >= 0; --i)
+            f.push_back(uint8_t(uint64_t(payload.size()) >> (8 * i)));
+    }
+    f.insert(f.end(), payload.begin(), payload.end());
+    return f;
+}
+
+// Write in pieces of 1..13 B with pauses: the client sees every split
+static bool sendSplit(int fd, const Bytes &data)
+{
+    size_t i = 0, k = 0;
+    while (i < data.size())
+    {
+        const size_t n = std::min<size_t>(1 + k++ % 13, data.size() - i);
+        if (!sendAll(fd, data.data() + i, n))
+            return false;
+        i += n;
+        if (k % 16 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
+
+struct ClientFrame
+{
+    uint8_t op = 0;
+    bool fin = false;
+    bool masked = false;
+    Bytes payload;
+};
+
+static bool readFrame(int fd, ClientFrame &f)
+{
+    uint8_t h[2];
+    if (!recvAll(fd, h, 2))
+        return false;
+    f.fin = h[0] & 0x80;
+    f.op = h[0] & 0x0F;
+    f.masked = h[1] & 0x80;
+    uint64_t len = h[1] & 0x7F;
+    uint8_t ext[8];
+    if (len == 126)
+    {
+        if (!recvAll(fd, ext, 2))
+            return false;
+        len = uint64_t(ext[0]) << 8 | ext[1];
+    }
+    else if (len == 127)
+    {
+        if (!recvAll(fd, ext, 8))
+            return false;
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+            len = len << 8 | ext[i];
+    }
+    uint8_t mask[4] = {};
+    if (f.masked && !recvAll(fd, mask, 4))
+        return false;
+    f.payload.resize(len);
+    if (!recvAll(fd, f.payload.data(), len))
+        return false;
+    for (size_t i = 0; i < len; ++i)
+        f.payload[i] ^= mask[i % 4];
+    return true;
+}
+
+enum class Upgrade
+{
+    OK,
+    BAD_ACCEPT,
+    REFUSED,
+};
+
+struct ServerRun
+{
+    std::string request; // the client's upgrade request
+    std::vector<ClientFrame> frames;
+};
+
+// One connection: upgrade, then `script(fd)`
+static void serve(int listen_fd, Upgrade mode, const Bytes &after_101, ServerRun &run,
+                  const std::function<void(int)> &script)
+{
+    const int fd = ::accept(listen_fd, nullptr, nullptr);
+    if (fd < 0)
+        return;
+    timeval tv{3, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char c;
+    while (run.request.find("\r\n\r\n") == std::string::npos && ::recv(fd, &c, 1, 0) == 1)
+        run.request += c;
+    std::string key;
+    const size_t k = run.request.find("Sec-WebSocket-Key: ");
+    if (k != std::string::npos)
+        key = run.request.substr(k + 19, run.request.find("\r\n", k) - k - 19);
+
+    std::string resp;
+    if (mode == Upgrade::REFUSED)
+        resp = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n";
+    else
+        resp = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+               "Sec-WebSocket-Accept: " +
+               (mode == Upgrade::OK ? acceptFor(key) : acceptFor(key + "x")) + "\r\n\r\n";
+    Bytes out(resp.begin(), resp.end());
+    out.insert(out.end(), after_101.begin(), after_101.end()); // same segment as the 101
+    sendAll(fd, out.data(), out.size());
+
+    if (mode == Upgrade::OK && script)
+        script(fd);
+    ::close(fd);
+}
+
+static int listenLocal(uint16_t &port)
+{
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(a);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a)) != 0 || ::listen(fd, 1) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr *>(&a), &len) != 0)
+        return -1;
+    port = ntohs(a.sin_port);
+    return fd;
+}
+
+// ============================================================================
+// Client side: the NetworkLoop pattern (waitReady → poll)
+// ============================================================================
+struct Client
+{
+    PlainSocket sock;
+    WebSocketClient ws;
+    uint8_t rx[512]; // the minimum: larger messages arrive in pieces
+    std::vector<int> statuses;
+    std::vector<std::string> texts;
+    std::vector<Bytes> binaries;
+    Bytes current;
+    size_t pieces = 0;
+    bool offsets_ok = true;
+    std::function<void(const uint8_t *, size_t, size_t, size_t, bool)> on_piece;
+
+    explicit Client(uint16_t port)
+    {
+        ws.setSocket(&sock);
+        ws.setRxBuffer(rx, sizeof(rx));
+        ws.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/ws");
+        ws.setKeepalive(60, 60);
+        ws.onStatus([this](int s) { statuses.push_back(s); });
+        ws.onText([this](std::string_view t) { texts.emplace_back(t); });
+        ws.onBinary([this](const uint8_t *d, size_t len, size_t offset, size_t total, bool last)
+                    {
+                        ++pieces;
+                        if (offset == 0)
+                            current.clear();
+                        // total 0: sent in several frames, length unknown
+                        offsets_ok = offsets_ok && offset == current.size() &&
+                                     (total == 0 || (offset + len <= total && last == (offset + len == total)));
+                        current.insert(current.end(), d, d + len);
+                        if (on_piece)
+                            on_piece(d, len, offset, total, last);
+                        if (last)
+                            binaries.push_back(current);
+                    });
+    }
+
+    int status() const { return statuses.empty() ? 0 : statuses.back(); }
+
+    // Run the loop until done() or timeout
+    bool runUntil(const std::function<bool()> &done, uint32_t timeout_ms = 3000)
+    {
+        const uint32_t start = net::nowMs();
+        while (!done())
+        {
+            if (net::nowMs() - start > timeout_ms)
+                return false;
+            const uint32_t wait = ws.hasBuffered() ? 0 : std::min<uint32_t>(ws.dueMs(), 20);
+            net::waitReady(ws.fd(), true, ws.wantsWrite(), -1, wait);
+            ws.poll();
+        }
+        return true;
+    }
+};
+
+static Bytes pattern(size_t n, uint8_t seed)
+{
+    Bytes b(n);
+    for (size_t i = 0; i < n; ++i)
+        b[i] = uint8_t(i * 31 + seed);
+    return b;
+}
+
+int main()
+{
+    // The server's SHA-1 against RFC 6455 §1.3
+    CHECK(acceptFor("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+
+    uint16_t port = 0;
+    const int listen_fd = listenLocal(port);
+    CHECK(listen_fd >= 0);
+    if (listen_fd < 0)
+        return checkResult("test_websocket_client");
+
+    // Whole session
+    {
+        const std::string hello = "{\"type\":\"hello\"}";
+        const std::string long_text(600, 't'); // > rx buffer: reassembled
+        const Bytes mid = pattern(5000, 1);     // 16-bit length
+        const Bytes big = pattern(70000, 2);    // 64-bit length
+        const Bytes ping_payload{'a', 'b', 'c'};
+        const Bytes up = pattern(300, 3);
+        const Bytes up_in_place = pattern(1000, 4);
+
+        ServerRun run;
+        bool sent = false;
+        std::thread server(serve, listen_fd, Upgrade::OK, frame(0x1, Bytes(hello.begin(), hello.end())),
+                           std::ref(run), [&](int fd)
+                           {
+                               Bytes s = frame(0x2, mid);
+                               const Bytes lt = frame(0x1, Bytes(long_text.begin(), long_text.end()));
+                               s.insert(s.end(), lt.begin(), lt.end());
+                               const Bytes bg = frame(0x2, big);
+                               s.insert(s.end(), bg.begin(), bg.end());
+                               const Bytes pg = frame(0x9, ping_payload);
+                               s.insert(s.end(), pg.begin(), pg.end());
+                               const Bytes end = frame(0x1, {'e', 'n', 'd'}); // pong went out before it
+                               s.insert(s.end(), end.begin(), end.end());
+                               sent = sendSplit(fd, s);
+                               // pong, two binaries, the close echo
+                               ClientFrame f;
+                               while (readFrame(fd, f))
+                               {
+                                   run.frames.push_back(f);
+                                   if (f.op == 0x2 && run.frames.size() == 3)
+                                       sendAll(fd, frame(0x8, {0x03, 0xE8}).data(), 4);
+                                   if (f.op == 0x8)
+                                       break;
+                               }
+                           });
+
+        Client cl(port);
+        cl.ws.connect();
+        CHECK(cl.runUntil([&] { return cl.texts.size() == 3; }));
+        CHECK(cl.status() == 2 && cl.ws.isConnected());
+
+        CHECK(cl.texts.size() == 3 && cl.texts[0] == hello && cl.texts[1] == long_text);
+        CHECK(cl.binaries.size() == 2 && cl.binaries[0] == mid && cl.binaries[1] == big);
+        CHECK(cl.offsets_ok);
+        CHECK(cl.pieces > (mid.size() + big.size()) / sizeof(cl.rx)); // delivered in place, in pieces
+
+        // Client → server, after the server's ping
+        CHECK(cl.ws.sendBinary(up.data(), up.size()));
+        static uint8_t buf[WebSocketClient::FRAME_HEADROOM + 1000];
+        std::memcpy(buf + WebSocketClient::FRAME_HEADROOM, up_in_place.data(), up_in_place.size());
+        CHECK(cl.ws.sendBinaryInPlace(buf + WebSocketClient::FRAME_HEADROOM, up_in_place.size()));
+
+        // Server closes, the client echoes and reports CLOSED
+        CHECK(cl.runUntil([&] { return cl.status() == 0; }));
+        server.join();
+        CHECK(sent);
+
+        CHECK(run.request.rfind("GET /ws HTTP/1.1\r\n", 0) == 0);
+        CHECK(run.request.find("Host: 127.0.0.1:" + std::to_string(port) + "\r\n") != std::string::npos);
+        CHECK(run.request.find("Upgrade: websocket\r\n") != std::string::npos);
+        CHECK(run.request.find("Sec-WebSocket-Version: 13\r\n") != std::string::npos);
+
+        bool all_masked = true;
+        for (const ClientFrame &f : run.frames)
+            all_masked = all_masked && f.masked && f.fin;
+        CHECK(all_masked);
+        CHECK(run.frames.size() == 4);
+        if (run.frames.size() == 4)
+        {
+            CHECK(run.frames[0].op == 0xA && run.frames[0].payload == ping_payload);
+            CHECK(run.frames[1].op == 0x2 && run.frames[1].payload == up);
+            CHECK(run.frames[2].op == 0x2 && run.frames[2].payload == up_in_place);
+            CHECK(run.frames[3].op == 0x8 && run.frames[3].payload == Bytes({0x03, 0xE8}));
+        }
+        CHECK(cl.statuses == std::vector<int>({1, 2, 0}));
+    }
+
+    // Fragmented messages: a framed AUDIO message in 3 WS frames with a
+    // PING between them, a text in 2. Pieces in order, FrameReader takes
+    // the length from the proto header.
+    {
+        const Bytes audio = pattern(3000, 5);
+        proto::Header h;
+        h.type = proto::MsgType::AUDIO;
+        h.codec = proto::Codec::ADPCM_IMA;
+        h.seq = 7;
+        h.payload_len = uint16_t(audio.size());
+        Bytes msg(proto::HEADER_SIZE);
+        proto::writeHeader(h, msg.data(), msg.size());
+        msg.insert(msg.end(), audio.begin(), audio.end());
+        const Bytes ping_payload{'f', 'r'};
+
+        ServerRun run;
+        bool sent = false;
+        std::thread server(serve, listen_fd, Upgrade::OK, Bytes{}, std::ref(run), [&](int fd)
+                           {
+                               Bytes s = frame(0x2, Bytes(msg.begin(), msg.begin() + 5), false);
+                               const Bytes pg = frame(0x9, ping_payload);
+                               s.insert(s.end(), pg.begin(), pg.end());
+                               const Bytes c1 = frame(0x0, Bytes(msg.begin() + 5, msg.begin() + 1700), false);
+                               s.insert(s.end(), c1.begin(), c1.end());
+                               const Bytes c2 = frame(0x0, Bytes(msg.begin() + 1700, msg.end()));
+                               s.insert(s.end(), c2.begin(), c2.end());
+                               const Bytes t1 = frame(0x1, {'f', 'r', 'a', 'g'}, false);
+                               s.insert(s.end(), t1.begin(), t1.end());
+                               s.insert(s.end(), pg.begin(), pg.end());
+                               const Bytes t2 = frame(0x0, {'m', 'e', 'n', 't'});
+                               s.insert(s.end(), t2.begin(), t2.end());
+                               sent = sendSplit(fd, s);
+                               ClientFrame f;
+                               while (readFrame(fd, f))
+                               {
+                                   run.frames.push_back(f);
+                                   if (run.frames.size() == 2)
+                                       sendAll(fd, frame(0x8, {0x03, 0xE8}).data(), 4);
+                                   if (f.op == 0x8)
+                                       break;
+                               }
+                           });
+
+        Client cl(port);
+        proto::FrameReader reader;
+        Bytes payload;
+        int firsts = 0, lasts = 0, done = 0, bad = 0;
+        cl.on_piece = [&](const uint8_t *d, size_t len, size_t offset, size_t total, bool last)
+        {
+            const auto st = reader.feed(d, len, offset, total,
+                                        [&](const proto::Header &ph, const uint8_t *sl, size_t n, bool first, bool end)
+                                        {
+                                            bad += ph.seq != 7;
+                                            payload.insert(payload.end(), sl, sl + n);
+                                            firsts += first;
+                                            lasts += end;
+                                        });
+            done += st == proto::FrameReader::Status::DONE;
+            bad += st == proto::FrameReader::Status::INVALID || st == proto::FrameReader::Status::NOT_FRAMED ||
+                   (last != (st == proto::FrameReader::Status::DONE));
+        };
+        cl.ws.connect();
+        CHECK(cl.runUntil([&] { return cl.texts.size() == 1; }));
+        CHECK(cl.binaries.size() == 1 && cl.binaries[0] == msg);
+        CHECK(cl.texts.size() == 1 && cl.texts[0] == "fragment");
+        CHECK(cl.offsets_ok);
+        CHECK(payload == audio && firsts == 1 && lasts == 1 && done == 1 && bad == 0);
+        CHECK(cl.ws.isConnected());
+        CHECK(cl.runUntil([&] { return cl.status() == 0; }));
+        server.join();
+        CHECK(sent);
+        CHECK(run.frames.size() == 3);
+        if (run.frames.size() == 3)
+        {
+            CHECK(run.frames[0].op == 0xA && run.frames[0].payload == ping_payload);
+            CHECK(run.frames[1].op == 0xA && run.frames[1].payload == ping_payload);
+            CHECK(run.frames[2].op == 0x8);
+        }
+    }
+
+    // Wrong Accept, refused upgrade: never OPEN
+    for (Upgrade mode : {Upgrade::BAD_ACCEPT, Upgrade::REFUSED})
+    {
+        ServerRun run;
+        std::thread server(serve, listen_fd, mode, Bytes{}, std::ref(run), nullptr);
+        Client cl(port);
+        cl.ws.connect();
+        CHECK(cl.runUntil([&] { return cl.statuses.size() >= 2; }));
+        server.join();
+        CHECK(cl.statuses == std::vector<int>({1, 0}));
+        CHECK(!cl.ws.isConnected());
+    }
+
+    ::close(listen_fd);
+    return checkResult("test_websocket_client");
+}